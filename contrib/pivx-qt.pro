@@ -89,7 +89,6 @@ HEADERS += src/activemasternode.h \
            src/key.h \
            src/keystore.h \
            src/leveldbwrapper.h \
-           src/limitedmap.h \
            src/main.h \
            src/masternode-budget.h \
            src/masternode-payments.h \
@@ -440,12 +440,8 @@ bool CActiveMasternode::SendMasternodePing(std::string& errorMessage)
 
         //mnodeman.mapSeenMasternodeBroadcast.lastPing is probably outdated, so we'll update it
         CMasternodeBroadcast mnb(*pmn);
-        uint256 hash = mnb.GetHash();
-        if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
-            // SetLastPing locks the masternode cs, be careful with the lock order.
-            // TODO: check why are we double setting the last ping here..
-            mnodeman.mapSeenMasternodeBroadcast[hash].SetLastPing(mnp);
-        }
+        // TODO: check why are we double setting the last ping here..
+        mnodeman.UpdateSeenMNBPing(mnb.GetHash(), mnp);
 
         mnp.Relay();
         return true;
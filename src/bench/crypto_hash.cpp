@@ -31,23 +31,45 @@ static void SHA1(benchmark::State& state)
         CSHA1().Write(in.data(), in.size()).Finalize(hash);
 }
 
-static void SHA256(benchmark::State& state)
+static void SHA256(benchmark::State& state, sha256_implementation::UseImplementation sha256_implementation)
 {
+    SHA256AutoDetect(sha256_implementation);
     uint8_t hash[CSHA256::OUTPUT_SIZE];
     std::vector<uint8_t> in(BUFFER_SIZE,0);
     while (state.KeepRunning())
         CSHA256().Write(in.data(), in.size()).Finalize(hash);
+    SHA256AutoDetect();
 }
+static void SHA256_STANDARD(benchmark::State& state) { SHA256(state, sha256_implementation::STANDARD); }
+static void SHA256_SHANI(benchmark::State& state) { SHA256(state, sha256_implementation::USE_SHANI); }
 
-static void SHA256_32b(benchmark::State& state)
+static void SHA256_32b(benchmark::State& state, sha256_implementation::UseImplementation sha256_implementation)
 {
+    SHA256AutoDetect(sha256_implementation);
     std::vector<uint8_t> in(32,0);
     while (state.KeepRunning()) {
         CSHA256()
             .Write(in.data(), in.size())
             .Finalize(in.data());
     }
+    SHA256AutoDetect();
 }
+static void SHA256_32b_STANDARD(benchmark::State& state) { SHA256_32b(state, sha256_implementation::STANDARD); }
+static void SHA256_32b_SHANI(benchmark::State& state) { SHA256_32b(state, sha256_implementation::USE_SHANI); }
+
+static void SHA256D64_1024(benchmark::State& state, sha256_implementation::UseImplementation sha256_implementation)
+{
+    SHA256AutoDetect(sha256_implementation);
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+    SHA256AutoDetect();
+}
+static void SHA256D64_1024_STANDARD(benchmark::State& state) { SHA256D64_1024(state, sha256_implementation::STANDARD); }
+static void SHA256D64_1024_SSE41(benchmark::State& state) { SHA256D64_1024(state, sha256_implementation::USE_SSE41); }
+static void SHA256D64_1024_AVX2(benchmark::State& state) { SHA256D64_1024(state, sha256_implementation::USE_AVX2); }
+static void SHA256D64_1024_SHANI(benchmark::State& state) { SHA256D64_1024(state, sha256_implementation::USE_SHANI); }
 
 static void SHA512(benchmark::State& state)
 {
@@ -77,9 +99,15 @@ static void FastRandom_1bit(benchmark::State& state)
 
 BENCHMARK(RIPEMD160, 440);
 BENCHMARK(SHA1, 570);
-BENCHMARK(SHA256, 340);
+BENCHMARK(SHA256_STANDARD, 340);
+BENCHMARK(SHA256_SHANI, 340);
 BENCHMARK(SHA512, 330);
 
-BENCHMARK(SHA256_32b, 4700 * 1000);
+BENCHMARK(SHA256_32b_STANDARD, 4700 * 1000);
+BENCHMARK(SHA256_32b_SHANI, 4700 * 1000);
+BENCHMARK(SHA256D64_1024_STANDARD, 7400);
+BENCHMARK(SHA256D64_1024_SSE41, 7400);
+BENCHMARK(SHA256D64_1024_AVX2, 7400);
+BENCHMARK(SHA256D64_1024_SHANI, 7400);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
@@ -56,10 +56,11 @@ std::shared_ptr<CBlock> createAndProcessBlock(
     block.hashFinalSaplingRoot = CalculateSaplingTreeRoot(&block, nextHeight, params);
 
     const auto& blockHash = block.GetHash();
-    CBlockIndex* fakeIndex = new CBlockIndex{block};
+    LOCK(cs_main);
+    CBlockIndex* fakeIndex = InsertBlockIndex(blockHash);
+    *fakeIndex = CBlockIndex{block};
     fakeIndex->nHeight = nextHeight;
-    BlockMap::iterator mi = mapBlockIndex.emplace(blockHash, fakeIndex).first;
-    fakeIndex->phashBlock = &((*mi).first);
+    fakeIndex->phashBlock = &mapBlockIndex.find(blockHash)->first;
     chainActive.SetTip(fakeIndex);
     assert(chainActive.Contains(fakeIndex));
     assert(nextHeight == chainActive.Height());
@@ -8,6 +8,7 @@
 #include "consensus/validation.h"
 #include "evo/deterministicmns.h"
 #include "masternodeman.h"
+#include "net_processing.h"
 #include "netmessagemaker.h"
 #include "tiertwo/tiertwo_sync_state.h"
 #include "tiertwo/netfulfilledman.h"
@@ -1301,7 +1302,7 @@ int CBudgetManager::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         {
             // Clear inv request
             LOCK(cs_main);
-            g_connman->RemoveAskFor(proposal.GetHash(), MSG_BUDGET_PROPOSAL);
+            RemoveAskFor(proposal.GetHash());
         }
         return ProcessProposal(proposal);
     }
@@ -1314,7 +1315,7 @@ int CBudgetManager::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         {
             // Clear inv request
             LOCK(cs_main);
-            g_connman->RemoveAskFor(vote.GetHash(), MSG_BUDGET_VOTE);
+            RemoveAskFor(vote.GetHash());
         }
 
         CValidationState state;
@@ -1337,7 +1338,7 @@ int CBudgetManager::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         {
             // Clear inv request
             LOCK(cs_main);
-            g_connman->RemoveAskFor(finalbudget.GetHash(), MSG_BUDGET_FINALIZED);
+            RemoveAskFor(finalbudget.GetHash());
         }
         return ProcessFinalizedBudget(finalbudget, pfrom);
     }
@@ -1350,7 +1351,7 @@ int CBudgetManager::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         {
             // Clear inv request
             LOCK(cs_main);
-            g_connman->RemoveAskFor(vote.GetHash(), MSG_BUDGET_FINALIZED_VOTE);
+            RemoveAskFor(vote.GetHash());
         }
 
         CValidationState state;
@@ -6,6 +6,7 @@
 
 #include "chain.h"
 #include "legacy/stakemodifier.h"  // for ComputeNextStakeModifier
+#include "sync.h"
 
 
 /**
@@ -130,7 +131,7 @@ CBlockIndex::CBlockIndex(const CBlock& block):
         nNonce{block.nNonce}
 {
     if(block.nVersion > 3 && block.nVersion < 7)
-        nAccumulatorCheckpoint = block.nAccumulatorCheckpoint;
+        SetAccumulatorCheckpoint(block.nAccumulatorCheckpoint);
     if (block.IsProofOfStake())
         SetProofOfStake();
 }
@@ -172,7 +173,7 @@ CBlockHeader CBlockIndex::GetBlockHeader() const
     block.nTime = nTime;
     block.nBits = nBits;
     block.nNonce = nNonce;
-    if (nVersion > 3 && nVersion < 7) block.nAccumulatorCheckpoint = nAccumulatorCheckpoint;
+    if (nVersion > 3 && nVersion < 7) block.nAccumulatorCheckpoint = GetAccumulatorCheckpoint();
     if (nVersion >= 8) block.hashFinalSaplingRoot = hashFinalSaplingRoot;
     return block;
 }
@@ -295,18 +296,109 @@ uint256 CBlockIndex::GetStakeModifierV2() const
     return nStakeModifier;
 }
 
+void CBlockIndex::SetAccumulatorCheckpoint(const uint256& nCheckpoint)
+{
+    if (!nCheckpoint.IsNull() || m_cold.get()) {
+        m_cold.GetOrCreate().nAccumulatorCheckpoint = nCheckpoint;
+    }
+}
+
+void CBlockIndex::SetSaplingValue(CAmount nValue)
+{
+    if (nValue != 0 || m_cold.get()) {
+        m_cold.GetOrCreate().nSaplingValue = nValue;
+    }
+}
+
 void CBlockIndex::SetChainSaplingValue()
 {
     // Sapling, update chain value
     if (pprev) {
         if (pprev->nChainSaplingValue) {
-            nChainSaplingValue = *pprev->nChainSaplingValue + nSaplingValue;
+            nChainSaplingValue = *pprev->nChainSaplingValue + GetSaplingValue();
         } else {
             nChainSaplingValue = nullopt;
         }
     } else {
-        nChainSaplingValue = nSaplingValue;
+        nChainSaplingValue = GetSaplingValue();
+    }
+}
+
+/**
+ * Pool of default constructed objects, allocated in chunks. Released objects are
+ * kept in a free list for the next allocations, the chunks are never freed.
+ */
+template <typename T>
+class ChunkedPool
+{
+private:
+    static constexpr size_t CHUNK_SIZE = 1024;
+
+    Mutex cs;
+    std::vector<std::unique_ptr<T[]>> m_chunks GUARDED_BY(cs);
+    std::vector<T*> m_free GUARDED_BY(cs);
+
+public:
+    T* Allocate()
+    {
+        LOCK(cs);
+        if (m_free.empty()) {
+            m_chunks.emplace_back(new T[CHUNK_SIZE]);
+            for (size_t i = CHUNK_SIZE; i > 0; i--) {
+                m_free.push_back(&m_chunks.back()[i - 1]);
+            }
+        }
+        T* p = m_free.back();
+        m_free.pop_back();
+        return p;
+    }
+
+    void Free(T* p)
+    {
+        *p = T();
+        LOCK(cs);
+        m_free.push_back(p);
+    }
+};
+
+template <typename T>
+static ChunkedPool<T>& GetChunkedPool()
+{
+    // Never destroyed: block index entries (and their copies) can outlive the static objects
+    static ChunkedPool<T>* pool = new ChunkedPool<T>();
+    return *pool;
+}
+
+CBlockIndex::ColdFields* CBlockIndex::ColdFieldsPtr::Allocate()
+{
+    return GetChunkedPool<ColdFields>().Allocate();
+}
+
+void CBlockIndex::ColdFieldsPtr::Free(ColdFields* fields)
+{
+    GetChunkedPool<ColdFields>().Free(fields);
+}
+
+CBlockIndex* CBlockIndexArena::AllocateSlot()
+{
+    if (m_used == CHUNK_SIZE) {
+        m_chunks.push_back(static_cast<CBlockIndex*>(::operator new(CHUNK_SIZE * sizeof(CBlockIndex))));
+        m_used = 0;
+    }
+    return m_chunks.back() + m_used++;
+}
+
+void CBlockIndexArena::Clear()
+{
+    for (size_t i = 0; i < m_chunks.size(); i++) {
+        const size_t nEntries = (i + 1 == m_chunks.size()) ? m_used : CHUNK_SIZE;
+        for (size_t j = 0; j < nEntries; j++) {
+            m_chunks[i][j].~CBlockIndex();
+        }
+        ::operator delete(m_chunks[i]);
     }
+    m_chunks.clear();
+    m_used = CHUNK_SIZE;
 }
 
 //! Check whether this block index entry is valid up to the passed validity level.
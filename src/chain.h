@@ -13,6 +13,7 @@
 #include "chainparams.h"
 #include "flatfile.h"
 #include "optional.h"
+#include "prevector.h"
 #include "primitives/block.h"
 #include "timedata.h"
 #include "tinyformat.h"
@@ -20,6 +21,7 @@
 #include "util/system.h"
 #include "libzerocoin/Denominations.h"
 
+#include <memory>
 #include <vector>
 
 /**
@@ -137,6 +139,56 @@ enum {
  */
 class CBlockIndex
 {
+private:
+    //! Fields that only a minority of the entries set (zerocoin era blocks,
+    //! blocks with shielded transactions), kept out of line so that the other
+    //! entries don't pay for their size.
+    struct ColdFields {
+        uint256 nAccumulatorCheckpoint{};
+        CAmount nSaplingValue{0};
+    };
+
+    //! Owning pointer to the cold fields, null while they are all unset. Copies are deep.
+    //! The fields are taken from a shared pool of chunks, instead of being allocated one by one.
+    class ColdFieldsPtr
+    {
+    private:
+        ColdFields* m_fields{nullptr};
+
+        static ColdFields* Allocate();
+        static void Free(ColdFields* fields);
+
+    public:
+        ColdFieldsPtr() = default;
+        ColdFieldsPtr(const ColdFieldsPtr& other) { *this = other; }
+        ColdFieldsPtr(ColdFieldsPtr&& other) noexcept : m_fields(other.m_fields) { other.m_fields = nullptr; }
+        ~ColdFieldsPtr() { if (m_fields) Free(m_fields); }
+        ColdFieldsPtr& operator=(const ColdFieldsPtr& other)
+        {
+            if (!other.m_fields) {
+                if (m_fields) Free(m_fields);
+                m_fields = nullptr;
+            } else if (m_fields != other.m_fields) {
+                GetOrCreate() = *other.m_fields;
+            }
+            return *this;
+        }
+        ColdFieldsPtr& operator=(ColdFieldsPtr&& other) noexcept
+        {
+            std::swap(m_fields, other.m_fields);
+            return *this;
+        }
+
+        const ColdFields* get() const { return m_fields; }
+        ColdFields& GetOrCreate()
+        {
+            if (!m_fields) m_fields = Allocate();
+            return *m_fields;
+        }
+    };
+
+    ColdFieldsPtr m_cold{};
+
 public:
     //! pointer to the hash of the block, if any. memory is owned by this CBlockIndex
     const uint256* phashBlock{nullptr};
@@ -175,16 +227,11 @@ public:
     uint32_t nStatus{0};
 
     // proof-of-stake specific fields
-    // char vector holding the stake modifier bytes. It is empty for PoW blocks.
+    // char vector holding the stake modifier bytes, stored inline. It is empty for PoW blocks.
     // Modifier V1 is 64 bit while modifier V2 is 256 bit.
-    std::vector<unsigned char> vStakeModifier{};
+    prevector<32, unsigned char> vStakeModifier{};
     unsigned int nFlags{0};
 
-    //! Change in value held by the Sapling circuit over this block.
-    //! Not a Optional because this was added before Sapling activated, so we can
-    //! rely on the invariant that every block before this was added had nSaplingValue = 0.
-    CAmount nSaplingValue{0};
-
     //! (memory only) Total value held by the Sapling circuit up to and including this block.
     //! Will be nullopt if nChainTx is zero.
    Optional<CAmount> nChainSaplingValue{nullopt};
@@ -196,7 +243,6 @@ public:
     uint32_t nTime{0};
     uint32_t nBits{0};
     uint32_t nNonce{0};
-    uint256 nAccumulatorCheckpoint{};
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId{0};
@@ -236,6 +282,16 @@ public:
     uint64_t GetStakeModifierV1() const;
     uint256 GetStakeModifierV2() const;
 
+    //! Accumulator checkpoint of the block header (only for version 4, 5 and 6)
+    const uint256& GetAccumulatorCheckpoint() const { return m_cold.get() ? m_cold.get()->nAccumulatorCheckpoint : UINT256_ZERO; }
+    void SetAccumulatorCheckpoint(const uint256& nCheckpoint);
+
+    //! Change in value held by the Sapling circuit over this block.
+    //! Not a Optional because this was added before Sapling activated, so we can
+    //! rely on the invariant that every block before this was added had a Sapling value of 0.
+    CAmount GetSaplingValue() const { return m_cold.get() ? m_cold.get()->nSaplingValue : 0; }
+    void SetSaplingValue(CAmount nValue);
+
     // Update Sapling chain value
     void SetChainSaplingValue();
 
@@ -297,13 +353,18 @@ public:
             READWRITE(obj.nTime);
             READWRITE(obj.nBits);
             READWRITE(obj.nNonce);
-            if(obj.nVersion > 3 && obj.nVersion < 7)
-                READWRITE(obj.nAccumulatorCheckpoint);
+            if(obj.nVersion > 3 && obj.nVersion < 7) {
+                uint256 nAccumulatorCheckpoint = obj.GetAccumulatorCheckpoint();
+                READWRITE(nAccumulatorCheckpoint);
+                SER_READ(obj, obj.SetAccumulatorCheckpoint(nAccumulatorCheckpoint));
+            }
 
             // Sapling blocks
             if (obj.nVersion >= 8) {
+                CAmount nSaplingValue = obj.GetSaplingValue();
                 READWRITE(obj.hashFinalSaplingRoot);
-                READWRITE(obj.nSaplingValue);
+                READWRITE(nSaplingValue);
+                SER_READ(obj, obj.SetSaplingValue(nSaplingValue));
             }
         } else if (nSerVersion > DBI_OLD_SER_VERSION && ser_action.ForRead()) {
             // Serialization with CLIENT_VERSION = 4009901
@@ -320,7 +381,11 @@ public:
             READWRITE(obj.nNonce);
             if (obj.nVersion > 3) {
                 READWRITE(mapZerocoinSupply);
-                if (obj.nVersion < 7) READWRITE(obj.nAccumulatorCheckpoint);
+                if (obj.nVersion < 7) {
+                    uint256 nAccumulatorCheckpoint;
+                    READWRITE(nAccumulatorCheckpoint);
+                    SER_READ(obj, obj.SetAccumulatorCheckpoint(nAccumulatorCheckpoint));
+                }
             }
         } else if (ser_action.ForRead()) {
             // Serialization with CLIENT_VERSION = 4009900-
@@ -355,7 +420,9 @@ public:
             if (obj.nVersion > 3) {
                 std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
                 std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
-                READWRITE(obj.nAccumulatorCheckpoint);
+                uint256 nAccumulatorCheckpoint;
+                READWRITE(nAccumulatorCheckpoint);
+                SER_READ(obj, obj.SetAccumulatorCheckpoint(nAccumulatorCheckpoint));
                 READWRITE(mapZerocoinSupply);
                 READWRITE(vMintDenominationsInBlock);
             }
@@ -372,7 +439,7 @@ public:
         block.nBits = nBits;
         block.nNonce = nNonce;
         if (nVersion > 3 && nVersion < 7)
-            block.nAccumulatorCheckpoint = nAccumulatorCheckpoint;
+            block.nAccumulatorCheckpoint = GetAccumulatorCheckpoint();
         if (nVersion >= 8)
             block.hashFinalSaplingRoot = hashFinalSaplingRoot;
         return block.GetHash();
@@ -388,6 +455,42 @@ public:
     }
 };
 
+/**
+ * Storage of the block index entries. Entries are constructed in chunks of
+ * contiguous memory instead of being allocated one by one, which saves the
+ * per-allocation overhead and keeps the entries close together for the walks
+ * along pprev/pskip. Entries are never freed individually: they stay valid
+ * until Clear().
+ */
+class CBlockIndexArena
+{
+private:
+    static constexpr size_t CHUNK_SIZE = 4096;
+
+    std::vector<CBlockIndex*> m_chunks;
+    //! Number of entries constructed in the last chunk
+    size_t m_used{CHUNK_SIZE};
+
+    CBlockIndex* AllocateSlot();
+
+public:
+    CBlockIndexArena() = default;
+    CBlockIndexArena(const CBlockIndexArena&) = delete;
+    CBlockIndexArena& operator=(const CBlockIndexArena&) = delete;
+    ~CBlockIndexArena() { Clear(); }
+
+    template <typename... Args>
+    CBlockIndex* Emplace(Args&&... args)
+    {
+        return new (AllocateSlot()) CBlockIndex(std::forward<Args>(args)...);
+    }
+
+    //! Destroy all the entries
+    void Clear();
+
+    size_t Size() const { return m_chunks.empty() ? 0 : (m_chunks.size() - 1) * CHUNK_SIZE + m_used; }
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain
 {
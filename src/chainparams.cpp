@@ -42,6 +42,16 @@ void CChainParams::UpdateNetworkUpgradeParameters(Consensus::UpgradeIndex idx, i
     consensus.vUpgrades[idx].nActivationHeight = nActivationHeight;
 }
 
+void CChainParams::UpdateAssumeutxoParameters(int nHeight, const uint256& hashSnapshot)
+{
+    assert(IsRegTestNet()); // only available for regtest
+    if (hashSnapshot.IsNull()) {
+        mapAssumeutxo.erase(nHeight);
+    } else {
+        mapAssumeutxo[nHeight] = hashSnapshot;
+    }
+}
+
 /**
  * Build the genesis block. Note that the output of the genesis coinbase cannot
  * be spent as it did not originally exist in the database.
@@ -259,6 +269,9 @@ public:
         // validation by-pass
         consensus.nPivxBadBlockTime = 1471401614;    // Skip nBit validation of Block 259201 per PR #915
         consensus.nPivxBadBlockBits = 0x1c056dac;    // Skip nBit validation of Block 259201 per PR #915
+        // The script checks are skipped below the last checkpoint anyway: set at release time
+        // to a recent block past it (see doc/release-process.md).
+        consensus.defaultAssumeValid = UINT256_ZERO;
 
         // Zerocoin-related params
         consensus.ZC_Modulus = "25195908475657893494027183240048398571429282126204032027777137836043662020707595556264018525880784"
@@ -318,6 +331,7 @@ public:
         pchMessageStart[2] = 0xfd;
         pchMessageStart[3] = 0xe9;
         nDefaultPort = 51472;
+        nPruneAfterHeight = 200000;
 
         // Note that of those with the service bits flag, most only support a subset of possible options
         vSeeds.emplace_back("pivx.seed.fuzzbawls.pw", true);     // Primary DNS Seeder from Fuzzbawls
@@ -338,6 +352,11 @@ public:
         // Reject non-standard transactions by default
         fRequireStandard = true;
 
+        // Keep the blocks download (getblocks/inv). The PoS headers cost no work, and their
+        // kernel can only be checked with the coinstake: the header chain could be filled
+        // with fake branches, as there is no minimum chain work to connect to.
+        fHeadersFirstSyncing = false;
+
         // Sapling
         bech32HRPs[SAPLING_PAYMENT_ADDRESS]      = "ps";
         bech32HRPs[SAPLING_FULL_VIEWING_KEY]     = "pviews";
@@ -416,6 +435,7 @@ public:
         consensus.height_last_ZC_AccumCheckpoint = -1;
         consensus.height_last_ZC_WrappedSerials = -1;
         consensus.ZC_HeightStart = 0;
+        consensus.defaultAssumeValid = UINT256_ZERO;
 
         // Zerocoin-related params
         consensus.ZC_Modulus = "25195908475657893494027183240048398571429282126204032027777137836043662020707595556264018525880784"
@@ -461,6 +481,7 @@ public:
         pchMessageStart[2] = 0xd5;
         pchMessageStart[3] = 0xca;
         nDefaultPort = 51474;
+        nPruneAfterHeight = 1000;
 
         // nodes with support for servicebits filtering should be at the top
         vSeeds.emplace_back("pivx-testnet.seed.fuzzbawls.pw", true);
@@ -481,6 +502,9 @@ public:
 
         fRequireStandard = false;
 
+        // Download the header chain first
+        fHeadersFirstSyncing = true;
+
         // Sapling
         bech32HRPs[SAPLING_PAYMENT_ADDRESS]      = "ptestsapling";
         bech32HRPs[SAPLING_FULL_VIEWING_KEY]     = "pviewtestsapling";
@@ -561,6 +585,7 @@ public:
         consensus.height_last_invalid_UTXO = -1;
         consensus.height_last_ZC_AccumCheckpoint = 310;     // no checkpoints on regtest
         consensus.height_last_ZC_WrappedSerials = -1;
+        consensus.defaultAssumeValid = UINT256_ZERO;
 
         // Zerocoin-related params
         consensus.ZC_Modulus = "25195908475657893494027183240048398571429282126204032027777137836043662020707595556264018525880784"
@@ -609,6 +634,7 @@ public:
         pchMessageStart[2] = 0x7e;
         pchMessageStart[3] = 0xac;
         nDefaultPort = 51476;
+        nPruneAfterHeight = 1000;
 
         base58Prefixes[PUBKEY_ADDRESS] = std::vector<unsigned char>(1, 139); // Testnet pivx addresses start with 'x' or 'y'
         base58Prefixes[SCRIPT_ADDRESS] = std::vector<unsigned char>(1, 19);  // Testnet pivx script addresses start with '8' or '9'
@@ -624,6 +650,9 @@ public:
         // Reject non-standard transactions by default
         fRequireStandard = true;
 
+        // Download the header chain first
+        fHeadersFirstSyncing = true;
+
         // Sapling
         bech32HRPs[SAPLING_PAYMENT_ADDRESS]      = "ptestsapling";
         bech32HRPs[SAPLING_FULL_VIEWING_KEY]     = "pviewtestsapling";
@@ -677,3 +706,8 @@ void UpdateNetworkUpgradeParameters(Consensus::UpgradeIndex idx, int nActivation
 {
     globalChainParams->UpdateNetworkUpgradeParameters(idx, nActivationHeight);
 }
+
+void UpdateAssumeutxoParameters(int nHeight, const uint256& hashSnapshot)
+{
+    globalChainParams->UpdateAssumeutxoParameters(nHeight, hashSnapshot);
+}
@@ -25,6 +25,9 @@ struct CDNSSeedData {
 
 typedef std::map<int, uint256> MapCheckpoints;
 
+/** Height -> content hash of the UTXO snapshot (dumptxoutset) of the block at that height */
+typedef std::map<int, uint256> MapAssumeutxo;
+
 struct CCheckpointData {
     const MapCheckpoints* mapCheckpoints;
     int64_t nTimeLastCheckpoint;
@@ -71,6 +74,8 @@ public:
     const Consensus::Params& GetConsensus() const { return consensus; }
     const CMessageHeader::MessageStartChars& MessageStart() const { return pchMessageStart; }
     int GetDefaultPort() const { return nDefaultPort; }
+    /** Height below which block files are never pruned (-prune) */
+    uint64_t PruneAfterHeight() const { return nPruneAfterHeight; }
 
     const CBlock& GenesisBlock() const { return genesis; }
     /** Policy: Filter transactions that do not match well-defined patterns */
@@ -81,8 +86,8 @@ public:
     bool IsTestChain() const { return IsTestnet() || IsRegTestNet(); }
     /** Make miner wait to have peers to avoid wasting work */
     bool MiningRequiresPeers() const { return !IsRegTestNet(); }
-    /** Headers first syncing is disabled */
-    bool HeadersFirstSyncingActive() const { return false; };
+    /** Sync the header chain first, then download the blocks in parallel from several peers */
+    bool HeadersFirstSyncingActive() const { return fHeadersFirstSyncing; };
     /** Default value for -checkmempool and -checkblockindex argument */
     bool DefaultConsistencyChecks() const { return IsRegTestNet(); }
 
@@ -93,6 +98,8 @@ public:
     const std::string& Bech32HRP(Bech32Type type) const { return bech32HRPs[type]; }
     const std::vector<uint8_t>& FixedSeeds() const { return vFixedSeeds; }
     virtual const CCheckpointData& Checkpoints() const = 0;
+    /** UTXO snapshots that can be loaded with loadtxoutset */
+    const MapAssumeutxo& AssumeutxoData() const { return mapAssumeutxo; }
 
     bool IsRegTestNet() const { return NetworkIDString() == CBaseChainParams::REGTEST; }
     bool IsTestnet() const { return NetworkIDString() == CBaseChainParams::TESTNET; }
@@ -101,6 +108,7 @@ public:
     int FulfilledRequestExpireTime() const { return nFulfilledRequestExpireTime; }
 
     void UpdateNetworkUpgradeParameters(Consensus::UpgradeIndex idx, int nActivationHeight);
+    void UpdateAssumeutxoParameters(int nHeight, const uint256& hashSnapshot);
 protected:
     CChainParams() {}
 
@@ -109,11 +117,14 @@ protected:
     Consensus::Params consensus;
     CMessageHeader::MessageStartChars pchMessageStart;
     int nDefaultPort;
+    uint64_t nPruneAfterHeight;
+    MapAssumeutxo mapAssumeutxo;
     std::vector<CDNSSeedData> vSeeds;
     std::vector<unsigned char> base58Prefixes[MAX_BASE58_TYPES];
     std::string bech32HRPs[MAX_BECH32_TYPES];
     std::vector<uint8_t> vFixedSeeds;
     bool fRequireStandard;
+    bool fHeadersFirstSyncing;
 
     // Tier two
     int nLLMQConnectionRetryTimeout;
@@ -144,4 +155,10 @@ void SelectParams(const std::string& chain);
  */
 void UpdateNetworkUpgradeParameters(Consensus::UpgradeIndex idx, int nActivationHeight);
 
+/**
+ * Allows committing a UTXO snapshot (content hash at a height) in the regtest parameters.
+ * A null hash removes the snapshot committed at that height.
+ */
+void UpdateAssumeutxoParameters(int nHeight, const uint256& hashSnapshot);
+
 #endif // BITCOIN_CHAINPARAMS_H
@@ -25,6 +25,12 @@ bool CCoinsView::BatchWrite(CCoinsMap& mapCoins,
                             CAnchorsSaplingMap& mapSaplingAnchors,
                             CNullifiersMap& mapSaplingNullifiers) { return false; }
 
+bool CCoinsView::BatchWritePartial(CCoinsMap& mapCoins,
+                                   const uint256& hashBlock,
+                                   const uint256& hashSaplingAnchor,
+                                   CAnchorsSaplingMap& mapSaplingAnchors,
+                                   CNullifiersMap& mapSaplingNullifiers) { return false; }
+
 // Sapling
 bool CCoinsView::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const { return false; }
 bool CCoinsView::GetNullifier(const uint256 &nullifier) const { return false; }
@@ -46,6 +52,13 @@ bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins,
                                   CNullifiersMap& mapSaplingNullifiers)
 { return base->BatchWrite(mapCoins, hashBlock, hashSaplingAnchor, mapSaplingAnchors, mapSaplingNullifiers); }
 
+bool CCoinsViewBacked::BatchWritePartial(CCoinsMap& mapCoins,
+                                         const uint256& hashBlock,
+                                         const uint256& hashSaplingAnchor,
+                                         CAnchorsSaplingMap& mapSaplingAnchors,
+                                         CNullifiersMap& mapSaplingNullifiers)
+{ return base->BatchWritePartial(mapCoins, hashBlock, hashSaplingAnchor, mapSaplingAnchors, mapSaplingNullifiers); }
+
 // Sapling
 bool CCoinsViewBacked::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const { return base->GetSaplingAnchorAt(rt, tree); }
 bool CCoinsViewBacked::GetNullifier(const uint256 &nullifier) const { return base->GetNullifier(nullifier); }
@@ -60,9 +73,16 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) +
            memusage::DynamicUsage(cacheSaplingAnchors) +
            memusage::DynamicUsage(cacheSaplingNullifiers) +
+           dirtyQueue.size() * sizeof(COutPoint) +
            cachedCoinsUsage;
 }
 
+size_t CCoinsViewCache::ReusableMemoryUsage() const {
+    return m_cache_coins_memory_resource.NumUnusedBytes() +
+           m_cache_anchors_memory_resource.NumUnusedBytes() +
+           m_cache_nullifiers_memory_resource.NumUnusedBytes();
+}
+
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint& outpoint) const
 {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
@@ -81,6 +101,15 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint& outpoint) const
     return ret;
 }
 
+void CCoinsViewCache::AddFetchedCoin(const COutPoint& outpoint, Coin&& coin)
+{
+    assert(!coin.IsSpent());
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)));
+    if (ret.second) {
+        cachedCoinsUsage += memusage::DynamicUsage(ret.first->second.coin);
+    }
+}
+
 bool CCoinsViewCache::GetCoin(const COutPoint& outpoint, Coin& coin) const
 {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
@@ -99,6 +128,7 @@ void CCoinsViewCache::AddCoin(const COutPoint& outpoint, Coin&& coin, bool possi
     bool inserted;
     std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::tuple<>());
     bool fresh = false;
+    const bool fWasDirty = it->second.flags & CCoinsCacheEntry::DIRTY;
     if (!inserted) {
         cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
     }
@@ -111,6 +141,7 @@ void CCoinsViewCache::AddCoin(const COutPoint& outpoint, Coin&& coin, bool possi
     it->second.coin = std::move(coin);
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    if (!fWasDirty) TrackDirty(outpoint);
 }
 
 void AddCoins(CCoinsViewCache& cache, const CTransaction& tx, int nHeight, bool check, bool fSkipInvalid)
@@ -141,6 +172,7 @@ void CCoinsViewCache::SpendCoin(const COutPoint& outpoint, Coin* moveout)
     if (it->second.flags & CCoinsCacheEntry::FRESH) {
         cacheCoins.erase(it);
     } else {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) TrackDirty(outpoint);
         it->second.flags |= CCoinsCacheEntry::DIRTY;
         it->second.coin.Clear();
     }
@@ -265,6 +297,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins,
                 if (it->second.flags & CCoinsCacheEntry::FRESH) {
                     entry.flags |= CCoinsCacheEntry::FRESH;
                 }
+                TrackDirty(it->first);
             }
         } else {
             // Assert that the child cache entry was not marked FRESH if the
@@ -287,6 +320,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins,
                 cachedCoinsUsage -= memusage::DynamicUsage(itUs->second.coin);
                 itUs->second.coin = std::move(it->second.coin);
                 cachedCoinsUsage += memusage::DynamicUsage(itUs->second.coin);
+                if (!(itUs->second.flags & CCoinsCacheEntry::DIRTY)) TrackDirty(it->first);
                 itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 // NOTE: It is possible the child has a FRESH flag here in
                 // the event the entry we found in the parent is pruned. But
@@ -316,10 +350,106 @@ bool CCoinsViewCache::Flush()
     cacheCoins.clear();
     cacheSaplingAnchors.clear();
     cacheSaplingNullifiers.clear();
+    ReallocateCache();
     cachedCoinsUsage = 0;
+    dirtyQueue.clear();
+    dirtyQueue.shrink_to_fit();
     return fOk;
 }
 
+void CCoinsViewCache::ReallocateCache()
+{
+    // Cache should be empty when we're calling this.
+    assert(cacheCoins.empty() && cacheSaplingAnchors.empty() && cacheSaplingNullifiers.empty());
+    cacheCoins.~CCoinsMap();
+    m_cache_coins_memory_resource.~CCoinsMapMemoryResource();
+    ::new (&m_cache_coins_memory_resource) CCoinsMapMemoryResource{};
+    ::new (&cacheCoins) CCoinsMap{0, SaltedOutpointHasher{}, CCoinsMap::key_equal{}, &m_cache_coins_memory_resource};
+
+    cacheSaplingAnchors.~CAnchorsSaplingMap();
+    m_cache_anchors_memory_resource.~CAnchorsSaplingMapMemoryResource();
+    ::new (&m_cache_anchors_memory_resource) CAnchorsSaplingMapMemoryResource{SAPLING_CACHE_CHUNK_BYTES};
+    ::new (&cacheSaplingAnchors) CAnchorsSaplingMap{0, SaltedIdHasher{}, CAnchorsSaplingMap::key_equal{}, &m_cache_anchors_memory_resource};
+
+    cacheSaplingNullifiers.~CNullifiersMap();
+    m_cache_nullifiers_memory_resource.~CNullifiersMapMemoryResource();
+    ::new (&m_cache_nullifiers_memory_resource) CNullifiersMapMemoryResource{SAPLING_CACHE_CHUNK_BYTES};
+    ::new (&cacheSaplingNullifiers) CNullifiersMap{0, SaltedIdHasher{}, CNullifiersMap::key_equal{}, &m_cache_nullifiers_memory_resource};
+}
+
+void CCoinsViewCache::SetTrackDirty(bool fTrack)
+{
+    fTrackDirty = fTrack;
+    dirtyQueue.clear();
+    if (!fTrackDirty) return;
+    // Entries that are already dirty are written first
+    for (const auto& entry : cacheCoins) {
+        if (entry.second.flags & CCoinsCacheEntry::DIRTY) dirtyQueue.push_back(entry.first);
+    }
+}
+
+bool CCoinsViewCache::WriteOldestDirty(size_t nMaxCoins)
+{
+    assert(fTrackDirty);
+    // Write copies of the entries, so that they stay cached
+    CCoinsMapMemoryResource resource;
+    CCoinsMap mapWrite{0, SaltedOutpointHasher{}, CCoinsMap::key_equal{}, &resource};
+    std::vector<COutPoint> vWritten;
+    while (!dirtyQueue.empty() && vWritten.size() < nMaxCoins) {
+        const COutPoint outpoint = dirtyQueue.front();
+        dirtyQueue.pop_front();
+        // Skip the entries removed (or written) since they got dirty
+        CCoinsMap::const_iterator it = cacheCoins.find(outpoint);
+        if (it == cacheCoins.end() || !(it->second.flags & CCoinsCacheEntry::DIRTY)) continue;
+        if (mapWrite.emplace(outpoint, it->second).second) vWritten.push_back(outpoint);
+    }
+    // The Sapling changes are written too (copies of the dirty entries, as the base view erases them)
+    CAnchorsSaplingMapMemoryResource anchorsResource{SAPLING_CACHE_CHUNK_BYTES};
+    CAnchorsSaplingMap mapAnchorsWrite{0, SaltedIdHasher{}, CAnchorsSaplingMap::key_equal{}, &anchorsResource};
+    for (const auto& entry : cacheSaplingAnchors) {
+        if (entry.second.flags & CAnchorsSaplingCacheEntry::DIRTY) mapAnchorsWrite.emplace(entry);
+    }
+    CNullifiersMapMemoryResource nullifiersResource{SAPLING_CACHE_CHUNK_BYTES};
+    CNullifiersMap mapNullifiersWrite{0, SaltedIdHasher{}, CNullifiersMap::key_equal{}, &nullifiersResource};
+    for (const auto& entry : cacheSaplingNullifiers) {
+        if (entry.second.flags & CNullifiersCacheEntry::DIRTY) mapNullifiersWrite.emplace(entry);
+    }
+    if (!base->BatchWritePartial(mapWrite, hashBlock, hashSaplingAnchor, mapAnchorsWrite, mapNullifiersWrite)) {
+        dirtyQueue.insert(dirtyQueue.begin(), vWritten.begin(), vWritten.end());
+        return false;
+    }
+    for (auto& entry : cacheSaplingAnchors) entry.second.flags = 0;
+    for (auto& entry : cacheSaplingNullifiers) entry.second.flags = 0;
+    // The base view now has the entries: they are neither dirty nor fresh anymore
+    for (const COutPoint& outpoint : vWritten) {
+        CCoinsMap::iterator it = cacheCoins.find(outpoint);
+        assert(it != cacheCoins.end());
+        if (it->second.coin.IsSpent()) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            cacheCoins.erase(it);
+        } else {
+            it->second.flags = 0;
+        }
+    }
+    return true;
+}
+
+size_t CCoinsViewCache::UncacheClean(size_t nTargetUsage)
+{
+    size_t nRemoved = 0;
+    CCoinsMap::iterator it = cacheCoins.begin();
+    while (it != cacheCoins.end() && DynamicMemoryUsage() - ReusableMemoryUsage() > nTargetUsage) {
+        if (it->second.flags == 0) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+            nRemoved++;
+        } else {
+            ++it;
+        }
+    }
+    return nRemoved;
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& outpoint)
 {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
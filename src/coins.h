@@ -19,6 +19,7 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <deque>
 #include <unordered_map>
 
 /**
@@ -171,10 +172,33 @@ struct CNullifiersCacheEntry
     CNullifiersCacheEntry() : entered(false), flags(0) {}
 };
 
-typedef std::unordered_map<uint256, CAnchorsSaplingCacheEntry, SaltedIdHasher> CAnchorsSaplingMap;
-typedef std::unordered_map<uint256, CNullifiersCacheEntry, SaltedIdHasher> CNullifiersMap;
+/**
+ * The cache maps allocate their nodes from a PoolResource, instead of with one
+ * malloc per entry: this avoids the allocator overhead per coin (and the heap
+ * fragmentation), and their memory usage is accounted exactly, as the chunks
+ * of the pool. The resource must outlive the map, and is passed on construction:
+ *
+ *     CCoinsMapMemoryResource resource;
+ *     CCoinsMap map{0, CCoinsMap::hasher{}, CCoinsMap::key_equal{}, &resource};
+ *
+ * The size of the pool blocks covers the map node: the key/value pair, plus
+ * the next pointer and cached hash of the node, with some headroom.
+ */
+template <typename Key, typename Value, typename Hash>
+using CPooledCacheMap = std::unordered_map<Key, Value, Hash, std::equal_to<Key>,
+                                           PoolAllocator<std::pair<const Key, Value>,
+                                                         sizeof(std::pair<const Key, Value>) + sizeof(void*) * 4>>;
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/** Chunk size of the memory resources of the Sapling cache maps, which hold few entries */
+static const size_t SAPLING_CACHE_CHUNK_BYTES = 1 << 14;
+
+typedef CPooledCacheMap<uint256, CAnchorsSaplingCacheEntry, SaltedIdHasher> CAnchorsSaplingMap;
+typedef CAnchorsSaplingMap::allocator_type::ResourceType CAnchorsSaplingMapMemoryResource;
+typedef CPooledCacheMap<uint256, CNullifiersCacheEntry, SaltedIdHasher> CNullifiersMap;
+typedef CNullifiersMap::allocator_type::ResourceType CNullifiersMapMemoryResource;
+
+typedef CPooledCacheMap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+typedef CCoinsMap::allocator_type::ResourceType CCoinsMapMemoryResource;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -224,6 +248,16 @@ public:
                             CAnchorsSaplingMap& mapSaplingAnchors,
                             CNullifiersMap& mapSaplingNullifiers);
 
+    //! Write part of the Coin changes (+ the Sapling changes), leaving the
+    //! view inconsistent until the next BatchWrite: GetHeadBlocks() then
+    //! returns hashBlock, which must be the block the changes come from.
+    //! Written entries are erased from the passed maps.
+    virtual bool BatchWritePartial(CCoinsMap& mapCoins,
+                                   const uint256& hashBlock,
+                                   const uint256& hashSaplingAnchor,
+                                   CAnchorsSaplingMap& mapSaplingAnchors,
+                                   CNullifiersMap& mapSaplingNullifiers);
+
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor* Cursor() const;
 
@@ -266,6 +300,11 @@ public:
                     const uint256& hashSaplingAnchor,
                     CAnchorsSaplingMap& mapSaplingAnchors,
                     CNullifiersMap& mapSaplingNullifiers) override;
+    bool BatchWritePartial(CCoinsMap& mapCoins,
+                           const uint256& hashBlock,
+                           const uint256& hashSaplingAnchor,
+                           CAnchorsSaplingMap& mapSaplingAnchors,
+                           CNullifiersMap& mapSaplingNullifiers) override;
 
     // Sapling
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const override;
@@ -287,16 +326,24 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
-    mutable CCoinsMap cacheCoins;
+    mutable CCoinsMapMemoryResource m_cache_coins_memory_resource{};
+    mutable CCoinsMap cacheCoins{0, SaltedOutpointHasher{}, CCoinsMap::key_equal{}, &m_cache_coins_memory_resource};
 
     // Sapling
     mutable uint256 hashSaplingAnchor;
-    mutable CAnchorsSaplingMap cacheSaplingAnchors;
-    mutable CNullifiersMap cacheSaplingNullifiers;
+    mutable CAnchorsSaplingMapMemoryResource m_cache_anchors_memory_resource{SAPLING_CACHE_CHUNK_BYTES};
+    mutable CAnchorsSaplingMap cacheSaplingAnchors{0, SaltedIdHasher{}, CAnchorsSaplingMap::key_equal{}, &m_cache_anchors_memory_resource};
+    mutable CNullifiersMapMemoryResource m_cache_nullifiers_memory_resource{SAPLING_CACHE_CHUNK_BYTES};
+    mutable CNullifiersMap cacheSaplingNullifiers{0, SaltedIdHasher{}, CNullifiersMap::key_equal{}, &m_cache_nullifiers_memory_resource};
 
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    //! Outpoints of the entries in the order they got dirty (if tracked),
+    //! used to write the oldest changes first. May hold stale outpoints.
+    bool fTrackDirty{false};
+    std::deque<COutPoint> dirtyQueue;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -339,6 +386,13 @@ public:
                     CAnchorsSaplingMap& mapSaplingAnchors,
                     CNullifiersMap& mapSaplingNullifiers) override;
 
+    //! Not supported by a cache: its changes are only visible once complete
+    bool BatchWritePartial(CCoinsMap& mapCoins,
+                           const uint256& hashBlock,
+                           const uint256& hashSaplingAnchor,
+                           CAnchorsSaplingMap& mapSaplingAnchors,
+                           CNullifiersMap& mapSaplingNullifiers) override { return false; }
+
     /**
      * Check if we have the given utxo already loaded in this cache.
      * The semantics are the same as HaveCoin(), but no calls to
@@ -346,6 +400,13 @@ public:
      */
     bool HaveCoinInCache(const COutPoint& outpoint) const;
 
+    /**
+     * Add a coin that the caller read from the base view (e.g. prefetched in
+     * parallel), as FetchCoin would have: the entry is neither dirty nor
+     * fresh. Nothing is done if the outpoint is already cached.
+     */
+    void AddFetchedCoin(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Return a reference to a Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin. Modifications to other cache entries are
@@ -384,6 +445,43 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    /**
+     * Recreate the (empty) cache maps and their memory resources, which keep
+     * the memory of the erased entries: this gives it back after a flush.
+     */
+    void ReallocateCache();
+
+    /**
+     * Keep the order in which the entries get dirty, so that they can be
+     * written to the base view incrementally with WriteOldestDirty.
+     */
+    void SetTrackDirty(bool fTrack);
+
+    /**
+     * Write the oldest (at most nMaxCoins) dirty entries, and the Sapling
+     * changes, to the base view. The written entries (Sapling ones included)
+     * stay in the cache, as clean entries. The base view is left inconsistent until the next Flush
+     * (see CCoinsView::BatchWritePartial), which must not be skipped: a
+     * reorg in the meantime requires flushing first.
+     * Returns false if the base view can't be written partially.
+     */
+    bool WriteOldestDirty(size_t nMaxCoins);
+
+    //! Number of entries waiting to be written by WriteOldestDirty
+    size_t GetDirtyQueueSize() const { return dirtyQueue.size(); }
+
+    /**
+     * Remove clean entries until the memory in use by the cache is at most
+     * nTargetUsage. Returns the number of removed entries.
+     */
+    size_t UncacheClean(size_t nTargetUsage);
+
+    /**
+     * The part of DynamicMemoryUsage that the cache keeps for reuse: the
+     * memory of the removed entries, which is only given back on Flush.
+     */
+    size_t ReusableMemoryUsage() const;
+
     /**
      * Amount of pivx coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -416,6 +514,12 @@ public:
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint& outpoint) const;
 
+    //! Record an entry turning dirty, if tracked
+    void TrackDirty(const COutPoint& outpoint)
+    {
+        if (fTrackDirty) dirtyQueue.push_back(outpoint);
+    }
+
     //! Generalized interface for popping anchors
     template<typename Tree, typename Cache, typename CacheEntry>
     void AbstractPopAnchor(
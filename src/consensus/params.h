@@ -207,6 +207,8 @@ struct Params {
     // validation by-pass
     int64_t nPivxBadBlockTime;
     unsigned int nPivxBadBlockBits;
+    /** By default assume that the signatures in ancestors of this block are valid (-assumevalid) */
+    uint256 defaultAssumeValid;
 
     // Map with network updates
     NetworkUpgrade vUpgrades[MAX_NETWORK_UPGRADES];
@@ -258,12 +260,17 @@ struct Params {
 
     libzerocoin::ZerocoinParams* Zerocoin_Params(bool useModulusV1) const
     {
-        static CBigNum bnHexModulus = 0;
-        if (!bnHexModulus) bnHexModulus.SetHex(ZC_Modulus);
-        static libzerocoin::ZerocoinParams ZCParamsHex = libzerocoin::ZerocoinParams(bnHexModulus);
-        static CBigNum bnDecModulus = 0;
-        if (!bnDecModulus) bnDecModulus.SetDec(ZC_Modulus);
-        static libzerocoin::ZerocoinParams ZCParamsDec = libzerocoin::ZerocoinParams(bnDecModulus);
+        // Initialized once, even when first called concurrently (e.g. by the zerocoin check queue workers)
+        static libzerocoin::ZerocoinParams ZCParamsHex = libzerocoin::ZerocoinParams([this]() {
+            CBigNum bnHexModulus = 0;
+            bnHexModulus.SetHex(ZC_Modulus);
+            return bnHexModulus;
+        }());
+        static libzerocoin::ZerocoinParams ZCParamsDec = libzerocoin::ZerocoinParams([this]() {
+            CBigNum bnDecModulus = 0;
+            bnDecModulus.SetDec(ZC_Modulus);
+            return bnDecModulus;
+        }());
         return (useModulusV1 ? &ZCParamsHex : &ZCParamsDec);
     }
 
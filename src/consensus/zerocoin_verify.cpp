@@ -265,12 +265,18 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const lib
     return true;
 }
 
+bool CZerocoinSpendCheck::operator()()
+{
+    return ContextualCheckZerocoinSpendNoSerialCheck(*tx, spend.get(), nHeight);
+}
+
 bool ParseAndValidateZerocoinSpends(const Consensus::Params& consensus,
-                                    const CTransaction& tx, int chainHeight,
+                                    const CTransactionRef& tx, int chainHeight,
                                     CValidationState& state,
-                                    std::vector<std::pair<CBigNum, uint256>>& vSpendsRet)
+                                    std::vector<std::pair<CBigNum, uint256>>& vSpendsRet,
+                                    std::vector<CZerocoinSpendCheck>* pvChecks)
 {
-    for (const CTxIn& txIn : tx.vin) {
+    for (const CTxIn& txIn : tx->vin) {
         bool isPublicSpend = txIn.IsZerocoinPublicSpend();
         bool isPrivZerocoinSpend = txIn.IsZerocoinSpend();
         if (!isPrivZerocoinSpend && !isPublicSpend)
@@ -281,28 +287,36 @@ bool ParseAndValidateZerocoinSpends(const Consensus::Params& consensus,
             return false;
         }
 
+        std::shared_ptr<libzerocoin::CoinSpend> spend;
         if (isPublicSpend) {
             libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-            PublicCoinSpend publicSpend(params);
-            if (!ZPIVModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend)) {
-                return false;
-            }
-            //queue for db write after the 'justcheck' section has concluded
-            if (!ContextualCheckZerocoinSpend(tx, &publicSpend, chainHeight)) {
-                state.DoS(100, error("%s: failed to add block %s with invalid public zc spend", __func__,
-                                     tx.GetHash().GetHex()), REJECT_INVALID);
+            auto publicSpend = std::make_shared<PublicCoinSpend>(params);
+            if (!ZPIVModule::ParseZerocoinPublicSpend(txIn, *tx, state, *publicSpend)) {
                 return false;
             }
-            vSpendsRet.emplace_back(publicSpend.getCoinSerialNumber(), tx.GetHash());
+            spend = std::move(publicSpend);
         } else {
-            libzerocoin::CoinSpend spend = ZPIVModule::TxInToZerocoinSpend(txIn);
-            //queue for db write after the 'justcheck' section has concluded
-            if (!ContextualCheckZerocoinSpend(tx, &spend, chainHeight)) {
-                return state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__,
-                                     tx.GetHash().GetHex()), REJECT_INVALID);
-            }
-            vSpendsRet.emplace_back(spend.getCoinSerialNumber(), tx.GetHash());
+            spend = std::make_shared<libzerocoin::CoinSpend>(ZPIVModule::TxInToZerocoinSpend(txIn));
+        }
+
+        //Reject serial's that are already in the blockchain
+        int nHeightTx = 0;
+        if (IsSerialInBlockchain(spend->getCoinSerialNumber(), nHeightTx)) {
+            return state.DoS(100, error("%s: failed to add block %s with zerocoinspend serial %s already in block %d", __func__,
+                                 tx->GetHash().GetHex(), spend->getCoinSerialNumber().GetHex(), nHeightTx), REJECT_INVALID);
+        }
+
+        // The signature and serial range checks don't depend on the chain state: defer them if requested
+        CZerocoinSpendCheck check(tx, spend, chainHeight);
+        if (pvChecks) {
+            pvChecks->emplace_back();
+            check.swap(pvChecks->back());
+        } else if (!check()) {
+            return state.DoS(100, error("%s: failed to add block %s with invalid %s", __func__,
+                                 tx->GetHash().GetHex(), isPublicSpend ? "public zc spend" : "zerocoinspend"), REJECT_INVALID);
         }
+        //queue for db write after the 'justcheck' section has concluded
+        vSpendsRet.emplace_back(spend->getCoinSerialNumber(), tx->GetHash());
     }
     return !vSpendsRet.empty();
 }
@@ -8,6 +8,8 @@
 #include "consensus/consensus.h"
 #include "script/interpreter.h"
 
+#include <memory>
+
 class CValidationState;
 class CBigNum;
 
@@ -28,10 +30,38 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const lib
 
 bool IsSerialInBlockchain(const CBigNum& bnSerial, int& nHeightTx);
 
+/**
+ * Closure representing the contextual verification of a zerocoin spend, but the serial double-spend
+ * check (see ContextualCheckZerocoinSpendNoSerialCheck).
+ */
+class CZerocoinSpendCheck
+{
+private:
+    CTransactionRef tx;
+    std::shared_ptr<const libzerocoin::CoinSpend> spend;
+    int nHeight;
+
+public:
+    CZerocoinSpendCheck() : nHeight(0) {}
+    CZerocoinSpendCheck(const CTransactionRef& txIn, std::shared_ptr<const libzerocoin::CoinSpend> spendIn, int nHeightIn) :
+        tx(txIn), spend(std::move(spendIn)), nHeight(nHeightIn) {}
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check)
+    {
+        tx.swap(check.tx);
+        spend.swap(check.spend);
+        std::swap(nHeight, check.nHeight);
+    }
+};
+
 // Returns false if coin spend is invalid. Invalidity/DoS causes are treated inside the function.
+// If pvChecks is not null, the verification of the spends is appended to it, instead of being done inline.
 bool ParseAndValidateZerocoinSpends(const Consensus::Params& consensus,
-                                    const CTransaction& tx, int chainHeight,
+                                    const CTransactionRef& tx, int chainHeight,
                                     CValidationState& state,
-                                    std::vector<std::pair<CBigNum, uint256>>& vSpendsRet);
+                                    std::vector<std::pair<CBigNum, uint256>>& vSpendsRet,
+                                    std::vector<CZerocoinSpendCheck>* pvChecks = nullptr);
 
 #endif //PIVX_CONSENSUS_ZEROCOIN_VERIFY_H
@@ -0,0 +1,171 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// SHA-256 with the x86 SHA extensions, after the public domain intrinsics code
+// by Jeffrey Walton, based on Intel's reference.
+
+#ifdef ENABLE_SHANI
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace {
+
+alignas(__m128i) const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** Byte swap of the 32-bit words of a message block. */
+const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+/** Four rounds, on the message words msg (with their round constants added). */
+void inline __attribute__((always_inline)) QuadRound(__m128i& state0, __m128i& state1, __m128i msg)
+{
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+/** The next four message words, from the previous sixteen. */
+__m128i inline __attribute__((always_inline)) NextMsg(__m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    return _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), _mm_alignr_epi8(m3, m2, 4)), m3);
+}
+
+/** Convert the (a, b, ..., h) state into the (abef, cdgh) layout of the SHA instructions. */
+void inline Unshuffle(const uint32_t* s, __m128i& state0, __m128i& state1)
+{
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)s), 0xb1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(s + 4)), 0x1b);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+}
+
+/** The reverse of Unshuffle. */
+void inline Shuffle(uint32_t* s, __m128i state0, __m128i state1)
+{
+    __m128i tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    _mm_storeu_si128((__m128i*)s, _mm_blend_epi16(tmp, state1, 0xf0));
+    _mm_storeu_si128((__m128i*)(s + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+/** One SHA-256 transformation of a 64-byte chunk, in the SHA instructions layout. */
+void inline __attribute__((always_inline)) TransformChunk(__m128i& state0, __m128i& state1, const unsigned char* chunk)
+{
+    const __m128i save0 = state0, save1 = state1;
+    __m128i m[4];
+    for (int i = 0; i < 4; i++) {
+        m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16 * i)), MASK);
+        QuadRound(state0, state1, _mm_add_epi32(m[i], _mm_load_si128((const __m128i*)(K256 + 4 * i))));
+    }
+    for (int i = 4; i < 16; i++) {
+        m[i & 3] = NextMsg(m[i & 3], m[(i + 1) & 3], m[(i + 2) & 3], m[(i + 3) & 3]);
+        QuadRound(state0, state1, _mm_add_epi32(m[i & 3], _mm_load_si128((const __m128i*)(K256 + 4 * i))));
+    }
+    state0 = _mm_add_epi32(state0, save0);
+    state1 = _mm_add_epi32(state1, save1);
+}
+
+/** Two interleaved SHA-256 transformations, of independent chunks and states. */
+void inline __attribute__((always_inline)) TransformChunk2(__m128i& state0a, __m128i& state1a, __m128i& state0b, __m128i& state1b, const unsigned char* chunka, const unsigned char* chunkb)
+{
+    const __m128i save0a = state0a, save1a = state1a, save0b = state0b, save1b = state1b;
+    __m128i ma[4], mb[4];
+    for (int i = 0; i < 4; i++) {
+        const __m128i k = _mm_load_si128((const __m128i*)(K256 + 4 * i));
+        ma[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunka + 16 * i)), MASK);
+        mb[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunkb + 16 * i)), MASK);
+        QuadRound(state0a, state1a, _mm_add_epi32(ma[i], k));
+        QuadRound(state0b, state1b, _mm_add_epi32(mb[i], k));
+    }
+    for (int i = 4; i < 16; i++) {
+        const __m128i k = _mm_load_si128((const __m128i*)(K256 + 4 * i));
+        ma[i & 3] = NextMsg(ma[i & 3], ma[(i + 1) & 3], ma[(i + 2) & 3], ma[(i + 3) & 3]);
+        mb[i & 3] = NextMsg(mb[i & 3], mb[(i + 1) & 3], mb[(i + 2) & 3], mb[(i + 3) & 3]);
+        QuadRound(state0a, state1a, _mm_add_epi32(ma[i & 3], k));
+        QuadRound(state0b, state1b, _mm_add_epi32(mb[i & 3], k));
+    }
+    state0a = _mm_add_epi32(state0a, save0a);
+    state1a = _mm_add_epi32(state1a, save1a);
+    state0b = _mm_add_epi32(state0b, save0b);
+    state1b = _mm_add_epi32(state1b, save1b);
+}
+
+/** The initial state, in the SHA instructions layout. */
+void inline Initialize(__m128i& state0, __m128i& state1)
+{
+    static const uint32_t init[8] = {0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul};
+    Unshuffle(init, state0, state1);
+}
+
+/** Write the state as a big endian hash. */
+void inline WriteHash(unsigned char* out, __m128i state0, __m128i state1)
+{
+    uint32_t s[8];
+    Shuffle(s, state0, state1);
+    for (int i = 0; i < 8; i++) {
+        WriteBE32(out + 4 * i, s[i]);
+    }
+}
+
+// The padding of a 64-byte message: the bit length is 512
+const unsigned char PADDING1[64] = {
+    0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+};
+
+} // namespace
+
+namespace sha256_shani {
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i state0, state1;
+    Unshuffle(s, state0, state1);
+    while (blocks--) {
+        TransformChunk(state0, state1, chunk);
+        chunk += 64;
+    }
+    Shuffle(s, state0, state1);
+}
+} // namespace sha256_shani
+
+namespace sha256d64_shani {
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    __m128i state0a, state1a, state0b, state1b;
+
+    // Transform 1 and 2: the 64-byte inputs, and their padding
+    Initialize(state0a, state1a);
+    Initialize(state0b, state1b);
+    TransformChunk2(state0a, state1a, state0b, state1b, in, in + 64);
+    TransformChunk2(state0a, state1a, state0b, state1b, PADDING1, PADDING1);
+
+    // Transform 3: the first hashes, padded as 256-bit messages
+    unsigned char buffera[64] = {0}, bufferb[64] = {0};
+    WriteHash(buffera, state0a, state1a);
+    WriteHash(bufferb, state0b, state1b);
+    buffera[32] = bufferb[32] = 0x80;
+    buffera[62] = bufferb[62] = 0x01;
+    Initialize(state0a, state1a);
+    Initialize(state0b, state1b);
+    TransformChunk2(state0a, state1a, state0b, state1b, buffera, bufferb);
+
+    WriteHash(out, state0a, state1a);
+    WriteHash(out + 32, state0b, state1b);
+}
+} // namespace sha256d64_shani
+
+#endif // ENABLE_SHANI
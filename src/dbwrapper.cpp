@@ -104,6 +104,9 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+CDBSnapshot::CDBSnapshot(CDBWrapper& db) : pdb(db.pdb), psnapshot(db.pdb->GetSnapshot()) {}
+CDBSnapshot::~CDBSnapshot() { pdb->ReleaseSnapshot(psnapshot); }
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
@@ -185,6 +185,12 @@ public:
         return true;
     }
 
+    CDataStream GetValue()
+    {
+        leveldb::Slice slValue = piter->value();
+        return CDataStream(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+    }
+
     unsigned int GetValueSize()
     {
         return piter->value().size();
@@ -192,8 +198,28 @@ public:
 
 };
 
+/** A consistent, read-only view of a CDBWrapper as of the time it was taken. The database
+ *  can be iterated through it (see CDBWrapper::NewIterator) while it keeps being written. */
+class CDBSnapshot
+{
+    friend class CDBWrapper;
+
+private:
+    leveldb::DB* pdb;
+    const leveldb::Snapshot* psnapshot;
+
+public:
+    explicit CDBSnapshot(CDBWrapper& db);
+    ~CDBSnapshot();
+
+    CDBSnapshot(const CDBSnapshot&) = delete;
+    CDBSnapshot& operator=(const CDBSnapshot&) = delete;
+};
+
 class CDBWrapper
 {
+    friend class CDBSnapshot;
+
 private:
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
@@ -336,6 +362,15 @@ public:
         return new CDBIterator(pdb->NewIterator(iteroptions));
     }
 
+    //! Iterator over the database as of the given snapshot (of this database)
+    CDBIterator* NewIterator(const CDBSnapshot& snapshot)
+    {
+        assert(snapshot.pdb == pdb);
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot.psnapshot;
+        return new CDBIterator(pdb->NewIterator(options));
+    }
+
    /**
     * Return true if the database managed by this class contains no entries.
     */
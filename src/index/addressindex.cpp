@@ -0,0 +1,226 @@
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/addressindex.h"
+
+#include "hash.h"
+#include "undo.h"
+#include "util/system.h"
+#include "validation.h"
+
+static constexpr char DB_ADDRESSINDEX = 'a';
+static constexpr char DB_ADDRESSUNSPENT = 'u';
+
+std::unique_ptr<AddressIndex> g_addressindex;
+
+uint160 GetScriptHashForIndex(const CScript& script)
+{
+    return Hash160(script.begin(), script.end());
+}
+
+namespace {
+
+/** Seek key for the history of a script, starting at the given height. */
+struct CAddressIndexIteratorKey {
+    uint160 script_hash;
+    int height;
+
+    CAddressIndexIteratorKey(const uint160& script_hash_in, int height_in) :
+        script_hash(script_hash_in), height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        script_hash.Serialize(s);
+        ser_writedata32be(s, height);
+    }
+};
+
+/** Outputs of a transaction that the index records (the coins that get into the UTXO set). */
+bool IsIndexedOutput(const CTxOut& out)
+{
+    return !out.scriptPubKey.empty() && !out.scriptPubKey.IsUnspendable();
+}
+
+/** The transparent inputs of a transaction with their spent coins, if it has any. */
+const std::vector<Coin>* GetSpentCoins(const CTransaction& tx, size_t tx_pos, const CBlockUndo& block_undo)
+{
+    if (tx_pos == 0) return nullptr;
+    const std::vector<Coin>& prevouts = block_undo.vtxundo[tx_pos - 1].vprevout;
+    // Zerocoin spends have no undo entries for their inputs
+    return prevouts.size() == tx.vin.size() && !prevouts.empty() ? &prevouts : nullptr;
+}
+
+} // namespace
+
+/** Access to the address index database (indexes/addressindex/) */
+class AddressIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    bool ReadAddressIndex(const uint160& script_hash, int start_height, int end_height,
+                          std::vector<std::pair<CAddressIndexKey, CAmount>>& entries);
+
+    bool ReadAddressUnspent(const uint160& script_hash,
+                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent);
+};
+
+AddressIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "addressindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool AddressIndex::DB::ReadAddressIndex(const uint160& script_hash, int start_height, int end_height,
+                                        std::vector<std::pair<CAddressIndexKey, CAmount>>& entries)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(script_hash, start_height)));
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.script_hash != script_hash) {
+            break;
+        }
+        if (end_height > 0 && key.second.height > end_height) {
+            break;
+        }
+        CAmount value;
+        if (!pcursor->GetValue(value)) {
+            return error("%s: failed to read address index value", __func__);
+        }
+        entries.emplace_back(key.second, value);
+    }
+    return true;
+}
+
+bool AddressIndex::DB::ReadAddressUnspent(const uint160& script_hash,
+                                          std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENT, script_hash));
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENT || key.second.script_hash != script_hash) {
+            break;
+        }
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value)) {
+            return error("%s: failed to read address unspent value", __func__);
+        }
+        unspent.emplace_back(key.second, value);
+    }
+    return true;
+}
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(std::make_unique<AddressIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+AddressIndex::~AddressIndex() {}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis outputs are not spendable
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return error("%s: failed to read undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: undo data mismatch for block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    // Transactions are processed in block order, so that an output spent
+    // within the same block gets its unspent entry written, then erased.
+    CDBBatch batch;
+    const int height = pindex->nHeight;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        const std::vector<Coin>* spent_coins = GetSpentCoins(tx, i, block_undo);
+        for (size_t j = 0; spent_coins && j < spent_coins->size(); j++) {
+            const CTxOut& prev_out = (*spent_coins)[j].out;
+            const COutPoint& prevout = tx.vin[j].prevout;
+            const uint160 script_hash = GetScriptHashForIndex(prev_out.scriptPubKey);
+            batch.Write(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(script_hash, height, txid, j, true)),
+                        -prev_out.nValue);
+            batch.Erase(std::make_pair(DB_ADDRESSUNSPENT, CAddressUnspentKey(script_hash, prevout.hash, prevout.n)));
+        }
+
+        for (size_t k = 0; k < tx.vout.size(); k++) {
+            const CTxOut& out = tx.vout[k];
+            if (!IsIndexedOutput(out)) continue;
+            const uint160 script_hash = GetScriptHashForIndex(out.scriptPubKey);
+            batch.Write(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(script_hash, height, txid, k, false)),
+                        out.nValue);
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENT, CAddressUnspentKey(script_hash, txid, k)),
+                        CAddressUnspentValue(out.nValue, out.scriptPubKey, height));
+        }
+    }
+    return m_db->WriteBatch(batch);
+}
+
+bool AddressIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // Undo the blocks from the tip down, and their transactions in reverse
+    // order, restoring the unspent entries of the coins they spent.
+    CDBBatch batch;
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        if (pindex->nHeight == 0) continue;
+
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!ReadBlockFromDisk(block, pindex) || !UndoReadFromDisk(block_undo, pindex) ||
+            block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+
+        const int height = pindex->nHeight;
+        for (size_t i = block.vtx.size(); i-- > 0;) {
+            const CTransaction& tx = *block.vtx[i];
+            const uint256& txid = tx.GetHash();
+
+            for (size_t k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                if (!IsIndexedOutput(out)) continue;
+                const uint160 script_hash = GetScriptHashForIndex(out.scriptPubKey);
+                batch.Erase(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(script_hash, height, txid, k, false)));
+                batch.Erase(std::make_pair(DB_ADDRESSUNSPENT, CAddressUnspentKey(script_hash, txid, k)));
+            }
+
+            const std::vector<Coin>* spent_coins = GetSpentCoins(tx, i, block_undo);
+            for (size_t j = 0; spent_coins && j < spent_coins->size(); j++) {
+                const Coin& coin = (*spent_coins)[j];
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const uint160 script_hash = GetScriptHashForIndex(coin.out.scriptPubKey);
+                batch.Erase(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(script_hash, height, txid, j, true)));
+                batch.Write(std::make_pair(DB_ADDRESSUNSPENT, CAddressUnspentKey(script_hash, prevout.hash, prevout.n)),
+                            CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight));
+            }
+        }
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& AddressIndex::GetDB() const { return *m_db; }
+
+bool AddressIndex::GetAddressIndex(const uint160& script_hash,
+                                   std::vector<std::pair<CAddressIndexKey, CAmount>>& entries,
+                                   int start_height, int end_height) const
+{
+    return m_db->ReadAddressIndex(script_hash, start_height, end_height, entries);
+}
+
+bool AddressIndex::GetAddressUnspent(const uint160& script_hash,
+                                     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent) const
+{
+    return m_db->ReadAddressUnspent(script_hash, unspent);
+}
@@ -0,0 +1,149 @@
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_INDEX_ADDRESSINDEX_H
+#define PIVX_INDEX_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "index/base.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <memory>
+#include <vector>
+
+/** Default for -addressindex */
+static const bool DEFAULT_ADDRESSINDEX = false;
+
+/**
+ * The address index keys its records by the hash of the output script, so
+ * that any script type (P2PKH, P2SH, P2CS, ...) can be looked up. Addresses
+ * are translated to their script before querying.
+ */
+uint160 GetScriptHashForIndex(const CScript& script);
+
+/**
+ * An entry of the history of a script: an output paying to it (spending ==
+ * false) or an input spending one of its outputs (spending == true). Entries
+ * of a script are ordered by height, which is serialized big-endian.
+ */
+struct CAddressIndexKey {
+    uint160 script_hash;
+    int height{0};
+    uint256 txid;
+    uint32_t index{0}; //!< Output index, or input index for spending entries
+    bool spending{false};
+
+    CAddressIndexKey() = default;
+    CAddressIndexKey(const uint160& script_hash_in, int height_in, const uint256& txid_in,
+                     uint32_t index_in, bool spending_in) :
+        script_hash(script_hash_in), height(height_in), txid(txid_in),
+        index(index_in), spending(spending_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        script_hash.Serialize(s);
+        ser_writedata32be(s, height);
+        txid.Serialize(s);
+        ser_writedata32be(s, index);
+        ser_writedata8(s, spending);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        script_hash.Unserialize(s);
+        height = ser_readdata32be(s);
+        txid.Unserialize(s);
+        index = ser_readdata32be(s);
+        spending = ser_readdata8(s);
+    }
+};
+
+/** An output of a script that is still unspent at the index tip. */
+struct CAddressUnspentKey {
+    uint160 script_hash;
+    uint256 txid;
+    uint32_t index{0};
+
+    CAddressUnspentKey() = default;
+    CAddressUnspentKey(const uint160& script_hash_in, const uint256& txid_in, uint32_t index_in) :
+        script_hash(script_hash_in), txid(txid_in), index(index_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        script_hash.Serialize(s);
+        txid.Serialize(s);
+        ser_writedata32be(s, index);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        script_hash.Unserialize(s);
+        txid.Unserialize(s);
+        index = ser_readdata32be(s);
+    }
+};
+
+struct CAddressUnspentValue {
+    CAmount value{0};
+    CScript script;
+    int height{0};
+
+    CAddressUnspentValue() = default;
+    CAddressUnspentValue(CAmount value_in, const CScript& script_in, int height_in) :
+        value(value_in), script(script_in), height(height_in) {}
+
+    SERIALIZE_METHODS(CAddressUnspentValue, obj) { READWRITE(obj.value, obj.script, obj.height); }
+};
+
+/**
+ * AddressIndex keeps, for each output script, the history of the outputs
+ * paying to it and of the inputs spending them, plus the set of its outputs
+ * that are still unspent. It answers "history/balance/utxos of address X"
+ * with a range read instead of a scan of the chain or of the UTXO set.
+ */
+class AddressIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "addressindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~AddressIndex() override;
+
+    /// Get the history of a script, optionally restricted to the blocks in
+    /// [start_height, end_height] (end_height = 0 means no upper bound).
+    bool GetAddressIndex(const uint160& script_hash,
+                         std::vector<std::pair<CAddressIndexKey, CAmount>>& entries,
+                         int start_height = 0, int end_height = 0) const;
+
+    /// Get the unspent outputs of a script.
+    bool GetAddressUnspent(const uint160& script_hash,
+                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent) const;
+};
+
+/// The global address index. May be null.
+extern std::unique_ptr<AddressIndex> g_addressindex;
+
+#endif // PIVX_INDEX_ADDRESSINDEX_H
@@ -0,0 +1,343 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/coinstatsindex.h"
+
+#include "coins.h"
+#include "invalid.h"
+#include "streams.h"
+#include "undo.h"
+#include "util/system.h"
+#include "validation.h"
+
+/* The index database stores the statistics of the UTXO set after each block. Those of the blocks
+ * on the active chain are indexed by height, and those of the blocks that have been reorganized out
+ * of the active chain by block hash, as in the block filter index.
+ * The running MuHash of the index tip, which can't be recovered from its finalized hash, is stored
+ * under the DB_MUHASH key, and committed with the best block locator.
+ *
+ * Keys for the height index have the type [DB_BLOCK_HEIGHT, uint32 (BE)].
+ * Keys for the hash index have the type [DB_BLOCK_HASH, uint256].
+ */
+static constexpr char DB_BLOCK_HASH = 's';
+static constexpr char DB_BLOCK_HEIGHT = 't';
+static constexpr char DB_MUHASH = 'M';
+
+std::unique_ptr<CoinStatsIndex> g_coinstatsindex;
+
+namespace {
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for coinstatsindex DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+struct DBHashKey {
+    uint256 hash;
+
+    explicit DBHashKey(const uint256& hash_in) : hash(hash_in) {}
+
+    SERIALIZE_METHODS(DBHashKey, obj) {
+        char prefix = DB_BLOCK_HASH;
+        READWRITE(prefix);
+        if (prefix != DB_BLOCK_HASH) {
+            throw std::ios_base::failure("Invalid format for coinstatsindex DB hash key");
+        }
+
+        READWRITE(obj.hash);
+    }
+};
+
+/** The serialization of an unspent output that gets into the MuHash. */
+CDataStream TxOutSer(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.nHeight * 4 + (coin.fCoinBase ? 2u : 0u) + (coin.fCoinStake ? 1u : 0u));
+    ss << coin.out;
+    return ss;
+}
+
+/** Whether an output of a block gets into the UTXO set (see AddCoins). */
+bool IsUTXOSetOutput(const COutPoint& outpoint, const CTxOut& out, bool fSkipInvalid)
+{
+    return !out.scriptPubKey.IsUnspendable() && !out.IsZerocoinMint() &&
+           !(fSkipInvalid && invalid_out::ContainsOutPoint(outpoint));
+}
+
+} // namespace
+
+uint64_t GetBogoSize(const CScript& script_pub_key)
+{
+    return 32 /* txid */ +
+           4 /* vout index */ +
+           4 /* height + coinbase */ +
+           8 /* amount */ +
+           2 /* scriptPubKey len */ +
+           script_pub_key.size() /* scriptPubKey */;
+}
+
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    muhash.Insert(MakeUCharSpan(TxOutSer(outpoint, coin)));
+}
+
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    muhash.Remove(MakeUCharSpan(TxOutSer(outpoint, coin)));
+}
+
+/** Access to the coin stats index database (indexes/coinstats/) */
+class CoinStatsIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+};
+
+CoinStatsIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "coinstats", n_cache_size, f_memory, f_wipe)
+{}
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(std::make_unique<CoinStatsIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+CoinStatsIndex::~CoinStatsIndex() {}
+
+static bool ReadBlockUndo(const CBlock& block, const CBlockIndex* pindex, CBlockUndo& block_undo)
+{
+    return UndoReadFromDisk(block_undo, pindex) && block_undo.vtxundo.size() + 1 == block.vtx.size();
+}
+
+static bool LookUpOne(const CDBWrapper& db, const CBlockIndex* block_index, CCoinStatsIndexValue& result)
+{
+    // First check if the result is stored under the height index and the value there matches the
+    // block hash. This should be the case if the block is on the active chain.
+    std::pair<uint256, CCoinStatsIndexValue> read_out;
+    if (!db.Read(DBHeightKey(block_index->nHeight), read_out)) {
+        return false;
+    }
+    if (read_out.first == block_index->GetBlockHash()) {
+        result = std::move(read_out.second);
+        return true;
+    }
+
+    // If value at the height index corresponds to an different block, the result will be stored in
+    // the hash index.
+    return db.Read(DBHashKey(block_index->GetBlockHash()), result);
+}
+
+bool CoinStatsIndex::Init()
+{
+    if (!m_db->Read(DB_MUHASH, m_muhash)) {
+        // Check that the cause of the read failure is that the key does not exist. Any other errors
+        // indicate database corruption or a disk failure, and starting the index would cause
+        // further corruption.
+        if (m_db->Exists(DB_MUHASH)) {
+            return error("%s: Cannot read current %s state; index may be corrupted",
+                         __func__, GetName());
+        }
+    }
+
+    if (!BaseIndex::Init()) return false;
+
+    const CBlockIndex* pindex = CurrentIndex();
+    if (pindex) {
+        if (!LookUpOne(*m_db, pindex, m_stats)) {
+            return error("%s: Cannot read current %s state; index may be corrupted",
+                         __func__, GetName());
+        }
+        // The running MuHash is the one of the last committed block: it doesn't match if the
+        // index tip was reorganized out of the active chain while the node was down.
+        uint256 out;
+        m_muhash.Finalize(out);
+        if (out != m_stats.muhash) {
+            return error("%s: %s tip is not on the active chain, restart with -reindex to rebuild it",
+                         __func__, GetName());
+        }
+    }
+    return true;
+}
+
+bool CoinStatsIndex::CommitInternal(CDBBatch& batch)
+{
+    // The running MuHash is committed with the best block locator
+    batch.Write(DB_MUHASH, m_muhash);
+    return BaseIndex::CommitInternal(batch);
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis outputs are not spendable: the UTXO set is empty
+    if (pindex->nHeight > 0) {
+        CBlockUndo block_undo;
+        if (!ReadBlockUndo(block, pindex, block_undo)) {
+            return error("%s: failed to read undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+
+        // The running state must be the one of the previous block
+        std::pair<uint256, CCoinStatsIndexValue> read_out;
+        if (!m_db->Read(DBHeightKey(pindex->nHeight - 1), read_out)) {
+            return false;
+        }
+        if (read_out.first != pindex->pprev->GetBlockHash()) {
+            return error("%s: previous block header belongs to unexpected block %s; expected %s",
+                         __func__, read_out.first.ToString(), pindex->pprev->GetBlockHash().ToString());
+        }
+
+        const bool fSkipInvalid = SkipInvalidUTXOS(pindex->nHeight);
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            const uint256& txid = tx.GetHash();
+
+            for (size_t k = 0; k < tx.vout.size(); k++) {
+                const COutPoint outpoint(txid, k);
+                const CTxOut& out = tx.vout[k];
+                if (!IsUTXOSetOutput(outpoint, out, fSkipInvalid)) continue;
+                ApplyCoinHash(m_muhash, outpoint, Coin(out, pindex->nHeight, tx.IsCoinBase(), tx.IsCoinStake()));
+                m_stats.transaction_output_count++;
+                m_stats.bogo_size += GetBogoSize(out.scriptPubKey);
+                m_stats.total_amount += out.nValue;
+            }
+
+            // Zerocoin spends have no undo entries for their inputs
+            if (i == 0 || tx.HasZerocoinSpendInputs()) continue;
+            const std::vector<Coin>& prevouts = block_undo.vtxundo[i - 1].vprevout;
+            if (prevouts.size() != tx.vin.size()) {
+                return error("%s: undo data of transaction %s doesn't match its inputs", __func__, txid.ToString());
+            }
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                const Coin& coin = prevouts[j];
+                RemoveCoinHash(m_muhash, tx.vin[j].prevout, coin);
+                m_stats.transaction_output_count--;
+                m_stats.bogo_size -= GetBogoSize(coin.out.scriptPubKey);
+                m_stats.total_amount -= coin.out.nValue;
+            }
+        }
+    }
+
+    m_muhash.Finalize(m_stats.muhash);
+    return m_db->Write(DBHeightKey(pindex->nHeight), std::make_pair(pindex->GetBlockHash(), m_stats));
+}
+
+static bool CopyHeightIndexToHashIndex(CDBIterator& db_it, CDBBatch& batch,
+                                       const std::string& index_name,
+                                       int start_height, int stop_height)
+{
+    DBHeightKey key(start_height);
+    db_it.Seek(key);
+
+    for (int height = start_height; height <= stop_height; ++height) {
+        if (!db_it.GetKey(key) || key.height != height) {
+            return error("%s: unexpected key in %s: expected (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        std::pair<uint256, CCoinStatsIndexValue> value;
+        if (!db_it.GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        batch.Write(DBHashKey(value.first), std::move(value.second));
+
+        db_it.Next();
+    }
+    return true;
+}
+
+bool CoinStatsIndex::ReverseBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    if (!ReadBlockUndo(block, pindex, block_undo)) {
+        return error("%s: failed to read undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    const bool fSkipInvalid = SkipInvalidUTXOS(pindex->nHeight);
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        for (size_t k = 0; k < tx.vout.size(); k++) {
+            const COutPoint outpoint(txid, k);
+            const CTxOut& out = tx.vout[k];
+            if (!IsUTXOSetOutput(outpoint, out, fSkipInvalid)) continue;
+            RemoveCoinHash(m_muhash, outpoint, Coin(out, pindex->nHeight, tx.IsCoinBase(), tx.IsCoinStake()));
+        }
+
+        if (i == 0 || tx.HasZerocoinSpendInputs()) continue;
+        const std::vector<Coin>& prevouts = block_undo.vtxundo[i - 1].vprevout;
+        if (prevouts.size() != tx.vin.size()) {
+            return error("%s: undo data of transaction %s doesn't match its inputs", __func__, txid.ToString());
+        }
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            ApplyCoinHash(m_muhash, tx.vin[j].prevout, prevouts[j]);
+        }
+    }
+
+    // The totals are the ones of the previous block, whose MuHash must match the rolled back one
+    CCoinStatsIndexValue prev_stats;
+    if (!LookUpOne(*m_db, pindex->pprev, prev_stats)) {
+        return error("%s: unable to read the statistics of block %s", __func__, pindex->pprev->GetBlockHash().ToString());
+    }
+    uint256 out;
+    m_muhash.Finalize(out);
+    if (out != prev_stats.muhash) {
+        return error("%s: rolled back MuHash of block %s doesn't match the index", __func__, pindex->pprev->GetBlockHash().ToString());
+    }
+    m_stats = prev_stats;
+    return true;
+}
+
+bool CoinStatsIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // During a reorg, we need to copy the statistics of the blocks that are getting disconnected
+    // from the height index to the hash index so we can still find them when the height index
+    // entries are overwritten.
+    CDBBatch batch;
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    if (!CopyHeightIndexToHashIndex(*db_it, batch, GetName(), new_tip->nHeight, current_tip->nHeight)) {
+        return false;
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!ReverseBlock(block, pindex)) return false;
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& CoinStatsIndex::GetDB() const { return *m_db; }
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex* block_index, CCoinStatsIndexValue& stats) const
+{
+    return LookUpOne(*m_db, block_index, stats);
+}
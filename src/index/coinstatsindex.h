@@ -0,0 +1,89 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_INDEX_COINSTATSINDEX_H
+#define PIVX_INDEX_COINSTATSINDEX_H
+
+#include "amount.h"
+#include "crypto/muhash.h"
+#include "index/base.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <memory>
+
+class Coin;
+class COutPoint;
+class CScript;
+
+/** Default for -coinstatsindex */
+static const bool DEFAULT_COINSTATSINDEX = false;
+
+/** Statistics of the UTXO set after a block. */
+struct CCoinStatsIndexValue {
+    uint256 muhash;                         //!< Finalized MuHash3072 of the UTXO set
+    uint64_t transaction_output_count{0};   //!< Number of unspent outputs
+    uint64_t bogo_size{0};                  //!< Database-independent size metric, see GetBogoSize
+    CAmount total_amount{0};                //!< Value of the unspent outputs
+
+    SERIALIZE_METHODS(CCoinStatsIndexValue, obj) { READWRITE(obj.muhash, obj.transaction_output_count, obj.bogo_size, obj.total_amount); }
+};
+
+/** Database-independent size metric of an unspent output (as in gettxoutsetinfo "bogosize"). */
+uint64_t GetBogoSize(const CScript& script_pub_key);
+
+/** Add (or remove) an unspent output to (from) a MuHash of the UTXO set. */
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+/**
+ * CoinStatsIndex maintains the statistics of the UTXO set (a rolling MuHash
+ * of it, and the totals of its outputs) after each block, so that they can
+ * be looked up without scanning the coins database.
+ */
+class CoinStatsIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+    /// Running state of the UTXO set at the index tip
+    MuHash3072 m_muhash;
+    CCoinStatsIndexValue m_stats;
+
+    /// Undo the changes of a block to the running state
+    bool ReverseBlock(const CBlock& block, const CBlockIndex* pindex);
+
+protected:
+    bool Init() override;
+
+    bool CommitInternal(CDBBatch& batch) override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "coinstatsindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~CoinStatsIndex() override;
+
+    /// Look up the statistics of the UTXO set after a block (on the active
+    /// chain or not). Returns false if the index has not reached the block.
+    bool LookUpStats(const CBlockIndex* block_index, CCoinStatsIndexValue& stats) const;
+};
+
+/// The global UTXO set statistics index. May be null.
+extern std::unique_ptr<CoinStatsIndex> g_coinstatsindex;
+
+#endif // PIVX_INDEX_COINSTATSINDEX_H
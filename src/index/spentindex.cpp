@@ -0,0 +1,103 @@
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/spentindex.h"
+
+#include "index/addressindex.h"
+#include "undo.h"
+#include "util/system.h"
+#include "validation.h"
+
+static constexpr char DB_SPENTINDEX = 'p';
+
+std::unique_ptr<SpentIndex> g_spentindex;
+
+/** Access to the spent index database (indexes/spentindex/) */
+class SpentIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+};
+
+SpentIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "spentindex", n_cache_size, f_memory, f_wipe)
+{}
+
+SpentIndex::SpentIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(std::make_unique<SpentIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+SpentIndex::~SpentIndex() {}
+
+static bool ReadBlockAndUndo(const CBlockIndex* pindex, CBlock& block, CBlockUndo& block_undo)
+{
+    if (!ReadBlockFromDisk(block, pindex) || !UndoReadFromDisk(block_undo, pindex)) {
+        return false;
+    }
+    return block_undo.vtxundo.size() + 1 == block.vtx.size();
+}
+
+bool SpentIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex) || block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: failed to read undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    CDBBatch batch;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const std::vector<Coin>& prevouts = block_undo.vtxundo[i - 1].vprevout;
+        // Zerocoin spends have no undo entries for their inputs
+        if (prevouts.size() != tx.vin.size()) continue;
+
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            CSpentIndexValue value;
+            value.txid = tx.GetHash();
+            value.input_index = j;
+            value.height = pindex->nHeight;
+            value.value = prevouts[j].out.nValue;
+            value.script_hash = GetScriptHashForIndex(prevouts[j].out.scriptPubKey);
+            batch.Write(std::make_pair(DB_SPENTINDEX, tx.vin[j].prevout), value);
+        }
+    }
+    return m_db->WriteBatch(batch);
+}
+
+bool SpentIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // An output is spent at most once in a chain, so the entries of the
+    // disconnected blocks can be erased in any order.
+    CDBBatch batch;
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        if (pindex->nHeight == 0) continue;
+
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!ReadBlockAndUndo(pindex, block, block_undo)) {
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            if (block_undo.vtxundo[i - 1].vprevout.size() != tx.vin.size()) continue;
+            for (const CTxIn& txin : tx.vin) {
+                batch.Erase(std::make_pair(DB_SPENTINDEX, txin.prevout));
+            }
+        }
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& SpentIndex::GetDB() const { return *m_db; }
+
+bool SpentIndex::GetSpentInfo(const COutPoint& outpoint, CSpentIndexValue& value) const
+{
+    return m_db->Read(std::make_pair(DB_SPENTINDEX, outpoint), value);
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_INDEX_SPENTINDEX_H
+#define PIVX_INDEX_SPENTINDEX_H
+
+#include "amount.h"
+#include "index/base.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <memory>
+
+/** Default for -spentindex */
+static const bool DEFAULT_SPENTINDEX = false;
+
+/** Where (and with which value) a transparent output was spent. */
+struct CSpentIndexValue {
+    uint256 txid;           //!< The spending transaction
+    uint32_t input_index{0};
+    int height{0};          //!< Height of the block including the spending transaction
+    CAmount value{0};       //!< Value of the spent output
+    uint160 script_hash;    //!< Hash of the spent output script, see GetScriptHashForIndex
+
+    SERIALIZE_METHODS(CSpentIndexValue, obj) { READWRITE(obj.txid, obj.input_index, obj.height, obj.value, obj.script_hash); }
+};
+
+/**
+ * SpentIndex maps each spent transparent output to the input spending it.
+ */
+class SpentIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "spentindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit SpentIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~SpentIndex() override;
+
+    /// Look up the input spending an output. Returns false if the output is
+    /// unspent (or unknown) at the index tip.
+    bool GetSpentInfo(const COutPoint& outpoint, CSpentIndexValue& value) const;
+};
+
+/// The global spent index. May be null.
+extern std::unique_ptr<SpentIndex> g_spentindex;
+
+#endif // PIVX_INDEX_SPENTINDEX_H
@@ -0,0 +1,71 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_INDEX_TXINDEX_H
+#define PIVX_INDEX_TXINDEX_H
+
+#include "index/base.h"
+
+#include <memory>
+
+class CBlockTreeDB;
+
+/**
+ * TxIndex is used to look up transactions included in the blockchain by hash.
+ * The index is written to a LevelDB database and records the filesystem
+ * location of each transaction by transaction hash.
+ */
+class TxIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    /// Override base class init to migrate from old database.
+    bool Init() override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    /// Once in sync, the index is written by ConnectBlock instead of the (asynchronous)
+    /// notifications. As the legacy records, entries of disconnected blocks are kept.
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex) override {}
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block, const uint256& blockHash, int nBlockHeight, int64_t blockTime) override {}
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "txindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit TxIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~TxIndex() override;
+
+    /// Look up a transaction by hash.
+    ///
+    /// @param[in]   tx_hash  The hash of the transaction to be returned.
+    /// @param[out]  block_hash  The hash of the block the transaction is found in.
+    /// @param[out]  tx  The transaction itself.
+    /// @return  true if transaction is found, false otherwise
+    bool FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const;
+
+    /// Index a block being connected to the active chain (cs_main held), so that the consensus
+    /// lookups through GetTransaction see its txs as soon as it is the tip. Does nothing while
+    /// the sync thread is catching up, or if the block is already indexed (e.g. VerifyDB).
+    bool ConnectBlock(const CBlock& block, const CBlockIndex* pindex);
+
+    /// Erase the txindex records that older versions wrote to the block tree DB, when the node
+    /// runs without -txindex and they can't be migrated anymore. Resumes if interrupted.
+    static bool EraseLegacyData(CBlockTreeDB& block_tree_db);
+};
+
+/// The global transaction index, used in GetTransaction. May be null.
+extern std::unique_ptr<TxIndex> g_txindex;
+
+#endif // PIVX_INDEX_TXINDEX_H
@@ -17,13 +17,20 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockfilter.h"
 #include "bls/bls_wrapper.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
+#include "crypto/sha256.h"
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "index/addressindex.h"
+#include "index/blockfilterindex.h"
+#include "index/coinstatsindex.h"
+#include "index/spentindex.h"
+#include "index/txindex.h"
 #include "invalid.h"
 #include "key.h"
 #include "mapport.h"
@@ -34,6 +41,7 @@
 #include "policy/policy.h"
 #include "rpc/register.h"
 #include "rpc/server.h"
+#include "sapling/sapling_validation.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
 #include "scheduler.h"
@@ -106,6 +114,8 @@ static CZMQNotificationInterface* pzmqNotificationInterface = NULL;
 static const char* DEFAULT_ASMAP_FILENAME="ip_asn.map";
 
 static const char* FEE_ESTIMATES_FILENAME = "fee_estimates.dat";
+
+static std::set<BlockFilterType> g_enabled_filter_types;
 CClientUIInterface uiInterface;  // Declared but not defined in guiinterface.h
 
 /**
@@ -193,6 +203,19 @@ void Interrupt()
     InterruptMapPort();
     if (g_connman)
         g_connman->Interrupt();
+    if (g_txindex) {
+        g_txindex->Interrupt();
+    }
+    if (g_addressindex) {
+        g_addressindex->Interrupt();
+    }
+    if (g_spentindex) {
+        g_spentindex->Interrupt();
+    }
+    if (g_coinstatsindex) {
+        g_coinstatsindex->Interrupt();
+    }
+    ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Interrupt(); });
 }
 
 void Shutdown()
@@ -225,7 +248,10 @@ void Shutdown()
 
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
-    if (peerLogic) UnregisterValidationInterface(peerLogic.get());
+    if (peerLogic) {
+        UnregisterValidationInterface(peerLogic.get());
+        peerLogic->StopTierTwoWorkers();
+    }
     if (g_connman) g_connman->Stop();
 
     StopTorControl();
@@ -271,6 +297,26 @@ void Shutdown()
     // up with our current chain to avoid any strange pruning edge cases and make
     // next startup faster by avoiding rescan.
 
+    // Stop and delete all indexes only after flushing background callbacks.
+    if (g_txindex) {
+        g_txindex->Stop();
+        g_txindex.reset();
+    }
+    if (g_addressindex) {
+        g_addressindex->Stop();
+        g_addressindex.reset();
+    }
+    if (g_spentindex) {
+        g_spentindex->Stop();
+        g_spentindex.reset();
+    }
+    if (g_coinstatsindex) {
+        g_coinstatsindex->Stop();
+        g_coinstatsindex.reset();
+    }
+    ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Stop(); });
+    DestroyAllBlockFilterIndexes();
+
     {
         LOCK(cs_main);
         if (pcoinsTip != NULL) {
@@ -388,12 +434,19 @@ std::string HelpMessage(HelpMessageMode mode)
     std::string strUsage = HelpMessageGroup("Options:");
     strUsage += HelpMessageOpt("-?", "This help message");
     strUsage += HelpMessageOpt("-version", "Print version and exit");
+    strUsage += HelpMessageOpt("-addressindex", strprintf("Maintain an index of the history and unspent outputs of each address, used by the getaddress* rpc calls. The index is built in the background (default: %u)", DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)");
+    strUsage += HelpMessageOpt("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)",
+            defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()));
+    strUsage += HelpMessageOpt("-asyncverify", strprintf("Verify the block and undo data of the blocks requested by -checkblocks beyond the last %d in the background, once the node is started (default: %u)", ASYNC_VERIFYDB_STARTUP_BLOCKS, DEFAULT_ASYNC_VERIFYDB));
+    strUsage += HelpMessageOpt("-blockfilterindex=<type>", strprintf("Maintain an index of compact filters by block (default: %s, values: %s). "
+            "If <type> is not supplied or if <type> = 1, indexes for all known types are enabled.", DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()));
     strUsage += HelpMessageOpt("-blocksdir=<dir>", "Specify directory to hold blocks subdirectory for *.dat files (default: <datadir>)");
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)");
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf("How thorough the block verification of -checkblocks is (0-4, default: %u)", DEFAULT_CHECKLEVEL));
 
+    strUsage += HelpMessageOpt("-coinstatsindex", strprintf("Maintain the statistics of the UTXO set (and its MuHash) after each block, used by the gettxoutsetinfo rpc call. The index is built in the background (default: %u)", DEFAULT_COINSTATSINDEX));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf("Specify configuration file (default: %s)", PIVX_CONF_FILENAME));
     if (mode == HMM_BITCOIND) {
 #if !defined(WIN32)
@@ -408,6 +461,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf("Specify location of debug log file: this can be an absolute path or a path relative to the data directory (default: %s)", DEFAULT_DEBUGLOGFILE));
     strUsage += HelpMessageOpt("-disablesystemnotifications", strprintf("Disable OS notifications for incoming transactions (default: %u)", 0));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf("Set database cache size in megabytes (%d to %d, default: %d)", nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-incrementalflush", strprintf("Write the oldest changes of the UTXO cache to disk every few seconds, evicting unmodified entries when it fills up, instead of writing the whole cache at once when it is full (default: %u)", DEFAULT_INCREMENTAL_FLUSH));
+    strUsage += HelpMessageOpt("-importthreads=<n>", strprintf("Set the number of threads decoding blocks during -reindex and -loadblock (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)", -GetNumCores(), MAX_IMPORT_THREADS, DEFAULT_IMPORT_THREADS));
     strUsage += HelpMessageOpt("-loadblock=<file>", "Imports blocks from external blk000??.dat file on startup");
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf("Set the Maximum reorg depth (default: %u)", DEFAULT_MAX_REORG_DEPTH));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf("Keep at most <n> unconnectable transactions in memory (default: %u)", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -418,13 +473,17 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf("Specify pid file (default: %s)", PIVX_PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf("Reduce storage requirements by pruning (deleting) old blocks. This mode is incompatible with -txindex, -blockfilterindex, -addressindex, -spentindex and -coinstatsindex. "
+            "Warning: Reverting this setting requires re-downloading the entire blockchain. "
+            "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks");
     strUsage += HelpMessageOpt("-reindex", "Rebuild block chain index from current blk000??.dat files on startup");
     strUsage += HelpMessageOpt("-resync", "Delete blockchain folders and resync from scratch on startup");
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", "Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)");
 #endif
-    strUsage += HelpMessageOpt("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)", DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-spentindex", strprintf("Maintain an index of the inputs spending each output, used by the getspentinfo rpc call. The index is built in the background (default: %u)", DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call. The index is built in the background and can be enabled without a reindex, masternodes must start with -reindex to have it in sync (default: %u)", DEFAULT_TXINDEX));
     strUsage += HelpMessageOpt("-forcestart", "Attempt to force blockchain corruption recovery on startup");
 
     strUsage += HelpMessageGroup("Connection options:");
@@ -447,6 +506,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)", "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", "Only connect to nodes in network <net> (ipv4, ipv6 or onion)");
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf("Relay non-P2SH multisig (default: %u)", DEFAULT_PERMIT_BAREMULTISIG));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf("Serve compact block filters to peers per BIP 157 (default: %u)", DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf("Support filtering of blocks and transaction with bloom filters (default: %u)", DEFAULT_PEERBLOOMFILTERS));
     strUsage += HelpMessageOpt("-port=<port>", strprintf("Listen for connections on <port> (default: %u or testnet: %u)", defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", "Connect through SOCKS5 proxy");
@@ -497,6 +557,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-sporkkey=<privkey>", "Enable spork administration functionality with the appropriate private key.");
         strUsage += HelpMessageOpt("-nuparams=upgradeName:activationHeight", "Use given activation height for specified network upgrade (regtest-only)");
+        strUsage += HelpMessageOpt("-assumeutxo=height:contentHash", "Allow loading the UTXO snapshot of the block at the given height, with the given content hash (see dumptxoutset) (regtest-only)");
     }
     strUsage += HelpMessageOpt("-debug=<category>", strprintf("Output debugging information (default: %u, supplying <category> is optional)", 0) + ". " +
         "If <category> is not supplied, output all debugging information. <category> can be: " + ListLogCategories() + ".");
@@ -511,6 +572,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug) {
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsaplingproofcachesize=<n>", strprintf("Limit size of Sapling proofs cache to <n> MiB (default: %u)", DEFAULT_MAX_SAPLING_PROOF_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf("Fees (in %s/Kb) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)", CURRENCY_UNIT, FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -616,6 +678,46 @@ static void BlockNotifyGenesisWait(bool, const CBlockIndex *pBlockIndex)
 ////////////////////////////////////////////////////
 
 
+/** If we're using -prune with -reindex, then delete block files that will be ignored by the
+ * reindex.  Since reindexing works by starting at block file 0 and looping until a blockfile
+ * is missing, do the same here to delete any later block files after a gap.  Also delete all
+ * rev files since they'll be rewritten by the reindex anyway.  This ensures that vinfoBlockFile
+ * is in sync with what's actually on disk by the time we start downloading, so that pruning
+ * works correctly.
+ */
+static void CleanupBlockRevFiles()
+{
+    std::map<std::string, fs::path> mapBlockFiles;
+
+    // Glob all blk?????.dat and rev?????.dat files from the blocks directory.
+    // Remove the rev files immediately and insert the blk file paths into an
+    // ordered map keyed by block file index.
+    LogPrintf("Removing unusable blk?????.dat and rev?????.dat files for -reindex with -prune\n");
+    const fs::path& blocksdir = GetBlocksDir();
+    for (fs::directory_iterator it(blocksdir); it != fs::directory_iterator(); it++) {
+        const std::string strFilename = it->path().filename().string();
+        if (fs::is_regular_file(*it) && strFilename.length() == 12 && strFilename.substr(8, 4) == ".dat") {
+            if (strFilename.substr(0, 3) == "blk")
+                mapBlockFiles[strFilename.substr(3, 5)] = it->path();
+            else if (strFilename.substr(0, 3) == "rev")
+                fs::remove(it->path());
+        }
+    }
+
+    // Remove all block files that aren't part of a contiguous set starting at
+    // zero by walking the ordered map (keys are block file indices) by
+    // keeping a separate counter.  Once we hit a gap (or if 0 doesn't exist)
+    // start removing block files.
+    int nContigCounter = 0;
+    for (const std::pair<const std::string, fs::path>& item : mapBlockFiles) {
+        if (atoi(item.first) == nContigCounter) {
+            nContigCounter++;
+            continue;
+        }
+        fs::remove(item.second);
+    }
+}
+
 struct CImportingNow {
     CImportingNow()
     {
@@ -705,6 +807,19 @@ void ThreadImport(const std::vector<fs::path>& vImportFiles)
     ::mempool.SetIsLoaded(!ShutdownRequested());
 }
 
+static void ThreadVerifyChain(int nCheckLevel, int nHeightStart, int nHeightEnd)
+{
+    util::ThreadRename("pivx-verifydb");
+    ScheduleBatchPriority();
+
+    if (!VerifyChainData(nCheckLevel, nHeightStart, nHeightEnd)) {
+        uiInterface.ThreadSafeMessageBox(
+            _("Corrupted block database detected") + ".\n\n" + _("Please restart with -reindex to rebuild the block database."),
+            "", CClientUIInterface::MSG_ERROR);
+        StartShutdown();
+    }
+}
+
 /** Sanity checks
  *  Ensure that PIVX is running in a usable environment with all
  *  necessary library support.
@@ -898,6 +1013,12 @@ void InitParameterInteraction()
         if (gArgs.SoftSetBoolArg("-discover", false))
             LogPrintf("%s : parameter interaction: -externalip set -> setting -discover=0\n", __func__);
     }
+
+    if (gArgs.GetArg("-prune", 0) > 0) {
+        // the transaction index needs all the block files
+        if (gArgs.SoftSetBoolArg("-txindex", false))
+            LogPrintf("%s : parameter interaction: -prune set -> setting -txindex=0\n", __func__);
+    }
 }
 
 bool InitNUParams()
@@ -935,6 +1056,28 @@ bool InitNUParams()
     return true;
 }
 
+static bool InitAssumeutxoParams()
+{
+    if (gArgs.IsArgSet("-assumeutxo")) {
+        // Allow committing UTXO snapshots for testing
+        if (Params().NetworkIDString() != "regtest") {
+            return UIError(_("UTXO snapshots may only be committed with -assumeutxo on regtest."));
+        }
+        for (const std::string& strSnapshot : gArgs.GetArgs("-assumeutxo")) {
+            std::vector<std::string> vSnapshotParams;
+            boost::split(vSnapshotParams, strSnapshot, boost::is_any_of(":"));
+            int nHeight;
+            if (vSnapshotParams.size() != 2 || !ParseInt32(vSnapshotParams[0], &nHeight) || nHeight <= 0 ||
+                    !IsHex(vSnapshotParams[1]) || vSnapshotParams[1].size() != 64) {
+                return UIError(strprintf(_("UTXO snapshot parameters malformed, expecting %s"), "height:contentHash"));
+            }
+            UpdateAssumeutxoParameters(nHeight, uint256S(vSnapshotParams[1]));
+            LogPrintf("Committing the UTXO snapshot of height=%d with content hash %s\n", nHeight, vSnapshotParams[1]);
+        }
+    }
+    return true;
+}
+
 static std::string ResolveErrMsg(const char * const optname, const std::string& strBind)
 {
     return strprintf(_("Cannot resolve -%s address: '%s'"), optname, strBind);
@@ -1047,6 +1190,7 @@ bool AppInitParameterInteraction()
         mempool.setSanityCheck(1.0 / ratio);
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
+    fIncrementalFlush = gArgs.GetBoolArg("-incrementalflush", DEFAULT_INCREMENTAL_FLUSH);
     Checkpoints::fEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
 
     // -mempoollimit limits
@@ -1065,6 +1209,12 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // -importthreads=0 means autodetect, leaving one core to the thread connecting the blocks
+    nImportThreads = gArgs.GetArg("-importthreads", DEFAULT_IMPORT_THREADS);
+    if (nImportThreads <= 0)
+        nImportThreads += GetNumCores() - 1;
+    nImportThreads = std::max(1, std::min(nImportThreads, MAX_IMPORT_THREADS));
+
     setvbuf(stdout, NULL, _IOLBF, 0); /// ***TODO*** do we still need this after -printtoconsole is gone?
 
 #ifndef ENABLE_WALLET
@@ -1121,11 +1271,72 @@ bool AppInitParameterInteraction()
     if (gArgs.GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    // parse and validate enabled filter types
+    std::string blockfilterindex_value = gArgs.GetArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
+    if (blockfilterindex_value == "" || blockfilterindex_value == "1") {
+        g_enabled_filter_types = AllBlockFilterTypes();
+    } else if (blockfilterindex_value != "0") {
+        const std::vector<std::string> names = gArgs.GetArgs("-blockfilterindex");
+        for (const auto& name : names) {
+            BlockFilterType filter_type;
+            if (!BlockFilterTypeByName(name, filter_type)) {
+                return UIError(strprintf(_("Unknown -blockfilterindex value %s."), name));
+            }
+            g_enabled_filter_types.insert(filter_type);
+        }
+    }
+
+    // Signal NODE_COMPACT_FILTERS if peerblockfilters and basic filters index are both enabled.
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (g_enabled_filter_types.count(BlockFilterType::BASIC_FILTER) != 1) {
+            return UIError(_("Cannot set -peerblockfilters without -blockfilterindex."));
+        }
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     nMaxTipAge = gArgs.GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
+    hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", Params().GetConsensus().defaultAssumeValid.GetHex()));
+    if (!hashAssumeValid.IsNull())
+        LogPrintf("Assuming ancestors of block %s have valid signatures.\n", hashAssumeValid.GetHex());
+    else
+        LogPrintf("Validating signatures for all blocks.\n");
+
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nSignedPruneTarget = gArgs.GetArg("-prune", 0) * 1024 * 1024;
+    if (nSignedPruneTarget < 0) {
+        return UIError(_("Prune cannot be configured with a negative value."));
+    }
+    nPruneTarget = (uint64_t) nSignedPruneTarget;
+    if (nPruneTarget) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES) {
+            return UIError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        }
+        if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+            return UIError(_("Prune mode is incompatible with -txindex."));
+        }
+        if (!g_enabled_filter_types.empty()) {
+            return UIError(_("Prune mode is incompatible with -blockfilterindex."));
+        }
+        if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+            return UIError(_("Prune mode is incompatible with -addressindex."));
+        }
+        if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+            return UIError(_("Prune mode is incompatible with -spentindex."));
+        }
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+            return UIError(_("Prune mode is incompatible with -coinstatsindex."));
+        }
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+    }
+
     if (!InitNUParams())
         return false;
 
+    if (!InitAssumeutxoParams())
+        return false;
+
     return true;
 }
 
@@ -1146,6 +1357,9 @@ bool AppInitSanityChecks()
 {
     // ********************************************************* Step 4: sanity checks
 
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+
     // Initialize elliptic curve code
     RandomInit();
     ECC_Start();
@@ -1203,11 +1417,16 @@ bool AppInitMain()
     }
 
     InitSignatureCache();
+    InitSaplingProofCache();
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script and Sapling proofs verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadSaplingCheck);
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+            threadGroup.create_thread(&ThreadZerocoinCheck);
+        }
     }
 
     if (gArgs.IsArgSet("-sporkkey")) // spork priv key
@@ -1429,15 +1648,45 @@ bool AppInitMain()
     int64_t nTotalCache = (gArgs.GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greater than nMaxDbcache
-    int64_t nBlockTreeDBCache = nTotalCache / 8;
-    nBlockTreeDBCache = std::min(nBlockTreeDBCache, (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
+    int64_t nBlockTreeDBCache = std::min(nTotalCache / 8, nMaxBlockDBCache << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nTxIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxTxIndexCache << 20 : 0);
+    nTotalCache -= nTxIndexCache;
+    int64_t nAddressIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) ? nMaxAddressIndexCache << 20 : 0);
+    nTotalCache -= nAddressIndexCache;
+    int64_t nSpentIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) ? nMaxSpentIndexCache << 20 : 0);
+    nTotalCache -= nSpentIndexCache;
+    int64_t nCoinStatsIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX) ? nMaxCoinStatsIndexCache << 20 : 0);
+    nTotalCache -= nCoinStatsIndexCache;
+    int64_t filter_index_cache = 0;
+    if (!g_enabled_filter_types.empty()) {
+        size_t n_indexes = g_enabled_filter_types.size();
+        int64_t max_cache = std::min(nTotalCache / 8, max_filter_index_cache << 20);
+        filter_index_cache = max_cache / n_indexes;
+        nTotalCache -= filter_index_cache * n_indexes;
+    }
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        LogPrintf("* Using %.1fMiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        LogPrintf("* Using %.1fMiB for address index database\n", nAddressIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+        LogPrintf("* Using %.1fMiB for spent index database\n", nSpentIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        LogPrintf("* Using %.1fMiB for coin stats index database\n", nCoinStatsIndexCache * (1.0 / 1024 / 1024));
+    }
+    for (BlockFilterType filter_type : g_enabled_filter_types) {
+        LogPrintf("* Using %.1fMiB for %s block filter index database\n",
+                  filter_index_cache * (1.0 / 1024 / 1024), BlockFilterTypeName(filter_type));
+    }
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
@@ -1445,9 +1694,13 @@ bool AppInitMain()
     const Consensus::Params& consensus = chainparams.GetConsensus();
 
     bool fLoaded = false;
+    // Heights of the -checkblocks blocks left to verify once the node is started
+    int nAsyncCheckStart = 0;
+    int nAsyncCheckEnd = -1;
     while (!fLoaded && !ShutdownRequested()) {
         bool fReset = fReindex;
         std::string strLoadError;
+        nAsyncCheckEnd = -1;
 
         LOCK(cs_main);
 
@@ -1470,6 +1723,9 @@ bool AppInitMain()
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
+                    //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
+                    if (fPruneMode)
+                        CleanupBlockRevFiles();
                 }
 
                 // End loop if shutdown was requested
@@ -1479,8 +1735,7 @@ bool AppInitMain()
                 uiInterface.InitMessage(_("Loading sporks..."));
                 sporkManager.LoadSporksFromDB();
 
-                // LoadBlockIndex will load fTxIndex from the db, or set it if
-                // we're reindexing. It will also load fHavePruned if we've
+                // LoadBlockIndex will load fHavePruned if we've
                 // ever removed a block file from disk.
                 // Note that it also sets fReindex based on the disk flag!
                 // From here on out fReindex and fReset mean something different!
@@ -1499,9 +1754,22 @@ bool AppInitMain()
                     return UIError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
                 }
 
-                // Check for changed -txindex state
-                if (fTxIndex != gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = strprintf(_("You need to rebuild the database using %s to change %s"), "-reindex-chainstate", "-txindex");
+                // The transaction index lives in its own database now. Entries left in the block
+                // tree database by older versions can only be migrated while they are kept in sync
+                // with the chain, so erase them as soon as we run without -txindex.
+                if (!gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+                    uiInterface.InitMessage(_("Erasing the legacy transaction index..."));
+                    if (!TxIndex::EraseLegacyData(*pblocktree)) {
+                        if (ShutdownRequested()) break;
+                        strLoadError = _("Error erasing the legacy transaction index");
+                        break;
+                    }
+                }
+
+                // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
+                // in the past, but is now trying to run unpruned.
+                if (fHavePruned && !fPruneMode) {
+                    strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
                     break;
                 }
 
@@ -1536,6 +1804,7 @@ bool AppInitMain()
 
                 // The on-disk coinsdb is now in a good state, create the cache
                 pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
+                pcoinsTip->SetTrackDirty(fIncrementalFlush);
 
                 InitTierTwoPostCoinsCacheLoad();
 
@@ -1583,8 +1852,24 @@ bool AppInitMain()
                         break;
                     }
 
-                    if (!CVerifyDB().VerifyDB(pcoinsdbview.get(), gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL),
-                            gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
+                    if (fHavePruned && gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS) > MIN_BLOCKS_TO_KEEP) {
+                        LogPrintf("Prune: pruned datadir may not have more than %d blocks; only checking available blocks\n",
+                                MIN_BLOCKS_TO_KEEP);
+                    }
+
+                    // With -asyncverify, only the last blocks are verified at startup
+                    // (including the coins database checks), and the block and undo data
+                    // of the deeper blocks requested by -checkblocks in the background.
+                    const int nCheckLevel = gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL);
+                    int nCheckDepth = gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS);
+                    if (gArgs.GetBoolArg("-asyncverify", DEFAULT_ASYNC_VERIFYDB) &&
+                            (nCheckDepth <= 0 || nCheckDepth > ASYNC_VERIFYDB_STARTUP_BLOCKS) &&
+                            chainActive.Height() > ASYNC_VERIFYDB_STARTUP_BLOCKS) {
+                        nAsyncCheckStart = nCheckDepth <= 0 ? 1 : chainActive.Height() - nCheckDepth;
+                        nAsyncCheckEnd = chainActive.Height() - ASYNC_VERIFYDB_STARTUP_BLOCKS - 1;
+                        nCheckDepth = ASYNC_VERIFYDB_STARTUP_BLOCKS;
+                    }
+                    if (!CVerifyDB().VerifyDB(pcoinsdbview.get(), nCheckLevel, nCheckDepth)) {
                         strLoadError = _("Corrupted block database detected");
                         break;
                     }
@@ -1633,6 +1918,32 @@ bool AppInitMain()
         mempool.ReadFeeEstimates(est_filein);
     fFeeEstimatesInitialized = true;
 
+    // ********************************************************* Step 7b: start indexers
+    if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        g_txindex = std::make_unique<TxIndex>(nTxIndexCache, false, fReindex);
+        g_txindex->Start();
+    }
+
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        g_addressindex = std::make_unique<AddressIndex>(nAddressIndexCache, false, fReindex);
+        g_addressindex->Start();
+    }
+
+    if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+        g_spentindex = std::make_unique<SpentIndex>(nSpentIndexCache, false, fReindex);
+        g_spentindex->Start();
+    }
+
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        g_coinstatsindex = std::make_unique<CoinStatsIndex>(nCoinStatsIndexCache, false, fReindex);
+        g_coinstatsindex->Start();
+    }
+
+    for (const auto& filter_type : g_enabled_filter_types) {
+        InitBlockFilterIndex(filter_type, filter_index_cache, false, fReindex);
+        GetBlockFilterIndex(filter_type)->Start();
+    }
+
 // ********************************************************* Step 8: Backup and Load wallet
 #ifdef ENABLE_WALLET
     if (!InitLoadWallet())
@@ -1640,6 +1951,18 @@ bool AppInitMain()
 #else
     LogPrintf("No wallet compiled in!\n");
 #endif
+
+    // if pruning, unset the service bit and perform the initial blockstore prune
+    // after any wallet rescanning has taken place.
+    if (fPruneMode) {
+        LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+        if (!fReindex) {
+            uiInterface.InitMessage(_("Pruning blockstore..."));
+            PruneAndFlush();
+        }
+    }
+
     // ********************************************************* Step 9: import blocks
 
     if (!CheckDiskSpace(GetDataDir())) {
@@ -1844,6 +2167,11 @@ bool AppInitMain()
 
     // ********************************************************* Step 12: finished
 
+    if (nAsyncCheckEnd >= nAsyncCheckStart) {
+        threadGroup.create_thread(std::bind(&ThreadVerifyChain, gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL),
+                                            nAsyncCheckStart, nAsyncCheckEnd));
+    }
+
     SetRPCWarmupFinished();
     uiInterface.InitMessage(_("Done loading"));
 
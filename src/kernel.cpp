@@ -88,7 +88,7 @@ bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
  */
 
 // helper function for CheckProofOfStake and GetStakeKernelHash
-static bool LoadStakeInput(const CBlock& block, std::unique_ptr<CStakeInput>& stake, int nHeight)
+static bool LoadStakeInput(const CBlock& block, std::unique_ptr<CStakeInput>& stake, const CBlockIndex* pindexPrev)
 {
     // Check that this is a PoS block
     if (!block.IsProofOfStake())
@@ -97,8 +97,8 @@ static bool LoadStakeInput(const CBlock& block, std::unique_ptr<CStakeInput>& st
     // Construct the stakeinput object
     const CTxIn& txin = block.vtx[1]->vin[0];
     stake = txin.IsZerocoinSpend() ?
-            std::unique_ptr<CStakeInput>(CLegacyZPivStake::NewZPivStake(txin, nHeight)) :
-            std::unique_ptr<CStakeInput>(CPivStake::NewPivStake(txin, nHeight, block.nTime));
+            std::unique_ptr<CStakeInput>(CLegacyZPivStake::NewZPivStake(txin, pindexPrev->nHeight + 1)) :
+            std::unique_ptr<CStakeInput>(CPivStake::NewPivStake(txin, pindexPrev, block.nTime));
 
     return stake != nullptr;
 }
@@ -138,10 +138,9 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
  */
 bool CheckProofOfStake(const CBlock& block, std::string& strError, const CBlockIndex* pindexPrev)
 {
-    const int nHeight = pindexPrev->nHeight + 1;
     // Initialize stake input
     std::unique_ptr<CStakeInput> stakeInput;
-    if (!LoadStakeInput(block, stakeInput, nHeight)) {
+    if (!LoadStakeInput(block, stakeInput, pindexPrev)) {
         strError = "stake input initialization failed";
         return false;
     }
@@ -189,7 +188,7 @@ bool GetStakeKernelHash(uint256& hashRet, const CBlock& block, const CBlockIndex
 {
     // Initialize stake input
     std::unique_ptr<CStakeInput> stakeInput;
-    if (!LoadStakeInput(block, stakeInput, pindexPrev->nHeight + 1))
+    if (!LoadStakeInput(block, stakeInput, pindexPrev))
         return error("%s : stake input initialization failed", __func__);
 
     CStakeKernel stakeKernel(pindexPrev, stakeInput.get(), block.nBits, block.nTime);
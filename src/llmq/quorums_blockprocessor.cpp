@@ -13,6 +13,7 @@
 #include "evo/evodb.h"
 #include "evo/specialtx_validation.h"
 #include "net.h"
+#include "net_processing.h"
 #include "primitives/block.h"
 #include "spork.h"
 #include "validation.h"
@@ -52,7 +53,7 @@ void CQuorumBlockProcessor::ProcessMessage(CNode* pfrom, CDataStream& vRecv, int
     uint256 qfc_hash{::SerializeHash(qc)};
     {
         LOCK(cs_main);
-        g_connman->RemoveAskFor(qfc_hash, MSG_QUORUM_FINAL_COMMITMENT);
+        RemoveAskFor(qfc_hash);
     }
 
     if (qc.IsNull()) {
@@ -10,6 +10,7 @@
 #include "fs.h"
 #include "budget/budgetmanager.h"
 #include "masternodeman.h"
+#include "net_processing.h"
 #include "netmessagemaker.h"
 #include "tiertwo/netfulfilledman.h"
 #include "spork.h"
@@ -430,7 +431,7 @@ bool CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
         {
             // Clear inv request
             LOCK(cs_main);
-            g_connman->RemoveAskFor(winner.GetHash(), MSG_MASTERNODE_WINNER);
+            RemoveAskFor(winner.GetHash());
         }
 
         ProcessMNWinner(winner, pfrom, state);
@@ -79,7 +79,9 @@ private:
 
     // Tier two sync node state
     // map of nodeID --> TierTwoPeerData
-    std::map<NodeId, TierTwoPeerData> peersSyncState;
+    // (updated by the tier two message workers and by the sync thread)
+    RecursiveMutex cs_peers_sync_state;
+    std::map<NodeId, TierTwoPeerData> peersSyncState GUARDED_BY(cs_peers_sync_state);
     static int GetNextAsset(int currentAsset);
 
     void SyncRegtest(CNode* pnode);
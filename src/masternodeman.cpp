@@ -12,6 +12,7 @@
 #include "masternode-sync.h"
 #include "masternode.h"
 #include "messagesigner.h"
+#include "net_processing.h"
 #include "netbase.h"
 #include "netmessagemaker.h"
 #include "shutdown.h"
@@ -787,7 +788,7 @@ bool CMasternodeMan::CheckInputs(CMasternodeBroadcast& mnb, int nChainHeight, in
     if (collateralUtxoDepth < consensus.MasternodeCollateralMinConf()) {
         LogPrint(BCLog::MASTERNODE,"mnb - Input must have at least %d confirmations\n", consensus.MasternodeCollateralMinConf());
         // maybe we miss few blocks, let this mnb to be checked again later
-        mapSeenMasternodeBroadcast.erase(mnb.GetHash());
+        WITH_LOCK(cs, mapSeenMasternodeBroadcast.erase(mnb.GetHash()));
         g_tiertwo_sync_state.EraseSeenMNB(mnb.GetHash());
         return false;
     }
@@ -808,7 +809,7 @@ bool CMasternodeMan::CheckInputs(CMasternodeBroadcast& mnb, int nChainHeight, in
 int CMasternodeMan::ProcessMNBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb)
 {
     const uint256& mnbHash = mnb.GetHash();
-    if (mapSeenMasternodeBroadcast.count(mnbHash)) { //seen
+    if (HasSeenMNB(mnbHash)) { //seen
         g_tiertwo_sync_state.AddedMasternodeList(mnbHash);
         return 0;
     }
@@ -825,7 +826,10 @@ int CMasternodeMan::ProcessMNBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb)
     }
 
     // now that did the mnb checks, can add it.
-    mapSeenMasternodeBroadcast.emplace(mnbHash, mnb);
+    {
+        LOCK(cs);
+        mapSeenMasternodeBroadcast.emplace(mnbHash, mnb);
+    }
 
     // All checks performed, add it
     LogPrint(BCLog::MASTERNODE,"%s - Got NEW Masternode entry - %s - %lli \n", __func__,
@@ -892,6 +896,7 @@ void CMasternodeMan::BroadcastInvMN(CMasternode* mn, CNode* pfrom)
     pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
 
     // Add to mapSeenMasternodeBroadcast in case that isn't there for some reason.
+    LOCK(cs);
     if (!mapSeenMasternodeBroadcast.count(hash)) mapSeenMasternodeBroadcast.emplace(hash, mnb);
 }
 
@@ -911,6 +916,7 @@ int CMasternodeMan::ProcessGetMNList(CNode* pfrom, CTxIn& vin)
     // Check if the node asked for mn list sync before.
     bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
     if (!isLocal) {
+        LOCK(cs);
         auto itAskedUsMNList = mAskedUsForMasternodeList.find(pfrom->addr);
         if (itAskedUsMNList != mAskedUsForMasternodeList.end()) {
             int64_t t = (*itAskedUsMNList).second;
@@ -968,7 +974,7 @@ int CMasternodeMan::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         {
             // Clear inv request
             LOCK(cs_main);
-            g_connman->RemoveAskFor(mnb.GetHash(), MSG_MASTERNODE_ANNOUNCE);
+            RemoveAskFor(mnb.GetHash());
         }
         return ProcessMNBroadcast(pfrom, mnb);
 
@@ -979,7 +985,7 @@ int CMasternodeMan::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         {
             // Clear inv request
             LOCK(cs_main);
-            g_connman->RemoveAskFor(mnb.GetHash(), MSG_MASTERNODE_ANNOUNCE);
+            RemoveAskFor(mnb.GetHash());
         }
 
         // For now, let's not process mnb2 with pre-BIP155 node addr format.
@@ -998,7 +1004,7 @@ int CMasternodeMan::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         {
             // Clear inv request
             LOCK(cs_main);
-            g_connman->RemoveAskFor(mnp.GetHash(), MSG_MASTERNODE_PING);
+            RemoveAskFor(mnp.GetHash());
         }
         return ProcessMNPing(pfrom, mnp);
 
@@ -1029,7 +1035,10 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast& mnb)
     }
 
     mapSeenMasternodePing.emplace(mnb.lastPing.GetHash(), mnb.lastPing);
-    mapSeenMasternodeBroadcast.emplace(mnb.GetHash(), mnb);
+    {
+        LOCK(cs);
+        mapSeenMasternodeBroadcast.emplace(mnb.GetHash(), mnb);
+    }
     g_tiertwo_sync_state.AddedMasternodeList(mnb.GetHash());
 
     LogPrint(BCLog::MASTERNODE,"%s -- masternode=%s\n", __func__, mnb.vin.prevout.ToString());
@@ -1043,6 +1052,46 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast& mnb)
     }
 }
 
+bool CMasternodeMan::HasSeenMNB(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapSeenMasternodeBroadcast.count(hash);
+}
+
+bool CMasternodeMan::GetSeenMNB(const uint256& hash, CMasternodeBroadcast& mnbRet) const
+{
+    LOCK(cs);
+    auto it = mapSeenMasternodeBroadcast.find(hash);
+    if (it == mapSeenMasternodeBroadcast.end()) {
+        return false;
+    }
+    mnbRet = it->second;
+    return true;
+}
+
+void CMasternodeMan::UpdateSeenMNBPing(const uint256& hash, const CMasternodePing& mnp)
+{
+    // SetLastPing locks the masternode cs (always locked after this one).
+    LOCK(cs);
+    auto it = mapSeenMasternodeBroadcast.find(hash);
+    if (it != mapSeenMasternodeBroadcast.end()) {
+        it->second.SetLastPing(mnp);
+    }
+}
+
+void CMasternodeMan::RemoveInvalidSeenMNB()
+{
+    LOCK(cs);
+    auto it = mapSeenMasternodeBroadcast.begin();
+    while (it != mapSeenMasternodeBroadcast.end()) {
+        if (!it->second.addr.IsValid()) {
+            it = mapSeenMasternodeBroadcast.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
 int64_t CMasternodeMan::SecondsSincePayment(const MasternodeRef& mn, int count_enabled, const CBlockIndex* BlockReading) const
 {
     int64_t sec = (GetAdjustedTime() - GetLastPaid(mn, count_enabled, BlockReading));
@@ -1093,6 +1142,7 @@ int64_t CMasternodeMan::GetLastPaid(const MasternodeRef& mn, int count_enabled,
 
 std::string CMasternodeMan::ToString() const
 {
+    LOCK(cs);
     std::ostringstream info;
     info << "Masternodes: " << (int)mapMasternodes.size()
          << ", peers who asked us for Masternode list: " << (int)mAskedUsForMasternodeList.size()
@@ -1168,14 +1218,7 @@ void ThreadCheckMasternodes()
 
         // Startup-only, clean any stored seen MN broadcast with an invalid service that
         // could have been invalidly stored on a previous release
-        auto itSeenMNB = mnodeman.mapSeenMasternodeBroadcast.begin();
-        while (itSeenMNB != mnodeman.mapSeenMasternodeBroadcast.end()) {
-            if (!itSeenMNB->second.addr.IsValid()) {
-                itSeenMNB = mnodeman.mapSeenMasternodeBroadcast.erase(itSeenMNB);
-            } else {
-                itSeenMNB++;
-            }
-        }
+        mnodeman.RemoveInvalidSeenMNB();
 
         while (true) {
 
@@ -65,7 +65,7 @@ private:
     // map to hold all MNs (indexed by collateral outpoint)
     std::map<COutPoint, MasternodeRef> mapMasternodes;
     // who's asked for the Masternode list and the last time
-    std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
+    std::map<CNetAddr, int64_t> mAskedUsForMasternodeList GUARDED_BY(cs);
     // who we asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mWeAskedForMasternodeList;
     // which Masternodes we've asked for
@@ -88,9 +88,11 @@ private:
     // Validation
     bool CheckInputs(CMasternodeBroadcast& mnb, int nChainHeight, int& nDoS);
 
+    // Keep track of all broadcasts I've seen. The tier two messages are processed by several
+    // threads, and the seen broadcasts are also read by the message handler thread (inv, getdata).
+    std::map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast GUARDED_BY(cs);
+
 public:
-    // Keep track of all broadcasts I've seen
-    std::map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
     // Keep track of all pings I've seen
     std::map<uint256, CMasternodePing> mapSeenMasternodePing;
 
@@ -182,6 +184,13 @@ public:
     /// Update masternode list and maps using provided CMasternodeBroadcast
     void UpdateMasternodeList(CMasternodeBroadcast& mnb);
 
+    /// Seen broadcasts management
+    bool HasSeenMNB(const uint256& hash) const;
+    bool GetSeenMNB(const uint256& hash, CMasternodeBroadcast& mnbRet) const;
+    void UpdateSeenMNBPing(const uint256& hash, const CMasternodePing& mnp);
+    /// Remove the seen broadcasts with an invalid service, that a previous release could have stored
+    void RemoveInvalidSeenMNB();
+
     /// Get the time a masternode was last paid
     int64_t GetLastPaid(const MasternodeRef& mn, int count_enabled, const CBlockIndex* BlockReading) const;
     int64_t SecondsSincePayment(const MasternodeRef& mn, int count_enabled, const CBlockIndex* BlockReading) const;
@@ -7,6 +7,7 @@
 
 #include "indirectmap.h"
 #include "prevector.h"
+#include "support/allocators/pool.h"
 
 #include <stdlib.h>
 
@@ -221,6 +222,20 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template <class Key, class T, class Hash, class Pred, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const std::unordered_map<Key, T, Hash, Pred, PoolAllocator<std::pair<const Key, T>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>>& m)
+{
+    // The nodes are allocated from the chunks of the pool resource (which
+    // are accounted as a whole, free blocks included), the buckets array
+    // outside of it. The chunks are stored in a std::list, with nodes of 3
+    // pointers: next, previous, and the chunk itself.
+    const auto* pool_resource = m.get_allocator().resource();
+    const size_t estimated_list_node_size = MallocUsage(sizeof(void*) * 3);
+    const size_t usage_resource = estimated_list_node_size * pool_resource->NumAllocatedChunks();
+    const size_t usage_chunks = MallocUsage(pool_resource->ChunkSizeBytes()) * pool_resource->NumAllocatedChunks();
+    return usage_resource + usage_chunks + MallocUsage(sizeof(void*) * m.bucket_count());
+}
+
 // Dispatch to class method as fallback
 
 template<typename X>
@@ -29,6 +29,7 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #if HAVE_DECL_GETIFADDRS && HAVE_DECL_FREEIFADDRS
@@ -39,6 +40,10 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #include <cstdint>
 #include <unordered_map>
 
@@ -77,6 +82,14 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+// Max size of the data buffer of a received message allocated ahead of its reception
+static const unsigned int RECV_ALLOCATE_AHEAD_SIZE = 256 * 1024;
+
+#ifdef USE_EPOLL
+// Max number of socket events handled by each SocketHandler pass
+static const int MAX_EPOLL_EVENTS = 256;
+#endif
+
 const static std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 constexpr const CConnman::CFullyConnectedOnly CConnman::FullyConnectedOnly;
@@ -94,8 +107,6 @@ std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 static bool vfLimited[NET_MAX] = {};
 std::string strSubVersion;
 
-limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
-
 void CConnman::AddOneShot(const std::string& strDest)
 {
     LOCK(cs_vOneShots);
@@ -802,19 +813,19 @@ int CNode::GetSendVersion() const
 int CNetMessage::readHeader(const char* pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
-    unsigned int nRemaining = 24 - nHdrPos;
+    unsigned int nRemaining = CMessageHeader::HEADER_SIZE - nHdrPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
     memcpy(&hdrbuf[nHdrPos], pch, nCopy);
     nHdrPos += nCopy;
 
     // if header incomplete, exit
-    if (nHdrPos < 24)
+    if (nHdrPos < CMessageHeader::HEADER_SIZE)
         return nCopy;
 
     // deserialize to CMessageHeader
     try {
-        hdrbuf >> hdr;
+        SpanReader(vRecv.GetType(), vRecv.GetVersion(), hdrbuf) >> hdr;
     } catch (const std::exception&) {
         return -1;
     }
@@ -826,6 +837,12 @@ int CNetMessage::readHeader(const char* pch, unsigned int nBytes)
     // switch state to reading message data
     in_data = true;
 
+    // Take a buffer from the cache: one fitting the whole message if there is one, otherwise
+    // one for the data allocated ahead of its reception (see readData).
+    if (hdr.nMessageSize > 0) {
+        CNetMessageBufferPool::Instance().Get(vRecv, hdr.nMessageSize, std::min(hdr.nMessageSize, RECV_ALLOCATE_AHEAD_SIZE));
+    }
+
     return nCopy;
 }
 
@@ -836,7 +853,7 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
 
     if (vRecv.size() < nDataPos + nCopy) {
         // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + RECV_ALLOCATE_AHEAD_SIZE));
     }
 
     hasher.Write((const unsigned char*)pch, nCopy);
@@ -854,40 +871,165 @@ const uint256& CNetMessage::GetMessageHash() const
     return data_hash;
 }
 
+CNetMessageBufferPool::CNetMessageBufferPool()
+{
+    for (auto& v : vCache) {
+        v.reserve(MAX_CACHED_PER_CLASS);
+    }
+}
+
+CNetMessageBufferPool& CNetMessageBufferPool::Instance()
+{
+    // Never destroyed: messages can be released during the static destruction
+    static CNetMessageBufferPool* instance = new CNetMessageBufferPool();
+    return *instance;
+}
+
+int CNetMessageBufferPool::GetClass(size_t nSize)
+{
+    int nBits = MIN_CLASS_BITS;
+    while (nBits <= MAX_CLASS_BITS && ((size_t)1 << nBits) < nSize) {
+        nBits++;
+    }
+    return nBits - MIN_CLASS_BITS;
+}
+
+void CNetMessageBufferPool::Get(CDataStream& stream, size_t nSize, size_t nMinSize)
+{
+    assert(stream.empty() && nMinSize <= nSize);
+    LOCK(cs);
+    for (int nClass = GetClass(nSize); nClass >= GetClass(nMinSize); nClass--) {
+        if (nClass == NUM_CLASSES || vCache[nClass].empty()) continue;
+        std::vector<CDataStream>& v = vCache[nClass];
+        const int nVersion = stream.GetVersion();
+        std::swap(stream, v.back());
+        stream.SetVersion(nVersion);
+        nCachedBytes -= stream.capacity();
+        // The stream buffer, if it had one, takes the place of the cached one
+        if (v.back().capacity() > 0) {
+            nCachedBytes += v.back().capacity();
+        } else {
+            v.pop_back();
+        }
+        nReused++;
+        return;
+    }
+    // Allocate the whole class size, so that the buffer can be reused for any message of the class
+    const int nMinClass = GetClass(nMinSize);
+    if (nMinClass < NUM_CLASSES) {
+        stream.reserve((size_t)1 << (nMinClass + MIN_CLASS_BITS));
+    }
+    nAllocated++;
+}
+
+void CNetMessageBufferPool::Release(CDataStream& stream)
+{
+    const size_t nCapacity = stream.capacity();
+    if (nCapacity < ((size_t)1 << MIN_CLASS_BITS) || nCapacity >= ((size_t)2 << MAX_CLASS_BITS)) {
+        return;
+    }
+    // Largest class whose buffers are not larger than this one
+    int nBits = MIN_CLASS_BITS;
+    while (nBits < MAX_CLASS_BITS && ((size_t)2 << nBits) <= nCapacity) {
+        nBits++;
+    }
+
+    LOCK(cs);
+    std::vector<CDataStream>& v = vCache[nBits - MIN_CLASS_BITS];
+    if (v.size() >= MAX_CACHED_PER_CLASS || nCachedBytes + nCapacity > MAX_CACHED_BYTES) {
+        return;
+    }
+    stream.clear();
+    v.emplace_back(std::move(stream));
+    nCachedBytes += nCapacity;
+}
+
+CNetMessageBufferPool::Stats CNetMessageBufferPool::GetStats() const
+{
+    LOCK(cs);
+    Stats stats{0, nCachedBytes, nReused, nAllocated};
+    for (const auto& v : vCache) {
+        stats.cached += v.size();
+    }
+    return stats;
+}
+
+int SendQueuedData(SOCKET hSocket, const std::deque<std::vector<unsigned char>>& vSendMsg, size_t nSendOffset, size_t& nQueuedRet)
+{
+    assert(!vSendMsg.empty());
+#ifdef WIN32
+    const auto& data = vSendMsg.front();
+    nQueuedRet = data.size() - nSendOffset;
+    return send(hSocket, reinterpret_cast<const char*>(data.data()) + nSendOffset, nQueuedRet, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+    struct iovec iov[MAX_SEND_IOVECS];
+    size_t nIov = 0;
+    nQueuedRet = 0;
+    for (auto it = vSendMsg.begin(); it != vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++it, ++nIov) {
+        const size_t nOffset = nIov == 0 ? nSendOffset : 0;
+        iov[nIov].iov_base = const_cast<unsigned char*>(it->data()) + nOffset;
+        iov[nIov].iov_len = it->size() - nOffset;
+        nQueuedRet += iov[nIov].iov_len;
+    }
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = nIov;
+    return sendmsg(hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+}
+
+size_t PopSentData(std::deque<std::vector<unsigned char>>& vSendMsg, size_t& nSendOffset, size_t nBytes)
+{
+    size_t nPopped = 0;
+    while (nBytes > 0) {
+        assert(!vSendMsg.empty());
+        const auto& data = vSendMsg.front();
+        if (nBytes < data.size() - nSendOffset) {
+            nSendOffset += nBytes;
+            break;
+        }
+        nBytes -= data.size() - nSendOffset;
+        nSendOffset = 0;
+        nPopped += data.size();
+        vSendMsg.pop_front();
+    }
+    return nPopped;
+}
+
 // requires LOCK(cs_vSend)
 size_t CConnman::SocketSendData(CNode* pnode)
 {
-    auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
-    while (it != pnode->vSendMsg.end()) {
-        const auto& data = *it;
-        assert(data.size() > pnode->nSendOffset);
+    while (!pnode->vSendMsg.empty()) {
+        assert(pnode->vSendMsg.front().size() > pnode->nSendOffset);
         int nBytes = 0;
+        size_t nQueued = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = SendQueuedData(pnode->hSocket, pnode->vSendMsg, pnode->nSendOffset, nQueued);
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
-                pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
-                // could not send full message; stop sending more
+            pnode->nSendSize -= PopSentData(pnode->vSendMsg, pnode->nSendOffset, nBytes);
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nQueued) {
+                // could not send all the data; stop sending more
+                pnode->fCanSendData = false;
                 break;
             }
         } else {
             if (nBytes < 0) {
                 // error
                 int nErr = WSAGetLastError();
+                // The socket is full (an interrupted send is retried in the next pass)
+                if (nErr == WSAEWOULDBLOCK) {
+                    pnode->fCanSendData = false;
+                }
                 if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
                     LogPrintf("socket send error %s\n", NetworkErrorString(nErr));
                     pnode->CloseSocketDisconnect();
@@ -898,11 +1040,10 @@ size_t CConnman::SocketSendData(CNode* pnode)
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
     return nSentSize;
 }
 
@@ -1151,6 +1292,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        RegisterSocketEvents(pnode);
     }
 
     // We received a new connection, harvest entropy from the time (and our peer count)
@@ -1178,6 +1320,7 @@ void CConnman::DisconnectNodes()
             if (pnode->fDisconnect) {
                 // remove from vNodes
                 vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                UnregisterSocketEvents(pnode);
 
                 // release outbound grant (if any)
                 pnode->grantOutbound.Release();
@@ -1253,6 +1396,42 @@ void CConnman::InactivityCheck(CNode* pnode)
     }
 }
 
+void CConnman::RegisterSocketEvents(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    AssertLockHeld(cs_vNodes);
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET)
+        return;
+
+    // Edge-triggered: SocketHandler keeps track of the readiness of the socket in the node,
+    // until it would block. The registration is dropped by the kernel when the socket is closed.
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.fd = pnode->hSocket;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("%s: epoll_ctl failed for peer=%d: %s\n", __func__, pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+        return;
+    }
+    mapSocketToNode[pnode->hSocket] = pnode;
+#endif
+}
+
+void CConnman::UnregisterSocketEvents(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    AssertLockHeld(cs_vNodes);
+    // The socket may already be closed (and its descriptor reused), so look the node up
+    for (auto it = mapSocketToNode.begin(); it != mapSocketToNode.end(); ++it) {
+        if (it->second == pnode) {
+            mapSocketToNode.erase(it);
+            return;
+        }
+    }
+#endif
+}
+
 bool CConnman::GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
 {
     for (const ListenSocket& hListenSocket : vhListenSocket) {
@@ -1298,7 +1477,63 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& s
     return !recv_set.empty() || !send_set.empty() || !error_set.empty();
 }
 
-#ifdef USE_POLL
+#ifdef USE_EPOLL
+/**
+ * Peers sockets are registered (edge-triggered) when the node is added, so there is no set to
+ * rebuild at each pass, and only the sockets that became ready are reported. Their readiness is
+ * recorded in the fHasRecvData/fCanSendData node flags, which are cleared when the socket would
+ * block, and SocketHandler services the nodes based on them. Only the listening sockets are
+ * returned in recv_set.
+ */
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    // Don't wait if some sockets have not been drained yet
+    const int timeout = fSocketEventsPending ? 0 : SELECT_TIMEOUT_MILLISECONDS;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, MAX_EPOLL_EVENTS, timeout);
+
+    if (interruptNet) return;
+
+    if (nEvents < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    LOCK(cs_vNodes);
+    for (int i = 0; i < nEvents; i++) {
+        const SOCKET hSocket = events[i].data.fd;
+        auto it = mapSocketToNode.find(hSocket);
+        if (it == mapSocketToNode.end()) {
+            // listening socket
+            if (events[i].events & EPOLLIN) recv_set.insert(hSocket);
+            continue;
+        }
+        CNode* pnode = it->second;
+        // errors and hang-ups are reported by recv
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            pnode->fHasRecvData = true;
+        }
+        if (events[i].events & EPOLLOUT) {
+            // under cs_vSend, not to override the flag reset of a concurrent send
+            LOCK(pnode->cs_vSend);
+            pnode->fCanSendData = true;
+        }
+    }
+}
+
+/** Whether the node socket is ready for the operations that SocketHandler wants to do on it */
+static void GetNodeSocketReadiness(CNode* pnode, bool& recvReady, bool& sendReady)
+{
+    // Same logic of GenerateSelectSet: first drain the send queue, then receive more data.
+    bool fHasSendData = WITH_LOCK(pnode->cs_vSend, return !pnode->vSendMsg.empty(); );
+    sendReady = fHasSendData && pnode->fCanSendData;
+    recvReady = !fHasSendData && !pnode->fPauseRecv && pnode->fHasRecvData;
+}
+#elif defined(USE_POLL)
 void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
@@ -1441,6 +1676,9 @@ void CConnman::SocketHandler()
         for (CNode* pnode : vNodesCopy)
             pnode->AddRef();
     }
+#ifdef USE_EPOLL
+    bool fPending = false;
+#endif
     for (CNode* pnode : vNodesCopy) {
         if (interruptNet)
             return;
@@ -1455,10 +1693,15 @@ void CConnman::SocketHandler()
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
+#ifndef USE_EPOLL
             recvSet = recv_set.count(pnode->hSocket) > 0;
             sendSet = send_set.count(pnode->hSocket) > 0;
             errorSet = error_set.count(pnode->hSocket) > 0;
+#endif
         }
+#ifdef USE_EPOLL
+        GetNodeSocketReadiness(pnode, recvSet, sendSet);
+#endif
         if (recvSet || errorSet) {
             // typical socket buffer is 8K-64K
             char pchBuf[0x10000];
@@ -1469,6 +1712,10 @@ void CConnman::SocketHandler()
                     continue;
                 nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
             }
+            // A short read drained the socket: the next data will be reported by a new event.
+            if (nBytes > 0 && nBytes < (int)sizeof(pchBuf)) {
+                pnode->fHasRecvData = false;
+            }
             if (nBytes > 0) {
                 bool notify = false;
                 if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
@@ -1498,6 +1745,10 @@ void CConnman::SocketHandler()
             } else if (nBytes < 0) {
                 // error
                 int nErr = WSAGetLastError();
+                // Nothing left to read (an interrupted recv is retried in the next pass)
+                if (nErr == WSAEWOULDBLOCK) {
+                    pnode->fHasRecvData = false;
+                }
                 if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
                     if (!pnode->fDisconnect)
                         LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
@@ -1516,6 +1767,12 @@ void CConnman::SocketHandler()
                 RecordBytesSent(nBytes);
         }
 
+#ifdef USE_EPOLL
+        bool recvReady, sendReady;
+        GetNodeSocketReadiness(pnode, recvReady, sendReady);
+        fPending |= recvReady || sendReady;
+#endif
+
         InactivityCheck(pnode);
     }
     {
@@ -1523,6 +1780,9 @@ void CConnman::SocketHandler()
         for (CNode* pnode : vNodesCopy)
             pnode->Release();
     }
+#ifdef USE_EPOLL
+    fSocketEventsPending = fPending;
+#endif
 }
 
 void CConnman::ThreadSocketHandler()
@@ -1939,6 +2199,7 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        RegisterSocketEvents(pnode);
     }
 }
 
@@ -2059,6 +2320,19 @@ bool CConnman::BindListenPort(const CService& addrBind, std::string& strError, b
         return false;
     }
 
+#ifdef USE_EPOLL
+    // Level-triggered: pending connections are accepted one per SocketHandler pass
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = hListenSocket;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hListenSocket, &event) != 0) {
+        strError = strprintf("Error: Listening for incoming connections failed (epoll_ctl returned error %s)", NetworkErrorString(WSAGetLastError()));
+        LogPrintf("%s\n", strError);
+        CloseSocket(hListenSocket);
+        return false;
+    }
+#endif
+
     vhListenSocket.emplace_back(hListenSocket, fWhitelisted);
 
     if (addrBind.IsRoutable() && fDiscover && !fWhitelisted)
@@ -2132,6 +2406,12 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
     flagInterruptMsgProc = false;
+#ifdef USE_EPOLL
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd == -1) {
+        throw std::runtime_error(strprintf("epoll_create1 failed: %s", NetworkErrorString(WSAGetLastError())));
+    }
+#endif
 
     Options connOptions;
     Init(connOptions);
@@ -2388,6 +2668,9 @@ void CConnman::Stop()
     }
     vNodes.clear();
     vNodesDisconnected.clear();
+#ifdef USE_EPOLL
+    WITH_LOCK(cs_vNodes, mapSocketToNode.clear());
+#endif
     vhListenSocket.clear();
     semOutbound.reset();
     semAddnode.reset();
@@ -2408,6 +2691,9 @@ CConnman::~CConnman()
 {
     Interrupt();
     Stop();
+#ifdef USE_EPOLL
+    close(epollfd);
+#endif
 }
 
 void CConnman::SetServices(const CService &addr, ServiceFlags nServices)
@@ -2524,16 +2810,6 @@ void CConnman::RelayInv(CInv& inv)
     }
 }
 
-void CConnman::RemoveAskFor(const uint256& invHash, int invType)
-{
-    mapAlreadyAskedFor.erase(CInv(invType, invHash));
-
-    LOCK(cs_vNodes);
-    for (const auto& pnode : vNodes) {
-        pnode->AskForInvReceived(invHash);
-    }
-}
-
 void CConnman::UpdateQuorumRelayMemberIfNeeded(CNode* pnode)
 {
     if (!pnode->m_masternode_iqr_connection && pnode->m_masternode_connection &&
@@ -2652,52 +2928,6 @@ CNode::~CNode()
     CloseSocket(hSocket);
 }
 
-void CNode::AskFor(const CInv& inv)
-{
-    if (mapAskFor.size() > MAPASKFOR_MAX_SZ || setAskFor.size() > SETASKFOR_MAX_SZ)
-        return;
-    // a peer may not have multiple non-responded queue positions for a single inv item
-    if (!setAskFor.insert(inv.hash).second)
-        return;
-
-    // We're using mapAskFor as a priority queue,
-    // the key is the earliest time the request can be sent
-    int64_t nRequestTime;
-    limitedmap<CInv, int64_t>::const_iterator it = mapAlreadyAskedFor.find(inv);
-    if (it != mapAlreadyAskedFor.end())
-        nRequestTime = it->second;
-    else
-        nRequestTime = 0;
-    LogPrint(BCLog::NET, "askfor %s  %d (%s) peer=%d\n", inv.ToString(), nRequestTime, FormatISO8601Time(nRequestTime / 1000000), id);
-
-    // Make sure not to reuse time indexes to keep things in the same order
-    int64_t nNow = GetTimeMicros() - 1000000;
-    static int64_t nLastTime;
-    ++nLastTime;
-    nNow = std::max(nNow, nLastTime);
-    nLastTime = nNow;
-
-    // Each retry is 2 minutes after the last
-    nRequestTime = std::max(nRequestTime + 2 * 60 * 1000000, nNow);
-    if (it != mapAlreadyAskedFor.end())
-        mapAlreadyAskedFor.update(it, nRequestTime);
-    else
-        mapAlreadyAskedFor.insert(std::make_pair(inv, nRequestTime));
-    mapAskFor.insert(std::make_pair(nRequestTime, inv));
-}
-
-void CNode::AskForInvReceived(const uint256& invHash)
-{
-    setAskFor.erase(invHash);
-    for (auto it = mapAskFor.begin(); it != mapAskFor.end();) {
-        if (it->second.hash == invHash) {
-            it = mapAskFor.erase(it);
-        } else {
-            ++it;
-        }
-    }
-}
-
 bool CConnman::NodeFullyConnected(const CNode* pnode)
 {
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
@@ -14,7 +14,6 @@
 #include "crypto/siphash.h"
 #include "fs.h"
 #include "hash.h"
-#include "limitedmap.h"
 #include "netaddress.h"
 #include "protocol.h"
 #include "random.h"
@@ -28,6 +27,7 @@
 #include <cstdint>
 #include <deque>
 #include <thread>
+#include <unordered_map>
 #include <memory>
 #include <condition_variable>
 
@@ -65,10 +65,6 @@ static const int MAX_ADDNODE_CONNECTIONS = 16;
 static const int INBOUND_EVICTION_PROTECTION_TIME = 1;
 /** -listen default */
 static const bool DEFAULT_LISTEN = true;
-/** The maximum number of entries in mapAskFor */
-static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
-/** The maximum number of entries in setAskFor (larger due to getdata latency)*/
-static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
 /** Disconnected peers are added to setOffsetDisconnectedPeers only if node has less than ENOUGH_CONNECTIONS */
@@ -85,6 +81,11 @@ static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
 
+#ifndef WIN32
+/** Max number of queued buffers sent by a single sendmsg call */
+static const size_t MAX_SEND_IOVECS = 64;
+#endif
+
 typedef int NodeId;
 
 struct AddedNodeInfo
@@ -274,9 +275,6 @@ public:
         post();
     };
 
-    // Clears AskFor requests for every known peer
-    void RemoveAskFor(const uint256& invHash, int invType);
-
     void RelayInv(CInv& inv);
     bool IsNodeConnected(const CAddress& addr);
     // Retrieves a connected peer (if connection success). Used only to check peer address availability for now.
@@ -345,6 +343,9 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake the message handler thread up, when there is new work for it */
+    void WakeMessageHandler();
+
     void SetAsmap(std::vector<bool> asmap) { addrman.m_asmap = std::move(asmap); }
     /** Unique tier two connections manager */
     TierTwoConnMan* GetTierTwoConnMan() { return m_tiertwo_conn_man.get(); };
@@ -371,13 +372,13 @@ private:
     void NotifyNumConnectionsChanged();
     void InactivityCheck(CNode* pnode);
     bool GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+    void RegisterSocketEvents(CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_vNodes);
+    void UnregisterSocketEvents(CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_vNodes);
     void SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
     void SocketHandler();
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
-    void WakeMessageHandler();
-
     uint64_t CalculateKeyedNetGroup(const CAddress& ad);
 
     CNode* FindNode(const CNetAddr& ip);
@@ -438,6 +439,14 @@ private:
     std::vector<CNode*> vNodes;
     std::list<CNode*> vNodesDisconnected;
     mutable RecursiveMutex cs_vNodes;
+#ifdef USE_EPOLL
+    /** Listening and peers sockets are registered once in this epoll instance */
+    int epollfd{-1};
+    /** Peers registered in epollfd, by socket */
+    std::unordered_map<SOCKET, CNode*> mapSocketToNode GUARDED_BY(cs_vNodes);
+    /** Whether some socket is still ready after the last SocketHandler pass (only used by the net thread) */
+    bool fSocketEventsPending{false};
+#endif
     std::atomic<NodeId> nLastNodeId;
     unsigned int nPrevNodeCount;
 
@@ -476,6 +485,8 @@ private:
     std::thread threadMessageHandler;
 
     std::unique_ptr<TierTwoConnMan> m_tiertwo_conn_man;
+
+    friend struct CConnmanTest;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover();
@@ -483,6 +494,20 @@ uint16_t GetListenPort();
 bool BindListenPort(const CService& bindAddr, std::string& strError, bool fWhitelisted = false);
 void CheckOffsetDisconnectedPeers(const CNetAddr& ip);
 
+/**
+ * Send the data queued for a node, starting at nSendOffset inside the first buffer.
+ * Outside Windows, the queued buffers (up to MAX_SEND_IOVECS of them) are gathered in a
+ * single sendmsg call, without copying them. nQueuedRet is set to the number of bytes
+ * that were tried to be sent.
+ */
+int SendQueuedData(SOCKET hSocket, const std::deque<std::vector<unsigned char>>& vSendMsg, size_t nSendOffset, size_t& nQueuedRet);
+/**
+ * Account for nBytes sent starting at nSendOffset inside the first queued buffer: drop the
+ * buffers fully sent, and move nSendOffset inside the partially sent one.
+ * Returns the size of the dropped buffers.
+ */
+size_t PopSentData(std::deque<std::vector<unsigned char>>& vSendMsg, size_t& nSendOffset, size_t nBytes);
+
 struct CombinerAll {
     typedef bool result_type;
 
@@ -534,8 +559,6 @@ bool validateMasternodeIP(const std::string& addrStr);          // valid, reacha
 extern bool fDiscover;
 extern bool fListen;
 
-extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
-
 /** Subversion as sent to the P2P network in `version` messages */
 extern std::string strSubVersion;
 
@@ -585,6 +608,53 @@ public:
 };
 
 
+/**
+ * Cache of the data buffers of the received messages, by size class (the powers of two,
+ * from 256 B to 4 MiB, of their capacity). The buffer of a message is given back when the
+ * message is destroyed, and reused by a later message of the same class, instead of
+ * allocating (and growing) a new one for each message.
+ */
+class CNetMessageBufferPool
+{
+public:
+    struct Stats
+    {
+        size_t cached;        // number of buffers in the cache
+        size_t cached_bytes;  // total capacity of the buffers in the cache
+        uint64_t reused;      // messages that got a buffer from the cache
+        uint64_t allocated;   // messages that didn't
+    };
+
+    static CNetMessageBufferPool& Instance();
+
+    /** Swap an empty stream with a cached buffer of nSize bytes, or at least nMinSize bytes, if there is one */
+    void Get(CDataStream& stream, size_t nSize, size_t nMinSize);
+    /** Move the buffer of the stream to the cache (if there is room), leaving the stream empty */
+    void Release(CDataStream& stream);
+
+    Stats GetStats() const;
+
+private:
+    static constexpr int MIN_CLASS_BITS = 8;
+    static constexpr int MAX_CLASS_BITS = 22;
+    static constexpr int NUM_CLASSES = MAX_CLASS_BITS - MIN_CLASS_BITS + 1;
+    //! Max total capacity of the cached buffers
+    static constexpr size_t MAX_CACHED_BYTES = 32 << 20;
+    //! Max number of cached buffers in each class
+    static constexpr size_t MAX_CACHED_PER_CLASS = 128;
+
+    mutable Mutex cs;
+    std::vector<CDataStream> vCache[NUM_CLASSES] GUARDED_BY(cs);
+    size_t nCachedBytes GUARDED_BY(cs){0};
+    uint64_t nReused GUARDED_BY(cs){0};
+    uint64_t nAllocated GUARDED_BY(cs){0};
+
+    CNetMessageBufferPool();
+
+    /** Index of the smallest class whose buffers hold nSize bytes, NUM_CLASSES if there is none */
+    static int GetClass(size_t nSize);
+};
+
 class CNetMessage
 {
 private:
@@ -593,7 +663,7 @@ private:
 public:
     bool in_data; // parsing header (false) or data (true)
 
-    CDataStream hdrbuf; // partially received header
+    unsigned char hdrbuf[CMessageHeader::HEADER_SIZE]; // partially received header
     CMessageHeader hdr; // complete header
     unsigned int nHdrPos;
 
@@ -602,14 +672,18 @@ public:
 
     int64_t nTime; // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
     }
 
+    ~CNetMessage()
+    {
+        CNetMessageBufferPool::Instance().Release(vRecv);
+    }
+
     bool complete() const
     {
         if (!in_data)
@@ -621,7 +695,6 @@ public:
 
     void SetVersion(int nVersionIn)
     {
-        hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
 
@@ -650,6 +723,8 @@ public:
     RecursiveMutex cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
+    // Size (with headers) of the tier two messages of the peer waiting for a message worker
+    std::atomic<size_t> nTierTwoQueueSize{0};
 
     RecursiveMutex cs_sendProcessing;
 
@@ -699,6 +774,9 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Socket readiness reported by epoll, until the socket would block (see CConnman::SocketEvents)
+    std::atomic_bool fHasRecvData{false};
+    std::atomic_bool fCanSendData{false};
 
     // If true, we will announce/send him plain recovered sigs (usually true for full nodes)
     std::atomic<bool> m_wants_recsigs{false};
@@ -734,8 +812,6 @@ public:
     // Set of tier two messages ids we still have to announce.
     std::vector<CInv> vInventoryTierTwoToSend;
     RecursiveMutex cs_inventory;
-    std::multimap<int64_t, CInv> mapAskFor;
-    std::set<uint256> setAskFor;
     std::vector<uint256> vBlockRequested;
     std::chrono::microseconds nNextInvSend{0};
     // Used for BIP35 mempool sending, also protected by cs_inventory
@@ -886,10 +962,6 @@ public:
         }
     }
 
-    void AskFor(const CInv& inv);
-    // inv response received, clear it from the waiting inv set.
-    void AskForInvReceived(const uint256& invHash);
-
     void CloseSocketDisconnect();
     bool DisconnectOldProtocol(int nVersionIn, int nVersionRequired);
 
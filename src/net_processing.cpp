@@ -7,10 +7,13 @@
 
 #include "net_processing.h"
 
+#include "blockencodings.h"
+#include "blockfilter.h"
 #include "budget/budgetmanager.h"
 #include "chain.h"
 #include "evo/deterministicmns.h"
 #include "evo/mnauth.h"
+#include "index/blockfilterindex.h"
 #include "llmq/quorums_blockprocessor.h"
 #include "llmq/quorums_dkgsessionmgr.h"
 #include "masternodeman.h"
@@ -25,6 +28,7 @@
 #include "sporkdb.h"
 #include "streams.h"
 #include "tiertwo/tiertwo_sync_state.h"
+#include "txrequest.h"
 #include "validation.h"
 #include "util/validation.h"
 
@@ -34,6 +38,22 @@ static const uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL; // SH
 
 /** the maximum percentage of addresses from our addrman to return in response to a getaddr message. */
 static constexpr size_t MAX_PCT_ADDR_TO_SEND = 23;
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static constexpr uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static constexpr uint32_t MAX_GETCFHEADERS_SIZE = 2000;
+/** Maximum number of in-flight inventory requests (transactions and tier two objects) to a peer. It's not a
+ *  hard limit, but the threshold at which OVERLOADED_PEER_INV_DELAY kicks in. */
+static constexpr size_t MAX_PEER_INV_REQUEST_IN_FLIGHT = 100;
+/** Maximum number of inventory items announced by a peer, that are tracked for download. Well above what a peer
+ *  announces between two requests (INVENTORY_BROADCAST_MAX per trickle), and it bounds the memory of the tracker. */
+static constexpr size_t MAX_PEER_INV_ANNOUNCEMENTS = 5000;
+/** How long to delay requesting inventory items from non-preferred peers */
+static constexpr auto NONPREF_PEER_INV_DELAY = std::chrono::seconds{2};
+/** How long to delay requesting inventory items from overloaded peers (see MAX_PEER_INV_REQUEST_IN_FLIGHT) */
+static constexpr auto OVERLOADED_PEER_INV_DELAY = std::chrono::seconds{2};
+/** How long to wait for the response to an inventory request, before asking another peer */
+static constexpr auto GETDATA_INV_INTERVAL = std::chrono::seconds{60};
 
 struct IteratorComparator
 {
@@ -100,9 +120,21 @@ struct QueuedBlock {
     int64_t nTime;              //! Time of "getdata" request in microseconds.
     int nValidatedQueuedBefore; //! Number of blocks queued with validated headers (globally) at the time this one is requested.
     bool fValidatedHeaders;     //! Whether this block has validated headers at the time of request.
+    std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //! Optional, used for cmpctblock downloads
 };
 std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+/** Requests of the transactions and tier two objects announced by the peers. Protected by cs_main. */
+std::unique_ptr<TxRequestTracker> g_txrequest;
+
+/** Stack of nodes which we have set to announce using compact blocks (high-bandwidth mode). Protected by cs_main. */
+std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+/** The last block connected, to announce it and answer getdata/getblocktxn without reading it from disk. */
+RecursiveMutex cs_most_recent_block;
+std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent_block);
+std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
+
 /** Number of blocks in flight with validated headers. */
 int nQueuedValidatedHeaders = 0;
 
@@ -219,6 +251,10 @@ struct CNodeState {
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether this peer can give us compact blocks (it sent a sendcmpct with a supported version).
+    bool fProvidesHeaderAndIDs;
+    //! Whether this peer wants new blocks announced with a cmpctblock instead of an inv (high-bandwidth mode).
+    bool fPreferHeaderAndIDs;
 
     CNodeBlocks nodeBlocks;
 
@@ -233,6 +269,8 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        fProvidesHeaderAndIDs = false;
+        fPreferHeaderAndIDs = false;
     }
 };
 
@@ -305,7 +343,8 @@ void MarkBlockAsReceived(const uint256& hash)
 }
 
 // Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr)
+// With fCompact, the returned entry has a PartiallyDownloadedBlock to reconstruct the block from a cmpctblock.
+QueuedBlock& MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr, bool fCompact = false)
 {
     CNodeState* state = State(nodeid);
     assert(state != nullptr);
@@ -313,11 +352,58 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
-    QueuedBlock newentry = {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != nullptr};
-    nQueuedValidatedHeaders += newentry.fValidatedHeaders;
-    std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
+    std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
+            {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != nullptr,
+             std::unique_ptr<PartiallyDownloadedBlock>(fCompact ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+    nQueuedValidatedHeaders += it->fValidatedHeaders;
     state->nBlocksInFlight++;
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+    return *it;
+}
+
+/** Ask the peer to announce new blocks with a cmpctblock, keeping at most MAX_CMPCTBLOCK_HB_PEERS such peers:
+ *  the ones which most recently gave us a new block. */
+static void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid, CConnman* connman) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+
+    CNodeState* nodestate = State(nodeid);
+    if (!nodestate || !nodestate->fProvidesHeaderAndIDs) {
+        // Never ask from peers who can't provide compact blocks.
+        return;
+    }
+    for (std::list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == nodeid) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+            return;
+        }
+    }
+    connman->ForNode(nodeid, [connman](CNode* pfrom) {
+        if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_CMPCTBLOCK_HB_PEERS) {
+            // As per BIP152, we only get 3 of our peers to announce blocks using compact encodings.
+            connman->ForNode(lNodesAnnouncingHeaderAndIDs.front(), [connman](CNode* pnodeStop) {
+                connman->PushMessage(pnodeStop, CNetMsgMaker(pnodeStop->GetSendVersion()).Make(NetMsgType::SENDCMPCT, false, CMPCTBLOCKS_VERSION));
+                return true;
+            });
+            lNodesAnnouncingHeaderAndIDs.pop_front();
+        }
+        connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::SENDCMPCT, true, CMPCTBLOCKS_VERSION));
+        lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+        return true;
+    });
+}
+
+/** Whether we are close enough to the tip to fetch announced blocks directly, instead of through the download window */
+static bool CanDirectFetch() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    return chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - Params().GetConsensus().nTargetSpacing * 20;
+}
+
+/** Whether the header chain is synced first with this peer, and the blocks downloaded afterwards. */
+static bool IsHeadersFirstPeer(const CNode* pnode)
+{
+    return Params().HeadersFirstSyncingActive() && pnode->nVersion >= HEADERS_FIRST_VERSION;
 }
 
 /** Check whether the last unknown block a peer advertised is not yet known. */
@@ -423,6 +509,9 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
             if (pindex->nStatus & BLOCK_HAVE_DATA) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
+            } else if (IsBlockPendingParent(pindex->GetBlockHash())) {
+                // Already downloaded, waiting for its parent.
+                continue;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
                 if (pindex->nHeight > nWindowEnd) {
@@ -475,6 +564,7 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     for (const QueuedBlock& entry : state->vBlocksInFlight)
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
+    g_txrequest->DisconnectedPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
 
     mapNodeState.erase(nodeid);
@@ -676,15 +766,38 @@ static void CheckBlockSpam(NodeId nodeId, const uint256& hashBlock)
 // blockchain -> download logic notification
 //
 
+static bool ProcessTierTwoMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman* connman);
+
 PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn) :
         connman(connmanIn)
 {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    g_txrequest.reset(new TxRequestTracker());
+    tierTwoWorkers.reset(new CTierTwoMessageWorkers(connman, TIERTWO_MSG_WORKERS,
+            [this](CNode* pfrom, std::string& strCommand, CDataStream& vRecv) {
+                return ProcessTierTwoMessage(pfrom, strCommand, vRecv, connman);
+            }));
+}
+
+PeerLogicValidation::~PeerLogicValidation()
+{
+    StopTierTwoWorkers();
+}
+
+void PeerLogicValidation::StopTierTwoWorkers()
+{
+    tierTwoWorkers->Stop();
 }
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex)
 {
+    {
+        LOCK(cs_most_recent_block);
+        most_recent_block = pblock;
+        most_recent_compact_block.reset();
+    }
+
     LOCK(g_cs_orphans);
 
     std::vector<uint256> vOrphanErase;
@@ -721,13 +834,39 @@ void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex* pindexNew, const CB
 
     if (!fInitialDownload) {
         const uint256& hashNewTip = pindexNew->GetBlockHash();
+
+        // A new tip extending the previous one is announced with a cmpctblock
+        // to the peers that asked for it (high-bandwidth mode).
+        std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock;
+        std::set<NodeId> setHighBandwidthPeers;
+        if (pindexNew->pprev == pindexFork) {
+            {
+                LOCK(cs_most_recent_block);
+                if (most_recent_block && most_recent_block->GetHash() == hashNewTip) {
+                    most_recent_compact_block = std::make_shared<const CBlockHeaderAndShortTxIDs>(*most_recent_block);
+                    pcmpctblock = most_recent_compact_block;
+                }
+            }
+            if (pcmpctblock) {
+                LOCK(cs_main);
+                for (const auto& it : mapNodeState) {
+                    if (it.second.fPreferHeaderAndIDs)
+                        setHighBandwidthPeers.insert(it.first);
+                }
+            }
+        }
+
         // Relay inventory, but don't relay old inventory during initial block download.
-        connman->ForEachNode([nNewHeight, hashNewTip](CNode* pnode) {
+        connman->ForEachNode([this, nNewHeight, &hashNewTip, &pcmpctblock, &setHighBandwidthPeers](CNode* pnode) {
             // Don't sync from MN only connections.
             if (!pnode->CanRelay()) {
                 return;
             }
-            if (nNewHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : 0)) {
+            if (setHighBandwidthPeers.count(pnode->GetId())) {
+                LogPrint(BCLog::NET, "%s sending cmpctblock %s to peer=%d\n", __func__, hashNewTip.ToString(), pnode->GetId());
+                connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+                pnode->AddInventoryKnown(CInv(MSG_BLOCK, hashNewTip));
+            } else if (nNewHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : 0)) {
                 pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
             }
         });
@@ -754,6 +893,10 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const CValidationSta
             // Spam filter
             CheckBlockSpam(it->second, block.GetHash());
         }
+    } else if (state.IsValid() && fMasterNode && !IsInitialBlockDownload() && it != mapBlockSource.end()) {
+        // Masternodes get new blocks announced with a cmpctblock (high-bandwidth mode)
+        // by the peers which most recently gave us a new block.
+        MaybeSetPeerAsAnnouncingHeaderAndIDs(it->second, connman);
     }
 
     if (it != mapBlockSource.end())
@@ -831,7 +974,7 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         }
         return false;
     case MSG_MASTERNODE_ANNOUNCE:
-        if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
+        if (mnodeman.HasSeenMNB(inv.hash)) {
             g_tiertwo_sync_state.AddedMasternodeList(inv.hash);
             return true;
         }
@@ -850,6 +993,32 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/** Track an inventory item announced by a peer, to request it from the best of the announcing peers */
+static void AddInvAnnouncement(const CNode& node, const CInv& inv, std::chrono::microseconds current_time) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    const NodeId nodeid = node.GetId();
+    if (!node.fWhitelisted && g_txrequest->Count(nodeid) >= MAX_PEER_INV_ANNOUNCEMENTS) {
+        // Too many items announced by this peer are being tracked already
+        return;
+    }
+
+    // Give the preferred (outbound) and not overloaded peers a head start, so that they get asked first
+    const bool preferred = State(nodeid)->fPreferredDownload;
+    auto delay = std::chrono::microseconds{0};
+    if (!preferred) delay += NONPREF_PEER_INV_DELAY;
+    if (!node.fWhitelisted && g_txrequest->CountInFlight(nodeid) >= MAX_PEER_INV_REQUEST_IN_FLIGHT) {
+        delay += OVERLOADED_PEER_INV_DELAY;
+    }
+    g_txrequest->ReceivedInv(nodeid, inv, preferred, current_time + delay);
+}
+
+void RemoveAskFor(const uint256& invHash)
+{
+    AssertLockHeld(cs_main);
+    g_txrequest->ForgetInvHash(invHash);
+}
+
 static void RelayTransaction(const CTransaction& tx, CConnman* connman)
 {
     CInv inv(MSG_TX, tx.GetHash());
@@ -992,10 +1161,8 @@ bool static PushTierTwoGetDataRequest(const CInv& inv,
 
     // !TODO: remove when transition to DMN is complete
     if (inv.type == MSG_MASTERNODE_ANNOUNCE && !deterministicMNManager->LegacyMNObsolete()) {
-        auto it = mnodeman.mapSeenMasternodeBroadcast.find(inv.hash);
-        if (it != mnodeman.mapSeenMasternodeBroadcast.end()) {
-            const auto& mnb = it->second;
-
+        CMasternodeBroadcast mnb;
+        if (mnodeman.GetSeenMNB(inv.hash, mnb)) {
             int version = !mnb.addr.IsAddrV1Compatible() ? PROTOCOL_VERSION | ADDRV2_FORMAT : PROTOCOL_VERSION;
             CDataStream ss(SER_NETWORK, version);
             ss.reserve(1000);
@@ -1021,6 +1188,19 @@ bool static PushTierTwoGetDataRequest(const CInv& inv,
     return false;
 }
 
+/**
+ * To prevent fingerprinting attacks, only serve data for blocks outside of the
+ * active chain if they are valid, and no more than a max reorg depth than the
+ * best header chain we know about.
+ */
+static bool BlockRequestAllowed(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    if (chainActive.Contains(pindex)) return true;
+    return pindex->IsValid(BLOCK_VALID_SCRIPTS) && pindexBestHeader &&
+           (chainActive.Height() - pindex->nHeight < gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH));
+}
+
 void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     LOCK(cs_main);
@@ -1029,27 +1209,46 @@ void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman* connman
     bool send = false;
     CBlockIndex* pindex = LookupBlockIndex(inv.hash);
     if (pindex) {
-        if (chainActive.Contains(pindex)) {
-            send = true;
-        } else {
-            // To prevent fingerprinting attacks, only send blocks outside of the active
-            // chain if they are valid, and no more than a max reorg depth than the best header
-            // chain we know about.
-            send = pindex->IsValid(BLOCK_VALID_SCRIPTS) && pindexBestHeader &&
-                   (chainActive.Height() - pindex->nHeight < gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH));
-            if (!send) {
-                LogPrint(BCLog::NET, "ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
-            }
+        send = BlockRequestAllowed(pindex);
+        if (!send) {
+            LogPrint(BCLog::NET, "ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
         }
     }
     // Don't send not-validated blocks
     if (send && (pindex->nStatus & BLOCK_HAVE_DATA)) {
         // Send block from disk
         CBlock block;
-        if (!ReadBlockFromDisk(block, pindex))
+        if (inv.type != MSG_BLOCK && !ReadBlockFromDisk(block, pindex))
             assert(!"cannot load block from disk");
-        if (inv.type == MSG_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+        if (inv.type == MSG_BLOCK) {
+            // The block is sent as it is stored, without being deserialized, and its
+            // buffer is handed over to the send queue, without being copied.
+            CSerializedNetMsg msg;
+            msg.command = NetMsgType::BLOCK;
+            if (!ReadRawBlockFromDisk(msg.data, pindex))
+                assert(!"cannot load block from disk");
+            connman->PushMessage(pfrom, std::move(msg));
+        } else if (inv.type == MSG_CMPCT_BLOCK) {
+            // If a peer is asking for old blocks, we're almost guaranteed
+            // they won't have a useful mempool to match against a compact block,
+            // and we don't feel like constructing the object for them, so
+            // instead we respond with the full, non-compact block.
+            if (pindex->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock;
+                {
+                    LOCK(cs_most_recent_block);
+                    if (most_recent_compact_block && most_recent_compact_block->header.GetHash() == inv.hash)
+                        pcmpctblock = most_recent_compact_block;
+                }
+                if (pcmpctblock) {
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+                } else {
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block)));
+                }
+            } else {
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+            }
+        }
         else // MSG_FILTERED_BLOCK)
         {
             bool send_ = false;
@@ -1155,7 +1354,7 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, const std::atomic<bo
 
     if (it != pfrom->vRecvGetData.end() && !pfrom->fPauseSend) {
         const CInv &inv = *it;
-        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
             it++;
             ProcessGetBlockData(pfrom, inv, connman, interruptMsgProc);
         }
@@ -1176,7 +1375,241 @@ void static ProcessGetData(CNode* pfrom, CConnman* connman, const std::atomic<bo
 }
 
 bool fRequestedSporksIDB = false;
-bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman* connman, std::atomic<bool>& interruptMsgProc)
+/**
+ * Validation logic for compact filters request handling.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   filter_type     The filter type the request is for. Must be basic filters.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the request can be serviced.
+ * @param[out]  filter_index    The filter index, if the request can be serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, BlockFilterType filter_type,
+                                      uint32_t start_height, const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index, BlockFilterIndex*& filter_index)
+{
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC_FILTER &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        stop_index = LookupBlockIndex(stop_hash);
+
+        // Check that the stop block exists and the peer would be allowed to fetch it.
+        if (!stop_index || !BlockRequestAllowed(stop_index)) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with "
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = GetBlockFilterIndex(filter_type);
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n", BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle a cfilters request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const auto& filter : filters) {
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+    }
+}
+
+/**
+ * Handle a cfheaders request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::CFHEADERS,
+                                                                          filter_type_ser,
+                                                                          stop_index->GetBlockHash(),
+                                                                          prev_header,
+                                                                          filter_hashes));
+}
+
+/**
+ * Handle a getcfcheckpt request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::CFCHECKPT,
+                                                                          filter_type_ser,
+                                                                          stop_index->GetBlockHash(),
+                                                                          headers));
+}
+
+static bool IsTierTwoMessage(const std::string& strCommand)
+{
+    const std::vector<std::string>& allMessages = getTierTwoNetMessageTypes();
+    return std::find(allMessages.begin(), allMessages.end(), strCommand) != allMessages.end();
+}
+
+static bool ProcessTierTwoMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman* connman)
+{
+    // Check if the dispatcher can process this message first. If not, try going with the old flow.
+    if (!masternodeSync.MessageDispatcher(pfrom, strCommand, vRecv)) {
+        // Probably one the extensions, future: encapsulate all of this inside tiertwo_networksync.
+        int dosScore{0};
+        if (!mnodeman.ProcessMessage(pfrom, strCommand, vRecv, dosScore)) {
+            WITH_LOCK(cs_main, Misbehaving(pfrom->GetId(), dosScore));
+            return false;
+        }
+        if (!g_budgetman.ProcessMessage(pfrom, strCommand, vRecv, dosScore)) {
+            WITH_LOCK(cs_main, Misbehaving(pfrom->GetId(), dosScore));
+            return false;
+        }
+        CValidationState state_payments;
+        if (!masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv, state_payments)) {
+            if (state_payments.IsInvalid(dosScore)) {
+                WITH_LOCK(cs_main, Misbehaving(pfrom->GetId(), dosScore));
+            }
+            return false;
+        }
+        if (!sporkManager.ProcessSpork(pfrom, strCommand, vRecv, dosScore)) {
+            WITH_LOCK(cs_main, Misbehaving(pfrom->GetId(), dosScore));
+            return false;
+        }
+
+        CValidationState mnauthState;
+        if (!CMNAuth::ProcessMessage(pfrom, strCommand, vRecv, *connman, mnauthState)) {
+            int dosScore{0};
+            if (mnauthState.IsInvalid(dosScore) && dosScore > 0) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), dosScore, mnauthState.GetRejectReason());
+            }
+        }
+    }
+    return true;
+}
+
+bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman* connman, CTierTwoMessageWorkers* tierTwoWorkers, std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
     if (gArgs.IsArgSet("-dropmessagestest") && GetRand(gArgs.GetArg("-dropmessagestest", 0)) == 0) {
@@ -1394,6 +1827,14 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             CMNAuth::PushMNAUTH(pfrom, *connman);
         }
 
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Tell our peer we are willing to provide cmpctblocks.
+            // However, we do not request new block announcements using
+            // cmpctblock messages (high-bandwidth mode) until a masternode
+            // picks its fastest peers, see MaybeSetPeerAsAnnouncingHeaderAndIDs.
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, false, CMPCTBLOCKS_VERSION));
+        }
+
         pfrom->fSuccessfullyConnected = true;
         LogPrintf("New outbound peer connected: version: %d, blocks=%d, peer=%d%s\n",
                   pfrom->nVersion.load(), pfrom->nStartingHeight, pfrom->GetId(),
@@ -1507,7 +1948,9 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
         LOCK(cs_main);
 
+        const bool fHeadersFirst = IsHeadersFirstPeer(pfrom);
         std::vector<CInv> vToFetch;
+        const auto current_time = std::chrono::microseconds{GetTimeMicros()};
 
         for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
             const CInv& inv = vInv[nInv];
@@ -1528,7 +1971,25 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
-                if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
+                if (fHeadersFirst) {
+                    if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
+                        // First request the headers preceding the announced block. In the normal fully-synced
+                        // case where a new block is announced that succeeds the current tip (no reorganization),
+                        // there are no such headers.
+                        // Secondly, and only when we are close to being synced, we request the announced block
+                        // afterwards, to avoid an extra round-trip. During IBD the blocks are downloaded, in
+                        // parallel from all the peers, by SendMessages.
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), inv.hash));
+                        if (CanDirectFetch()) {
+                            // Ask for a cmpctblock when the peer can provide it: most of the
+                            // transactions are already in our mempool.
+                            const bool fCompact = State(pfrom->GetId())->fProvidesHeaderAndIDs;
+                            vToFetch.emplace_back(fCompact ? MSG_CMPCT_BLOCK : MSG_BLOCK, inv.hash);
+                            MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
+                        }
+                        LogPrint(BCLog::NET, "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->GetId());
+                    }
+                } else if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
                     // Add this to the list of blocks to request
                     vToFetch.push_back(inv);
                     LogPrint(BCLog::NET, "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->GetId());
@@ -1554,7 +2015,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 if (!fAlreadyHave) {
                     bool allowWhileInIBD = allowWhileInIBDObjs.count(inv.type);
                     if (allowWhileInIBD || !IsInitialBlockDownload()) {
-                        pfrom->AskFor(inv);
+                        AddInvAnnouncement(*pfrom, inv, current_time);
                     }
                 }
             }
@@ -1586,7 +2047,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::GETBLOCKS || strCommand == NetMsgType::GETHEADERS) {
+    else if (strCommand == NetMsgType::GETBLOCKS) {
 
         // Don't relay blocks inv to masternode-only connections
         if (!pfrom->CanRelay()) {
@@ -1619,6 +2080,13 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 LogPrint(BCLog::NET, "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
             }
+            // If pruning, don't inv blocks unless we have on disk and are likely to still have
+            // for some reasonable time window (1 hour) that block relay might require.
+            const int nPrunedBlocksLikelyToHave = MIN_BLOCKS_TO_KEEP - 3600 / Params().GetConsensus().nTargetSpacing;
+            if (fPruneMode && (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave)) {
+                LogPrint(BCLog::NET, "  getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                break;
+            }
             pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             if (--nLimit <= 0) {
                 // When this block is requested, we'll send an inv that'll make them
@@ -1631,27 +2099,35 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == NetMsgType::HEADERS && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == NetMsgType::GETHEADERS) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
         if (locator.vHave.size() > MAX_LOCATOR_SZ) {
-            LogPrint(BCLog::NET, "getblocks locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
+            LogPrint(BCLog::NET, "getheaders locator size %lld > %d, disconnect peer=%d\n", locator.vHave.size(), MAX_LOCATOR_SZ, pfrom->GetId());
             pfrom->fDisconnect = true;
             return true;
         }
 
+        // Don't relay blocks to masternode-only connections
+        if (!pfrom->CanRelay()) {
+            LogPrint(BCLog::NET, "getheaders, don't relay blocks to masternode connection. peer=%d\n", pfrom->GetId());
+            return true;
+        }
+
         LOCK(cs_main);
 
-        if (IsInitialBlockDownload())
+        if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
+            LogPrint(BCLog::NET, "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom->GetId());
             return true;
+        }
 
-        CBlockIndex* pindex = nullptr;
+        const CBlockIndex* pindex = nullptr;
         if (locator.IsNull()) {
             // If locator is null, return the hashStop block
-            CBlockIndex* pindex = LookupBlockIndex(hashStop);
-            if (!pindex)
+            pindex = LookupBlockIndex(hashStop);
+            if (!pindex || !chainActive.Contains(pindex))
                 return true;
         } else {
             // Find the last block the caller has in the main chain
@@ -1663,7 +2139,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         std::vector<CBlock> vHeaders;
         int nLimit = MAX_HEADERS_RESULTS;
-        LogPrintf("getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->GetId());
+        LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->GetId());
         for (; pindex; pindex = chainActive.Next(pindex)) {
             vHeaders.push_back(pindex->GetBlockHeader());
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
@@ -1688,8 +2164,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         bool fMissingInputs = false;
         CValidationState state;
 
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv);
+        g_txrequest->ReceivedResponse(pfrom->GetId(), inv.hash);
 
         if (ptx->ContainsZerocoins()) {
             // Don't even try to check zerocoins at all.
@@ -1698,6 +2173,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         }
 
         if (AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, false, ignoreFees)) {
+            g_txrequest->ForgetInvHash(tx.GetHash());
             mempool.check(pcoinsTip.get());
             RelayTransaction(tx, connman);
             for (unsigned int i = 0; i < tx.vout.size(); i++) {
@@ -1778,12 +2254,15 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 }
             }
             if (!fRejectedParents) {
+                const auto current_time = std::chrono::microseconds{GetTimeMicros()};
                 for (const uint256& parent_txid : unique_parents) {
                     CInv _inv(MSG_TX, parent_txid);
                     pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
+                    if (!AlreadyHave(_inv)) AddInvAnnouncement(*pfrom, _inv, current_time);
                 }
                 AddOrphanTx(ptx, pfrom->GetId());
+                // Once added to the orphan pool, the tx is AlreadyHave, don't request it anymore
+                g_txrequest->ForgetInvHash(tx.GetHash());
 
                 // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
                 unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -1801,6 +2280,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 assert(recentRejects);
                 recentRejects->insert(tx.GetHash());
             }
+            g_txrequest->ForgetInvHash(tx.GetHash());
             if (pfrom->fWhitelisted) {
                 // Always relay transactions received from whitelisted peers, even
                 // if they were rejected from the mempool, allowing the node to
@@ -1841,36 +2321,36 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        LOCK(cs_main);
-
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
-        CBlockIndex* pindexLast = nullptr;
-        for (const CBlockHeader& header : headers) {
-            CValidationState state;
-            if (pindexLast && header.hashPrevBlock != pindexLast->GetBlockHash()) {
+
+        for (unsigned int n = 1; n < nCount; n++) {
+            if (headers[n].hashPrevBlock != headers[n - 1].GetHash()) {
+                LOCK(cs_main);
                 Misbehaving(pfrom->GetId(), 20, "non-continuous headers sequence");
                 return false;
             }
+        }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
-                int nDoS;
-                if (state.IsInvalid(nDoS)) {
-                    if (nDoS > 0) {
-                        Misbehaving(pfrom->GetId(), nDoS, "invalid header received");
-                    } else {
-                        LogPrint(BCLog::NET, "peer=%d: invalid header received\n", pfrom->GetId());
-                    }
-                    return false;
+        CValidationState state;
+        const CBlockIndex* pindexLast = nullptr;
+        if (!ProcessNewBlockHeaders(headers, state, &pindexLast)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                LOCK(cs_main);
+                if (nDoS > 0) {
+                    Misbehaving(pfrom->GetId(), nDoS, "invalid header received");
+                } else {
+                    LogPrint(BCLog::NET, "peer=%d: invalid header received\n", pfrom->GetId());
                 }
+                return false;
             }
         }
 
+        LOCK(cs_main);
+
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
@@ -1878,11 +2358,273 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
-            LogPrintf("more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->GetId(), pfrom->nStartingHeight);
+            LogPrint(BCLog::NET, "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->GetId(), pfrom->nStartingHeight);
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexLast), UINT256_ZERO));
         }
     }
 
+    else if (strCommand == NetMsgType::SENDCMPCT) {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fProvidesHeaderAndIDs = true;
+            State(pfrom->GetId())->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN) {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        std::shared_ptr<const CBlock> pblock;
+        {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block && most_recent_block->GetHash() == req.blockhash)
+                pblock = most_recent_block;
+        }
+        if (!pblock) {
+            LOCK(cs_main);
+
+            const CBlockIndex* pindex = LookupBlockIndex(req.blockhash);
+            if (!pindex || !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->GetId());
+                return true;
+            }
+
+            if (pindex->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+                // If an older block is requested (should never happen in practice,
+                // but can happen in tests) send a block response instead of a
+                // blocktxn response. Sending a full block response instead of a
+                // small blocktxn response is preferable in the case where a peer
+                // might maliciously send lots of getblocktxn requests to trigger
+                // expensive disk reads, because it will require the peer to
+                // actually receive all the data read from disk over the network.
+                LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->GetId(), MAX_BLOCKTXN_DEPTH);
+                pfrom->vRecvGetData.emplace_back(MSG_BLOCK, req.blockhash);
+                // The message processing loop will go around again (without pausing) and we'll respond then
+                return true;
+            }
+
+            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*pblockRead, pindex))
+                assert(!"cannot load block from disk");
+            pblock = pblockRead;
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= pblock->vtx.size()) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 100, strprintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->GetId()));
+                return true;
+            }
+            resp.txn[i] = pblock->vtx[req.indexes[i]];
+        }
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCKTXN, resp));
+    }
+
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        const uint256& hashBlock = cmpctblock.header.GetHash();
+
+        {
+            LOCK(cs_main);
+            if (!LookupBlockIndex(cmpctblock.header.hashPrevBlock)) {
+                // Doesn't connect, request the missing headers instead
+                if (!IsInitialBlockDownload())
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), UINT256_ZERO));
+                return true;
+            }
+        }
+
+        // Accept the header first: this checks everything it commits to
+        const CBlockIndex* pindex = nullptr;
+        CValidationState state;
+        if (!ProcessNewBlockHeaders({cmpctblock.header}, state, &pindex)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                if (nDoS > 0) {
+                    LOCK(cs_main);
+                    Misbehaving(pfrom->GetId(), nDoS, strprintf("Peer %d sent us invalid header via cmpctblock", pfrom->GetId()));
+                } else {
+                    LogPrint(BCLog::NET, "Peer %d sent us invalid header via cmpctblock\n", pfrom->GetId());
+                }
+                return true;
+            }
+        }
+        if (!pindex)
+            return true;
+
+        // When all the transactions of the block are available, we jump to the
+        // BLOCKTXN handling code, with an empty blocktxn message, to complete
+        // the processing of the block without cs_main.
+        bool fProcessBLOCKTXN = false;
+        CDataStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
+
+        // Keep a CBlock for "optimistic" compactblock reconstructions (see below)
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        bool fBlockReconstructed = false;
+
+        {
+            LOCK(cs_main);
+            UpdateBlockAvailability(pfrom->GetId(), hashBlock);
+
+            auto blockInFlightIt = mapBlocksInFlight.find(hashBlock);
+            const bool fAlreadyInFlight = blockInFlightIt != mapBlocksInFlight.end();
+
+            if ((pindex->nStatus & BLOCK_HAVE_DATA) || IsBlockPendingParent(hashBlock)) // Nothing to do here
+                return true;
+
+            if (pindex->nChainWork <= chainActive.Tip()->nChainWork) {
+                // We know something better
+                if (fAlreadyInFlight) {
+                    // We requested this block for some reason, but our mempool will probably be useless
+                    // so we just grab the block via normal getdata
+                    std::vector<CInv> vInv(1, CInv(MSG_BLOCK, hashBlock));
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
+                }
+                return true;
+            }
+
+            // If we're not close to tip yet, give up and let parallel block fetch work its magic
+            if (!fAlreadyInFlight && !CanDirectFetch())
+                return true;
+
+            CNodeState* nodestate = State(pfrom->GetId());
+
+            // We want to be a bit conservative just to be extra careful about DoS
+            // possibilities in compact block processing...
+            if (pindex->nHeight <= chainActive.Height() + 2) {
+                if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+                        (fAlreadyInFlight && blockInFlightIt->second.first == pfrom->GetId())) {
+                    if (fAlreadyInFlight && blockInFlightIt->second.second->partialBlock) {
+                        // The block was already in flight using compact blocks from the same peer
+                        LogPrint(BCLog::NET, "Peer sent us compact block we were already syncing!\n");
+                        return true;
+                    }
+
+                    PartiallyDownloadedBlock& partialBlock = *MarkBlockAsInFlight(pfrom->GetId(), hashBlock, pindex, true).partialBlock;
+                    ReadStatus status = partialBlock.InitData(cmpctblock);
+                    if (status == READ_STATUS_INVALID) {
+                        MarkBlockAsReceived(hashBlock); // Reset in-flight state in case of whitelist
+                        Misbehaving(pfrom->GetId(), 100, strprintf("Peer %d sent us invalid compact block", pfrom->GetId()));
+                        return true;
+                    } else if (status == READ_STATUS_FAILED) {
+                        // Duplicate txindexes, the block is now in-flight, so just request it
+                        std::vector<CInv> vInv(1, CInv(MSG_BLOCK, hashBlock));
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
+                        return true;
+                    }
+
+                    BlockTransactionsRequest req;
+                    for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                        if (!partialBlock.IsTxAvailable(i))
+                            req.indexes.push_back(i);
+                    }
+                    if (req.indexes.empty()) {
+                        BlockTransactions txn;
+                        txn.blockhash = hashBlock;
+                        blockTxnMsg << txn;
+                        fProcessBLOCKTXN = true;
+                    } else {
+                        req.blockhash = hashBlock;
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+                    }
+                } else {
+                    // This block is either already in flight from a different
+                    // peer, or this peer has too many blocks outstanding to
+                    // download from.
+                    // Optimistically try to reconstruct anyway since we might be
+                    // able to without any round trips.
+                    PartiallyDownloadedBlock tempBlock(&mempool);
+                    if (tempBlock.InitData(cmpctblock) != READ_STATUS_OK) {
+                        // TODO: don't ignore failures
+                        return true;
+                    }
+                    std::vector<CTransactionRef> dummy;
+                    fBlockReconstructed = tempBlock.FillBlock(*pblock, dummy) == READ_STATUS_OK;
+                }
+            } else if (fAlreadyInFlight) {
+                // We requested this block, but its far into the future, so our
+                // mempool will probably be useless - request the block normally
+                std::vector<CInv> vInv(1, CInv(MSG_BLOCK, hashBlock));
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
+                return true;
+            }
+        } // cs_main
+
+        if (fProcessBLOCKTXN)
+            return ProcessMessage(pfrom, NetMsgType::BLOCKTXN, blockTxnMsg, nTimeReceived, connman, tierTwoWorkers, interruptMsgProc);
+
+        if (fBlockReconstructed) {
+            // If we got here, we were able to optimistically reconstruct a
+            // block that is in flight from some other peer.
+            WITH_LOCK(cs_main, mapBlockSource.emplace(hashBlock, pfrom->GetId()); );
+            // Clear the download state of the block, which is in process from some
+            // other peer, only if it was accepted: the block signature is not
+            // committed to by the header, so a malleated cmpctblock must not
+            // interfere with the regular download.
+            if (ProcessNewBlock(pblock, nullptr)) {
+                LOCK(cs_main);
+                MarkBlockAsReceived(hashBlock);
+            }
+        }
+    }
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        bool fBlockRead = false;
+        {
+            LOCK(cs_main);
+
+            auto it = mapBlocksInFlight.find(resp.blockhash);
+            if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+                    it->second.first != pfrom->GetId()) {
+                LogPrint(BCLog::NET, "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->GetId());
+                return true;
+            }
+
+            PartiallyDownloadedBlock& partialBlock = *it->second.second->partialBlock;
+            ReadStatus status = partialBlock.FillBlock(*pblock, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100, strprintf("Peer %d sent us invalid compact block/non-matching block transactions", pfrom->GetId()));
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to getdata now :(
+                std::vector<CInv> vInv(1, CInv(MSG_BLOCK, resp.blockhash));
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
+            } else {
+                MarkBlockAsReceived(resp.blockhash);
+                mapBlockSource.emplace(resp.blockhash, pfrom->GetId());
+                fBlockRead = true;
+            }
+        } // Don't hold cs_main when we call into ProcessNewBlock
+        if (fBlockRead) {
+            ProcessNewBlock(pblock, nullptr);
+        }
+    }
+
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
@@ -1892,7 +2634,14 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         LogPrint(BCLog::NET, "received block %s peer=%d\n", inv.hash.ToString(), pfrom->GetId());
 
         // sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(pblock->hashPrevBlock)) {
+        if (!WITH_LOCK(cs_main, return LookupBlockIndex(pblock->hashPrevBlock); )) {
+            if (IsHeadersFirstPeer(pfrom)) {
+                // ask for the headers connecting it to our best header, the block is downloaded afterwards
+                LOCK(cs_main);
+                MarkBlockAsReceived(hashBlock);
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), hashBlock));
+                return true;
+            }
             CBlockLocator locator = WITH_LOCK(cs_main, return chainActive.GetLocator(););
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 // we already asked for this block, so lets work backwards and ask for the previous block
@@ -1905,12 +2654,18 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             }
         } else {
             pfrom->AddInventoryKnown(inv);
-            if (!mapBlockIndex.count(hashBlock)) {
-                {
-                    LOCK(cs_main);
+            bool fAlreadyHave;
+            {
+                LOCK(cs_main);
+                // With headers-first sync the header of the block is usually known already
+                const CBlockIndex* pindex = LookupBlockIndex(hashBlock);
+                fAlreadyHave = pindex && (pindex->nStatus & BLOCK_HAVE_DATA);
+                if (!fAlreadyHave) {
                     MarkBlockAsReceived(hashBlock);
                     mapBlockSource.emplace(hashBlock, pfrom->GetId());
                 }
+            }
+            if (!fAlreadyHave) {
                 ProcessNewBlock(pblock, nullptr);
 
                 // Disconnect node if its running an old protocol version,
@@ -2082,52 +2837,32 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
     else if (strCommand == NetMsgType::NOTFOUND) {
-        // We do not care about the NOTFOUND message (for now), but logging an Unknown Command
-        // message is undesirable as we transmit it ourselves.
+        // Ask another peer for the items that this peer didn't have
+        std::vector<CInv> vInv;
+        vRecv >> vInv;
+        if (vInv.size() <= MAX_PEER_INV_ANNOUNCEMENTS) {
+            LOCK(cs_main);
+            for (const CInv& inv : vInv) {
+                if (inv.type != MSG_BLOCK) {
+                    g_txrequest->ReceivedResponse(pfrom->GetId(), inv.hash);
+                }
+            }
+        }
         return true;
     }
 
-    else {
-        // Tier two msg type search
-        const std::vector<std::string>& allMessages = getTierTwoNetMessageTypes();
-        if (std::find(allMessages.begin(), allMessages.end(), strCommand) != allMessages.end()) {
-            // Check if the dispatcher can process this message first. If not, try going with the old flow.
-            if (!masternodeSync.MessageDispatcher(pfrom, strCommand, vRecv)) {
-                // Probably one the extensions, future: encapsulate all of this inside tiertwo_networksync.
-                int dosScore{0};
-                if (!mnodeman.ProcessMessage(pfrom, strCommand, vRecv, dosScore)) {
-                    WITH_LOCK(cs_main, Misbehaving(pfrom->GetId(), dosScore));
-                    return false;
-                }
-                if (!g_budgetman.ProcessMessage(pfrom, strCommand, vRecv, dosScore)) {
-                    WITH_LOCK(cs_main, Misbehaving(pfrom->GetId(), dosScore));
-                    return false;
-                }
-                CValidationState state_payments;
-                if (!masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv, state_payments)) {
-                    if (state_payments.IsInvalid(dosScore)) {
-                        WITH_LOCK(cs_main, Misbehaving(pfrom->GetId(), dosScore));
-                    }
-                    return false;
-                }
-                if (!sporkManager.ProcessSpork(pfrom, strCommand, vRecv, dosScore)) {
-                    WITH_LOCK(cs_main, Misbehaving(pfrom->GetId(), dosScore));
-                    return false;
-                }
-
-                CValidationState mnauthState;
-                if (!CMNAuth::ProcessMessage(pfrom, strCommand, vRecv, *connman, mnauthState)) {
-                    int dosScore{0};
-                    if (mnauthState.IsInvalid(dosScore) && dosScore > 0) {
-                        LOCK(cs_main);
-                        Misbehaving(pfrom->GetId(), dosScore, mnauthState.GetRejectReason());
-                    }
-                }
-            }
-        } else {
-            // Ignore unknown commands for extensibility
-            LogPrint(BCLog::NET, "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->GetId());
+    else if (IsTierTwoMessage(strCommand)) {
+        // Processed by a worker thread, unless the workers are stopped
+        if (tierTwoWorkers && CTierTwoMessageWorkers::IsWorkerMessage(strCommand) &&
+                tierTwoWorkers->Push(pfrom, strCommand, vRecv)) {
+            return true;
         }
+        return ProcessTierTwoMessage(pfrom, strCommand, vRecv, connman);
+    }
+
+    else {
+        // Ignore unknown commands for extensibility
+        LogPrint(BCLog::NET, "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->GetId());
     }
 
     return true;
@@ -2157,6 +2892,124 @@ static bool DisconnectIfBanned(CNode* pnode, CConnman* connman)
     return false;
 }
 
+CTierTwoMessageWorkers::CTierTwoMessageWorkers(CConnman* connmanIn, int nWorkers, ProcessFunc processFuncIn) :
+        connman(connmanIn),
+        processFunc(std::move(processFuncIn))
+{
+    for (int i = 0; i < nWorkers; i++) {
+        vWorkers.emplace_back(new Worker());
+        vWorkers.back()->thread = std::thread(&TraceThread<std::function<void()> >, strprintf("t2msg.%d", i),
+                                              std::function<void()>(std::bind(&CTierTwoMessageWorkers::ThreadWorker, this, std::ref(*vWorkers.back()))));
+    }
+}
+
+CTierTwoMessageWorkers::~CTierTwoMessageWorkers()
+{
+    Stop();
+}
+
+bool CTierTwoMessageWorkers::IsWorkerMessage(const std::string& strCommand)
+{
+    // MNAUTH and SYNCSTATUSCOUNT update state (the masternode authentication of the peer, the sync
+    // counters) that is not guarded for concurrent access: keep them on the message handler thread.
+    return IsTierTwoMessage(strCommand) &&
+           strCommand != NetMsgType::MNAUTH &&
+           strCommand != NetMsgType::SYNCSTATUSCOUNT;
+}
+
+bool CTierTwoMessageWorkers::CanTakeMessage(const CNode* pfrom, const std::string& strCommand, size_t nFloodSize)
+{
+    // Keep the order of the messages of the peer: while it has tier two messages waiting for a
+    // worker, only queue more of them, and only until they reach the receive flood size.
+    const size_t nTierTwoQueueSize = pfrom->nTierTwoQueueSize;
+    return nTierTwoQueueSize == 0 || (nTierTwoQueueSize < nFloodSize && IsWorkerMessage(strCommand));
+}
+
+bool CTierTwoMessageWorkers::Push(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv)
+{
+    Worker& worker = *vWorkers[pfrom->GetId() % vWorkers.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (fStop) return false;
+        const size_t nSize = vRecv.size() + CMessageHeader::HEADER_SIZE;
+        pfrom->nTierTwoQueueSize += nSize;
+        worker.queue.push_back(Message{pfrom->AddRef(), strCommand, std::move(vRecv), nSize});
+    }
+    worker.cond.notify_one();
+    return true;
+}
+
+void CTierTwoMessageWorkers::Stop()
+{
+    if (fStop.exchange(true)) return;
+    for (const auto& worker : vWorkers) {
+        // Pushes either see fStop or are queued before the lock is taken
+        { std::lock_guard<std::mutex> lock(worker->mutex); }
+        worker->cond.notify_all();
+    }
+    for (const auto& worker : vWorkers) {
+        if (worker->thread.joinable()) worker->thread.join();
+        // Drop the messages that were not processed
+        for (Message& msg : worker->queue) {
+            ProcessQueued(msg);
+        }
+        worker->queue.clear();
+    }
+}
+
+void CTierTwoMessageWorkers::ThreadWorker(Worker& worker)
+{
+    while (true) {
+        std::deque<Message> msgs;
+        {
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            worker.cond.wait(lock, [&]{ return fStop || !worker.queue.empty(); });
+            if (fStop) return;
+            msgs.swap(worker.queue);
+        }
+        for (Message& msg : msgs) {
+            ProcessQueued(msg);
+        }
+    }
+}
+
+void CTierTwoMessageWorkers::ProcessQueued(Message& msg)
+{
+    CNode* pfrom = msg.pfrom;
+    if (!fStop && !pfrom->fDisconnect) {
+        const unsigned int nMessageSize = msg.vRecv.size();
+        bool fRet = false;
+        try {
+            fRet = processFunc(pfrom, msg.strCommand, msg.vRecv);
+        } catch (const std::ios_base::failure& e) {
+            // Allow exceptions from under-length or over-long messages, as ProcessMessages does
+            LogPrint(BCLog::NET, "%s(%s, %u bytes): Exception '%s' caught\n", __func__, SanitizeString(msg.strCommand), nMessageSize, e.what());
+        } catch (const std::exception& e) {
+            PrintExceptionContinue(&e, "ProcessTierTwoMessage()");
+        } catch (...) {
+            PrintExceptionContinue(nullptr, "ProcessTierTwoMessage()");
+        }
+
+        if (!fRet) {
+            LogPrint(BCLog::NET, "ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(msg.strCommand), nMessageSize,
+                     pfrom->GetId());
+        }
+
+        LOCK(cs_main);
+        DisconnectIfBanned(pfrom, connman);
+    }
+    CNetMessageBufferPool::Instance().Release(msg.vRecv);
+
+    // The message handler skips the peer while it has tier two messages queued before its next
+    // one, or too many of them (see ProcessMessages): wake it up when that is no longer the case.
+    const size_t nFloodSize = connman->GetReceiveFloodSize();
+    const size_t nQueueSize = (pfrom->nTierTwoQueueSize -= msg.nSize);
+    if (nQueueSize == 0 || (nQueueSize < nFloodSize && nQueueSize + msg.nSize >= nFloodSize)) {
+        connman->WakeMessageHandler();
+    }
+    pfrom->Release();
+}
+
 bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     // Message format
@@ -2186,6 +3039,10 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
             return false;
+        if (!CTierTwoMessageWorkers::CanTakeMessage(pfrom, pfrom->vProcessMsg.front().hdr.GetCommand(),
+                                                    connman->GetReceiveFloodSize())) {
+            return false;
+        }
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
@@ -2228,7 +3085,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     // Process message
     bool fRet = false;
     try {
-        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, connman, interruptMsgProc);
+        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, connman, tierTwoWorkers.get(), interruptMsgProc);
         if (interruptMsgProc)
             return false;
         if (!pfrom->vRecvGetData.empty())
@@ -2372,10 +3229,13 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             if ((nSyncStarted == 0 && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->GetId(), pto->nStartingHeight);
-                //pto->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO);
-                connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                if (IsHeadersFirstPeer(pto)) {
+                    const CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->GetId(), pto->nStartingHeight);
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO));
+                } else {
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                }
             }
         }
 
@@ -2536,7 +3396,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             for (const CBlockIndex* pindex : vToDownload) {
                 vGetData.emplace_back(MSG_BLOCK, pindex->GetBlockHash());
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), pindex);
-                LogPrintf("Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
+                LogPrint(BCLog::NET, "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                     pindex->nHeight, pto->GetId());
             }
             if (state.nBlocksInFlight == 0 && staller != -1) {
@@ -2550,8 +3410,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         //
         // Message: getdata (non-blocks)
         //
-        while (!pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow) {
-            const CInv& inv = (*pto->mapAskFor.begin()).second;
+        // Uses the system time (as the announcements do), not the mockable one
+        const auto now = std::chrono::microseconds{nNow};
+        std::vector<std::pair<NodeId, CInv>> expired;
+        for (const CInv& inv : g_txrequest->GetRequestable(pto->GetId(), now, &expired)) {
             if (!AlreadyHave(inv)) {
                 LogPrint(BCLog::NET, "Requesting %s peer=%d\n", inv.ToString(), pto->GetId());
                 vGetData.push_back(inv);
@@ -2559,11 +3421,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
                     vGetData.clear();
                 }
+                g_txrequest->RequestedInv(pto->GetId(), inv.hash, now + GETDATA_INV_INTERVAL);
             } else {
-                //If we're not going to ask, don't expect a response.
-                pto->setAskFor.erase(inv.hash);
+                // If we're not going to ask, don't expect a response.
+                g_txrequest->ForgetInvHash(inv.hash);
             }
-            pto->mapAskFor.erase(pto->mapAskFor.begin());
+        }
+        for (const auto& entry : expired) {
+            LogPrint(BCLog::NET, "timeout of inflight %s from peer=%d\n", entry.second.ToString(), entry.first);
         }
         if (!vGetData.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
@@ -10,6 +10,11 @@
 #include "net.h"
 #include "validationinterface.h"
 
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
+
 extern RecursiveMutex cs_main; // !TODO: change mutex to cs_orphans
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
@@ -32,13 +37,76 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
  *  Limits the impact of low-fee transaction floods. */
 static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
 
+/** Version of the compact blocks encoding, sent in sendcmpct */
+static const uint64_t CMPCTBLOCKS_VERSION = 1;
+/** Maximum depth of blocks we're willing to serve as compact blocks to peers
+ *  when requested. For older blocks, a regular BLOCK response will be sent. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of blocks we're willing to respond to GETBLOCKTXN requests for. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Number of peers a masternode asks to announce new blocks with a cmpctblock (high-bandwidth mode) */
+static const unsigned int MAX_CMPCTBLOCK_HB_PEERS = 3;
+/** Number of threads processing the tier two messages, out of the message handler thread */
+static const int TIERTWO_MSG_WORKERS = 2;
+
+/**
+ * Threads processing the tier two messages (masternodes, budget, sporks, LLMQ DKG), which don't
+ * need cs_main, out of the message handler thread: a burst of them would otherwise hold up the
+ * processing of the blocks. The messages of a peer always go to the same worker, which processes
+ * them in the order in which they were received.
+ */
+class CTierTwoMessageWorkers
+{
+public:
+    typedef std::function<bool(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)> ProcessFunc;
+
+    CTierTwoMessageWorkers(CConnman* connman, int nWorkers, ProcessFunc processFunc);
+    ~CTierTwoMessageWorkers();
+
+    /** Whether the message is processed by the workers */
+    static bool IsWorkerMessage(const std::string& strCommand);
+    /** Whether the message handler can take the next message of the peer, given its queued tier two messages */
+    static bool CanTakeMessage(const CNode* pfrom, const std::string& strCommand, size_t nFloodSize);
+
+    /** Queue a message to the worker of the peer, taking its data. Returns false if the workers are stopped. */
+    bool Push(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv);
+    void Stop();
+
+private:
+    struct Message {
+        CNode* pfrom;
+        std::string strCommand;
+        CDataStream vRecv;
+        size_t nSize; // accounted in pfrom->nTierTwoQueueSize
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<Message> queue;
+        std::thread thread;
+    };
+
+    CConnman* const connman;
+    const ProcessFunc processFunc;
+    std::vector<std::unique_ptr<Worker>> vWorkers;
+    std::atomic<bool> fStop{false};
+
+    void ThreadWorker(Worker& worker);
+    void ProcessQueued(Message& msg);
+};
+
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface {
 private:
     CConnman* connman;
+    std::unique_ptr<CTierTwoMessageWorkers> tierTwoWorkers;
 
 public:
     PeerLogicValidation(CConnman* connman);
-    ~PeerLogicValidation() = default;
+    ~PeerLogicValidation();
+
+    /** Stop the tier two message workers, dropping the messages still queued. Called before stopping the connman. */
+    void StopTierTwoWorkers();
 
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex) override;
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
@@ -70,5 +138,7 @@ struct CNodeStateStats {
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="") EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/** Stop requesting an inventory item from every peer, once it's been received. */
+void RemoveAskFor(const uint256& invHash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 #endif // BITCOIN_NET_PROCESSING_H
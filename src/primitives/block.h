@@ -87,6 +87,8 @@ public:
 
     // memory only
     mutable bool fChecked{false};
+    mutable bool fCheckedMerkleRoot{false}; // merkle root verified ahead of CheckBlock
+    mutable bool fCheckedSignature{false};  // block signature verified ahead of CheckBlock
 
     CBlock()
     {
@@ -112,6 +114,8 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         fChecked = false;
+        fCheckedMerkleRoot = false;
+        fCheckedSignature = false;
         vchBlockSig.clear();
     }
 
@@ -9,6 +9,7 @@
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "httpserver.h"
+#include "index/txindex.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -333,6 +334,10 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    if (g_txindex) {
+        g_txindex->BlockUntilSyncedToCurrentChain();
+    }
+
     CTransactionRef tx;
     uint256 hashBlock = uint256();
     if (!GetTransaction(hash, tx, hashBlock, true))
@@ -5,11 +5,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or https://www.opensource.org/licenses/mit-license.php.
 
+#include "blockfilter.h"
 #include "budget/budgetmanager.h"
 #include "checkpoints.h"
 #include "clientversion.h"
 #include "core_io.h"
 #include "consensus/upgrades.h"
+#include "index/blockfilterindex.h"
+#include "index/coinstatsindex.h"
 #include "kernel.h"
 #include "key_io.h"
 #include "masternodeman.h"
@@ -22,6 +25,7 @@
 #include "util/system.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
+#include "utxo_snapshot.h"
 #include "hash.h"
 #include "validationinterface.h"
 #include "wallet/wallet.h"
@@ -126,9 +130,9 @@ UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex
     result.pushKV("bits", strprintf("%08x", blockindex->nBits));
     result.pushKV("difficulty", GetDifficulty(blockindex));
     result.pushKV("chainwork", blockindex->nChainWork.GetHex());
-    result.pushKV("acc_checkpoint", blockindex->nAccumulatorCheckpoint.GetHex());
+    result.pushKV("acc_checkpoint", blockindex->GetAccumulatorCheckpoint().GetHex());
     // Sapling shield pool value
-    result.pushKV("shield_pool_value", ValuePoolDesc(blockindex->nChainSaplingValue, blockindex->nSaplingValue));
+    result.pushKV("shield_pool_value", ValuePoolDesc(blockindex->nChainSaplingValue, blockindex->GetSaplingValue()));
     if (blockindex->pprev)
         result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
     if (pnext)
@@ -594,6 +598,9 @@ UniValue getblock(const JSONRPCRequest& request)
     if (pblockindex == nullptr)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+
     CBlock block;
     if (!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
@@ -667,6 +674,84 @@ UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(chainActive.Tip(), pblockindex);
 }
 
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block.\n"
+            "Requires -blockfilterindex to be enabled for the given filter type.\n"
+
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=basic) The type name of the filter\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",   (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hex\"    (string) the hex-encoded filter header\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"") +
+            HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\""));
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    std::string filtertype_name = "basic";
+    if (request.params.size() > 1) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    BlockFilterIndex* index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + filtertype_name);
+    }
+
+    const CBlockIndex* block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        block_index = LookupBlockIndex(block_hash);
+        if (!block_index) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_was_connected = block_index->IsValid(BLOCK_VALID_SCRIPTS);
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filter_header.GetHex());
+    return ret;
+}
+
 UniValue getsupplyinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -719,35 +804,64 @@ struct CCoinsStats
     uint256 hashBlock{UINT256_ZERO};
     uint64_t nTransactions{0};
     uint64_t nTransactionOutputs{0};
+    uint64_t nBogoSize{0};
     uint256 hashSerialized{UINT256_ZERO};
     uint64_t nDiskSize{0};
     CAmount nTotalAmount{0};
 };
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+enum class CoinStatsHashType {
+    HASH_SERIALIZED,
+    MUHASH,
+    NONE,
+};
+
+static CoinStatsHashType ParseHashType(const std::string& hash_type_input)
+{
+    if (hash_type_input == "hash_serialized_2") {
+        return CoinStatsHashType::HASH_SERIALIZED;
+    } else if (hash_type_input == "muhash") {
+        return CoinStatsHashType::MUHASH;
+    } else if (hash_type_input == "none") {
+        return CoinStatsHashType::NONE;
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hash_type_input));
+}
+
+static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, MuHash3072& muhash, CoinStatsHashType hash_type, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
     assert(!outputs.empty());
-    ss << hash;
     const Coin& coin = outputs.begin()->second;
-    ss << VARINT(coin.nHeight * 4 + (coin.fCoinBase ? 2u : 0u) + (coin.fCoinStake ? 1u : 0u));
+    if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+        ss << hash;
+        ss << VARINT(coin.nHeight * 4 + (coin.fCoinBase ? 2u : 0u) + (coin.fCoinStake ? 1u : 0u));
+    }
     stats.nTransactions++;
     for (const auto& output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.out.scriptPubKey;
-        ss << VARINT_MODE(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            ss << VARINT(output.first + 1);
+            ss << output.second.out.scriptPubKey;
+            ss << VARINT_MODE(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+        } else if (hash_type == CoinStatsHashType::MUHASH) {
+            ApplyCoinHash(muhash, COutPoint(hash, output.first), output.second);
+        }
         stats.nTransactionOutputs++;
+        stats.nBogoSize += GetBogoSize(output.second.out.scriptPubKey);
         stats.nTotalAmount += output.second.out.nValue;
     }
-    ss << VARINT(0u);
+    if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+        ss << VARINT(0u);
+    }
 }
 
 //! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats, CoinStatsHashType hash_type)
 {
     std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
     assert(pcursor);
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    MuHash3072 muhash;
     stats.hashBlock = pcursor->GetBestBlock();
     {
         LOCK(cs_main);
@@ -762,7 +876,7 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         Coin coin;
         if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
             if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
+                ApplyStats(stats, ss, muhash, hash_type, prevkey, outputs);
                 outputs.clear();
             }
             prevkey = key.hash;
@@ -773,45 +887,107 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         pcursor->Next();
     }
     if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
+        ApplyStats(stats, ss, muhash, hash_type, prevkey, outputs);
+    }
+    if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+        stats.hashSerialized = ss.GetHash();
+    } else if (hash_type == CoinStatsHashType::MUHASH) {
+        muhash.Finalize(stats.hashSerialized);
     }
-    stats.hashSerialized = ss.GetHash();
     stats.nDiskSize = view->EstimateSize();
     return true;
 }
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" hash_or_height )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless -coinstatsindex is enabled and hash_type is not 'hash_serialized_2'.\n"
+
+            "\nArguments:\n"
+            "1. \"hash_type\"      (string, optional, default=\"hash_serialized_2\") Which UTXO set hash should be calculated.\n"
+            "                    Options: 'hash_serialized_2' (the legacy algorithm), 'muhash', 'none'.\n"
+            "2. hash_or_height   (string or numeric, optional, default=the current best block) The block hash or height\n"
+            "                    of the target height. Requires -coinstatsindex, and hash_type 'muhash' or 'none'.\n"
 
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions (not available with -coinstatsindex)\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"hash_serialized_2\": \"hash\",   (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"bogosize\": n,          (numeric) A database-independent metric for UTXO set size\n"
+            "  \"hash_serialized_2\": \"hash\",   (string) The serialized hash (only present if 'hash_serialized_2' hash_type is chosen)\n"
+            "  \"muhash\": \"hash\",      (string) The MuHash3072 of the UTXO set (only present if 'muhash' hash_type is chosen)\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk (not available with -coinstatsindex)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
 
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") +
+            HelpExampleCli("gettxoutsetinfo", "\"none\" 1000") +
+            HelpExampleCli("gettxoutsetinfo", "\"muhash\"") +
+            HelpExampleRpc("gettxoutsetinfo", "\"none\", 1000"));
 
     UniValue ret(UniValue::VOBJ);
 
+    const CoinStatsHashType hash_type = request.params[0].isNull() ? CoinStatsHashType::HASH_SERIALIZED : ParseHashType(request.params[0].get_str());
+
+    // The statistics of past blocks, and the ones without the legacy hash, come from the index
+    if (g_coinstatsindex && hash_type != CoinStatsHashType::HASH_SERIALIZED) {
+        g_coinstatsindex->BlockUntilSyncedToCurrentChain();
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            if (request.params[1].isNull()) {
+                pindex = chainActive.Tip();
+            } else if (request.params[1].isNum()) {
+                const int height = request.params[1].get_int();
+                if (height < 0 || height > chainActive.Height()) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d out of range", height));
+                }
+                pindex = chainActive[height];
+            } else {
+                pindex = LookupBlockIndex(ParseHashV(request.params[1], "hash_or_height"));
+                if (!pindex) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+                }
+            }
+        }
+        CCoinStatsIndexValue stats;
+        if (!g_coinstatsindex->LookUpStats(pindex, stats)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set statistics from the index");
+        }
+        ret.pushKV("height", pindex->nHeight);
+        ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
+        ret.pushKV("txouts", stats.transaction_output_count);
+        ret.pushKV("bogosize", stats.bogo_size);
+        if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", stats.muhash.GetHex());
+        }
+        ret.pushKV("total_amount", ValueFromAmount(stats.total_amount));
+        return ret;
+    }
+
+    if (!request.params[1].isNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Querying specific block heights requires -coinstatsindex, and hash_type 'muhash' or 'none'");
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
-    if (GetUTXOStats(pcoinsTip.get(), stats)) {
+    if (GetUTXOStats(pcoinsTip.get(), stats, hash_type)) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
         ret.pushKV("transactions", (int64_t)stats.nTransactions);
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
-        ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        } else if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", stats.hashSerialized.GetHex());
+        }
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
         ret.pushKV("disk_size", stats.nDiskSize);
     }
@@ -1014,6 +1190,8 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "    \"valueDelta\":        (numeric) Change in value held by the Sapling circuit over the chain tip block\n"
             "  },\n"
             "  \"initial_block_downloading\": true|false, (boolean) whether the node is in initial block downloading state or not\n"
+            "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -1050,8 +1228,15 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
     obj.pushKV("verificationprogress", Checkpoints::GuessVerificationProgress(pChainTip));
     obj.pushKV("chainwork", pChainTip ? pChainTip->nChainWork.GetHex() : "");
     // Sapling shield pool value
-    obj.pushKV("shield_pool_value", pChainTip ? ValuePoolDesc(pChainTip->nChainSaplingValue, pChainTip->nSaplingValue) : 0);
+    obj.pushKV("shield_pool_value", pChainTip ? ValuePoolDesc(pChainTip->nChainSaplingValue, pChainTip->GetSaplingValue()) : 0);
     obj.pushKV("initial_block_downloading", IsInitialBlockDownload());
+    obj.pushKV("pruned", fPruneMode);
+    if (fPruneMode && pChainTip) {
+        const CBlockIndex* block = pChainTip;
+        while (block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
+            block = block->pprev;
+        obj.pushKV("pruneheight", block->nHeight);
+    }
     UniValue softforks(UniValue::VARR);
     softforks.push_back(SoftForkDesc("bip65", 5, pChainTip));
     obj.pushKV("softforks",             softforks);
@@ -1361,6 +1546,9 @@ UniValue getblockindexstats(const JSONRPCRequest& request) {
         throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid block height");
 
     while (pindex && pindex->nHeight >= heightStart) {
+        if (fHavePruned && !WITH_LOCK(cs_main, return pindex->nStatus & BLOCK_HAVE_DATA)) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+        }
         CBlock block;
         if (!ReadBlockFromDisk(block, pindex)) {
             throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block from disk");
@@ -1670,6 +1858,102 @@ UniValue scantxoutset(const JSONRPCRequest& request)
     return result;
 }
 
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the chainstate at the chain tip (UTXO set, Sapling anchors and nullifiers, masternode\n"
+            "lists and LLMQ commitments) to a snapshot file, that loadtxoutset can load on a new node.\n"
+            "The node doesn't process blocks while dumping, which may take some time.\n"
+
+            "\nArguments:\n"
+            "1. \"path\"     (string, required) path of the output file. If relative, it is prefixed by the data directory\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"path\",           (string) the absolute path of the snapshot\n"
+            "  \"base_hash\": \"hash\",      (string) the hash of the block the snapshot was taken at\n"
+            "  \"base_height\": n,         (numeric) the height of that block\n"
+            "  \"coins_written\": n,       (numeric) the number of coins written\n"
+            "  \"content_hash\": \"hash\",   (string) the hash of the snapshot content, to commit in the chain params\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") + HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    }
+
+    SnapshotMetadata metadata;
+    uint256 hashSnapshot;
+    std::string strError;
+    if (!DumpUTXOSnapshot(path, metadata, hashSnapshot, strError)) {
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("path", path.string());
+    ret.pushKV("base_hash", metadata.hashBlock.GetHex());
+    ret.pushKV("base_height", WITH_LOCK(cs_main, return LookupBlockIndex(metadata.hashBlock)->nHeight; ));
+    ret.pushKV("coins_written", (int64_t)metadata.nCoins);
+    ret.pushKV("content_hash", hashSnapshot.GetHex());
+    return ret;
+}
+
+UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "loadtxoutset \"path\"\n"
+            "\nLoad a snapshot written by dumptxoutset as the chainstate, and continue syncing from its block.\n"
+            "The content hash of the snapshot must be committed in the chain params (or with -assumeutxo on regtest),\n"
+            "the node must have synced the headers up to the snapshot block but connected no block yet, and it must\n"
+            "run with -prune: the blocks below the snapshot are never downloaded, nor can wallets be rescanned over them.\n"
+            "The history below the snapshot block is not validated, the committed content hash is trusted instead.\n"
+            "\nEXPERIMENTAL warning: this call is available only on regtest, with snapshots committed by -assumeutxo.\n"
+            "There is no background validation of the chain below the snapshot, and no snapshot is committed on\n"
+            "mainnet or testnet.\n"
+
+            "\nArguments:\n"
+            "1. \"path\"     (string, required) path of the snapshot. If relative, it is prefixed by the data directory\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hash\",      (string) the hash of the block the snapshot was taken at\n"
+            "  \"base_height\": n,         (numeric) the height of that block\n"
+            "  \"coins_loaded\": n,        (numeric) the number of coins loaded\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("loadtxoutset", "\"utxo.dat\"") + HelpExampleRpc("loadtxoutset", "\"utxo.dat\""));
+
+    if (!Params().IsRegTestNet()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "command available only for RegTest network");
+    }
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    SnapshotMetadata metadata;
+    std::string strError;
+    if (!LoadUTXOSnapshot(path, metadata, strError)) {
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    // Connect the blocks above the snapshot that were already downloaded
+    CValidationState state;
+    if (!ActivateBestChain(state)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, state.GetRejectReason());
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("base_hash", metadata.hashBlock.GetHex());
+    ret.pushKV("base_height", WITH_LOCK(cs_main, return LookupBlockIndex(metadata.hashBlock)->nHeight; ));
+    ret.pushKV("coins_loaded", (int64_t)metadata.nCoins);
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafe argNames
   //  --------------------- ------------------------  -----------------------  ------ --------
@@ -1678,6 +1962,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblock",               &getblock,               true,  {"blockhash","verbose|verbosity"} },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  {} },
     { "blockchain",         "getblockcount",          &getblockcount,          true,  {} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true,  {"blockhash","filtertype"} },
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         false, {"blockhash","verbose"} },
     { "blockchain",         "getblockindexstats",     &getblockindexstats,     true,  {"height","range"} },
@@ -1688,7 +1973,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "getsupplyinfo",          &getsupplyinfo,          true,  {"force_update"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {"hash_type","hash_or_height"} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true,  {"path"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           true,  {"path"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"nblocks"} },
 
     { "blockchain",         "scantxoutset",           &scantxoutset,           true,  {"action", "scanobjects"} },
@@ -29,6 +29,10 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "addmultisigaddress", 0, "nrequired" },
     { "addmultisigaddress", 1, "keys" },
     { "addpeeraddress", 1, "port" },
+    { "getaddressbalance", 0, "addresses" },
+    { "getaddresstxids", 0, "addresses" },
+    { "getaddressutxos", 0, "addresses" },
+    { "getspentinfo", 0, "outpoint" },
     { "autocombinerewards", 0, "enable" },
     { "autocombinerewards", 1, "threshold" },
     { "cleanbudget", 0, "try_sync" },
@@ -77,6 +81,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "gettransaction", 1, "include_watchonly" },
     { "gettxout", 1, "n" },
     { "gettxout", 2, "include_mempool" },
+    { "gettxoutsetinfo", 1, "hash_or_height" },
     { "importaddress", 2, "rescan" },
     { "importaddress", 3, "p2sh" },
     { "importmulti", 0, "requests" },
@@ -7,6 +7,8 @@
 
 #include "clientversion.h"
 #include "httpserver.h"
+#include "index/addressindex.h"
+#include "index/spentindex.h"
 #include "key_io.h"
 #include "sapling/key_io_sapling.h"
 #include "masternode-sync.h"
@@ -104,6 +106,9 @@ UniValue getinfo(const JSONRPCRequest& request)
                 case NODE_BLOOM_WITHOUT_MN:
                     services+= "BLOOM/";
                     break;
+                case NODE_COMPACT_FILTERS:
+                    services+= "COMPACT_FILTERS/";
+                    break;
                 default:
                     services+= "UNKNOWN/";
             }
@@ -713,6 +718,17 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCNetBuffersInfo()
+{
+    CNetMessageBufferPool::Stats stats = CNetMessageBufferPool::Instance().GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("cached", uint64_t(stats.cached));
+    obj.pushKV("cached_bytes", uint64_t(stats.cached_bytes));
+    obj.pushKV("reused", stats.reused);
+    obj.pushKV("allocated", stats.allocated);
+    return obj;
+}
+
 UniValue getmemoryinfo(const JSONRPCRequest& request)
 {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
@@ -731,6 +747,12 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"netbuffers\": {           (json object) Information about the cache of the received messages buffers\n"
+            "    \"cached\": xxxxx,        (numeric) Number of buffers in the cache\n"
+            "    \"cached_bytes\": xxxxx,  (numeric) Number of bytes of the buffers in the cache\n"
+            "    \"reused\": xxxxx,        (numeric) Number of received messages that reused a cached buffer\n"
+            "    \"allocated\": xxxxx,     (numeric) Number of received messages that allocated a new buffer\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -739,6 +761,7 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
         );
     UniValue obj(UniValue::VOBJ);
     obj.pushKV("locked", RPCLockedMemoryInfo());
+    obj.pushKV("netbuffers", RPCNetBuffersInfo());
     return obj;
 }
 
@@ -832,9 +855,289 @@ UniValue mnconnect(const JSONRPCRequest& request)
     return false;
 }
 
+/** Translate the addresses argument of the address index calls to script hashes. */
+static std::vector<std::pair<uint160, std::string>> ParseIndexAddresses(const UniValue& param)
+{
+    std::vector<std::string> addresses;
+    if (param.isStr()) {
+        addresses.push_back(param.get_str());
+    } else if (param.isObject()) {
+        const UniValue& addresses_arr = find_value(param.get_obj(), "addresses");
+        if (!addresses_arr.isArray()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        }
+        for (const UniValue& address : addresses_arr.getValues()) {
+            addresses.push_back(address.get_str());
+        }
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be a string or an object");
+    }
+
+    std::vector<std::pair<uint160, std::string>> ret;
+    for (const std::string& address : addresses) {
+        bool isStaking = false;
+        CTxDestination dest = DecodeDestination(address, isStaking);
+        if (!IsValidDestination(dest) || isStaking) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + address);
+        }
+        ret.emplace_back(GetScriptHashForIndex(GetScriptForDestination(dest)), address);
+    }
+    return ret;
+}
+
+static AddressIndex& GetSyncedAddressIndex()
+{
+    if (!g_addressindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled. Use -addressindex to enable it.");
+    }
+    if (!g_addressindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index is still being built, try again later.");
+    }
+    return *g_addressindex;
+}
+
+UniValue getaddresstxids(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddresstxids {\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the txids of the transactions paying to or spending from the given addresses.\n"
+            "Requires -addressindex.\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\": [      (array, required) The pivx addresses\n"
+            "    \"address\"         (string) The pivx address\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"start\": n,         (numeric, optional) The start block height\n"
+            "  \"end\": n            (numeric, optional) The end block height\n"
+            "}\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"   (string) The transaction id, ordered by block height\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\"]}'") +
+            HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\"]}"));
+
+    const auto& addresses = ParseIndexAddresses(request.params[0]);
+
+    int start = 0;
+    int end = 0;
+    if (request.params[0].isObject()) {
+        const UniValue& start_value = find_value(request.params[0].get_obj(), "start");
+        const UniValue& end_value = find_value(request.params[0].get_obj(), "end");
+        if (!start_value.isNull()) start = start_value.get_int();
+        if (!end_value.isNull()) end = end_value.get_int();
+        if (start < 0 || end < 0 || (end > 0 && start > end)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start or end height");
+        }
+    }
+
+    AddressIndex& index = GetSyncedAddressIndex();
+
+    std::set<std::pair<int, uint256>> txids_by_height;
+    for (const auto& address : addresses) {
+        std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+        if (!index.GetAddressIndex(address.first, entries, start, end)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read the address index for " + address.second);
+        }
+        for (const auto& entry : entries) {
+            txids_by_height.emplace(entry.first.height, entry.first.txid);
+        }
+    }
+
+    UniValue result(UniValue::VARR);
+    std::set<uint256> seen;
+    for (const auto& tx : txids_by_height) {
+        if (seen.insert(tx.second).second) {
+            result.push_back(tx.second.GetHex());
+        }
+    }
+    return result;
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressbalance {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the balance of the given addresses.\n"
+            "Requires -addressindex.\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\": [      (array, required) The pivx addresses\n"
+            "    \"address\"         (string) The pivx address\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": x.xxx,   (numeric) The current balance in " + CURRENCY_UNIT + "\n"
+            "  \"received\": x.xxx   (numeric) The total amount received in " + CURRENCY_UNIT + "\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\"]}'") +
+            HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\"]}"));
+
+    const auto& addresses = ParseIndexAddresses(request.params[0]);
+    AddressIndex& index = GetSyncedAddressIndex();
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (const auto& address : addresses) {
+        std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+        if (!index.GetAddressIndex(address.first, entries)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read the address index for " + address.second);
+        }
+        for (const auto& entry : entries) {
+            balance += entry.second;
+            if (entry.second > 0) received += entry.second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("balance", ValueFromAmount(balance));
+    result.pushKV("received", ValueFromAmount(received));
+    return result;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressutxos {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the unspent outputs of the given addresses.\n"
+            "Requires -addressindex.\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\": [      (array, required) The pivx addresses\n"
+            "    \"address\"         (string) The pivx address\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The pivx address\n"
+            "    \"txid\": \"hex\",         (string) The id of the transaction creating the output\n"
+            "    \"outputIndex\": n,        (numeric) The output index\n"
+            "    \"script\": \"hex\",       (string) The output script\n"
+            "    \"amount\": x.xxx,         (numeric) The output value in " + CURRENCY_UNIT + "\n"
+            "    \"height\": n              (numeric) The height of the block including the transaction\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\"]}'") +
+            HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\"]}"));
+
+    const auto& addresses = ParseIndexAddresses(request.params[0]);
+    AddressIndex& index = GetSyncedAddressIndex();
+
+    std::vector<std::tuple<CAddressUnspentKey, CAddressUnspentValue, const std::string*>> utxos;
+    for (const auto& address : addresses) {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> unspent;
+        if (!index.GetAddressUnspent(address.first, unspent)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read the address index for " + address.second);
+        }
+        for (auto& entry : unspent) {
+            utxos.emplace_back(std::move(entry.first), std::move(entry.second), &address.second);
+        }
+    }
+    std::stable_sort(utxos.begin(), utxos.end(), [](const auto& a, const auto& b) {
+        return std::get<1>(a).height < std::get<1>(b).height;
+    });
+
+    UniValue result(UniValue::VARR);
+    for (const auto& utxo : utxos) {
+        const CAddressUnspentKey& key = std::get<0>(utxo);
+        const CAddressUnspentValue& value = std::get<1>(utxo);
+        UniValue output(UniValue::VOBJ);
+        output.pushKV("address", *std::get<2>(utxo));
+        output.pushKV("txid", key.txid.GetHex());
+        output.pushKV("outputIndex", (int64_t)key.index);
+        output.pushKV("script", HexStr(value.script));
+        output.pushKV("amount", ValueFromAmount(value.value));
+        output.pushKV("height", value.height);
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getspentinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1 || !request.params[0].isObject())
+        throw std::runtime_error(
+            "getspentinfo {\"txid\": \"hex\", \"index\": n}\n"
+            "\nReturns the input spending the given output.\n"
+            "Requires -spentindex.\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"txid\": \"hex\",      (string, required) The id of the transaction creating the output\n"
+            "  \"index\": n          (numeric, required) The output index\n"
+            "}\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hex\",      (string) The id of the spending transaction\n"
+            "  \"index\": n,         (numeric) The index of the spending input\n"
+            "  \"height\": n         (numeric) The height of the block including the spending transaction\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    const UniValue& txid_value = find_value(request.params[0].get_obj(), "txid");
+    const UniValue& index_value = find_value(request.params[0].get_obj(), "index");
+    if (!txid_value.isStr() || !index_value.isNum()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid txid or index");
+    }
+    const int n = index_value.get_int();
+    if (n < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid index");
+    }
+    const COutPoint outpoint(ParseHashV(txid_value, "txid"), (uint32_t)n);
+
+    if (!g_spentindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index not enabled. Use -spentindex to enable it.");
+    }
+    if (!g_spentindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index is still being built, try again later.");
+    }
+
+    CSpentIndexValue value;
+    if (!g_spentindex->GetSpentInfo(outpoint, value)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("txid", value.txid.GetHex());
+    result.pushKV("index", (int64_t)value.input_index);
+    result.pushKV("height", value.height);
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafe argNames
   //  --------------------- ------------------------  -----------------------  ------ --------
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      true,  {"addresses"} },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        true,  {"addresses"} },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        true,  {"addresses"} },
+    { "addressindex",       "getspentinfo",           &getspentinfo,           true,  {"outpoint"} },
+
     { "control",            "getinfo",                &getinfo,                true,  {} }, /* uses wallet if enabled */
     { "control",            "getmemoryinfo",          &getmemoryinfo,          true,  {} },
     { "control",            "mnsync",                 &mnsync,                 true,  {"mode"} },
@@ -173,6 +173,52 @@ extern "C" {
     /// `librustzcash_sapling_verification_ctx_init`.
     void librustzcash_sapling_verification_ctx_free(void *);
 
+    /// Creates a Sapling batch validator, collecting the proofs and
+    /// signatures of many transactions to verify them all at once.
+    /// Either consume it with `librustzcash_sapling_batch_validate`
+    /// or free it with `librustzcash_sapling_batch_validator_free`.
+    void * librustzcash_sapling_batch_validator_init();
+
+    /// Performs the cheap checks of a Sapling Spend description, queueing
+    /// its proof and spend authorization signature into the batch.
+    bool librustzcash_sapling_batch_check_spend(
+        void *ctx,
+        const unsigned char *cv,
+        const unsigned char *anchor,
+        const unsigned char *nullifier,
+        const unsigned char *rk,
+        const unsigned char *zkproof,
+        const unsigned char *spendAuthSig,
+        const unsigned char *sighashValue
+    );
+
+    /// Performs the cheap checks of a Sapling Output description,
+    /// queueing its proof into the batch.
+    bool librustzcash_sapling_batch_check_output(
+        void *ctx,
+        const unsigned char *cv,
+        const unsigned char *cm,
+        const unsigned char *ephemeralKey,
+        const unsigned char *zkproof
+    );
+
+    /// Closes the current transaction, queueing its binding signature
+    /// into the batch. Must be called once per transaction, after all
+    /// of its spends and outputs have been added.
+    bool librustzcash_sapling_batch_final_check(
+        void *ctx,
+        int64_t valueBalance,
+        const unsigned char *bindingSig,
+        const unsigned char *sighashValue
+    );
+
+    /// Verifies all the queued proofs and signatures, and frees the validator.
+    bool librustzcash_sapling_batch_validate(void *ctx);
+
+    /// Frees a Sapling batch validator returned from
+    /// `librustzcash_sapling_batch_validator_init` (not yet validated).
+    void librustzcash_sapling_batch_validator_free(void *);
+
     /// Compute a Sapling nullifier.
     ///
     /// The `diversifier` parameter must be 11 bytes in length.
@@ -3,8 +3,10 @@
 
 use lazy_static;
 
-use ff::{PrimeField, PrimeFieldRepr};
+use ff::{Field, PrimeField, PrimeFieldRepr};
+use group::{CurveAffine, CurveProjective};
 use pairing::bls12_381::{Bls12, Fr, FrRepr};
+use pairing::{Engine, PairingCurveAffine};
 
 use zcash_primitives::{
     constants::CRH_IVK_PERSONALIZATION,
@@ -20,7 +22,7 @@ use zcash_proofs::circuit::sprout::{self, TREE_DEPTH as SPROUT_TREE_DEPTH};
 
 use bellman::gadgets::multipack;
 use bellman::groth16::{
-    create_random_proof, verify_proof, Parameters, PreparedVerifyingKey, Proof,
+    create_random_proof, verify_proof, Parameters, PreparedVerifyingKey, Proof, VerifyingKey,
 };
 
 use blake2s_simd::Params as Blake2sParams;
@@ -51,7 +53,7 @@ use zcash_primitives::{
     merkle_tree::CommitmentTreeWitness,
     note_encryption::sapling_ka_agree,
     primitives::{Diversifier, Note, PaymentAddress, ProofGenerationKey, ViewingKey},
-    redjubjub::{self, Signature},
+    redjubjub::{self, BatchEntry, Signature},
     sapling::{merkle_hash, spend_sig},
     transaction::components::Amount,
     zip32, JUBJUB,
@@ -727,6 +729,390 @@ pub extern "system" fn librustzcash_sapling_final_check(
     )
 }
 
+/// Returns true if the point is of small order (its order divides the cofactor).
+fn is_small_order<Order>(p: &edwards::Point<Bls12, Order>) -> bool {
+    p.double(&JUBJUB).double(&JUBJUB).double(&JUBJUB) == edwards::Point::zero()
+}
+
+/// Computes the value commitment to the given value balance, with zero randomness.
+fn compute_value_balance(value: i64) -> Option<edwards::Point<Bls12, Unknown>> {
+    // Compute |value|
+    let abs = match value.checked_abs() {
+        Some(a) => a as u64,
+        None => return None,
+    };
+
+    let mut value_balance = JUBJUB
+        .generator(FixedGenerators::ValueCommitmentValue)
+        .mul(FsRepr::from(abs), &JUBJUB);
+    if value.is_negative() {
+        value_balance = value_balance.negate();
+    }
+
+    Some(value_balance.into())
+}
+
+/// Verifies a set of Groth16 proofs (all against the same verifying key) with a
+/// random linear combination: a single multi Miller loop and a single final
+/// exponentiation for the whole batch.
+fn batch_verify_groth16(vk: &VerifyingKey<Bls12>, proofs: &[(Proof<Bls12>, Vec<Fr>)]) -> bool {
+    if proofs.is_empty() {
+        return true;
+    }
+
+    let mut rng = OsRng;
+    let mut acc_ic = <Bls12 as Engine>::G1::zero();
+    let mut acc_c = <Bls12 as Engine>::G1::zero();
+    let mut r_sum = Fr::zero();
+    let mut ab = Vec::with_capacity(proofs.len());
+
+    for (proof, inputs) in proofs {
+        if inputs.len() + 1 != vk.ic.len() {
+            return false;
+        }
+        let r = Fr::random(&mut rng);
+
+        // r * (IC_0 + sum(x_j * IC_j))
+        let mut ic = vk.ic[0].into_projective();
+        for (x, base) in inputs.iter().zip(vk.ic.iter().skip(1)) {
+            ic.add_assign(&base.mul(x.into_repr()));
+        }
+        ic.mul_assign(r.into_repr());
+        acc_ic.add_assign(&ic);
+
+        // r * C
+        acc_c.add_assign(&proof.c.mul(r.into_repr()));
+
+        // e(r * A, B)
+        ab.push((
+            proof.a.mul(r.into_repr()).into_affine().prepare(),
+            proof.b.prepare(),
+        ));
+        r_sum.add_assign(&r);
+    }
+
+    let mut neg_gamma = vk.gamma_g2;
+    neg_gamma.negate();
+    let neg_gamma = neg_gamma.prepare();
+    let mut neg_delta = vk.delta_g2;
+    neg_delta.negate();
+    let neg_delta = neg_delta.prepare();
+    let acc_ic = acc_ic.into_affine().prepare();
+    let acc_c = acc_c.into_affine().prepare();
+
+    let mut terms: Vec<_> = ab.iter().map(|(a, b)| (a, b)).collect();
+    terms.push((&acc_ic, &neg_gamma));
+    terms.push((&acc_c, &neg_delta));
+
+    // prod(e(r_i * A_i, B_i)) * e(sum(r_i * IC_i), -gamma) * e(sum(r_i * C_i), -delta)
+    //   == e(alpha, beta)^sum(r_i)
+    match Bls12::final_exponentiation(&Bls12::miller_loop(terms.iter())) {
+        Some(lhs) => lhs == Bls12::pairing(vk.alpha_g1, vk.beta_g2).pow(r_sum.into_repr()),
+        None => false,
+    }
+}
+
+/// A RedJubjub signature waiting for batch verification: key, signed message, signature.
+type PendingSignature = (redjubjub::PublicKey<Bls12>, [u8; 64], Signature);
+
+/// Collects the spend/output proofs and the spend-auth/binding signatures of
+/// many Sapling transactions, to verify all of them in a single batch.
+/// The cheap checks (encodings, small order points) are performed eagerly.
+pub struct SaplingBatchValidator {
+    /// Sum of the value commitments of the transaction being added
+    cv_sum: edwards::Point<Bls12, Unknown>,
+    spend_proofs: Vec<(Proof<Bls12>, Vec<Fr>)>,
+    output_proofs: Vec<(Proof<Bls12>, Vec<Fr>)>,
+    spend_auth_sigs: Vec<PendingSignature>,
+    binding_sigs: Vec<PendingSignature>,
+}
+
+impl SaplingBatchValidator {
+    fn new() -> Self {
+        SaplingBatchValidator {
+            cv_sum: edwards::Point::zero(),
+            spend_proofs: vec![],
+            output_proofs: vec![],
+            spend_auth_sigs: vec![],
+            binding_sigs: vec![],
+        }
+    }
+
+    fn check_spend(
+        &mut self,
+        cv: edwards::Point<Bls12, Unknown>,
+        anchor: Fr,
+        nullifier: &[u8; 32],
+        rk: redjubjub::PublicKey<Bls12>,
+        sighash_value: &[u8; 32],
+        spend_auth_sig: Signature,
+        zkproof: Proof<Bls12>,
+    ) -> bool {
+        if is_small_order(&cv) || is_small_order(&rk.0) {
+            return false;
+        }
+
+        // Accumulate the value commitment
+        self.cv_sum = self.cv_sum.add(&cv, &JUBJUB);
+
+        // Queue the spend authorization signature over rk || sighash
+        let mut data_to_be_signed = [0u8; 64];
+        rk.0.write(&mut data_to_be_signed[0..32])
+            .expect("message buffer should be 32 bytes");
+        (&mut data_to_be_signed[32..64]).copy_from_slice(&sighash_value[..]);
+
+        // Construct public input for circuit
+        let mut public_input = vec![Fr::zero(); 7];
+        {
+            let (x, y) = rk.0.to_xy();
+            public_input[0] = x;
+            public_input[1] = y;
+        }
+        {
+            let (x, y) = cv.to_xy();
+            public_input[2] = x;
+            public_input[3] = y;
+        }
+        public_input[4] = anchor;
+        // Add the nullifier through multiscalar packing
+        {
+            let nullifier = multipack::bytes_to_bits_le(nullifier);
+            let nullifier = multipack::compute_multipacking::<Bls12>(&nullifier);
+            assert_eq!(nullifier.len(), 2);
+            public_input[5] = nullifier[0];
+            public_input[6] = nullifier[1];
+        }
+
+        self.spend_auth_sigs
+            .push((rk, data_to_be_signed, spend_auth_sig));
+        self.spend_proofs.push((zkproof, public_input));
+        true
+    }
+
+    fn check_output(
+        &mut self,
+        cv: edwards::Point<Bls12, Unknown>,
+        cm: Fr,
+        epk: edwards::Point<Bls12, Unknown>,
+        zkproof: Proof<Bls12>,
+    ) -> bool {
+        if is_small_order(&cv) || is_small_order(&epk) {
+            return false;
+        }
+
+        // Accumulate the value commitment (negated)
+        self.cv_sum = self.cv_sum.add(&cv.negate(), &JUBJUB);
+
+        // Construct public input for circuit
+        let mut public_input = vec![Fr::zero(); 5];
+        {
+            let (x, y) = cv.to_xy();
+            public_input[0] = x;
+            public_input[1] = y;
+        }
+        {
+            let (x, y) = epk.to_xy();
+            public_input[2] = x;
+            public_input[3] = y;
+        }
+        public_input[4] = cm;
+
+        self.output_proofs.push((zkproof, public_input));
+        true
+    }
+
+    /// Closes the transaction being added, queueing its binding signature.
+    fn final_check(
+        &mut self,
+        value_balance: i64,
+        sighash_value: &[u8; 32],
+        binding_sig: Signature,
+    ) -> bool {
+        let value_balance = match compute_value_balance(value_balance) {
+            Some(vb) => vb,
+            None => return false,
+        };
+
+        // Subtract value_balance from the current bvk to get the final bvk,
+        // and reset the accumulator for the next transaction.
+        let bvk = self.cv_sum.add(&value_balance.negate(), &JUBJUB);
+        self.cv_sum = edwards::Point::zero();
+
+        let mut data_to_be_signed = [0u8; 64];
+        bvk.write(&mut data_to_be_signed[0..32])
+            .expect("bvk is 32 bytes");
+        (&mut data_to_be_signed[32..64]).copy_from_slice(&sighash_value[..]);
+
+        self.binding_sigs
+            .push((redjubjub::PublicKey(bvk), data_to_be_signed, binding_sig));
+        true
+    }
+
+    fn batch_verify_sigs(sigs: Vec<PendingSignature>, p_g: FixedGenerators) -> bool {
+        let mut rng = OsRng;
+        let (keys_and_sigs, msgs): (Vec<_>, Vec<_>) = sigs
+            .into_iter()
+            .map(|(vk, msg, sig)| ((vk, sig), msg))
+            .unzip();
+        let batch: Vec<BatchEntry<Bls12>> = keys_and_sigs
+            .into_iter()
+            .zip(msgs.iter())
+            .map(|((vk, sig), msg)| BatchEntry {
+                vk,
+                msg: &msg[..],
+                sig,
+            })
+            .collect();
+        redjubjub::batch_verify(&mut rng, &batch[..], p_g, &JUBJUB)
+    }
+
+    /// Verifies everything that was queued, consuming the validator.
+    fn validate(self) -> bool {
+        Self::batch_verify_sigs(self.spend_auth_sigs, FixedGenerators::SpendingKeyGenerator)
+            && Self::batch_verify_sigs(
+                self.binding_sigs,
+                FixedGenerators::ValueCommitmentRandomness,
+            )
+            && batch_verify_groth16(
+                &unsafe { SAPLING_SPEND_PARAMS.as_ref() }.unwrap().vk,
+                &self.spend_proofs,
+            )
+            && batch_verify_groth16(
+                &unsafe { SAPLING_OUTPUT_PARAMS.as_ref() }.unwrap().vk,
+                &self.output_proofs,
+            )
+    }
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_validator_init() -> *mut SaplingBatchValidator {
+    let ctx = Box::new(SaplingBatchValidator::new());
+
+    Box::into_raw(ctx)
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_validator_free(ctx: *mut SaplingBatchValidator) {
+    if !ctx.is_null() {
+        drop(unsafe { Box::from_raw(ctx) });
+    }
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_check_spend(
+    ctx: *mut SaplingBatchValidator,
+    cv: *const [c_uchar; 32],
+    anchor: *const [c_uchar; 32],
+    nullifier: *const [c_uchar; 32],
+    rk: *const [c_uchar; 32],
+    zkproof: *const [c_uchar; GROTH_PROOF_SIZE],
+    spend_auth_sig: *const [c_uchar; 64],
+    sighash_value: *const [c_uchar; 32],
+) -> bool {
+    // Deserialize the value commitment
+    let cv = match edwards::Point::<Bls12, Unknown>::read(&(unsafe { &*cv })[..], &JUBJUB) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    // Deserialize the anchor, which should be an element
+    // of Fr.
+    let anchor = match Fr::from_repr(read_le(&(unsafe { &*anchor })[..])) {
+        Ok(a) => a,
+        Err(_) => return false,
+    };
+
+    // Deserialize rk
+    let rk = match redjubjub::PublicKey::<Bls12>::read(&(unsafe { &*rk })[..], &JUBJUB) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    // Deserialize the signature
+    let spend_auth_sig = match Signature::read(&(unsafe { &*spend_auth_sig })[..]) {
+        Ok(sig) => sig,
+        Err(_) => return false,
+    };
+
+    // Deserialize the proof
+    let zkproof = match Proof::<Bls12>::read(&(unsafe { &*zkproof })[..]) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    unsafe { &mut *ctx }.check_spend(
+        cv,
+        anchor,
+        unsafe { &*nullifier },
+        rk,
+        unsafe { &*sighash_value },
+        spend_auth_sig,
+        zkproof,
+    )
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_check_output(
+    ctx: *mut SaplingBatchValidator,
+    cv: *const [c_uchar; 32],
+    cm: *const [c_uchar; 32],
+    epk: *const [c_uchar; 32],
+    zkproof: *const [c_uchar; GROTH_PROOF_SIZE],
+) -> bool {
+    // Deserialize the value commitment
+    let cv = match edwards::Point::<Bls12, Unknown>::read(&(unsafe { &*cv })[..], &JUBJUB) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    // Deserialize the commitment, which should be an element
+    // of Fr.
+    let cm = match Fr::from_repr(read_le(&(unsafe { &*cm })[..])) {
+        Ok(a) => a,
+        Err(_) => return false,
+    };
+
+    // Deserialize the ephemeral key
+    let epk = match edwards::Point::<Bls12, Unknown>::read(&(unsafe { &*epk })[..], &JUBJUB) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    // Deserialize the proof
+    let zkproof = match Proof::<Bls12>::read(&(unsafe { &*zkproof })[..]) {
+        Ok(p) => p,
+        Err(_) => return false,
+    };
+
+    unsafe { &mut *ctx }.check_output(cv, cm, epk, zkproof)
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_final_check(
+    ctx: *mut SaplingBatchValidator,
+    value_balance: i64,
+    binding_sig: *const [c_uchar; 64],
+    sighash_value: *const [c_uchar; 32],
+) -> bool {
+    if Amount::from_i64(value_balance).is_err() {
+        return false;
+    }
+
+    // Deserialize the signature
+    let binding_sig = match Signature::read(&(unsafe { &*binding_sig })[..]) {
+        Ok(sig) => sig,
+        Err(_) => return false,
+    };
+
+    unsafe { &mut *ctx }.final_check(value_balance, unsafe { &*sighash_value }, binding_sig)
+}
+
+#[no_mangle]
+pub extern "system" fn librustzcash_sapling_batch_validate(ctx: *mut SaplingBatchValidator) -> bool {
+    let ctx = unsafe { Box::from_raw(ctx) };
+    ctx.validate()
+}
+
 #[no_mangle]
 pub extern "system" fn librustzcash_sprout_prove(
     proof_out: *mut [c_uchar; GROTH_PROOF_SIZE],
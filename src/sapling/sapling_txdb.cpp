@@ -4,6 +4,10 @@
 
 #include "txdb.h"
 
+#include "util/system.h"
+
+#include <boost/thread.hpp>
+
 // Db keys
 static const char DB_SAPLING_ANCHOR = 'Z';
 static const char DB_SAPLING_NULLIFIER = 'S';
@@ -87,3 +91,37 @@ bool CCoinsViewDB::BatchWriteSapling(const uint256& hashSaplingAnchor,
         batch.Write(DB_BEST_SAPLING_ANCHOR, hashSaplingAnchor);
     return true;
 }
+
+bool CCoinsViewDB::ForEachSaplingAnchor(const std::function<bool(const uint256&, const SaplingMerkleTree&)>& func, const CDBSnapshot* snapshot) const
+{
+    CDBWrapper& rawdb = const_cast<CDBWrapper&>(db);
+    std::unique_ptr<CDBIterator> pcursor(snapshot ? rawdb.NewIterator(*snapshot) : rawdb.NewIterator());
+    pcursor->Seek(std::make_pair(DB_SAPLING_ANCHOR, UINT256_ZERO));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_SAPLING_ANCHOR) break;
+        SaplingMerkleTree tree;
+        if (!pcursor->GetValue(tree)) {
+            return error("%s: unable to read anchor %s", __func__, key.second.ToString());
+        }
+        if (!func(key.second, tree)) return false;
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CCoinsViewDB::ForEachSaplingNullifier(const std::function<bool(const uint256&)>& func, const CDBSnapshot* snapshot) const
+{
+    CDBWrapper& rawdb = const_cast<CDBWrapper&>(db);
+    std::unique_ptr<CDBIterator> pcursor(snapshot ? rawdb.NewIterator(*snapshot) : rawdb.NewIterator());
+    pcursor->Seek(std::make_pair(DB_SAPLING_NULLIFIER, UINT256_ZERO));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_SAPLING_NULLIFIER) break;
+        if (!func(key.second)) return false;
+        pcursor->Next();
+    }
+    return true;
+}
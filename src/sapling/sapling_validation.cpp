@@ -10,9 +10,72 @@
 #include "consensus/validation.h" // for CValidationState
 #include "util/system.h" // for error()
 #include "consensus/upgrades.h" // for CurrentEpochBranchId()
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h" // for SignatureCacheHasher
 
 #include <librustzcash.h>
 
+#include <atomic>
+
+#include <boost/thread/shared_mutex.hpp>
+
+namespace {
+/**
+ * Valid Sapling proofs cache, to avoid verifying the (expensive) shielded proofs
+ * and signatures of a transaction twice (once when accepted into memory pool, and
+ * again when accepted into the block chain)
+ */
+class CSaplingProofCache
+{
+private:
+    //! Entries are SHA256(nonce || txid || signature hash):
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_proofcache;
+
+public:
+    CSaplingProofCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& txid, const uint256& sighash)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(txid.begin(), 32).Write(sighash.begin(), 32).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, const bool erase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_proofcache);
+        return setValid.contains(entry, erase);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_proofcache);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+};
+
+static CSaplingProofCache saplingProofCache;
+}
+
+// To be called once in AppInitMain/BasicTestingSetup to initialize the saplingProofCache.
+void InitSaplingProofCache()
+{
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsaplingproofcachesize", DEFAULT_MAX_SAPLING_PROOF_CACHE_SIZE)), MAX_MAX_SAPLING_PROOF_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = saplingProofCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for Sapling proofs cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
 namespace SaplingValidation {
 
 // Verifies that Shielded txs are properly formed and performs content-independent checks
@@ -108,6 +171,8 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
 *    nHeight can become valid at a later height), we make the bans conditional on not
 *    being in Initial Block Download mode.
 * 4. The isInitBlockDownload argument is a function parameter to assist with testing.
+* 5. ContextualCheckBlock skips the proofs verification (fCheckProofs=false), as ConnectBlock
+*    performs it in parallel through the sapling check queue (see CSaplingCheck).
 *
 */
 bool ContextualCheckTransaction(
@@ -116,7 +181,8 @@ bool ContextualCheckTransaction(
         const CChainParams& chainparams,
         const int nHeight,
         const bool isMined,
-        bool isInitBlockDownload)
+        bool isInitBlockDownload,
+        bool fCheckProofs)
 {
     const int DOS_LEVEL_BLOCK = 100;
     // DoS level set to 10 to be more forgiving.
@@ -158,72 +224,216 @@ bool ContextualCheckTransaction(
                     REJECT_INVALID, "bad-cs-has-shielded-data");
     }
 
-    if (hasShieldedData) {
-        uint256 dataToBeSigned;
-        // Empty output script.
-        CScript scriptCode;
-        try {
-            dataToBeSigned = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL, 0, SIGVERSION_SAPLING);
-        } catch (const std::logic_error& ex) {
-            // A logic error should never occur because we pass NOT_AN_INPUT and
-            // SIGHASH_ALL to SignatureHash().
-            return state.DoS(100, error("%s: error computing signature hash", __func__ ),
-                             REJECT_INVALID, "error-computing-signature-hash");
-        }
+    if (hasShieldedData && fCheckProofs) {
+        // Cache the result of the mempool checks, for the block connection
+        return CheckTransactionProofs(tx, state, dosLevelPotentiallyRelaxing, !isMined);
+    }
+    return true;
+}
 
-        // Sapling verification process
-        auto ctx = librustzcash_sapling_verification_ctx_init();
-
-        for (const SpendDescription &spend : tx.sapData->vShieldedSpend) {
-            if (!librustzcash_sapling_check_spend(
-                    ctx,
-                    spend.cv.begin(),
-                    spend.anchor.begin(),
-                    spend.nullifier.begin(),
-                    spend.rk.begin(),
-                    spend.zkproof.begin(),
-                    spend.spendAuthSig.begin(),
-                    dataToBeSigned.begin())) {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                return state.DoS(
-                        dosLevelPotentiallyRelaxing,
-                        error("%s: Sapling spend description invalid", __func__ ),
-                        REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
-            }
-        }
+static bool GetShieldedSighash(const CTransaction& tx, uint256& dataToBeSigned)
+{
+    // Empty output script.
+    CScript scriptCode;
+    try {
+        dataToBeSigned = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL, 0, SIGVERSION_SAPLING);
+    } catch (const std::logic_error& ex) {
+        // A logic error should never occur because we pass NOT_AN_INPUT and
+        // SIGHASH_ALL to SignatureHash().
+        return false;
+    }
+    return true;
+}
 
-        for (const OutputDescription &output : tx.sapData->vShieldedOutput) {
-            if (!librustzcash_sapling_check_output(
-                    ctx,
-                    output.cv.begin(),
-                    output.cmu.begin(),
-                    output.ephemeralKey.begin(),
-                    output.zkproof.begin())) {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                // This should be a non-contextual check, but we check it here
-                // as we need to pass over the outputs anyway in order to then
-                // call librustzcash_sapling_final_check().
-                return state.DoS(100, error("%s: Sapling output description invalid", __func__ ),
-                                 REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
-            }
-        }
+// Verifies the proofs and signatures of tx with a per-tx verification context (no cache)
+static bool VerifyTransactionProofs(const CTransaction& tx, const uint256& dataToBeSigned, CValidationState& state, int dosLevelPotentiallyRelaxing)
+{
+    // Sapling verification process
+    auto ctx = librustzcash_sapling_verification_ctx_init();
 
-        if (!librustzcash_sapling_final_check(
+    for (const SpendDescription &spend : tx.sapData->vShieldedSpend) {
+        if (!librustzcash_sapling_check_spend(
                 ctx,
-                tx.sapData->valueBalance,
-                tx.sapData->bindingSig.begin(),
+                spend.cv.begin(),
+                spend.anchor.begin(),
+                spend.nullifier.begin(),
+                spend.rk.begin(),
+                spend.zkproof.begin(),
+                spend.spendAuthSig.begin(),
                 dataToBeSigned.begin())) {
             librustzcash_sapling_verification_ctx_free(ctx);
             return state.DoS(
                     dosLevelPotentiallyRelaxing,
-                    error("%s: Sapling binding signature invalid", __func__ ),
-                    REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
+                    error("%s: Sapling spend description invalid", __func__ ),
+                    REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
+        }
+    }
+
+    for (const OutputDescription &output : tx.sapData->vShieldedOutput) {
+        if (!librustzcash_sapling_check_output(
+                ctx,
+                output.cv.begin(),
+                output.cmu.begin(),
+                output.ephemeralKey.begin(),
+                output.zkproof.begin())) {
+            librustzcash_sapling_verification_ctx_free(ctx);
+            // This should be a non-contextual check, but we check it here
+            // as we need to pass over the outputs anyway in order to then
+            // call librustzcash_sapling_final_check().
+            return state.DoS(100, error("%s: Sapling output description invalid", __func__ ),
+                             REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
         }
+    }
 
+    if (!librustzcash_sapling_final_check(
+            ctx,
+            tx.sapData->valueBalance,
+            tx.sapData->bindingSig.begin(),
+            dataToBeSigned.begin())) {
         librustzcash_sapling_verification_ctx_free(ctx);
+        return state.DoS(
+                dosLevelPotentiallyRelaxing,
+                error("%s: Sapling binding signature invalid", __func__ ),
+                REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
+    }
+
+    librustzcash_sapling_verification_ctx_free(ctx);
+    return true;
+}
+
+bool CheckTransactionProofs(const CTransaction& tx, CValidationState& state, int dosLevelPotentiallyRelaxing, bool cacheStore)
+{
+    assert(tx.hasSaplingData());
+
+    uint256 dataToBeSigned;
+    if (!GetShieldedSighash(tx, dataToBeSigned)) {
+        return state.DoS(100, error("%s: error computing signature hash", __func__ ),
+                         REJECT_INVALID, "error-computing-signature-hash");
+    }
+
+    uint256 entry;
+    saplingProofCache.ComputeEntry(entry, tx.GetHash(), dataToBeSigned);
+    if (saplingProofCache.Get(entry, !cacheStore)) {
+        return true;
+    }
+    if (!VerifyTransactionProofs(tx, dataToBeSigned, state, dosLevelPotentiallyRelaxing)) {
+        return false;
+    }
+    if (cacheStore) {
+        saplingProofCache.Set(entry);
     }
     return true;
 }
 
+bool HasCachedProofs(const CTransaction& tx)
+{
+    uint256 dataToBeSigned;
+    if (!tx.hasSaplingData() || !GetShieldedSighash(tx, dataToBeSigned)) {
+        return false;
+    }
+    uint256 entry;
+    saplingProofCache.ComputeEntry(entry, tx.GetHash(), dataToBeSigned);
+    return saplingProofCache.Get(entry, false);
+}
+
+// Adds the shielded data of tx to the batch validator. Returns false if the cheap checks fail.
+static bool AddToBatch(void* batch, const CTransaction& tx, const uint256& dataToBeSigned)
+{
+    for (const SpendDescription& spend : tx.sapData->vShieldedSpend) {
+        if (!librustzcash_sapling_batch_check_spend(
+                batch,
+                spend.cv.begin(),
+                spend.anchor.begin(),
+                spend.nullifier.begin(),
+                spend.rk.begin(),
+                spend.zkproof.begin(),
+                spend.spendAuthSig.begin(),
+                dataToBeSigned.begin())) {
+            return false;
+        }
+    }
+
+    for (const OutputDescription& output : tx.sapData->vShieldedOutput) {
+        if (!librustzcash_sapling_batch_check_output(
+                batch,
+                output.cv.begin(),
+                output.cmu.begin(),
+                output.ephemeralKey.begin(),
+                output.zkproof.begin())) {
+            return false;
+        }
+    }
+
+    return librustzcash_sapling_batch_final_check(
+            batch,
+            tx.sapData->valueBalance,
+            tx.sapData->bindingSig.begin(),
+            dataToBeSigned.begin());
+}
+
+bool BatchCheckTransactionsProofs(const std::vector<const CTransaction*>& vtx, CValidationState& state, bool cacheStore)
+{
+    // Skip the txs whose proofs were already verified (e.g. when accepted into the mempool)
+    std::vector<std::pair<const CTransaction*, uint256>> vToVerify;
+    std::vector<uint256> vEntries;
+    for (const CTransaction* ptx : vtx) {
+        uint256 dataToBeSigned;
+        if (!GetShieldedSighash(*ptx, dataToBeSigned)) {
+            return state.DoS(100, error("%s: error computing signature hash", __func__ ),
+                             REJECT_INVALID, "error-computing-signature-hash");
+        }
+        uint256 entry;
+        saplingProofCache.ComputeEntry(entry, ptx->GetHash(), dataToBeSigned);
+        if (saplingProofCache.Get(entry, !cacheStore)) {
+            continue;
+        }
+        vToVerify.emplace_back(ptx, dataToBeSigned);
+        vEntries.emplace_back(entry);
+    }
+
+    if (vToVerify.empty()) {
+        return true;
+    }
+
+    auto batch = librustzcash_sapling_batch_validator_init();
+    bool fAdded = true;
+    for (const auto& p : vToVerify) {
+        if (!AddToBatch(batch, *p.first, p.second)) {
+            fAdded = false;
+            break;
+        }
+    }
+
+    if (fAdded) {
+        // the batch validator is freed by librustzcash_sapling_batch_validate
+        if (librustzcash_sapling_batch_validate(batch)) {
+            if (cacheStore) {
+                for (uint256& entry : vEntries) {
+                    saplingProofCache.Set(entry);
+                }
+            }
+            return true;
+        }
+    } else {
+        librustzcash_sapling_batch_validator_free(batch);
+    }
+
+    // The batch failed: verify one tx at a time, to identify the culprit
+    for (const auto& p : vToVerify) {
+        if (!VerifyTransactionProofs(*p.first, p.second, state, 100)) {
+            return error("%s: invalid Sapling proofs in tx %s", __func__, p.first->GetHash().ToString());
+        }
+    }
+
+    // Should never happen
+    return state.DoS(100, error("%s: Sapling batch verification failed", __func__),
+                     REJECT_INVALID, "bad-txns-sapling-batch-invalid");
+}
 
 } // End SaplingValidation namespace
+
+bool CSaplingCheck::operator()()
+{
+    CValidationState state;
+    return SaplingValidation::BatchCheckTransactionsProofs(vtx, state, cacheStore);
+}
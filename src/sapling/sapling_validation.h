@@ -8,9 +8,19 @@
 
 #include "chainparams.h"
 
+#include <vector>
+
 class CTransaction;
 class CValidationState;
 
+// Limit the Sapling proofs cache to 8MB (over 250000 entries on 64-bit systems)
+static const unsigned int DEFAULT_MAX_SAPLING_PROOF_CACHE_SIZE = 8;
+// Maximum Sapling proofs cache size allowed
+static const int64_t MAX_MAX_SAPLING_PROOF_CACHE_SIZE = 4096;
+
+/** Initialize the cache of the transactions whose Sapling proofs are known to be valid */
+void InitSaplingProofCache();
+
 namespace SaplingValidation {
 
 /** Context-independent validity checks */
@@ -21,10 +31,46 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
 
 /** Check a transaction contextually against a set of consensus rules */
 // Note: if v5 upgrade wasn't enforced, this method returns true without performing any check.
+// Note2: if fCheckProofs is false, the (expensive) proofs and signatures verification is skipped,
+// and must be performed by the caller with CheckTransactionProofs.
 bool ContextualCheckTransaction(const CTransaction &tx, CValidationState &state,
                                 const CChainParams &chainparams, int nHeight, bool isMined,
-                                bool sInitBlockDownload);
+                                bool sInitBlockDownload, bool fCheckProofs = true);
+
+/** Verify the spend/output zk-proofs and the spend-auth/binding signatures of a shielded tx.
+ *  Valid txs are added to the proofs cache if cacheStore is true, otherwise cache hits are evicted. */
+bool CheckTransactionProofs(const CTransaction& tx, CValidationState& state, int dosLevelPotentiallyRelaxing, bool cacheStore = false);
+
+/** Verify the proofs and signatures of a set of shielded txs in a single batch (skipping cached txs).
+ *  If the batch fails, the txs are checked one by one, to set the culprit's rejection reason. */
+bool BatchCheckTransactionsProofs(const std::vector<const CTransaction*>& vtx, CValidationState& state, bool cacheStore = false);
+
+/** Whether the proofs of the shielded tx are in the proofs cache (i.e. the next check of the tx won't verify them) */
+bool HasCachedProofs(const CTransaction& tx);
 
 }; // End SaplingValidation namespace
 
+/**
+ * Closure representing the (batched) proofs verification of a set of shielded transactions.
+ * Note that this stores references to the transactions.
+ */
+class CSaplingCheck
+{
+private:
+    std::vector<const CTransaction*> vtx;
+    bool cacheStore;
+
+public:
+    CSaplingCheck() : cacheStore(false) {}
+    CSaplingCheck(std::vector<const CTransaction*>&& vtxIn, bool cacheIn) : vtx(std::move(vtxIn)), cacheStore(cacheIn) {}
+
+    bool operator()();
+
+    void swap(CSaplingCheck& check)
+    {
+        vtx.swap(check.vtx);
+        std::swap(cacheStore, check.cacheStore);
+    }
+};
+
 #endif //PIVX_SAPLING_VALIDATION_H
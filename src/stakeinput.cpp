@@ -5,7 +5,10 @@
 #include "stakeinput.h"
 
 #include "chain.h"
+#include "consensus/consensus.h"
+#include "index/txindex.h"
 #include "txdb.h"
+#include "undo.h"
 #include "validation.h"
 
 static bool HasStakeMinAgeOrDepth(int nHeight, uint32_t nTime, const CBlockIndex* pindex)
@@ -19,12 +22,56 @@ static bool HasStakeMinAgeOrDepth(int nHeight, uint32_t nTime, const CBlockIndex
     return true;
 }
 
-CPivStake* CPivStake::NewPivStake(const CTxIn& txin, int nHeight, uint32_t nTime)
+/*
+ * Find a coin spent on the active chain after its split with the fork ending at pindexPrev, from
+ * the undo data of the spending block. A fork can't spend a coin that was spent on the active
+ * chain before the split, so only the blocks above the fork point are scanned (nothing, for a
+ * block extending the tip), and no more than -maxreorg of them: these blocks are never pruned.
+ * This covers the stake inputs of the fork blocks when the transactions can't be looked up
+ * (no -txindex, e.g. in prune mode).
+ */
+static bool FindRecentlySpentCoin(const COutPoint& prevout, const CBlockIndex* pindexPrev, Coin& coinRet)
+{
+    LOCK(cs_main);
+    const int nMaxDepth = gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH);
+    const CBlockIndex* pindexFork = chainActive.FindFork(pindexPrev);
+    const CBlockIndex* pindex = chainActive.Tip();
+    for (int nDepth = 0; nDepth < nMaxDepth && pindex && pindex != pindexFork && pindex->pprev; nDepth++, pindex = pindex->pprev) {
+        CBlock block;
+        CBlockUndo blockUndo;
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !ReadBlockFromDisk(block, pindex) ||
+                !UndoReadFromDisk(blockUndo, pindex)) {
+            return error("%s : failed to read block %s", __func__, pindex->GetBlockHash().GetHex());
+        }
+        if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s : inconsistent undo data for block %s", __func__, pindex->GetBlockHash().GetHex());
+        }
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            // zerocoin spends don't have regular inputs, nor undo data
+            if (tx.HasZerocoinSpendInputs()) continue;
+            const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size()) {
+                return error("%s : inconsistent undo data for tx %s", __func__, tx.GetHash().GetHex());
+            }
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                if (tx.vin[j].prevout == prevout) {
+                    coinRet = txundo.vprevout[j];
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+CPivStake* CPivStake::NewPivStake(const CTxIn& txin, const CBlockIndex* pindexPrev, uint32_t nTime)
 {
     if (txin.IsZerocoinSpend()) {
         error("%s: unable to initialize CPivStake from zerocoin spend", __func__);
         return nullptr;
     }
+    const int nHeight = pindexPrev->nHeight + 1;
 
     // Look for the stake input in the coins cache first
     const Coin& coin = pcoinsTip->AccessCoin(txin.prevout);
@@ -42,6 +89,15 @@ CPivStake* CPivStake::NewPivStake(const CTxIn& txin, int nHeight, uint32_t nTime
     uint256 hashBlock;
     CTransactionRef txPrev;
     if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true)) {
+        // Without the tx index, look for the coin spent on the active chain after the split
+        Coin spentCoin;
+        if (!g_txindex && FindRecentlySpentCoin(txin.prevout, pindexPrev, spentCoin)) {
+            const CBlockIndex* pindexFrom = WITH_LOCK(cs_main, return chainActive[spentCoin.nHeight]; );
+            if (!pindexFrom || !HasStakeMinAgeOrDepth(nHeight, nTime, pindexFrom)) {
+                return nullptr;
+            }
+            return new CPivStake(spentCoin.out, txin.prevout, pindexFrom);
+        }
         error("%s : INFO: read txPrev failed, tx id prev: %s", __func__, txin.prevout.hash.GetHex());
         return nullptr;
     }
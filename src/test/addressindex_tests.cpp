@@ -0,0 +1,154 @@
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "index/addressindex.h"
+#include "index/spentindex.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+static void WaitForSync(BaseIndex& index)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+}
+
+static CAmount GetBalance(const AddressIndex& index, const uint160& script_hash)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+    BOOST_CHECK(index.GetAddressIndex(script_hash, entries));
+    CAmount balance = 0;
+    for (const auto& entry : entries) balance += entry.second;
+    return balance;
+}
+
+BOOST_FIXTURE_TEST_CASE(addressindex_initial_sync, TestChain100Setup)
+{
+    AddressIndex address_index(1 << 20, true);
+    SpentIndex spent_index(1 << 20, true);
+
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const uint160 coinbase_hash = GetScriptHashForIndex(coinbase_script);
+
+    // Nothing is found before the indexes are started.
+    std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> unspent;
+    BOOST_CHECK(address_index.GetAddressIndex(coinbase_hash, entries));
+    BOOST_CHECK(entries.empty());
+    BOOST_CHECK(!address_index.BlockUntilSyncedToCurrentChain());
+
+    address_index.Start();
+    spent_index.Start();
+    WaitForSync(address_index);
+    WaitForSync(spent_index);
+
+    // Every coinbase output paying to the key shows up, in height order.
+    CAmount coinbase_total = 0;
+    size_t coinbase_outputs = 0;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex = chainActive[1]; pindex; pindex = chainActive.Next(pindex)) {
+            CBlock block;
+            BOOST_REQUIRE(ReadBlockFromDisk(block, pindex));
+            for (const CTxOut& out : block.vtx[0]->vout) {
+                if (out.scriptPubKey != coinbase_script) continue;
+                coinbase_total += out.nValue;
+                coinbase_outputs++;
+            }
+        }
+    }
+    BOOST_CHECK(coinbase_outputs >= coinbaseTxns.size());
+    BOOST_CHECK(address_index.GetAddressIndex(coinbase_hash, entries));
+    BOOST_CHECK_EQUAL(entries.size(), coinbase_outputs);
+    for (size_t i = 1; i < entries.size(); i++) {
+        BOOST_CHECK(entries[i - 1].first.height <= entries[i].first.height);
+        BOOST_CHECK(!entries[i].first.spending);
+    }
+    BOOST_CHECK(address_index.GetAddressUnspent(coinbase_hash, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), coinbase_outputs);
+    BOOST_CHECK_EQUAL(GetBalance(address_index, coinbase_hash), coinbase_total);
+
+    // Height ranges are inclusive.
+    entries.clear();
+    BOOST_CHECK(address_index.GetAddressIndex(coinbase_hash, entries, 10, 19));
+    BOOST_CHECK(!entries.empty());
+    for (const auto& entry : entries) {
+        BOOST_CHECK(entry.first.height >= 10 && entry.first.height <= 19);
+    }
+
+    // Spend a mature coinbase to a fresh key.
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript dest_script = GetScriptForDestination(key.GetPubKey().GetID());
+    const uint160 dest_hash = GetScriptHashForIndex(dest_script);
+    const CTransaction& coinbase_tx = coinbaseTxns[0];
+    const CAmount spent_value = coinbase_tx.vout[0].nValue;
+    const CAmount sent_value = spent_value - 10 * CENT;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbase_tx.GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = sent_value;
+    spend.vout[0].scriptPubKey = dest_script;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, spent_value, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, CScript() << OP_TRUE);
+    BOOST_REQUIRE(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash(); ) == block.GetHash());
+    const int spend_height = WITH_LOCK(cs_main, return chainActive.Height(); );
+    WaitForSync(address_index);
+    WaitForSync(spent_index);
+
+    // The receiving script has one unspent output...
+    BOOST_CHECK(address_index.GetAddressUnspent(dest_hash, unspent));
+    BOOST_REQUIRE_EQUAL(unspent.size(), 1U);
+    BOOST_CHECK(unspent[0].first.txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(unspent[0].second.value, sent_value);
+    BOOST_CHECK_EQUAL(unspent[0].second.height, spend_height);
+    BOOST_CHECK(unspent[0].second.script == dest_script);
+    BOOST_CHECK_EQUAL(GetBalance(address_index, dest_hash), sent_value);
+
+    // ...the coinbase script lost one, with a spending entry in its history...
+    BOOST_CHECK(address_index.GetAddressUnspent(coinbase_hash, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), coinbase_outputs - 1);
+    BOOST_CHECK_EQUAL(GetBalance(address_index, coinbase_hash), coinbase_total - spent_value);
+    BOOST_CHECK(address_index.GetAddressIndex(coinbase_hash, entries, spend_height, spend_height));
+    BOOST_REQUIRE_EQUAL(entries.size(), 1U);
+    BOOST_CHECK(entries[0].first.spending);
+    BOOST_CHECK(entries[0].first.txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(entries[0].second, -spent_value);
+
+    // ...and the spent index points at the spending input.
+    CSpentIndexValue spent_info;
+    BOOST_CHECK(spent_index.GetSpentInfo(spend.vin[0].prevout, spent_info));
+    BOOST_CHECK(spent_info.txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(spent_info.input_index, 0U);
+    BOOST_CHECK_EQUAL(spent_info.height, spend_height);
+    BOOST_CHECK_EQUAL(spent_info.value, spent_value);
+    BOOST_CHECK(spent_info.script_hash == coinbase_hash);
+    BOOST_CHECK(!spent_index.GetSpentInfo(COutPoint(spend.GetHash(), 0), spent_info));
+
+    address_index.Interrupt();
+    address_index.Stop();
+    spent_index.Interrupt();
+    spent_index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
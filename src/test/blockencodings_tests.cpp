@@ -0,0 +1,156 @@
+// Copyright (c) 2011-2016 The Bitcoin Core developers
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "consensus/merkle.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+#include "test/test_pivx.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, BasicTestingSetup)
+
+static CMutableTransaction BuildTx(const uint256& prevHash, uint32_t n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vin[0].prevout = COutPoint(prevHash, n);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+    return tx;
+}
+
+static CBlock BuildBlockTestCase(bool fProofOfStake)
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+    block.vtx.emplace_back(MakeTransactionRef(tx));
+
+    if (fProofOfStake) {
+        // coinstake: non-null prevout, first output empty
+        CMutableTransaction stake = BuildTx(InsecureRand256(), 0);
+        stake.vout.resize(2);
+        stake.vout[0].SetEmpty();
+        stake.vout[1].nValue = 42;
+        block.vtx.emplace_back(MakeTransactionRef(stake));
+        block.vchBlockSig = std::vector<unsigned char>(72, 0x42);
+    }
+
+    block.nVersion = 42;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff;
+
+    const CMutableTransaction tx1 = BuildTx(InsecureRand256(), 0);
+    const CMutableTransaction tx2 = BuildTx(tx1.GetHash(), 0);
+    const CMutableTransaction tx3 = BuildTx(tx2.GetHash(), 0);
+    block.vtx.emplace_back(MakeTransactionRef(tx1));
+    block.vtx.emplace_back(MakeTransactionRef(tx2));
+    block.vtx.emplace_back(MakeTransactionRef(tx3));
+
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+    return block;
+}
+
+static void CheckReconstruction(bool fProofOfStake)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase(fProofOfStake));
+    const size_t nPrefilled = fProofOfStake ? 2 : 1;
+
+    // Only the second regular transaction of the block is in the mempool
+    pool.addUnchecked(block.vtx[nPrefilled + 1]->GetHash(), entry.FromTx(*block.vtx[nPrefilled + 1]));
+
+    // Do a simple ShortTxIDs RT
+    {
+        CBlockHeaderAndShortTxIDs shortIDs(block);
+
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << shortIDs;
+
+        CBlockHeaderAndShortTxIDs shortIDs2;
+        stream >> shortIDs2;
+        BOOST_CHECK_EQUAL(shortIDs2.BlockTxCount(), block.vtx.size());
+        BOOST_CHECK(shortIDs2.vchBlockSig == block.vchBlockSig);
+
+        PartiallyDownloadedBlock partialBlock(&pool);
+        BOOST_CHECK(partialBlock.InitData(shortIDs2) == READ_STATUS_OK);
+        // Coinbase (and coinstake) are prefilled, the mempool provides one more
+        for (size_t i = 0; i < nPrefilled; i++) {
+            BOOST_CHECK(partialBlock.IsTxAvailable(i));
+        }
+        BOOST_CHECK(!partialBlock.IsTxAvailable(nPrefilled));
+        BOOST_CHECK(partialBlock.IsTxAvailable(nPrefilled + 1));
+        BOOST_CHECK(!partialBlock.IsTxAvailable(nPrefilled + 2));
+
+        // Wrong transaction: the merkle root does not match
+        {
+            PartiallyDownloadedBlock partialBlockCopy = partialBlock;
+            CBlock block2;
+            BOOST_CHECK(partialBlockCopy.FillBlock(block2, {block.vtx[nPrefilled + 2], block.vtx[nPrefilled]}) == READ_STATUS_FAILED);
+        }
+
+        // Wrong number of transactions
+        {
+            PartiallyDownloadedBlock partialBlockCopy = partialBlock;
+            CBlock block2;
+            BOOST_CHECK(partialBlockCopy.FillBlock(block2, {block.vtx[nPrefilled]}) == READ_STATUS_INVALID);
+        }
+
+        CBlock block3;
+        BOOST_CHECK(partialBlock.FillBlock(block3, {block.vtx[nPrefilled], block.vtx[nPrefilled + 2]}) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(block.GetHash().ToString(), block3.GetHash().ToString());
+        BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(), BlockMerkleRoot(block3).ToString());
+        BOOST_CHECK(block3.vchBlockSig == block.vchBlockSig);
+        BOOST_CHECK_EQUAL(block3.IsProofOfStake(), fProofOfStake);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(simple_roundtrip_test)
+{
+    CheckReconstruction(false);
+}
+
+BOOST_AUTO_TEST_CASE(proof_of_stake_roundtrip_test)
+{
+    CheckReconstruction(true);
+}
+
+BOOST_AUTO_TEST_CASE(empty_block_test)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlockHeaderAndShortTxIDs emptyIDs;
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(emptyIDs) == READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest)
+{
+    BlockTransactionsRequest req1;
+    req1.blockhash = InsecureRand256();
+    req1.indexes = {0, 1, 3, 4};
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req1;
+
+    BlockTransactionsRequest req2;
+    stream >> req2;
+
+    BOOST_CHECK_EQUAL(req1.blockhash.ToString(), req2.blockhash.ToString());
+    BOOST_CHECK(req1.indexes == req2.indexes);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,221 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "blockfilter.h"
+#include "index/blockfilterindex.h"
+#include "script/standard.h"
+#include "undo.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilter_index_tests)
+
+static bool ComputeFilter(BlockFilterType filter_type, const CBlockIndex* block_index,
+                          BlockFilter& filter)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, block_index)) {
+        return false;
+    }
+
+    CBlockUndo block_undo;
+    if (block_index->nHeight > 0 && !UndoReadFromDisk(block_undo, block_index)) {
+        return false;
+    }
+
+    filter = BlockFilter(filter_type, block, block_undo);
+    return true;
+}
+
+static bool CheckFilterLookups(BlockFilterIndex& filter_index, const CBlockIndex* block_index,
+                               uint256& last_header)
+{
+    BlockFilter expected_filter;
+    if (!ComputeFilter(filter_index.GetFilterType(), block_index, expected_filter)) {
+        BOOST_ERROR("ComputeFilter failed on block " << block_index->nHeight);
+        return false;
+    }
+
+    BlockFilter filter;
+    uint256 filter_header;
+    std::vector<BlockFilter> filters;
+    std::vector<uint256> filter_hashes;
+
+    BOOST_CHECK(filter_index.LookupFilter(block_index, filter));
+    BOOST_CHECK(filter_index.LookupFilterHeader(block_index, filter_header));
+    BOOST_CHECK(filter_index.LookupFilterRange(block_index->nHeight, block_index, filters));
+    BOOST_CHECK(filter_index.LookupFilterHashRange(block_index->nHeight, block_index,
+                                                   filter_hashes));
+
+    BOOST_CHECK_EQUAL(filters.size(), 1U);
+    BOOST_CHECK_EQUAL(filter_hashes.size(), 1U);
+
+    BOOST_CHECK(filter.GetHash() == expected_filter.GetHash());
+    BOOST_CHECK(filter_header == expected_filter.ComputeHeader(last_header));
+    BOOST_CHECK(filters[0].GetHash() == expected_filter.GetHash());
+    BOOST_CHECK(filter_hashes[0] == expected_filter.GetHash());
+
+    last_header = filter_header;
+    return true;
+}
+
+static void WaitForSync(BlockFilterIndex& filter_index)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!filter_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilter_index_initial_sync, TestChain100Setup)
+{
+    BlockFilterIndex filter_index(BlockFilterType::BASIC_FILTER, 1 << 20, true);
+
+    uint256 last_header;
+
+    // Filter should not be found in the index before it is started.
+    {
+        LOCK(cs_main);
+
+        BlockFilter filter;
+        uint256 filter_header;
+        std::vector<BlockFilter> filters;
+        std::vector<uint256> filter_hashes;
+
+        for (const CBlockIndex* block_index = chainActive.Genesis();
+             block_index != nullptr;
+             block_index = chainActive.Next(block_index)) {
+            BOOST_CHECK(!filter_index.LookupFilter(block_index, filter));
+            BOOST_CHECK(!filter_index.LookupFilterHeader(block_index, filter_header));
+            BOOST_CHECK(!filter_index.LookupFilterRange(block_index->nHeight, block_index, filters));
+            BOOST_CHECK(!filter_index.LookupFilterHashRange(block_index->nHeight, block_index,
+                                                            filter_hashes));
+        }
+    }
+
+    // BlockUntilSyncedToCurrentChain should return false before index is started.
+    BOOST_CHECK(!filter_index.BlockUntilSyncedToCurrentChain());
+
+    filter_index.Start();
+
+    // Allow filter index to catch up with the block index.
+    WaitForSync(filter_index);
+
+    // Check that filter index has all blocks that were in the chain before it started.
+    {
+        LOCK(cs_main);
+        const CBlockIndex* block_index;
+        for (block_index = chainActive.Genesis();
+             block_index != nullptr;
+             block_index = chainActive.Next(block_index)) {
+            CheckFilterLookups(filter_index, block_index, last_header);
+        }
+    }
+
+    // Range lookups return one entry per block, in height order.
+    {
+        LOCK(cs_main);
+        const CBlockIndex* tip = chainActive.Tip();
+        std::vector<BlockFilter> filters;
+        std::vector<uint256> filter_hashes;
+        BOOST_CHECK(filter_index.LookupFilterRange(1, tip, filters));
+        BOOST_CHECK(filter_index.LookupFilterHashRange(1, tip, filter_hashes));
+        BOOST_CHECK_EQUAL(filters.size(), (size_t)tip->nHeight);
+        BOOST_CHECK_EQUAL(filter_hashes.size(), (size_t)tip->nHeight);
+        BOOST_CHECK(filters.back().GetBlockHash() == tip->GetBlockHash());
+        BOOST_CHECK(filter_hashes.front() == filters.front().GetHash());
+
+        // Invalid ranges are rejected.
+        BOOST_CHECK(!filter_index.LookupFilterRange(-1, tip, filters));
+        BOOST_CHECK(!filter_index.LookupFilterRange(tip->nHeight + 1, tip, filters));
+    }
+
+    // Create two forks from the current tip and switch between them.
+    const CBlockIndex* fork_point = WITH_LOCK(cs_main, return chainActive.Tip(); );
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(true);
+    CScript script_pub_key1 = GetScriptForDestination(key1.GetPubKey().GetID());
+    CScript script_pub_key2 = GetScriptForDestination(key2.GetPubKey().GetID());
+
+    auto build_fork = [&](const CScript& script, size_t len) {
+        std::vector<const CBlockIndex*> chain;
+        CBlockIndex* prev = const_cast<CBlockIndex*>(fork_point);
+        for (size_t i = 0; i < len; i++) {
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(
+                    CreateBlock({}, script, true, false, true, prev));
+            BOOST_REQUIRE(ProcessNewBlock(pblock, nullptr));
+            prev = WITH_LOCK(cs_main, return LookupBlockIndex(pblock->GetHash()); );
+            BOOST_REQUIRE(prev);
+            chain.push_back(prev);
+        }
+        WaitForSync(filter_index);
+        return chain;
+    };
+
+    // chainB is one block longer than chainA, so connecting it reorgs chainA out.
+    std::vector<const CBlockIndex*> chainA = build_fork(script_pub_key1, 5);
+    BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip(); ) == chainA.back());
+    std::vector<const CBlockIndex*> chainB = build_fork(script_pub_key2, 6);
+    BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip(); ) == chainB.back());
+
+    // Filters for both forks can be looked up: chainB through the height index,
+    // and the disconnected chainA through the hash index.
+    for (const auto& chain : {chainA, chainB}) {
+        uint256 chain_last_header;
+        BOOST_CHECK(filter_index.LookupFilterHeader(fork_point, chain_last_header));
+        for (const CBlockIndex* block_index : chain) {
+            CheckFilterLookups(filter_index, block_index, chain_last_header);
+        }
+    }
+
+    filter_index.Interrupt();
+    filter_index.Stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilter_index_init_destroy, BasicTestingSetup)
+{
+    BlockFilterIndex* filter_index;
+
+    filter_index = GetBlockFilterIndex(BlockFilterType::BASIC_FILTER);
+    BOOST_CHECK(filter_index == nullptr);
+
+    BOOST_CHECK(InitBlockFilterIndex(BlockFilterType::BASIC_FILTER, 1 << 20, true, false));
+
+    filter_index = GetBlockFilterIndex(BlockFilterType::BASIC_FILTER);
+    BOOST_CHECK(filter_index != nullptr);
+    BOOST_CHECK(filter_index->GetFilterType() == BlockFilterType::BASIC_FILTER);
+
+    // Initialize returns false if index already exists.
+    BOOST_CHECK(!InitBlockFilterIndex(BlockFilterType::BASIC_FILTER, 1 << 20, true, false));
+
+    int iter_count = 0;
+    ForEachBlockFilterIndex([&iter_count](BlockFilterIndex& _index) { iter_count++; });
+    BOOST_CHECK_EQUAL(iter_count, 1);
+
+    BOOST_CHECK(DestroyBlockFilterIndex(BlockFilterType::BASIC_FILTER));
+
+    // Destroy returns false because index was already destroyed.
+    BOOST_CHECK(!DestroyBlockFilterIndex(BlockFilterType::BASIC_FILTER));
+
+    filter_index = GetBlockFilterIndex(BlockFilterType::BASIC_FILTER);
+    BOOST_CHECK(filter_index == nullptr);
+
+    // Reinitialize index.
+    BOOST_CHECK(InitBlockFilterIndex(BlockFilterType::BASIC_FILTER, 1 << 20, true, false));
+
+    DestroyAllBlockFilterIndexes();
+
+    filter_index = GetBlockFilterIndex(BlockFilterType::BASIC_FILTER);
+    BOOST_CHECK(filter_index == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -11,6 +11,8 @@
 #include "undo.h"
 #include "utilstrencodings.h"
 #include "random.h"
+#include "txdb.h"
+#include "validation.h"
 
 #include "sapling/incrementalmerkletree.h"
 
@@ -198,12 +200,16 @@ public:
         // Manually recompute the dynamic usage of the whole data, and compare it.
         size_t ret = memusage::DynamicUsage(cacheCoins) +
                      memusage::DynamicUsage(cacheSaplingAnchors) +
-                     memusage::DynamicUsage(cacheSaplingNullifiers);
+                     memusage::DynamicUsage(cacheSaplingNullifiers) +
+                     dirtyQueue.size() * sizeof(COutPoint);
         size_t count = 0;
         for (const auto& entry : cacheCoins) {
             ret += memusage::DynamicUsage(entry.second.coin);
             ++count;
         }
+        for (const auto& entry : cacheSaplingAnchors) {
+            ret += entry.second.tree.DynamicMemoryUsage();
+        }
         BOOST_CHECK_EQUAL(GetCacheSize(), count);
         BOOST_CHECK_EQUAL(memusage::DynamicUsage(*this), ret);
     }
@@ -1056,10 +1062,13 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
 
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map{0, CCoinsMap::hasher{}, CCoinsMap::key_equal{}, &resource};
     InsertCoinsMapEntry(map, value, flags);
-    CAnchorsSaplingMap mapSaplingAnchors;
-    CNullifiersMap mapSaplingNullifiers;
+    CAnchorsSaplingMapMemoryResource anchors_resource{SAPLING_CACHE_CHUNK_BYTES};
+    CAnchorsSaplingMap mapSaplingAnchors{0, CAnchorsSaplingMap::hasher{}, CAnchorsSaplingMap::key_equal{}, &anchors_resource};
+    CNullifiersMapMemoryResource nullifiers_resource{SAPLING_CACHE_CHUNK_BYTES};
+    CNullifiersMap mapSaplingNullifiers{0, CNullifiersMap::hasher{}, CNullifiersMap::key_equal{}, &nullifiers_resource};
     view.BatchWrite(map, {}, {}, mapSaplingAnchors, mapSaplingNullifiers);
 }
 
@@ -1235,6 +1244,146 @@ BOOST_AUTO_TEST_CASE(ccoins_add)
     CheckAddCoin(VALUE2, VALUE3, FAIL,   DIRTY|FRESH, NO_ENTRY    );
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_add_fetched)
+{
+    // A coin read ahead of time (see PrefetchInputs) is cached as FetchCoin
+    // would have: neither dirty nor fresh.
+    CCoinsView root;
+    CCoinsViewCacheTest cache(&root);
+    Coin coin;
+    coin.out.nValue = VALUE1;
+    cache.AddFetchedCoin(OUTPOINT, std::move(coin));
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, VALUE1);
+    BOOST_CHECK_EQUAL(result_flags, 0);
+    cache.SelfTest();
+
+    // It doesn't replace an entry that is already in the cache
+    Coin other;
+    other.out.nValue = VALUE2;
+    cache.AddFetchedCoin(OUTPOINT, std::move(other));
+    GetCoinsMapEntry(cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, VALUE1);
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_write_oldest_dirty)
+{
+    CCoinsViewDB base(1 << 20, true);
+    CCoinsViewCacheTest cache(&base);
+    cache.SetTrackDirty(true);
+    // The partial writes are completed by the flush of a descendant block
+    // (its ancestry is checked by the caller, see FlushStateToDisk)
+    const uint256 block1 = InsecureRand256();
+    const uint256 block2 = InsecureRand256();
+    cache.SetBestBlock(block1);
+
+    std::vector<COutPoint> outpoints;
+    for (uint32_t i = 0; i < 10; i++) {
+        Coin coin;
+        coin.out.nValue = VALUE1 + i;
+        coin.out.scriptPubKey = CScript() << OP_TRUE;
+        coin.nHeight = 1;
+        outpoints.emplace_back(InsecureRand256(), i);
+        cache.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    BOOST_CHECK_EQUAL(cache.GetDirtyQueueSize(), 10U);
+    cache.SelfTest();
+
+    // The oldest changes are written, and the entries stay cached, clean
+    BOOST_CHECK(cache.WriteOldestDirty(4));
+    BOOST_CHECK_EQUAL(cache.GetDirtyQueueSize(), 6U);
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        BOOST_CHECK_EQUAL(base.HaveCoin(outpoints[i]), i < 4);
+        BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+        BOOST_CHECK_EQUAL((int)cache.map().at(outpoints[i]).flags, i < 4 ? 0 : CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH);
+    }
+    cache.SelfTest();
+
+    // The database is inconsistent until the next flush
+    BOOST_CHECK(base.GetBestBlock().IsNull());
+    std::vector<uint256> heads = base.GetHeadBlocks();
+    BOOST_CHECK_EQUAL(heads.size(), 2U);
+    BOOST_CHECK(heads[0] == block1);
+    BOOST_CHECK(heads[1].IsNull());
+
+    // Spending a written coin makes it dirty again, and its removal is written
+    cache.SpendCoin(outpoints[0]);
+    BOOST_CHECK_EQUAL(cache.GetDirtyQueueSize(), 7U);
+    BOOST_CHECK(cache.WriteOldestDirty(100));
+    BOOST_CHECK_EQUAL(cache.GetDirtyQueueSize(), 0U);
+    BOOST_CHECK(!base.HaveCoin(outpoints[0]));
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoints[0]));
+    for (size_t i = 1; i < outpoints.size(); i++) {
+        BOOST_CHECK(base.HaveCoin(outpoints[i]));
+    }
+
+    // Only the clean entries can be evicted, and they are read back from the base
+    const COutPoint outpoint_new(InsecureRand256(), 0);
+    Coin coin_new;
+    coin_new.out.nValue = VALUE2;
+    coin_new.out.scriptPubKey = CScript() << OP_TRUE;
+    cache.AddCoin(outpoint_new, std::move(coin_new), false);
+    BOOST_CHECK_EQUAL(cache.UncacheClean(0), 9U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint_new));
+    BOOST_CHECK_EQUAL(cache.AccessCoin(outpoints[5]).out.nValue, VALUE1 + 5);
+    cache.SelfTest();
+
+    // The flush makes the database consistent again
+    cache.SetBestBlock(block2);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(base.GetBestBlock() == block2);
+    BOOST_CHECK(base.GetHeadBlocks().empty());
+    BOOST_CHECK(base.HaveCoin(outpoint_new));
+    BOOST_CHECK_EQUAL(cache.GetDirtyQueueSize(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_write_oldest_dirty_sapling)
+{
+    CCoinsViewDB base(1 << 20, true);
+    CCoinsViewCacheTest cache(&base);
+    cache.SetTrackDirty(true);
+    cache.SetBestBlock(InsecureRand256());
+
+    // An anchor and a nullifier in the cache
+    SaplingMerkleTree tree;
+    for (int i = 0; i < 5; i++) {
+        tree.append(GetRandHash());
+    }
+    cache.PushAnchor(tree);
+    TxWithNullifiers txWithNullifiers;
+    cache.SetNullifiers(*txWithNullifiers.tx, true);
+    const size_t nUsage = cache.usage();
+    BOOST_CHECK(nUsage > 0);
+    cache.SelfTest();
+
+    // The Sapling changes are written with the coins, and stay cached: the usage is unchanged
+    BOOST_CHECK(cache.WriteOldestDirty(10));
+    BOOST_CHECK_EQUAL(cache.usage(), nUsage);
+    cache.SelfTest();
+    SaplingMerkleTree treeRead;
+    BOOST_CHECK(base.GetSaplingAnchorAt(tree.root(), treeRead));
+    BOOST_CHECK(treeRead.root() == tree.root());
+    BOOST_CHECK(base.GetBestAnchor() == tree.root());
+    BOOST_CHECK(base.GetNullifier(txWithNullifiers.saplingNullifier));
+    BOOST_CHECK(GetAnchorAt(cache, tree.root(), treeRead));
+    checkNullifierCache(cache, txWithNullifiers, true);
+
+    // Nothing left to write: the next partial write keeps them
+    BOOST_CHECK(cache.WriteOldestDirty(10));
+    BOOST_CHECK_EQUAL(cache.usage(), nUsage);
+    BOOST_CHECK(base.GetSaplingAnchorAt(tree.root(), treeRead));
+
+    // The flush releases them
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.usage(), 0U);
+    BOOST_CHECK(base.GetSaplingAnchorAt(tree.root(), treeRead));
+    BOOST_CHECK(base.GetNullifier(txWithNullifiers.saplingNullifier));
+}
+
 void CheckWriteCoins(CAmount parent_value, CAmount child_value, CAmount expected_value, char parent_flags, char child_flags, char expected_flags)
 {
     SingleEntryCacheTest test(ABSENT, parent_value, parent_flags);
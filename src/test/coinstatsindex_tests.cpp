@@ -0,0 +1,115 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "coins.h"
+#include "index/coinstatsindex.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+static void WaitForSync(BaseIndex& index)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+}
+
+// The statistics of the UTXO set at the chain tip, from a scan of the coins database
+static CCoinStatsIndexValue ScanUTXOSet()
+{
+    FlushStateToDisk();
+    CCoinStatsIndexValue stats;
+    MuHash3072 muhash;
+    std::unique_ptr<CCoinsViewCursor> pcursor(WITH_LOCK(cs_main, return pcoinsdbview->Cursor(); ));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        ApplyCoinHash(muhash, key, coin);
+        stats.transaction_output_count++;
+        stats.bogo_size += GetBogoSize(coin.out.scriptPubKey);
+        stats.total_amount += coin.out.nValue;
+    }
+    muhash.Finalize(stats.muhash);
+    return stats;
+}
+
+static void CheckStats(const CCoinStatsIndexValue& stats, const CCoinStatsIndexValue& expected)
+{
+    BOOST_CHECK(stats.muhash == expected.muhash);
+    BOOST_CHECK_EQUAL(stats.transaction_output_count, expected.transaction_output_count);
+    BOOST_CHECK_EQUAL(stats.bogo_size, expected.bogo_size);
+    BOOST_CHECK_EQUAL(stats.total_amount, expected.total_amount);
+}
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup)
+{
+    CoinStatsIndex coin_stats_index(1 << 20, true);
+
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return chainActive.Tip(); );
+    CCoinStatsIndexValue stats;
+
+    // Nothing is found before the index is started.
+    BOOST_CHECK(!coin_stats_index.LookUpStats(tip, stats));
+    BOOST_CHECK(!coin_stats_index.BlockUntilSyncedToCurrentChain());
+
+    coin_stats_index.Start();
+    WaitForSync(coin_stats_index);
+
+    // The UTXO set of the genesis block is empty.
+    const CBlockIndex* genesis = WITH_LOCK(cs_main, return chainActive.Genesis(); );
+    BOOST_CHECK(coin_stats_index.LookUpStats(genesis, stats));
+    CCoinStatsIndexValue empty_stats;
+    MuHash3072().Finalize(empty_stats.muhash);
+    CheckStats(stats, empty_stats);
+
+    // The statistics of the tip match the ones of the coins database.
+    const CCoinStatsIndexValue tip_stats = ScanUTXOSet();
+    BOOST_CHECK(coin_stats_index.LookUpStats(tip, stats));
+    CheckStats(stats, tip_stats);
+
+    // Spend a mature coinbase in a new block.
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - 10 * CENT;
+    spend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, coinbaseTxns[0].vout[0].nValue, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    CreateAndProcessBlock({spend}, CScript() << OP_TRUE);
+    const CBlockIndex* new_tip = WITH_LOCK(cs_main, return chainActive.Tip(); );
+    BOOST_REQUIRE(new_tip->pprev == tip);
+    WaitForSync(coin_stats_index);
+
+    BOOST_CHECK(coin_stats_index.LookUpStats(new_tip, stats));
+    CheckStats(stats, ScanUTXOSet());
+
+    // The statistics of the previous block are still there.
+    BOOST_CHECK(coin_stats_index.LookUpStats(tip, stats));
+    CheckStats(stats, tip_stats);
+
+    coin_stats_index.Interrupt();
+    coin_stats_index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "consensus/params.h"
 #include "evo/specialtx_validation.h"
 #include "evo/deterministicmns.h"
+#include "index/txindex.h"
 #include "llmq/quorums_blockprocessor.h"
 #include "llmq/quorums_commitment.h"
 #include "llmq/quorums_utils.h"
@@ -94,6 +95,7 @@ static void SignTransaction(CMutableTransaction& tx, const CKey& coinbaseKey)
 {
     CBasicKeyStore tempKeystore;
     tempKeystore.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    g_txindex->BlockUntilSyncedToCurrentChain();
 
     for (size_t i = 0; i < tx.vin.size(); i++) {
         CTransactionRef txFrom;
@@ -283,6 +285,7 @@ static CMutableTransaction MalleateProUpRevTx(const CMutableTransaction& tx)
 
 static bool CheckTransactionSignature(const CMutableTransaction& tx)
 {
+    g_txindex->BlockUntilSyncedToCurrentChain();
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
         const auto& txin = tx.vin[i];
         CTransactionRef txFrom;
@@ -101,6 +101,71 @@ BOOST_AUTO_TEST_CASE(SaplingToSapling)
     BOOST_CHECK_EQUAL(state.GetRejectReason(), "");
 }
 
+BOOST_AUTO_TEST_CASE(DeferredProofsCheck)
+{
+    auto consensusParams = Params().GetConsensus();
+
+    CBasicKeyStore keystore;
+    CKey tsk = AddTestCKeyToKeyStore(keystore);
+    auto scriptPubKey = GetScriptForDestination(tsk.GetPubKey().GetID());
+    auto sk = libzcash::SaplingSpendingKey::random();
+    auto fvk = sk.full_viewing_key();
+    auto pa = sk.default_address();
+
+    auto builder = TransactionBuilder(consensusParams, &keystore);
+    builder.AddTransparentInput(COutPoint(uint256S("1234"), 0), scriptPubKey, 50000000);
+    builder.AddSaplingOutput(fvk.ovk, pa, 40000000, {});
+    builder.SetFee(10000000);
+    auto tx = builder.Build().GetTxOrThrow();
+    BOOST_CHECK(CSaplingCheck({&tx}, false)());
+
+    // Corrupt the output proof
+    CMutableTransaction mtx(tx);
+    mtx.sapData->vShieldedOutput[0].zkproof[0] ^= 0x01;
+    CTransaction badTx(mtx);
+
+    // The contextual checks pass when the proofs verification is deferred...
+    CValidationState state;
+    BOOST_CHECK(SaplingValidation::ContextualCheckTransaction(badTx, state, Params(), 2, true, false, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "");
+
+    // ...but the proofs check fails
+    BOOST_CHECK(!CSaplingCheck({&badTx}, false)());
+    BOOST_CHECK(!SaplingValidation::ContextualCheckTransaction(badTx, state, Params(), 2, true, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-sapling-output-description-invalid");
+
+    // Batch verification: the culprit is identified when the batch fails
+    CValidationState batchState;
+    BOOST_CHECK(SaplingValidation::BatchCheckTransactionsProofs({&tx, &tx}, batchState));
+    BOOST_CHECK(!CSaplingCheck({&tx, &badTx}, false)());
+    BOOST_CHECK(!SaplingValidation::BatchCheckTransactionsProofs({&tx, &badTx}, batchState));
+    BOOST_CHECK_EQUAL(batchState.GetRejectReason(), "bad-txns-sapling-output-description-invalid");
+
+    // Proofs cache: only valid txs are stored, and the later checks are served from the cache
+    CValidationState cacheState;
+    BOOST_CHECK(!SaplingValidation::HasCachedProofs(tx));
+    BOOST_CHECK(SaplingValidation::CheckTransactionProofs(tx, cacheState, 100, true));
+    BOOST_CHECK(SaplingValidation::HasCachedProofs(tx));
+    BOOST_CHECK(SaplingValidation::CheckTransactionProofs(tx, cacheState, 100, true));
+    BOOST_CHECK(SaplingValidation::HasCachedProofs(tx));
+    BOOST_CHECK(SaplingValidation::BatchCheckTransactionsProofs({&tx}, cacheState, false));
+    BOOST_CHECK(!SaplingValidation::CheckTransactionProofs(badTx, cacheState, 100, true));
+    BOOST_CHECK(!SaplingValidation::HasCachedProofs(badTx));
+    // The batch fails on the invalid tx, which is not stored
+    BOOST_CHECK(!SaplingValidation::BatchCheckTransactionsProofs({&tx, &badTx}, cacheState, true));
+    BOOST_CHECK(SaplingValidation::HasCachedProofs(tx));
+    BOOST_CHECK(!SaplingValidation::HasCachedProofs(badTx));
+    // The batch stores the valid txs
+    auto builder2 = TransactionBuilder(consensusParams, &keystore);
+    builder2.AddTransparentInput(COutPoint(uint256S("5678"), 0), scriptPubKey, 50000000);
+    builder2.AddSaplingOutput(fvk.ovk, pa, 40000000, {});
+    builder2.SetFee(10000000);
+    auto tx2 = builder2.Build().GetTxOrThrow();
+    BOOST_CHECK(!SaplingValidation::HasCachedProofs(tx2));
+    BOOST_CHECK(SaplingValidation::BatchCheckTransactionsProofs({&tx, &tx2}, cacheState, true));
+    BOOST_CHECK(SaplingValidation::HasCachedProofs(tx2));
+}
+
 BOOST_AUTO_TEST_CASE(ThrowsOnTransparentInputWithoutKeyStore)
 {
     auto builder = TransactionBuilder(Params().GetConsensus());
@@ -19,6 +19,10 @@
 #include <ios>
 #include <string>
 
+#ifndef WIN32
+#include <sys/socket.h>
+#endif
+
 #include <boost/test/unit_test.hpp>
 
 class CAddrManSerializationMock : public CAddrMan
@@ -79,6 +83,29 @@ CDataStream AddrmanToStream(CAddrManSerializationMock& addrman)
     return CDataStream(vchData, SER_DISK, CLIENT_VERSION);
 }
 
+#ifdef USE_EPOLL
+struct CConnmanTest {
+    static void AddNode(CConnman& connman, CNode* pnode)
+    {
+        LOCK(connman.cs_vNodes);
+        connman.vNodes.push_back(pnode);
+        connman.RegisterSocketEvents(pnode);
+    }
+    static void RemoveNode(CConnman& connman, CNode* pnode)
+    {
+        LOCK(connman.cs_vNodes);
+        connman.UnregisterSocketEvents(pnode);
+        connman.vNodes.erase(std::find(connman.vNodes.begin(), connman.vNodes.end(), pnode));
+    }
+    static void SocketEvents(CConnman& connman)
+    {
+        std::set<SOCKET> recv_set, send_set, error_set;
+        connman.SocketEvents(recv_set, send_set, error_set);
+    }
+    static void SocketHandler(CConnman& connman) { connman.SocketHandler(); }
+};
+#endif
+
 BOOST_FIXTURE_TEST_SUITE(net_tests, BasicTestingSetup)
 
 BOOST_AUTO_TEST_CASE(cnode_listen_port)
@@ -193,6 +220,177 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnetmessage_buffer_reuse)
+{
+    // A message with 1000 bytes of payload
+    std::vector<unsigned char> payload(1000, 0x42);
+    CMessageHeader hdr(Params().MessageStart(), NetMsgType::PING, payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream msg(SER_NETWORK, INIT_PROTO_VERSION);
+    msg << hdr;
+    msg.write((const char*)payload.data(), payload.size());
+
+    CNetMessageBufferPool& pool = CNetMessageBufferPool::Instance();
+    for (int i = 0; i < 2; i++) {
+        const CNetMessageBufferPool::Stats before = pool.GetStats();
+        CNetMessageBufferPool::Stats during;
+        {
+            // The header is received in two parts
+            CNetMessage netmsg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+            BOOST_CHECK_EQUAL(netmsg.readHeader(msg.data(), 10), 10);
+            BOOST_CHECK(!netmsg.in_data);
+            BOOST_CHECK_EQUAL(netmsg.readHeader(msg.data() + 10, msg.size() - 10), (int)CMessageHeader::HEADER_SIZE - 10);
+            BOOST_CHECK(netmsg.in_data);
+            BOOST_CHECK_EQUAL(netmsg.hdr.GetCommand(), NetMsgType::PING);
+            BOOST_CHECK_EQUAL(netmsg.readData(msg.data() + CMessageHeader::HEADER_SIZE, payload.size()), (int)payload.size());
+            BOOST_CHECK(netmsg.complete());
+            BOOST_CHECK(std::equal(netmsg.vRecv.begin(), netmsg.vRecv.end(), (const char*)payload.data()));
+            BOOST_CHECK(netmsg.GetMessageHash() == hash);
+            during = pool.GetStats();
+            BOOST_CHECK_EQUAL(during.reused + during.allocated, before.reused + before.allocated + 1);
+        }
+        // The buffer goes back to the cache, and the second message reuses it
+        const CNetMessageBufferPool::Stats after = pool.GetStats();
+        BOOST_CHECK_EQUAL(after.cached, during.cached + 1);
+        BOOST_CHECK(after.cached_bytes >= during.cached_bytes + payload.size());
+        if (i == 1) BOOST_CHECK_EQUAL(during.reused, before.reused + 1);
+    }
+}
+
+#ifdef USE_EPOLL
+BOOST_AUTO_TEST_CASE(epoll_socket_events)
+{
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    CConnman connman(0x1337, 0x1337);
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = htonl(INADDR_LOOPBACK);
+    CAddress addr(CService(ipv4Addr, 8333), NODE_NONE);
+    // The node owns (and closes) fds[0]
+    std::unique_ptr<CNode> pnode = std::make_unique<CNode>(0, NODE_NETWORK, 0, fds[0], addr, 0, 0, std::string{}, false);
+
+    // Register: a new socket is reported writable only
+    CConnmanTest::AddNode(connman, pnode.get());
+    CConnmanTest::SocketEvents(connman);
+    BOOST_CHECK(pnode->fCanSendData);
+    BOOST_CHECK(!pnode->fHasRecvData);
+
+    // Ready: partial message bytes (less than a header) are reported, and buffered by the node
+    const std::vector<unsigned char> data(CMessageHeader::HEADER_SIZE / 2, 0xaa);
+    BOOST_REQUIRE(send(fds[1], data.data(), data.size(), 0) == (ssize_t)data.size());
+    CConnmanTest::SocketEvents(connman);
+    BOOST_CHECK(pnode->fHasRecvData);
+
+    // Drain: the short read clears the flag, without disconnecting the node
+    CConnmanTest::SocketHandler(connman);
+    BOOST_CHECK(!pnode->fHasRecvData);
+    BOOST_CHECK_EQUAL(pnode->nRecvBytes, data.size());
+    BOOST_CHECK(!pnode->fDisconnect);
+
+    // No new event until more data arrives
+    CConnmanTest::SocketEvents(connman);
+    BOOST_CHECK(!pnode->fHasRecvData);
+
+    // Re-arm: new data is reported again, and drained
+    BOOST_REQUIRE(send(fds[1], data.data(), 1, 0) == 1);
+    CConnmanTest::SocketEvents(connman);
+    BOOST_CHECK(pnode->fHasRecvData);
+    CConnmanTest::SocketHandler(connman);
+    BOOST_CHECK(!pnode->fHasRecvData);
+    BOOST_CHECK_EQUAL(pnode->nRecvBytes, data.size() + 1);
+
+    // A stale flag is cleared by the recv that would block
+    pnode->fHasRecvData = true;
+    CConnmanTest::SocketHandler(connman);
+    BOOST_CHECK(!pnode->fHasRecvData);
+    BOOST_CHECK(!pnode->fDisconnect);
+
+    CConnmanTest::RemoveNode(connman, pnode.get());
+    close(fds[1]);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(pop_sent_data)
+{
+    std::deque<std::vector<unsigned char>> vSendMsg;
+    vSendMsg.emplace_back(10);
+    vSendMsg.emplace_back(20);
+    vSendMsg.emplace_back(30);
+    size_t nSendOffset = 0;
+
+    // Ending mid-buffer
+    BOOST_CHECK_EQUAL(PopSentData(vSendMsg, nSendOffset, 5), 0U);
+    BOOST_CHECK_EQUAL(vSendMsg.size(), 3U);
+    BOOST_CHECK_EQUAL(nSendOffset, 5U);
+
+    // Across a buffer, ending mid-buffer
+    BOOST_CHECK_EQUAL(PopSentData(vSendMsg, nSendOffset, 15), 10U);
+    BOOST_CHECK_EQUAL(vSendMsg.size(), 2U);
+    BOOST_CHECK_EQUAL(nSendOffset, 10U);
+
+    // Ending exactly on a buffer boundary
+    BOOST_CHECK_EQUAL(PopSentData(vSendMsg, nSendOffset, 10), 20U);
+    BOOST_CHECK_EQUAL(vSendMsg.size(), 1U);
+    BOOST_CHECK_EQUAL(nSendOffset, 0U);
+
+    // Nothing sent
+    BOOST_CHECK_EQUAL(PopSentData(vSendMsg, nSendOffset, 0), 0U);
+    BOOST_CHECK_EQUAL(vSendMsg.size(), 1U);
+    BOOST_CHECK_EQUAL(nSendOffset, 0U);
+
+    // Everything sent
+    BOOST_CHECK_EQUAL(PopSentData(vSendMsg, nSendOffset, 30), 30U);
+    BOOST_CHECK(vSendMsg.empty());
+    BOOST_CHECK_EQUAL(nSendOffset, 0U);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(send_queued_data_iovecs)
+{
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    // More buffers than a single sendmsg call gathers, the first one partially sent already
+    const size_t nBufSize = 100;
+    const size_t nSendOffset = 30;
+    std::deque<std::vector<unsigned char>> vSendMsg;
+    for (size_t i = 0; i < MAX_SEND_IOVECS + 10; i++) {
+        vSendMsg.emplace_back(nBufSize, (unsigned char)i);
+    }
+
+    size_t nQueued = 0;
+    const int nBytes = SendQueuedData(fds[0], vSendMsg, nSendOffset, nQueued);
+    BOOST_CHECK_EQUAL(nQueued, MAX_SEND_IOVECS * nBufSize - nSendOffset);
+    BOOST_REQUIRE_EQUAL(nBytes, (int)nQueued);
+
+    // The data is received in order
+    std::vector<unsigned char> received(nBytes);
+    size_t nReceived = 0;
+    while (nReceived < received.size()) {
+        ssize_t n = recv(fds[1], received.data() + nReceived, received.size() - nReceived, 0);
+        BOOST_REQUIRE(n > 0);
+        nReceived += n;
+    }
+    std::vector<unsigned char> expected;
+    for (size_t i = 0; i < MAX_SEND_IOVECS; i++) {
+        expected.insert(expected.end(), vSendMsg[i].begin() + (i == 0 ? nSendOffset : 0), vSendMsg[i].end());
+    }
+    BOOST_CHECK(received == expected);
+
+    // The sent buffers are dropped, and the next call sends the rest
+    size_t nOffset = nSendOffset;
+    BOOST_CHECK_EQUAL(PopSentData(vSendMsg, nOffset, nBytes), MAX_SEND_IOVECS * nBufSize);
+    BOOST_CHECK_EQUAL(vSendMsg.size(), 10U);
+    BOOST_CHECK_EQUAL(nOffset, 0U);
+    BOOST_CHECK_EQUAL(SendQueuedData(fds[0], vSendMsg, nOffset, nQueued), (int)(10 * nBufSize));
+    BOOST_CHECK_EQUAL(nQueued, 10 * nBufSize);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+#endif
+
 BOOST_AUTO_TEST_CASE(cnetaddr_basic)
 {
     CNetAddr addr;
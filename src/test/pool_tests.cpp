@@ -0,0 +1,132 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "memusage.h"
+#include "support/allocators/pool.h"
+#include "test/test_pivx.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(basic_allocate_deallocate)
+{
+    // Blocks up to 64 bytes come from the chunks, by steps of 8 bytes
+    PoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024U);
+
+    // The first chunk is allocated on first use
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+    BOOST_CHECK_EQUAL(resource.NumUnusedBytes(), 0U);
+    void* p1 = resource.Allocate(8, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL(resource.NumUnusedBytes(), 1016U);
+
+    // A freed block is reused for the next allocation of the same size class
+    resource.Deallocate(p1, 8, 8);
+    BOOST_CHECK_EQUAL(resource.NumUnusedBytes(), 1024U);
+    void* p2 = resource.Allocate(8, 8);
+    BOOST_CHECK(p1 == p2);
+    BOOST_CHECK_EQUAL(resource.NumUnusedBytes(), 1016U);
+
+    // Sizes are rounded up to the alignment: 12 and 16 bytes share a free list
+    void* p3 = resource.Allocate(12, 4);
+    resource.Deallocate(p3, 12, 4);
+    void* p4 = resource.Allocate(16, 8);
+    BOOST_CHECK(p3 == p4);
+    resource.Deallocate(p4, 16, 8);
+    resource.Deallocate(p2, 8, 8);
+
+    // Large blocks fall back to operator new, and don't use the chunks
+    void* p5 = resource.Allocate(65, 8);
+    BOOST_CHECK(p5 != nullptr);
+    resource.Deallocate(p5, 65, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // Exhausting the chunk allocates a new one
+    std::vector<void*> blocks;
+    for (int i = 0; i < 1024 / 64 + 1; i++) {
+        blocks.push_back(resource.Allocate(64, 8));
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    for (void* p : blocks) {
+        resource.Deallocate(p, 64, 8);
+    }
+    // The freed blocks stay in the resource
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(unordered_map_with_pool_allocator)
+{
+    typedef std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                               PoolAllocator<std::pair<const uint64_t, uint64_t>, 64>> PooledMap;
+    PooledMap::allocator_type::ResourceType resource(4096);
+    {
+        PooledMap map{0, PooledMap::hasher{}, PooledMap::key_equal{}, &resource};
+        for (uint64_t i = 0; i < 1000; i++) {
+            map[i] = i * 2;
+        }
+        for (uint64_t i = 0; i < 1000; i++) {
+            BOOST_CHECK_EQUAL(map.at(i), i * 2);
+        }
+        const size_t nChunks = resource.NumAllocatedChunks();
+        BOOST_CHECK(nChunks > 1);
+
+        // The memory usage accounts the chunks of the resource
+        BOOST_CHECK(memusage::DynamicUsage(map) >= nChunks * resource.ChunkSizeBytes());
+
+        // Erasing and inserting again reuses the freed nodes
+        for (uint64_t i = 0; i < 500; i++) {
+            map.erase(i);
+        }
+        for (uint64_t i = 1000; i < 1500; i++) {
+            map[i] = i;
+        }
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+    }
+}
+
+namespace {
+
+class PooledCoinsViewCache : public CCoinsViewCache
+{
+public:
+    explicit PooledCoinsViewCache(CCoinsView* base) : CCoinsViewCache(base) {}
+    size_t ChunksOfCoinsMap() const { return m_cache_coins_memory_resource.NumAllocatedChunks(); }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(coins_cache_flush_releases_memory)
+{
+    CCoinsView base;
+    PooledCoinsViewCache cache(&base);
+    const size_t nUsageEmpty = cache.DynamicMemoryUsage();
+    // An unused cache doesn't hold any chunk
+    BOOST_CHECK_EQUAL(cache.ChunksOfCoinsMap(), 0U);
+
+    for (uint32_t i = 0; i < 20000; i++) {
+        Coin coin;
+        coin.out.nValue = 1;
+        coin.out.scriptPubKey = CScript() << OP_TRUE;
+        cache.AddCoin(COutPoint(UINT256_ZERO, i), std::move(coin), false);
+    }
+    BOOST_CHECK(cache.ChunksOfCoinsMap() > 1);
+    BOOST_CHECK(cache.DynamicMemoryUsage() > nUsageEmpty);
+
+    // The base view can't be written to, but the cache is emptied anyway, and
+    // gives its memory back
+    cache.Flush();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(cache.ChunksOfCoinsMap(), 0U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), nUsageEmpty);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
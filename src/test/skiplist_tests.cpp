@@ -144,4 +144,71 @@ BOOST_AUTO_TEST_CASE(findearliestatleast_test)
         BOOST_CHECK(vBlocksMain[r].GetAncestor(ret->nHeight) == ret);
     }
 }
+BOOST_AUTO_TEST_CASE(blockindex_arena_test)
+{
+    // Entries keep their address across chunk allocations
+    CBlockIndexArena arena;
+    std::vector<CBlockIndex*> vIndex;
+    for (int i = 0; i < 10000; i++) {
+        CBlockIndex* pindex = arena.Emplace();
+        pindex->nHeight = i;
+        pindex->pprev = (i == 0) ? nullptr : vIndex.back();
+        pindex->BuildSkip();
+        vIndex.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(arena.Size(), vIndex.size());
+    for (int i = 0; i < 1000; i++) {
+        int from = InsecureRandRange(vIndex.size());
+        int to = InsecureRandRange(from + 1);
+        BOOST_CHECK(vIndex[from]->GetAncestor(to) == vIndex[to]);
+    }
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(blockindex_cold_fields_test)
+{
+    CBlockIndex index;
+    BOOST_CHECK(index.GetAccumulatorCheckpoint().IsNull());
+    BOOST_CHECK_EQUAL(index.GetSaplingValue(), 0);
+
+    const uint256 checkpoint = InsecureRand256();
+    index.nVersion = 4;
+    index.SetAccumulatorCheckpoint(checkpoint);
+    index.SetStakeModifier(InsecureRand256());
+    BOOST_CHECK(index.GetAccumulatorCheckpoint() == checkpoint);
+
+    // Copies don't share the cold fields
+    CBlockIndex copy(index);
+    copy.SetAccumulatorCheckpoint(UINT256_ZERO);
+    BOOST_CHECK(copy.GetAccumulatorCheckpoint().IsNull());
+    BOOST_CHECK(index.GetAccumulatorCheckpoint() == checkpoint);
+
+    // Released cold fields go back to the pool, and are handed out again reset
+    CBlockIndex moved(std::move(copy));
+    copy = CBlockIndex();
+    moved = CBlockIndex();
+    BOOST_CHECK(moved.GetAccumulatorCheckpoint().IsNull());
+    CBlockIndex other;
+    other.SetSaplingValue(COIN);
+    BOOST_CHECK(other.GetAccumulatorCheckpoint().IsNull());
+    BOOST_CHECK_EQUAL(other.GetSaplingValue(), COIN);
+    BOOST_CHECK(index.GetAccumulatorCheckpoint() == checkpoint);
+
+    // The disk format is unchanged: the cold fields and the stake modifier round-trip
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    BOOST_CHECK(diskindex.GetAccumulatorCheckpoint() == checkpoint);
+    BOOST_CHECK(diskindex.vStakeModifier == index.vStakeModifier);
+    BOOST_CHECK_EQUAL(diskindex.vStakeModifier.size(), 32U);
+
+    index.nVersion = 8;
+    index.SetSaplingValue(-5 * COIN);
+    ss << CDiskBlockIndex(&index);
+    ss >> diskindex;
+    BOOST_CHECK_EQUAL(diskindex.GetSaplingValue(), -5 * COIN);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
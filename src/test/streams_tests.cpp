@@ -191,6 +191,13 @@ BOOST_AUTO_TEST_CASE(streams_buffered_file)
     // by the rewind window (relative to our farthest read position, 40).
     BOOST_CHECK(bf.GetPos() <= 30);
 
+    // Seeking the file goes back anywhere, and clears the EOF indicator.
+    BOOST_CHECK(bf.Seek(5));
+    BOOST_CHECK(!bf.eof());
+    bf >> i;
+    BOOST_CHECK_EQUAL(i, 5);
+    BOOST_CHECK_EQUAL(bf.GetPos(), 6);
+
     // We can explicitly close the file, or the destructor will do it.
     bf.fclose();
 
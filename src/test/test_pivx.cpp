@@ -9,17 +9,20 @@
 
 #include "blockassembler.h"
 #include "consensus/merkle.h"
+#include "crypto/sha256.h"
 #include "bls/bls_wrapper.h"
 #include "guiinterface.h"
 #include "evo/deterministicmns.h"
 #include "evo/evodb.h"
 #include "evo/evonotificationinterface.h"
+#include "index/txindex.h"
 #include "llmq/quorums_init.h"
 #include "miner.h"
 #include "net_processing.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
 #include "pow.h"
+#include "sapling/sapling_validation.h"
 #include "script/sigcache.h"
 #include "sporkdb.h"
 #include "streams.h"
@@ -67,10 +70,12 @@ std::ostream& operator<<(std::ostream& os, const uint256& num)
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     : m_path_root{fs::temp_directory_path() / "test_pivx" / std::to_string(g_insecure_rand_ctx_temp_path.rand32())}
 {
+    SHA256AutoDetect();
     ECC_Start();
     BLSInit();
     SetupEnvironment();
     InitSignatureCache();
+    InitSaplingProofCache();
     fCheckBlockIndex = true;
     SelectParams(chainName);
     SeedInsecureRand();
@@ -132,9 +137,19 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
             bool ok = ActivateBestChain(state);
             BOOST_CHECK(ok);
         }
+        if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+            g_txindex = std::make_unique<TxIndex>(1 << 20, true);
+            g_txindex->Start();
+            // Only the genesis block to index: from here on it is written when the blocks are connected
+            while (!g_txindex->BlockUntilSyncedToCurrentChain()) MilliSleep(10);
+        }
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
+        for (int i=0; i < nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadSaplingCheck);
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+            threadGroup.create_thread(&ThreadZerocoinCheck);
+        }
         peerLogic.reset(new PeerLogicValidation(connman));
 }
 
@@ -144,6 +159,10 @@ TestingSetup::~TestingSetup()
         threadGroup.interrupt_all();
         threadGroup.join_all();
         GetMainSignals().FlushBackgroundCallbacks();
+        if (g_txindex) {
+            g_txindex->Stop();
+            g_txindex.reset();
+        }
         UnregisterAllValidationInterfaces();
         GetMainSignals().UnregisterBackgroundSignalScheduler();
         g_connman.reset();
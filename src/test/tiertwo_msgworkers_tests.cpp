@@ -0,0 +1,228 @@
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "net_processing.h"
+#include "protocol.h"
+
+#include <boost/test/unit_test.hpp>
+
+static const std::chrono::seconds WAIT_TIMEOUT{10};
+
+/** Records the messages processed by the workers, and can hold a worker up on a given message */
+class MessageRecorder
+{
+public:
+    std::vector<std::pair<NodeId, int>> vProcessed;
+
+    CTierTwoMessageWorkers::ProcessFunc Func()
+    {
+        return [this](CNode* pfrom, std::string& strCommand, CDataStream& vRecv) {
+            int n;
+            vRecv >> n;
+            std::unique_lock<std::mutex> lock(mutex);
+            vProcessed.emplace_back(pfrom->GetId(), n);
+            if (n == nBlockOn) {
+                fBlocked = true;
+                cond.notify_all();
+                cond.wait(lock, [&]{ return nBlockOn != n; });
+                fBlocked = false;
+            }
+            cond.notify_all();
+            return true;
+        };
+    }
+
+    void BlockOn(int n) { std::lock_guard<std::mutex> lock(mutex); nBlockOn = n; }
+    void Release() { std::lock_guard<std::mutex> lock(mutex); nBlockOn = -1; cond.notify_all(); }
+    bool WaitBlocked()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cond.wait_for(lock, WAIT_TIMEOUT, [&]{ return fBlocked; });
+    }
+    bool WaitProcessed(size_t n)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cond.wait_for(lock, WAIT_TIMEOUT, [&]{ return vProcessed.size() >= n; });
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    int nBlockOn{-1};
+    bool fBlocked{false};
+};
+
+static CDataStream MakeMsgData(int n)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << n;
+    return ss;
+}
+
+static const size_t MSG_SIZE = sizeof(int) + CMessageHeader::HEADER_SIZE;
+
+static bool Push(CTierTwoMessageWorkers& workers, CNode& node, int n)
+{
+    CDataStream vRecv = MakeMsgData(n);
+    return workers.Push(&node, NetMsgType::SPORK, vRecv);
+}
+
+/** The queue size is released by the workers after processing the message */
+static bool WaitQueueEmpty(const CNode& node)
+{
+    for (int i = 0; i < 1000 && node.nTierTwoQueueSize > 0; i++) {
+        UninterruptibleSleep(std::chrono::milliseconds{10});
+    }
+    return node.nTierTwoQueueSize == 0;
+}
+
+struct TierTwoWorkersSetup : public TestingSetup
+{
+    CNode node0{0, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(), 0, 0, "", true};
+    CNode node1{1, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(), 1, 1, "", true};
+
+    TierTwoWorkersSetup()
+    {
+        peerLogic->InitializeNode(&node0);
+        peerLogic->InitializeNode(&node1);
+    }
+    ~TierTwoWorkersSetup()
+    {
+        bool fUpdateConnectionTime = false;
+        peerLogic->FinalizeNode(node0.GetId(), fUpdateConnectionTime);
+        peerLogic->FinalizeNode(node1.GetId(), fUpdateConnectionTime);
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(tiertwo_msgworkers_tests, TierTwoWorkersSetup)
+
+BOOST_AUTO_TEST_CASE(worker_messages)
+{
+    BOOST_CHECK(CTierTwoMessageWorkers::IsWorkerMessage(NetMsgType::SPORK));
+    BOOST_CHECK(CTierTwoMessageWorkers::IsWorkerMessage(NetMsgType::MNPING));
+    BOOST_CHECK(CTierTwoMessageWorkers::IsWorkerMessage(NetMsgType::QCONTRIB));
+    // Not tier two
+    BOOST_CHECK(!CTierTwoMessageWorkers::IsWorkerMessage(NetMsgType::PING));
+    BOOST_CHECK(!CTierTwoMessageWorkers::IsWorkerMessage(NetMsgType::BLOCK));
+    // Kept on the message handler thread
+    BOOST_CHECK(!CTierTwoMessageWorkers::IsWorkerMessage(NetMsgType::MNAUTH));
+    BOOST_CHECK(!CTierTwoMessageWorkers::IsWorkerMessage(NetMsgType::SYNCSTATUSCOUNT));
+}
+
+BOOST_AUTO_TEST_CASE(per_peer_gate)
+{
+    const size_t nFloodSize = 1000;
+
+    // Nothing queued: any message can be taken
+    for (const char* cmd : {NetMsgType::SPORK, NetMsgType::PING, NetMsgType::MNAUTH}) {
+        BOOST_CHECK(CTierTwoMessageWorkers::CanTakeMessage(&node0, cmd, nFloodSize));
+    }
+
+    // Tier two messages queued: only more of them, until the flood size
+    node0.nTierTwoQueueSize = nFloodSize - 1;
+    BOOST_CHECK(CTierTwoMessageWorkers::CanTakeMessage(&node0, NetMsgType::SPORK, nFloodSize));
+    BOOST_CHECK(!CTierTwoMessageWorkers::CanTakeMessage(&node0, NetMsgType::PING, nFloodSize));
+    BOOST_CHECK(!CTierTwoMessageWorkers::CanTakeMessage(&node0, NetMsgType::MNAUTH, nFloodSize));
+    BOOST_CHECK(!CTierTwoMessageWorkers::CanTakeMessage(&node0, NetMsgType::SYNCSTATUSCOUNT, nFloodSize));
+    node0.nTierTwoQueueSize = nFloodSize;
+    BOOST_CHECK(!CTierTwoMessageWorkers::CanTakeMessage(&node0, NetMsgType::SPORK, nFloodSize));
+
+    // The gate is per peer
+    BOOST_CHECK(CTierTwoMessageWorkers::CanTakeMessage(&node1, NetMsgType::PING, nFloodSize));
+    node0.nTierTwoQueueSize = 0;
+}
+
+BOOST_AUTO_TEST_CASE(ordering)
+{
+    MessageRecorder recorder;
+    CTierTwoMessageWorkers workers(connman, 2, recorder.Func());
+
+    const int nMessages = 100;
+    for (int i = 0; i < nMessages; i++) {
+        BOOST_CHECK(Push(workers, node0, i));
+        BOOST_CHECK(Push(workers, node1, i));
+    }
+    BOOST_REQUIRE(recorder.WaitProcessed(2 * nMessages));
+    BOOST_CHECK(WaitQueueEmpty(node0));
+    BOOST_CHECK(WaitQueueEmpty(node1));
+
+    // The messages of each peer are processed in the order in which they were pushed
+    std::vector<int> vProcessed0, vProcessed1;
+    for (const auto& p : recorder.vProcessed) {
+        (p.first == node0.GetId() ? vProcessed0 : vProcessed1).push_back(p.second);
+    }
+    BOOST_REQUIRE_EQUAL(vProcessed0.size(), (size_t)nMessages);
+    BOOST_REQUIRE_EQUAL(vProcessed1.size(), (size_t)nMessages);
+    for (int i = 0; i < nMessages; i++) {
+        BOOST_CHECK_EQUAL(vProcessed0[i], i);
+        BOOST_CHECK_EQUAL(vProcessed1[i], i);
+    }
+
+    // The references on the nodes are released
+    workers.Stop();
+    BOOST_CHECK_EQUAL(node0.GetRefCount(), 0);
+    BOOST_CHECK_EQUAL(node1.GetRefCount(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(flood_size_bound)
+{
+    MessageRecorder recorder;
+    CTierTwoMessageWorkers workers(connman, 2, recorder.Func());
+    const size_t nFloodSize = 10 * MSG_SIZE;
+
+    // Hold the worker up, and queue messages until the gate closes
+    recorder.BlockOn(0);
+    BOOST_CHECK(Push(workers, node0, 0));
+    BOOST_REQUIRE(recorder.WaitBlocked());
+    int nPushed = 1;
+    while (CTierTwoMessageWorkers::CanTakeMessage(&node0, NetMsgType::SPORK, nFloodSize)) {
+        BOOST_REQUIRE(nPushed < 100);
+        BOOST_CHECK(Push(workers, node0, nPushed++));
+    }
+    BOOST_CHECK_EQUAL(nPushed, 10);
+    BOOST_CHECK_EQUAL(node0.nTierTwoQueueSize, nFloodSize);
+
+    // The other peer is not held up by it
+    BOOST_CHECK(CTierTwoMessageWorkers::CanTakeMessage(&node1, NetMsgType::PING, nFloodSize));
+
+    // Once processed, the gate opens again
+    recorder.Release();
+    BOOST_REQUIRE(recorder.WaitProcessed(nPushed));
+    BOOST_CHECK(WaitQueueEmpty(node0));
+    BOOST_CHECK(CTierTwoMessageWorkers::CanTakeMessage(&node0, NetMsgType::PING, nFloodSize));
+}
+
+BOOST_AUTO_TEST_CASE(stop_drains_queue)
+{
+    MessageRecorder recorder;
+    CTierTwoMessageWorkers workers(connman, 2, recorder.Func());
+
+    // Hold the worker up on the first message, with more queued behind it
+    recorder.BlockOn(0);
+    BOOST_CHECK(Push(workers, node0, 0));
+    BOOST_REQUIRE(recorder.WaitBlocked());
+    for (int i = 1; i < 4; i++) {
+        BOOST_CHECK(Push(workers, node0, i));
+    }
+    BOOST_CHECK_EQUAL(node0.nTierTwoQueueSize, 4 * MSG_SIZE);
+
+    // Stop while the worker is busy: pushes fail once it is stopping
+    std::thread stopper([&workers]{ workers.Stop(); });
+    for (int i = 0; i < 1000 && Push(workers, node0, 100 + i); i++) {
+        UninterruptibleSleep(std::chrono::milliseconds{10});
+    }
+    BOOST_CHECK(!Push(workers, node0, 0));
+    recorder.Release();
+    stopper.join();
+
+    // Only the message being processed went through, the queued ones were dropped
+    BOOST_REQUIRE_EQUAL(recorder.vProcessed.size(), 1U);
+    BOOST_CHECK_EQUAL(recorder.vProcessed[0].second, 0);
+    BOOST_CHECK_EQUAL(node0.nTierTwoQueueSize, 0U);
+    BOOST_CHECK_EQUAL(node0.GetRefCount(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
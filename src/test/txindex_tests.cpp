@@ -0,0 +1,106 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "index/txindex.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(txindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup)
+{
+    TxIndex txindex(1 << 20, true);
+
+    CTransactionRef tx_disk;
+    uint256 block_hash;
+
+    // Transaction should not be found in the index before it is started.
+    for (const auto& txn : coinbaseTxns) {
+        BOOST_CHECK(!txindex.FindTx(txn.GetHash(), block_hash, tx_disk));
+    }
+
+    // BlockUntilSyncedToCurrentChain should return false before txindex is started.
+    BOOST_CHECK(!txindex.BlockUntilSyncedToCurrentChain());
+
+    txindex.Start();
+
+    // Allow tx index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!txindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // Check that txindex has all txs that were in the chain before it started.
+    for (const auto& txn : coinbaseTxns) {
+        if (!txindex.FindTx(txn.GetHash(), block_hash, tx_disk)) {
+            BOOST_ERROR("FindTx failed");
+        } else if (tx_disk->GetHash() != txn.GetHash()) {
+            BOOST_ERROR("Read incorrect tx");
+        }
+    }
+
+    txindex.Stop();
+
+    // Check that new transactions in new blocks make it into the (global) index as soon as the
+    // block is connected, without waiting for the validation interface queue.
+    BOOST_REQUIRE(g_txindex);
+    for (int i = 0; i < 10; i++) {
+        CScript coinbase_script_pub_key = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+        std::vector<CMutableTransaction> no_txns;
+        const CBlock& block = CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+        const CTransaction& txn = *block.vtx[0];
+
+        if (!g_txindex->FindTx(txn.GetHash(), block_hash, tx_disk)) {
+            BOOST_ERROR("FindTx failed");
+        } else if (tx_disk->GetHash() != txn.GetHash()) {
+            BOOST_ERROR("Read incorrect tx");
+        } else {
+            BOOST_CHECK(block_hash == block.GetHash());
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(txindex_erase_legacy_data, TestingSetup)
+{
+    const auto legacyKey = [](const uint256& txid) { return std::make_pair('t', txid); };
+    std::vector<uint256> txids;
+    for (int i = 0; i < 10; i++) {
+        txids.push_back(InsecureRand256());
+        BOOST_CHECK(pblocktree->Write(legacyKey(txids.back()), CDiskTxPos(FlatFilePos(0, i), 0)));
+    }
+
+    // Nothing to do without the legacy flag or the migration block
+    BOOST_CHECK(TxIndex::EraseLegacyData(*pblocktree));
+    BOOST_CHECK(pblocktree->Exists(legacyKey(txids[0])));
+
+    BOOST_CHECK(pblocktree->WriteFlag("txindex", true));
+    BOOST_CHECK(pblocktree->WriteFlag("prunedblockfiles", true));
+    BOOST_CHECK(TxIndex::EraseLegacyData(*pblocktree));
+    for (const uint256& txid : txids) {
+        BOOST_CHECK(!pblocktree->Exists(legacyKey(txid)));
+    }
+    bool fValue = true;
+    BOOST_CHECK(pblocktree->ReadFlag("txindex", fValue));
+    BOOST_CHECK(!fValue);
+    BOOST_CHECK(pblocktree->ReadFlag("prunedblockfiles", fValue));
+    BOOST_CHECK(fValue);
+
+    // Same for a migration that was interrupted
+    BOOST_CHECK(pblocktree->Write(legacyKey(txids[0]), CDiskTxPos(FlatFilePos(0, 0), 0)));
+    BOOST_CHECK(pblocktree->Write('T', CBlockLocator()));
+    BOOST_CHECK(TxIndex::EraseLegacyData(*pblocktree));
+    BOOST_CHECK(!pblocktree->Exists(legacyKey(txids[0])));
+    BOOST_CHECK(!pblocktree->Exists('T'));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,151 @@
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_pivx.h"
+
+#include "txrequest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txrequest_tests, BasicTestingSetup)
+
+static const std::chrono::microseconds TIME_START{std::chrono::seconds{1000000}};
+static const std::chrono::microseconds REQUEST_TIMEOUT{std::chrono::seconds{60}};
+
+static bool SameInvs(const std::vector<CInv>& a, const std::vector<CInv>& b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const CInv& x, const CInv& y) {
+        return x.type == y.type && x.hash == y.hash;
+    });
+}
+
+static void CheckRequestable(TxRequestTracker& tracker, NodeId peer, std::chrono::microseconds now,
+                             const std::vector<CInv>& expected,
+                             std::vector<std::pair<NodeId, CInv>>* expired = nullptr)
+{
+    const std::vector<CInv> requestable = tracker.GetRequestable(peer, now, expired);
+    tracker.PostGetRequestableSanityCheck(now);
+    tracker.SanityCheck();
+    BOOST_CHECK(SameInvs(requestable, expected));
+}
+
+BOOST_AUTO_TEST_CASE(request_and_response)
+{
+    TxRequestTracker tracker(true);
+    const CInv inv(MSG_TX, InsecureRand256());
+
+    // Not requestable before its reqtime
+    tracker.ReceivedInv(0, inv, true, TIME_START + std::chrono::seconds{2});
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Count(0), 1U);
+    BOOST_CHECK_EQUAL(tracker.CountCandidates(0), 1U);
+    CheckRequestable(tracker, 0, TIME_START, {});
+    CheckRequestable(tracker, 0, TIME_START + std::chrono::seconds{2}, {inv});
+
+    tracker.RequestedInv(0, inv.hash, TIME_START + REQUEST_TIMEOUT);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(0), 1U);
+    BOOST_CHECK_EQUAL(tracker.CountCandidates(0), 0U);
+    // Requested items aren't returned again
+    CheckRequestable(tracker, 0, TIME_START + std::chrono::seconds{3}, {});
+
+    // The response of the only announcing peer drops everything about the item
+    tracker.ReceivedResponse(0, inv.hash);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+    BOOST_CHECK_EQUAL(tracker.Count(0), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(preferred_peer_and_timeout)
+{
+    TxRequestTracker tracker(true);
+    const CInv inv(MSG_BUDGET_VOTE, InsecureRand256());
+
+    // Peer 1 isn't preferred, peer 2 is: only peer 2 gets asked
+    tracker.ReceivedInv(1, inv, false, TIME_START);
+    tracker.ReceivedInv(2, inv, true, TIME_START);
+    CheckRequestable(tracker, 1, TIME_START, {});
+    CheckRequestable(tracker, 2, TIME_START, {inv});
+    tracker.RequestedInv(2, inv.hash, TIME_START + REQUEST_TIMEOUT);
+    CheckRequestable(tracker, 1, TIME_START + REQUEST_TIMEOUT - std::chrono::microseconds{1}, {});
+
+    // When the request expires, peer 1 gets asked
+    std::vector<std::pair<NodeId, CInv>> expired;
+    CheckRequestable(tracker, 1, TIME_START + REQUEST_TIMEOUT, {inv}, &expired);
+    BOOST_CHECK_EQUAL(expired.size(), 1U);
+    BOOST_CHECK_EQUAL(expired[0].first, 2);
+    BOOST_CHECK(expired[0].second.hash == inv.hash);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(2), 0U);
+    BOOST_CHECK_EQUAL(tracker.Count(2), 1U);
+
+    // Once peer 1 disconnects, only the completed announcement of peer 2 is left: it's dropped too
+    tracker.DisconnectedPeer(1);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(notfound_and_disconnect)
+{
+    TxRequestTracker tracker(true);
+    const CInv inv(MSG_TX, InsecureRand256());
+
+    // Among peers with the same preference, the priority picks who gets asked
+    std::vector<NodeId> peers{1, 2, 3};
+    for (NodeId peer : peers) {
+        tracker.ReceivedInv(peer, inv, false, TIME_START);
+    }
+    std::sort(peers.begin(), peers.end(), [&](NodeId a, NodeId b) {
+        return tracker.ComputePriority(inv.hash, a, false) > tracker.ComputePriority(inv.hash, b, false);
+    });
+    CheckRequestable(tracker, peers[1], TIME_START, {});
+    CheckRequestable(tracker, peers[2], TIME_START, {});
+    CheckRequestable(tracker, peers[0], TIME_START, {inv});
+    tracker.RequestedInv(peers[0], inv.hash, TIME_START + REQUEST_TIMEOUT);
+
+    // A NOTFOUND moves on to the next peer straight away
+    tracker.ReceivedResponse(peers[0], inv.hash);
+    tracker.SanityCheck();
+    CheckRequestable(tracker, peers[2], TIME_START, {});
+    CheckRequestable(tracker, peers[1], TIME_START, {inv});
+
+    // And so does a disconnection
+    tracker.DisconnectedPeer(peers[1]);
+    tracker.SanityCheck();
+    CheckRequestable(tracker, peers[2], TIME_START, {inv});
+    BOOST_CHECK_EQUAL(tracker.Size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(announcement_order_and_forget)
+{
+    TxRequestTracker tracker(true);
+    const std::vector<CInv> invs{
+        CInv(MSG_TX, InsecureRand256()),
+        CInv(MSG_BUDGET_PROPOSAL, InsecureRand256()),
+        CInv(MSG_MASTERNODE_PING, InsecureRand256()),
+    };
+    for (const CInv& inv : invs) {
+        tracker.ReceivedInv(0, inv, true, TIME_START);
+    }
+    // A second announcement of the same item by the same peer is ignored
+    tracker.ReceivedInv(0, invs[0], true, TIME_START);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Count(0), 3U);
+
+    // Items are returned in announcement order, with their type
+    CheckRequestable(tracker, 0, TIME_START, invs);
+
+    // Forgetting an item drops all of its announcements
+    tracker.ReceivedInv(1, invs[1], true, TIME_START);
+    tracker.ForgetInvHash(invs[1].hash);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Count(0), 2U);
+    BOOST_CHECK_EQUAL(tracker.Count(1), 0U);
+    CheckRequestable(tracker, 0, TIME_START, {invs[0], invs[2]});
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -165,4 +165,100 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
     BOOST_CHECK_EQUAL(sub.m_expected_tip, WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash()));
 }
 
+// construct a valid block at the given height (with the coinbase committing to it)
+static std::shared_ptr<const CBlock> GoodBlockAtHeight(const uint256& prev_hash, int nHeight)
+{
+    auto pblock = Block(prev_hash);
+    CMutableTransaction txCoinbase(*pblock->vtx[0]);
+    txCoinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
+    return FinalizeBlock(pblock);
+}
+
+static bool IsPendingParent(const uint256& hash)
+{
+    LOCK(cs_main);
+    return IsBlockPendingParent(hash);
+}
+
+static uint256 TipHash()
+{
+    LOCK(cs_main);
+    return chainActive.Tip()->GetBlockHash();
+}
+
+BOOST_AUTO_TEST_CASE(processnewblockheaders_tests)
+{
+    const uint256 genesis = TipHash();
+    const auto b1 = GoodBlockAtHeight(genesis, 1);
+    const auto b2 = GoodBlockAtHeight(b1->GetHash(), 2);
+
+    // Headers that don't connect to the known ones are rejected
+    CValidationState state;
+    BOOST_CHECK(!ProcessNewBlockHeaders({b2->GetBlockHeader()}, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "prevblk-not-found");
+
+    // A connecting chain of headers is accepted, without the block data
+    state = CValidationState();
+    const CBlockIndex* pindexLast = nullptr;
+    BOOST_CHECK(ProcessNewBlockHeaders({b1->GetBlockHeader(), b2->GetBlockHeader()}, state, &pindexLast));
+    BOOST_CHECK(state.IsValid());
+    BOOST_REQUIRE(pindexLast);
+    BOOST_CHECK_EQUAL(pindexLast->GetBlockHash(), b2->GetHash());
+    BOOST_CHECK_EQUAL(pindexLast->nHeight, 2);
+    BOOST_CHECK(!(pindexLast->nStatus & BLOCK_HAVE_DATA));
+    BOOST_CHECK_EQUAL(TipHash(), genesis);
+
+    // Known headers are accepted again
+    BOOST_CHECK(ProcessNewBlockHeaders({b1->GetBlockHeader()}, state, &pindexLast));
+    BOOST_CHECK_EQUAL(pindexLast->GetBlockHash(), b1->GetHash());
+
+    // A header with the wrong difficulty is rejected
+    CBlockHeader badHeader = GoodBlockAtHeight(b2->GetHash(), 3)->GetBlockHeader();
+    badHeader.nBits = 0x1d00ffff;
+    BOOST_CHECK(!ProcessNewBlockHeaders({badHeader}, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+    BOOST_CHECK(WITH_LOCK(cs_main, return LookupBlockIndex(badHeader.GetHash()); ) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(out_of_order_blocks)
+{
+    const uint256 genesis = TipHash();
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    std::vector<CBlockHeader> headers;
+    uint256 prev = genesis;
+    for (int nHeight = 1; nHeight <= 3; nHeight++) {
+        blocks.emplace_back(GoodBlockAtHeight(prev, nHeight));
+        headers.emplace_back(blocks.back()->GetBlockHeader());
+        prev = blocks.back()->GetHash();
+    }
+    CValidationState state;
+    BOOST_CHECK(ProcessNewBlockHeaders(headers, state));
+
+    // The blocks downloaded ahead of their parent are held...
+    BOOST_CHECK(ProcessNewBlock(blocks[2], nullptr));
+    BOOST_CHECK(ProcessNewBlock(blocks[1], nullptr));
+    BOOST_CHECK(IsPendingParent(blocks[2]->GetHash()));
+    BOOST_CHECK(IsPendingParent(blocks[1]->GetHash()));
+    BOOST_CHECK_EQUAL(TipHash(), genesis);
+
+    // ...and connected, in order, once the parent arrives
+    BOOST_CHECK(ProcessNewBlock(blocks[0], nullptr));
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(TipHash(), blocks[2]->GetHash());
+    BOOST_CHECK(!IsPendingParent(blocks[2]->GetHash()));
+    BOOST_CHECK(!IsPendingParent(blocks[1]->GetHash()));
+
+    // A block whose header is unknown isn't held, even if the header of its parent is known
+    const auto b4 = GoodBlockAtHeight(blocks[2]->GetHash(), 4);
+    const auto b5 = GoodBlockAtHeight(b4->GetHash(), 5);
+    BOOST_CHECK(ProcessNewBlockHeaders({b4->GetBlockHeader()}, state));
+    BOOST_CHECK(ProcessNewBlock(b5, nullptr));
+    BOOST_CHECK(!IsPendingParent(b5->GetHash()));
+    BOOST_CHECK(ProcessNewBlock(b4, nullptr));
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(TipHash(), b4->GetHash());
+    BOOST_CHECK(WITH_LOCK(cs_main, return LookupBlockIndex(b5->GetHash()); ) == nullptr);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,10 +4,20 @@
 
 #include "test/test_pivx.h"
 #include "blockassembler.h"
+#include "evo/deterministicmns.h"
+#include "index/txindex.h"
+#include "libzerocoin/CoinSpend.h"
+#include "pow.h"
 #include "primitives/transaction.h"
+#include "protocol.h"
 #include "sapling/sapling_validation.h"
+#include "script/sign.h"
+#include "stakeinput.h"
+#include "txdb.h"
 #include "test/librust/utiltest.h"
 #include "util/blockstatecatcher.h"
+#include "utxo_snapshot.h"
+#include "validationinterface.h"
 #include "wallet/test/wallet_test_fixture.h"
 
 #include <boost/test/unit_test.hpp>
@@ -159,4 +169,428 @@ BOOST_FIXTURE_TEST_CASE(zerocoin_rejection_tests, WalletRegTestingSetup)
     CheckMempoolZcRejection(mtx, "bad-txns-zc-public-spend");
 }
 
+/** A v2 private zerocoin spend, whose serial derives from the key signing it */
+class TestCoinSpend : public libzerocoin::CoinSpend
+{
+public:
+    TestCoinSpend(const CKey& key, const uint256& hashTxOut, bool fValidSig)
+    {
+        denomination = libzerocoin::ZQ_ONE;
+        version = libzerocoin::PUBKEY_VERSION;
+        ptxHash = hashTxOut;
+        setPubKey(key.GetPubKey(), true);
+        BOOST_CHECK(key.Sign(signatureHash(), vchSig));
+        if (!fValidSig) vchSig.back() ^= 1;
+    }
+};
+
+static CMutableTransaction CreateZerocoinSpendTx(const CKey& key, const CScript& scriptPubKey, bool fValidSig, CBigNum& serialRet)
+{
+    CMutableTransaction mtx;
+    mtx.vout.emplace_back(1 * COIN, scriptPubKey);
+    // The spend signs the outputs only
+    TestCoinSpend spend(key, mtx.GetHash(), fValidSig);
+    serialRet = spend.getCoinSerialNumber();
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << static_cast<const libzerocoin::CoinSpend&>(spend);
+
+    CTxIn in(COutPoint(UINT256_ZERO, 0));
+    in.nSequence = libzerocoin::ZQ_ONE;
+    in.scriptSig = CScript() << OP_ZEROCOINSPEND << (int64_t)ss.size();
+    in.scriptSig.insert(in.scriptSig.end(), ss.begin(), ss.end());
+    mtx.vin.emplace_back(in);
+    return mtx;
+}
+
+/*
+ * The private spends signatures are verified by the zerocoin check queue workers (started by the fixture)
+ */
+BOOST_FIXTURE_TEST_CASE(zerocoin_spends_check_queue, TestChain100Setup)
+{
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_ZC, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_ZC_V2, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    BOOST_CHECK(nScriptCheckThreads > 1);
+
+    const CScript scriptPubKey = CScript() << OP_TRUE;
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(true);
+    CBigNum serial1, serial2, serialBad;
+    const CMutableTransaction spend1 = CreateZerocoinSpendTx(key1, scriptPubKey, true, serial1);
+    const CMutableTransaction spend2 = CreateZerocoinSpendTx(key2, scriptPubKey, true, serial2);
+    const CMutableTransaction badSpend = CreateZerocoinSpendTx(key2, scriptPubKey, false, serialBad);
+    BOOST_CHECK(serial1 != serial2);
+    BOOST_CHECK(serial2 == serialBad);
+
+    // A badly signed spend is rejected, alone or next to a valid one
+    const uint256 tipHash = WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash(); );
+    for (const auto& txns : std::vector<std::vector<CMutableTransaction>>{{badSpend}, {spend1, badSpend}}) {
+        CreateAndProcessBlock(txns, coinbaseKey);
+        BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash(); ) == tipHash);
+    }
+
+    // Valid spends connect, and their serials are recorded
+    const CBlock block = CreateAndProcessBlock({spend1, spend2}, coinbaseKey);
+    BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash(); ) == block.GetHash());
+    uint256 txid;
+    BOOST_CHECK(zerocoinDB->ReadCoinSpend(serial1, txid));
+    BOOST_CHECK(txid == spend1.GetHash());
+    BOOST_CHECK(zerocoinDB->ReadCoinSpend(serial2, txid));
+    BOOST_CHECK(txid == spend2.GetHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(read_raw_block_from_disk, TestChain100Setup)
+{
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return chainActive.Tip(); );
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, tip));
+    std::vector<uint8_t> raw;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(raw, tip));
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    BOOST_CHECK(raw == std::vector<uint8_t>(ss.begin(), ss.end()));
+
+    // The data of another block doesn't match the index
+    CBlockIndex index = *tip->pprev;
+    index.nFile = tip->nFile;
+    index.nDataPos = tip->nDataPos;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, &index));
+}
+
+BOOST_FIXTURE_TEST_CASE(prune_one_block_file, TestChain100Setup)
+{
+    LOCK(cs_main);
+    // The whole test chain fits in the first block file
+    const uint64_t nUsage = CalculateCurrentUsage();
+    BOOST_CHECK(nUsage > 0);
+    BOOST_CHECK_EQUAL(nUsage, GetBlockFileInfo(0)->nSize + GetBlockFileInfo(0)->nUndoSize);
+
+    PruneOneBlockFile(0);
+    BOOST_CHECK_EQUAL(CalculateCurrentUsage(), 0U);
+    BOOST_CHECK_EQUAL(GetBlockFileInfo(0)->nBlocks, 0U);
+    for (const CBlockIndex* pindex = chainActive.Tip(); pindex; pindex = pindex->pprev) {
+        BOOST_CHECK(!(pindex->nStatus & BLOCK_HAVE_DATA));
+        BOOST_CHECK(!(pindex->nStatus & BLOCK_HAVE_UNDO));
+        // Pruned blocks stay linked: their transactions were processed once
+        BOOST_CHECK(pindex->nTx > 0);
+        BOOST_CHECK(pindex->nChainTx > 0);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(stake_input_spent_without_txindex, TestChain100Setup)
+{
+    // Prune mode runs without the tx index
+    if (g_txindex) {
+        g_txindex->Stop();
+        g_txindex.reset();
+    }
+
+    // Spend a coinbase on the active chain
+    const CTransaction& prevTx = coinbaseTxns[0];
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.emplace_back(prevTx.GetHash(), 0);
+    spend.vout.emplace_back(prevTx.vout[0].nValue - 10 * CENT, CScript() << OP_TRUE);
+    std::vector<unsigned char> vchSig;
+    const uint256 hash = SignatureHash(prevTx.vout[0].scriptPubKey, spend, 0, SIGHASH_ALL, prevTx.vout[0].nValue, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    CreateAndProcessBlock({spend}, coinbaseKey);
+
+    // A fork block can still stake it: the coin is found in the undo data of the spending block
+    LOCK(cs_main);
+    const CTxIn& txin = spend.vin[0];
+    BOOST_CHECK(pcoinsTip->AccessCoin(txin.prevout).IsSpent());
+    const CBlockIndex* tip = chainActive.Tip();
+    const CBlockIndex* pindexFork = tip->pprev;
+    std::unique_ptr<CPivStake> stake(CPivStake::NewPivStake(txin, pindexFork, tip->nTime));
+    BOOST_REQUIRE(stake);
+    BOOST_CHECK_EQUAL(stake->GetValue(), prevTx.vout[0].nValue);
+    BOOST_CHECK_EQUAL(stake->GetIndexFrom()->nHeight, 1);
+
+    // But not a block on top of the spending one (only the blocks above the fork point are scanned)
+    stake.reset(CPivStake::NewPivStake(txin, tip, tip->nTime));
+    BOOST_CHECK(!stake);
+
+    // Nor when it was spent deeper than -maxreorg (the fork would double spend it)
+    gArgs.ForceSetArg("-maxreorg", "0");
+    stake.reset(CPivStake::NewPivStake(txin, pindexFork, tip->nTime));
+    BOOST_CHECK(!stake);
+    gArgs.ForceSetArg("-maxreorg", std::to_string(DEFAULT_MAX_REORG_DEPTH));
+}
+
+BOOST_FIXTURE_TEST_CASE(assume_valid_blocks, BasicTestingSetup)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    // Two weeks of blocks, plus some
+    const int nBlocks = 60 * 60 * 24 * 7 * 2 / consensus.nTargetSpacing + 1000;
+    std::vector<CBlockIndex> blocks(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        blocks[i].nBits = UintToArith256(consensus.powLimit).GetCompact();
+        blocks[i].nChainWork = i ? blocks[i - 1].nChainWork + GetBlockProof(blocks[i]) : arith_uint256(0);
+        blocks[i].BuildSkip();
+    }
+    const CBlockIndex* pindexAssumeValid = &blocks[nBlocks - 100];
+    const CBlockIndex* pindexBestHeader = &blocks[nBlocks - 1];
+
+    // The scripts are skipped below the assumed-valid block, once buried by two weeks of work...
+    BOOST_CHECK(IsBlockAssumedValid(&blocks[1], pindexAssumeValid, pindexBestHeader, consensus));
+    BOOST_CHECK(IsBlockAssumedValid(&blocks[500], pindexAssumeValid, pindexBestHeader, consensus));
+    BOOST_CHECK(!IsBlockAssumedValid(&blocks[nBlocks - 500], pindexAssumeValid, pindexBestHeader, consensus));
+    BOOST_CHECK(!IsBlockAssumedValid(pindexAssumeValid, pindexAssumeValid, pindexBestHeader, consensus));
+
+    // ...and checked above it
+    BOOST_CHECK(!IsBlockAssumedValid(&blocks[nBlocks - 50], pindexAssumeValid, pindexBestHeader, consensus));
+
+    // and off its chain
+    CBlockIndex fork;
+    fork.pprev = &blocks[499];
+    fork.nHeight = 500;
+    fork.nBits = blocks[500].nBits;
+    fork.nChainWork = blocks[500].nChainWork;
+    fork.BuildSkip();
+    BOOST_CHECK(!IsBlockAssumedValid(&fork, pindexAssumeValid, pindexBestHeader, consensus));
+
+    // The best header must build on the assumed-valid block
+    BOOST_CHECK(!IsBlockAssumedValid(&blocks[500], pindexAssumeValid, &blocks[nBlocks - 200], consensus));
+    BOOST_CHECK(!IsBlockAssumedValid(&blocks[500], nullptr, pindexBestHeader, consensus));
+    BOOST_CHECK(!IsBlockAssumedValid(&blocks[500], pindexAssumeValid, nullptr, consensus));
+}
+
+BOOST_FIXTURE_TEST_CASE(utxo_snapshot_roundtrip, TestChain100Setup)
+{
+    const fs::path path = GetDataDir() / "utxo.dat";
+    SnapshotMetadata metadata;
+    uint256 hashDump;
+    std::string strError;
+
+    // The test chain tip has no stake modifier V2
+    BOOST_CHECK(!DumpUTXOSnapshot(path, metadata, hashDump, strError));
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V3_4, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    BOOST_CHECK(DumpUTXOSnapshot(path, metadata, hashDump, strError));
+    BOOST_CHECK(metadata.hashBlock == WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash(); ));
+
+    uint64_t nCoins = 0;
+    for (const CTransaction& tx : coinbaseTxns) {
+        for (const CTxOut& out : tx.vout) {
+            if (!out.scriptPubKey.IsUnspendable()) nCoins++;
+        }
+    }
+    BOOST_CHECK_EQUAL(metadata.nCoins, nCoins);
+
+    // Reading the snapshot back gives the same content
+    SnapshotMetadata metadataRead;
+    uint256 hashRead;
+    BOOST_CHECK(VerifyUTXOSnapshot(path, metadataRead, hashRead, strError));
+    BOOST_CHECK(hashRead == hashDump);
+    BOOST_CHECK_EQUAL(metadataRead.nCoins, metadata.nCoins);
+    BOOST_CHECK_EQUAL(metadataRead.nEvoRecords, metadata.nEvoRecords);
+
+    // No snapshot is committed in the regtest chain params
+    BOOST_CHECK(!LoadUTXOSnapshot(path, metadataRead, strError));
+    BOOST_CHECK(strError.find("not committed") != std::string::npos);
+
+    // Trailing data is rejected
+    FILE* file = fsbridge::fopen(path, "ab");
+    fputc(0, file);
+    fclose(file);
+    BOOST_CHECK(!VerifyUTXOSnapshot(path, metadataRead, hashRead, strError));
+
+    // Loading a snapshot is experimental, and only available on regtest
+    SelectParams(CBaseChainParams::TESTNET);
+    BOOST_CHECK(!LoadUTXOSnapshot(path, metadataRead, strError));
+    BOOST_CHECK(strError.find("regtest") != std::string::npos);
+    SelectParams(CBaseChainParams::REGTEST);
+    fs::remove(path);
+}
+
+BOOST_FIXTURE_TEST_CASE(utxo_snapshot_load, TestChain100Setup)
+{
+    // Prune mode runs without the tx index
+    if (g_txindex) {
+        g_txindex->Stop();
+        g_txindex.reset();
+    }
+    SyncWithValidationInterfaceQueue();
+
+    const fs::path path = GetDataDir() / "utxo.dat";
+    SnapshotMetadata metadata;
+    uint256 hashDump;
+    std::string strError;
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V3_4, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    BOOST_REQUIRE(DumpUTXOSnapshot(path, metadata, hashDump, strError));
+
+    std::vector<CBlockHeader> headers;
+    uint256 hashTip;
+    CAmount nTotalAmount;
+    int nHeight;
+    {
+        LOCK(cs_main);
+        for (int i = 1; i <= chainActive.Height(); i++) {
+            headers.push_back(chainActive[i]->GetBlockHeader());
+        }
+        hashTip = chainActive.Tip()->GetBlockHash();
+        nHeight = chainActive.Height();
+        nTotalAmount = pcoinsTip->GetTotalAmount();
+    }
+
+    // Start over as a new node, which synced the headers only
+    UnloadBlockIndex();
+    pcoinsTip.reset();
+    pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true));
+    pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+    pblocktree.reset(new CBlockTreeDB(1 << 20, true));
+    deterministicMNManager.reset(new CDeterministicMNManager(*evoDb));
+    BOOST_REQUIRE(LoadGenesisBlock());
+    CValidationState state;
+    BOOST_REQUIRE(ActivateBestChain(state));
+    BOOST_REQUIRE(ProcessNewBlockHeaders(headers, state));
+
+    // The snapshot must be committed, and the node pruned
+    BOOST_CHECK(!LoadUTXOSnapshot(path, metadata, strError));
+    BOOST_CHECK(strError.find("not committed") != std::string::npos);
+    UpdateAssumeutxoParameters(nHeight, hashDump);
+    BOOST_CHECK(!LoadUTXOSnapshot(path, metadata, strError));
+    BOOST_CHECK(strError.find("-prune") != std::string::npos);
+
+    fPruneMode = true;
+    BOOST_CHECK_MESSAGE(LoadUTXOSnapshot(path, metadata, strError), strError);
+    // Only once, on the genesis block
+    BOOST_CHECK(!LoadUTXOSnapshot(path, metadata, strError));
+    BOOST_CHECK(strError.find("not empty") != std::string::npos);
+    fPruneMode = false;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashTip);
+        BOOST_CHECK_EQUAL(pcoinsTip->GetTotalAmount(), nTotalAmount);
+        BOOST_CHECK(pcoinsTip->HaveCoin(COutPoint(coinbaseTxns.back().GetHash(), 0)));
+    }
+
+    // The chain goes on from the snapshot block
+    CreateAndProcessBlock({}, coinbaseKey);
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return chainActive.Height(); ), nHeight + 1);
+
+    UpdateAssumeutxoParameters(nHeight, UINT256_ZERO);
+    fHavePruned = false;
+    fs::remove(path);
+}
+
+static void WriteBlockRecord(CDataStream& ss, const CBlock& block)
+{
+    ss.write((const char*)Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE);
+    ss << (unsigned int)::GetSerializeSize(block, CLIENT_VERSION) << block;
+}
+
+/** Write a record that does not deserialize (the transactions count is too large),
+ *  with a block stored inside of it */
+static void WriteCorruptRecord(CDataStream& ss, const CBlock& block)
+{
+    CDataStream inner(SER_DISK, CLIENT_VERSION);
+    WriteBlockRecord(inner, block);
+    std::vector<unsigned char> payload(80, 0x00); // version 0 header
+    payload.resize(89, 0xff);                      // transactions count
+    payload.insert(payload.end(), inner.begin(), inner.end());
+    ss.write((const char*)Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE);
+    ss << (unsigned int)payload.size();
+    ss.write((const char*)payload.data(), payload.size());
+}
+
+static bool LoadBlockFile(const fs::path& path, const CDataStream& ss)
+{
+    FILE* file = fsbridge::fopen(path, "wb");
+    BOOST_REQUIRE(file);
+    BOOST_CHECK_EQUAL(fwrite(ss.data(), 1, ss.size(), file), ss.size());
+    fclose(file);
+
+    file = fsbridge::fopen(path, "rb");
+    BOOST_REQUIRE(file);
+    const bool fLoaded = LoadExternalBlockFile(file);
+    fs::remove(path);
+    return fLoaded;
+}
+
+/** Sets the number of block import threads for the scope of a test */
+struct ImportThreadsSetter
+{
+    const int nPrevious{nImportThreads};
+    explicit ImportThreadsSetter(int n) { nImportThreads = n; }
+    ~ImportThreadsSetter() { nImportThreads = nPrevious; }
+};
+
+BOOST_FIXTURE_TEST_CASE(load_external_block_file, TestChain100Setup)
+{
+    ImportThreadsSetter importThreads(2);
+    CBlock tip_block;
+    BOOST_CHECK(ReadBlockFromDisk(tip_block, WITH_LOCK(cs_main, return chainActive.Tip(); )));
+    const CBlock block = CreateBlock({}, coinbaseKey);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    // Garbage, then a block that is already known
+    ss << std::vector<unsigned char>(100, 0xfa);
+    WriteBlockRecord(ss, tip_block);
+    // The block in the corrupt record is found by the rescan
+    WriteCorruptRecord(ss, block);
+    // A truncated record at the end of the file
+    ss.write((const char*)Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE);
+    ss << (unsigned int)1000 << std::vector<unsigned char>(10, 0x01);
+
+    BOOST_CHECK(LoadBlockFile(GetDataDir() / "import.dat", ss));
+    BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash(); ) == block.GetHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(load_external_block_file_rescan_far_back, TestChain100Setup)
+{
+    ImportThreadsSetter importThreads(2);
+    const CBlock block = CreateBlock({}, coinbaseKey);
+
+    // The corrupt record is further from the end of the file than the read buffer rewinds
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    WriteCorruptRecord(ss, block);
+    ss << std::vector<unsigned char>(3 * MAX_BLOCK_SIZE_CURRENT, 0x00);
+
+    BOOST_CHECK(LoadBlockFile(GetDataDir() / "import.dat", ss));
+    BOOST_CHECK(WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash(); ) == block.GetHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(load_block_index_and_verify_chain, TestChain100Setup)
+{
+    FlushStateToDisk();
+
+    // The block index entries read back (by several threads) match the loaded ones
+    std::map<uint256, std::unique_ptr<CBlockIndex>> mapLoaded;
+    auto insertBlockIndex = [&mapLoaded](const uint256& hash) -> CBlockIndex* {
+        if (hash.IsNull()) return nullptr;
+        auto it = mapLoaded.find(hash);
+        if (it == mapLoaded.end()) {
+            it = mapLoaded.emplace(hash, std::make_unique<CBlockIndex>()).first;
+            it->second->phashBlock = &it->first;
+        }
+        return it->second.get();
+    };
+    BOOST_CHECK(pblocktree->LoadBlockIndexGuts(insertBlockIndex));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(mapLoaded.size(), mapBlockIndex.size());
+        for (const auto& item : mapBlockIndex) {
+            auto it = mapLoaded.find(item.first);
+            BOOST_REQUIRE(it != mapLoaded.end());
+            const CBlockIndex* pindex = it->second.get();
+            BOOST_CHECK_EQUAL(pindex->nHeight, item.second->nHeight);
+            BOOST_CHECK_EQUAL(pindex->nStatus, item.second->nStatus);
+            BOOST_CHECK_EQUAL(pindex->nTx, item.second->nTx);
+            BOOST_CHECK(pindex->hashMerkleRoot == item.second->hashMerkleRoot);
+            BOOST_CHECK((pindex->pprev ? pindex->pprev->GetBlockHash() : UINT256_ZERO) ==
+                        (item.second->pprev ? item.second->pprev->GetBlockHash() : UINT256_ZERO));
+        }
+    }
+
+    // The background verification of the chain succeeds, and is a no-op on empty ranges
+    const int nHeight = WITH_LOCK(cs_main, return chainActive.Height(); );
+    BOOST_CHECK(VerifyChainData(DEFAULT_CHECKLEVEL, 1, nHeight));
+    BOOST_CHECK(VerifyChainData(DEFAULT_CHECKLEVEL, nHeight, nHeight - 1));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,8 @@
 
 #include "threadinterrupt.h"
 
+CThreadInterrupt::CThreadInterrupt() : flag(false) {}
+
 CThreadInterrupt::operator bool() const
 {
     return flag.load(std::memory_order_acquire);
@@ -215,7 +215,7 @@ void SetBudgetFinMode(const std::string& mode)
 bool InitActiveMN()
 {
     fMasterNode = gArgs.GetBoolArg("-masternode", DEFAULT_MASTERNODE);
-    if ((fMasterNode || masternodeConfig.getCount() > -1) && fTxIndex == false) {
+    if ((fMasterNode || masternodeConfig.getCount() > -1) && !gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
         return UIError(strprintf(_("Enabling Masternode support requires turning on transaction indexing."
                                    "Please add %s to your configuration and start with %s"), "txindex=1", "-reindex"));
     }
@@ -17,6 +17,7 @@
 // Update in-flight message status if needed
 bool CMasternodeSync::UpdatePeerSyncState(const NodeId& id, const char* msg, const int nextSyncStatus)
 {
+    LOCK(cs_peers_sync_state);
     auto it = peersSyncState.find(id);
     if (it != peersSyncState.end()) {
         auto peerData = it->second;
@@ -155,6 +156,7 @@ void CMasternodeSync::PushMessage(CNode* pnode, const char* msg, Args&&... args)
 template <typename... Args>
 void CMasternodeSync::RequestDataTo(CNode* pnode, const char* msg, bool forceRequest, Args&&... args)
 {
+    LOCK(cs_peers_sync_state);
     const auto& it = peersSyncState.find(pnode->GetId());
     bool exist = it != peersSyncState.end();
     if (!exist || forceRequest) {
@@ -6,20 +6,26 @@
 
 #include "txdb.h"
 
+#include "chainparams.h"
 #include "random.h"
 #include "pow.h"
+#include "sync.h"
 #include "uint256.h"
 #include "util/system.h"
+#include "util/threadnames.h"
 #include "util/vector.h"
+#include "validation.h"
 
+#include <condition_variable>
+#include <deque>
 #include <stdint.h>
+#include <thread>
 
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
-static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -88,10 +94,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
 
     uint256 old_tip = GetBestBlock();
     if (old_tip.IsNull()) {
-        // We may be in the middle of replaying.
+        // We may be in the middle of replaying, or completing the partial
+        // writes of hashBlock (or of one of its ancestors, which the caller
+        // checks, see FlushStateToDisk).
         std::vector<uint256> old_heads = GetHeadBlocks();
         if (old_heads.size() == 2) {
-            assert(old_heads[0] == hashBlock);
             old_tip = old_heads[1];
         }
     }
@@ -142,6 +149,50 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
     return ret;
 }
 
+bool CCoinsViewDB::BatchWritePartial(CCoinsMap& mapCoins,
+                                     const uint256& hashBlock,
+                                     const uint256& hashSaplingAnchor,
+                                     CAnchorsSaplingMap& mapSaplingAnchors,
+                                     CNullifiersMap& mapSaplingNullifiers)
+{
+    CDBBatch batch;
+    size_t changed = 0;
+    assert(!hashBlock.IsNull());
+
+    // Mark the database as being in the middle of a transition from the last
+    // consistent tip to hashBlock (the coins written come from hashBlock, or
+    // from one of its ancestors for earlier partial writes): after a crash,
+    // ReplayBlocks completes it by rolling forward all the blocks in between.
+    uint256 old_tip = GetBestBlock();
+    if (old_tip.IsNull()) {
+        std::vector<uint256> old_heads = GetHeadBlocks();
+        if (old_heads.size() == 2) {
+            old_tip = old_heads[1];
+        }
+    }
+    batch.Erase(DB_BEST_BLOCK);
+    batch.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
+
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = mapCoins.erase(it)) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
+            else
+                batch.Write(entry, it->second.coin);
+            changed++;
+        }
+    }
+
+    // Write Sapling
+    BatchWriteSapling(hashSaplingAnchor, mapSaplingAnchors, mapSaplingNullifiers, batch);
+
+    LogPrint(BCLog::COINDB, "Writing incremental batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+    bool ret = db.WriteBatch(batch);
+    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs to coin database (incremental)...\n", (unsigned int)changed);
+    return ret;
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -182,10 +233,25 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
+    return NewCursor(const_cast<CDBWrapper&>(db).NewIterator());
+}
+
+CCoinsViewCursor *CCoinsViewDB::Cursor(const CDBSnapshot& snapshot) const
+{
+    return NewCursor(const_cast<CDBWrapper&>(db).NewIterator(snapshot));
+}
+
+std::unique_ptr<CDBSnapshot> CCoinsViewDB::GetSnapshot() const
+{
+    return std::make_unique<CDBSnapshot>(const_cast<CDBWrapper&>(db));
+}
+
+CCoinsViewCursor *CCoinsViewDB::NewCursor(CDBIterator* pcursor) const
+{
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(pcursor, GetBestBlock());
     i->pcursor->Seek(DB_COIN);
     // Cache key of first record
     // Cache key of first record
@@ -247,19 +313,6 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
-{
-    return Read(std::make_pair(DB_TXINDEX, txid), pos);
-}
-
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& vect)
-{
-    CDBBatch batch;
-    for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it = vect.begin(); it != vect.end(); it++)
-        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
-
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
@@ -284,62 +337,192 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+namespace {
+
+/** Records handed over by a block index reader at once */
+constexpr size_t BLOCK_INDEX_BATCH_SIZE = 1024;
+/** Batches waiting to be linked, above which the block index readers pause */
+constexpr size_t MAX_BLOCK_INDEX_BATCHES = 64;
+/** Maximum number of threads reading the block index at startup */
+constexpr int MAX_BLOCK_INDEX_THREADS = 8;
+
+typedef std::vector<std::pair<uint256, CDiskBlockIndex>> BlockIndexBatch;
+
+/**
+ * Reads the block index records with one cursor per range of keys. The keys
+ * are split on the first byte of the block hash, which is uniformly
+ * distributed. The reader threads deserialize the records, and compute (and
+ * check the proof of work of) their header hash, which is the bulk of the
+ * loading time. The records are then linked on the caller thread, in batches.
+ */
+class BlockIndexReader
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+public:
+    BlockIndexReader(CDBWrapper& db, int nThreads);
+    ~BlockIndexReader();
+
+    /** Get the next batch of records. Returns false once all of them were read, or on failure. */
+    bool Next(BlockIndexBatch& batch);
+    bool Failed();
+
+private:
+    void ReadRange(CDBWrapper& db, int nBegin, int nEnd);
+    bool Push(BlockIndexBatch& batch);
+    void Finish(bool fSuccess);
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<BlockIndexBatch> m_batches GUARDED_BY(m_mutex);
+    int m_running GUARDED_BY(m_mutex){0};
+    bool m_failed GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::vector<std::thread> m_threads;
+};
 
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, UINT256_ZERO));
+BlockIndexReader::BlockIndexReader(CDBWrapper& db, int nThreads)
+{
+    WITH_LOCK(m_mutex, m_running = nThreads);
+    for (int i = 0; i < nThreads; i++) {
+        m_threads.emplace_back(&BlockIndexReader::ReadRange, this, std::ref(db), 256 * i / nThreads, 256 * (i + 1) / nThreads);
+    }
+}
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                // sapling
-                pindexNew->nSaplingValue  = diskindex.nSaplingValue;
-                pindexNew->hashFinalSaplingRoot = diskindex.hashFinalSaplingRoot;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-
-                //Proof Of Stake
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->vStakeModifier = diskindex.vStakeModifier;
-
-                if (!Params().GetConsensus().NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_POS)) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("%s : CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-                }
+BlockIndexReader::~BlockIndexReader()
+{
+    WITH_LOCK(m_mutex, m_stop = true);
+    m_cond.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
 
-                pcursor->Next();
-            } else {
-                return error("%s : failed to read value", __func__);
-            }
-        } else {
+void BlockIndexReader::ReadRange(CDBWrapper& db, int nBegin, int nEnd)
+{
+    util::ThreadRename("pivx-loadidx");
+    const Consensus::Params& consensus = Params().GetConsensus();
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    uint256 hashBegin;
+    *hashBegin.begin() = (uint8_t)nBegin;
+    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, hashBegin));
+
+    BlockIndexBatch batch;
+    batch.reserve(BLOCK_INDEX_BATCH_SIZE);
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd) {
             break;
         }
+        CDiskBlockIndex diskindex;
+        if (!pcursor->GetValue(diskindex)) {
+            error("%s : failed to read value", __func__);
+            return Finish(false);
+        }
+        const uint256 hash = diskindex.GetBlockHash();
+        if (!consensus.NetworkUpgradeActive(diskindex.nHeight, Consensus::UPGRADE_POS) &&
+            !CheckProofOfWork(hash, diskindex.nBits)) {
+            error("%s : CheckProofOfWork failed: block %s, height %d", __func__, hash.ToString(), diskindex.nHeight);
+            return Finish(false);
+        }
+        batch.emplace_back(hash, std::move(diskindex));
+        if (batch.size() == BLOCK_INDEX_BATCH_SIZE && !Push(batch)) {
+            return Finish(false);
+        }
     }
+    Finish(batch.empty() || Push(batch));
+}
 
+bool BlockIndexReader::Push(BlockIndexBatch& batch)
+{
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (!m_stop && m_batches.size() >= MAX_BLOCK_INDEX_BATCHES) {
+            m_cond.wait(lock);
+        }
+        if (m_stop) return false;
+        m_batches.emplace_back(std::move(batch));
+    }
+    m_cond.notify_all();
+    batch.clear();
+    batch.reserve(BLOCK_INDEX_BATCH_SIZE);
+    return true;
+}
+
+void BlockIndexReader::Finish(bool fSuccess)
+{
+    {
+        LOCK(m_mutex);
+        m_running--;
+        if (!fSuccess) m_failed = true;
+    }
+    m_cond.notify_all();
+}
+
+bool BlockIndexReader::Next(BlockIndexBatch& batch)
+{
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (!m_failed && m_running > 0 && m_batches.empty()) {
+            m_cond.wait(lock);
+        }
+        if (m_failed || m_batches.empty()) return false;
+        batch = std::move(m_batches.front());
+        m_batches.pop_front();
+    }
+    m_cond.notify_all();
     return true;
 }
 
+bool BlockIndexReader::Failed()
+{
+    LOCK(m_mutex);
+    return m_failed;
+}
+
+} // namespace
+
+bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+{
+    const int nThreads = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_THREADS));
+    BlockIndexReader reader(*this, nThreads);
+
+    // Load mapBlockIndex
+    BlockIndexBatch batch;
+    while (reader.Next(batch)) {
+        boost::this_thread::interruption_point();
+        for (const auto& item : batch) {
+            const CDiskBlockIndex& diskindex = item.second;
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(item.first);
+            pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+
+            // sapling
+            pindexNew->SetSaplingValue(diskindex.GetSaplingValue());
+            pindexNew->hashFinalSaplingRoot = diskindex.hashFinalSaplingRoot;
+
+            //zerocoin
+            pindexNew->SetAccumulatorCheckpoint(diskindex.GetAccumulatorCheckpoint());
+
+            //Proof Of Stake
+            pindexNew->nFlags = diskindex.nFlags;
+            pindexNew->vStakeModifier = diskindex.vStakeModifier;
+        }
+    }
+
+    return !reader.Failed();
+}
+
 CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe)
 {
 }
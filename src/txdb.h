@@ -13,6 +13,7 @@
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/CoinSpend.h"
 
+#include <functional>
 #include <map>
 #include <string>
 #include <utility>
@@ -31,12 +32,20 @@ static const int64_t nDefaultDbBatchSize = 16 << 20;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
 static const int64_t nMinDbCache = 4;
-//! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
+//! Max memory allocated to block tree DB specific cache (MiB)
 static const int64_t nMaxBlockDBCache = 2;
-//! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
+//! Max memory allocated to tx index DB specific cache (MiB)
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
-static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
+static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to address index DB specific cache (MiB)
+static const int64_t nMaxAddressIndexCache = 1024;
+//! Max memory allocated to spent index DB specific cache (MiB)
+static const int64_t nMaxSpentIndexCache = 256;
+//! Max memory allocated to coin stats index DB specific cache (MiB)
+static const int64_t nMaxCoinStatsIndexCache = 8;
+//! Max memory allocated to all block filter index caches combined in MiB.
+static const int64_t max_filter_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -80,6 +89,10 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     CCoinsViewCursor* Cursor() const override;
+    //! Cursor over the coins of a snapshot of the database (see GetSnapshot)
+    CCoinsViewCursor* Cursor(const CDBSnapshot& snapshot) const;
+    //! Consistent view of the database, to read it while it keeps being written (UTXO snapshots)
+    std::unique_ptr<CDBSnapshot> GetSnapshot() const;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
@@ -90,6 +103,11 @@ public:
                     const uint256& hashSaplingAnchor,
                     CAnchorsSaplingMap& mapSaplingAnchors,
                     CNullifiersMap& mapSaplingNullifiers) override;
+    bool BatchWritePartial(CCoinsMap& mapCoins,
+                           const uint256& hashBlock,
+                           const uint256& hashSaplingAnchor,
+                           CAnchorsSaplingMap& mapSaplingAnchors,
+                           CNullifiersMap& mapSaplingNullifiers) override;
 
     // Sapling, the implementation of the following functions can be found in sapling_txdb.cpp.
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const override;
@@ -99,6 +117,16 @@ public:
                            CAnchorsSaplingMap& mapSaplingAnchors,
                            CNullifiersMap& mapSaplingNullifiers,
                            CDBBatch& batch);
+    //! Visit all the Sapling anchors and nullifiers in database order (for UTXO snapshots), as of
+    //! the given database snapshot, if any. Stops, and returns false, as soon as the visitor
+    //! returns false or a record can't be read.
+    bool ForEachSaplingAnchor(const std::function<bool(const uint256&, const SaplingMerkleTree&)>& func,
+                              const CDBSnapshot* snapshot = nullptr) const;
+    bool ForEachSaplingNullifier(const std::function<bool(const uint256&)>& func,
+                                 const CDBSnapshot* snapshot = nullptr) const;
+
+private:
+    CCoinsViewCursor* NewCursor(CDBIterator* pcursor) const;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -138,8 +166,6 @@ public:
     bool ReadLastBlockFile(int& nFile);
     bool WriteReindexing(bool fReindexing);
     bool ReadReindexing(bool& fReindexing);
-    bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& vect);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
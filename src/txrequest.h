@@ -0,0 +1,109 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_TXREQUEST_H
+#define PIVX_TXREQUEST_H
+
+#include "net.h" // For NodeId
+#include "protocol.h"
+#include "uint256.h"
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+ * Data structure to keep track of, and schedule, the requests of the inventory items (transactions
+ * and tier two objects) announced by the peers.
+ *
+ * For every (peer, hash) announcement it keeps a state:
+ * - CANDIDATE: announced, but not requested. It becomes requestable at its reqtime, which the caller
+ *   delays for non-preferred or overloaded peers.
+ * - REQUESTED: requested, until a response (the item or a NOTFOUND) arrives or it expires.
+ * - COMPLETED: response received, request expired or peer disconnected. Kept so that the item is not
+ *   requested twice from the same peer.
+ *
+ * For every hash, at most one announcement is requested at a time. Among the requestable candidates
+ * the preferred peers (outbound ones) come first, then a salted hash of the peer and the item picks one,
+ * so that peers can't predict, nor influence, who gets asked. When a request expires, or its peer
+ * disconnects or replies NOTFOUND, the next candidate becomes requestable straight away.
+ *
+ * All the operations are logarithmic in the number of tracked announcements (GetRequestable is also
+ * linear in the number of returned items), and everything about a hash is dropped as soon as no
+ * candidate nor requested announcement is left for it. The memory is bounded by the caller, which
+ * limits the number of announcements tracked for each peer.
+ *
+ * Not thread safe: in net_processing it's guarded by cs_main.
+ */
+class TxRequestTracker
+{
+    // Avoid littering this header file with implementation details.
+    class Impl;
+    const std::unique_ptr<Impl> m_impl;
+
+public:
+    //! Construct a TxRequestTracker. With deterministic set, the peer selection doesn't depend on a random salt (tests).
+    explicit TxRequestTracker(bool deterministic = false);
+    ~TxRequestTracker();
+
+    // Conceptually, the data structure consists of a collection of "announcements", one for each peer/hash
+    // combination:
+
+    /** Adds a new CANDIDATE announcement, unless the peer already announced the same hash.
+     *  It becomes requestable from reqtime. */
+    void ReceivedInv(NodeId peer, const CInv& inv, bool preferred, std::chrono::microseconds reqtime);
+
+    /** Deletes all the announcements of a peer. Their items get requested from other peers. */
+    void DisconnectedPeer(NodeId peer);
+
+    /** Deletes all the announcements of a hash, once the item is received (or not wanted anymore). */
+    void ForgetInvHash(const uint256& hash);
+
+    /** Find the items to request now from a peer, in announcement order.
+     *
+     *  It first moves the announcements whose reqtime or expiry passed (at now), and reports in expired
+     *  (if not nullptr) the requests that timed out. The caller must call RequestedInv (or ForgetInvHash)
+     *  for each returned item, before the next call to GetRequestable.
+     */
+    std::vector<CInv> GetRequestable(NodeId peer, std::chrono::microseconds now,
+                                     std::vector<std::pair<NodeId, CInv>>* expired = nullptr);
+
+    /** Marks an announcement returned by GetRequestable as REQUESTED, until the expiry time.
+     *  It's a no-op if the peer has no CANDIDATE announcement for the hash. */
+    void RequestedInv(NodeId peer, const uint256& hash, std::chrono::microseconds expiry);
+
+    /** Converts the announcement of a hash by a peer to COMPLETED, when the peer sent the item or a NOTFOUND. */
+    void ReceivedResponse(NodeId peer, const uint256& hash);
+
+    // The following functions don't modify the state of the data structure.
+
+    /** Count how many REQUESTED announcements a peer has. */
+    size_t CountInFlight(NodeId peer) const;
+
+    /** Count how many CANDIDATE announcements a peer has. */
+    size_t CountCandidates(NodeId peer) const;
+
+    /** Count how many announcements a peer has (REQUESTED, CANDIDATE and COMPLETED). */
+    size_t Count(NodeId peer) const;
+
+    /** Count how many announcements are being tracked in total across all peers and hashes. */
+    size_t Size() const;
+
+    /** Access to the internal priority computation (testing only) */
+    uint64_t ComputePriority(const uint256& hash, NodeId peer, bool preferred) const;
+
+    /** Run internal consistency check (testing only). */
+    void SanityCheck() const;
+
+    /** Run a time-dependent internal consistency check (testing only).
+     *
+     * This can only be called immediately after GetRequestable, with the same 'now' parameter.
+     */
+    void PostGetRequestableSanityCheck(std::chrono::microseconds now) const;
+};
+
+#endif // PIVX_TXREQUEST_H
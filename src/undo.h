@@ -8,6 +8,7 @@
 #define BITCOIN_UNDO_H
 
 #include "chain.h"
+#include "coins.h"
 #include "compressor.h"
 #include "consensus/consensus.h"
 #include "primitives/transaction.h"
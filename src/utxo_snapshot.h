@@ -0,0 +1,56 @@
+// Copyright (c) 2022 The PIVX developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_UTXO_SNAPSHOT_H
+#define PIVX_UTXO_SNAPSHOT_H
+
+#include "amount.h"
+#include "protocol.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <cstring>
+#include <vector>
+
+/**
+ * Metadata at the start of a UTXO snapshot file (dumptxoutset/loadtxoutset).
+ * It is followed, in database order, by the coins, the Sapling anchors and
+ * nullifiers, and the consensus records of the evo database at the snapshot block.
+ * The hash of the whole file content is what the chain params commit to.
+ */
+class SnapshotMetadata
+{
+public:
+    static const uint8_t CURRENT_VERSION = 1;
+
+    uint8_t nVersion{CURRENT_VERSION};
+    CMessageHeader::MessageStartChars pchMessageStart{};
+    //! The block the snapshot was taken at
+    uint256 hashBlock;
+    //! Chain values of the snapshot block, which can't be computed without the history
+    uint64_t nChainTx{0};
+    CAmount nChainSaplingValue{0};
+    std::vector<unsigned char> vStakeModifier;
+    uint256 hashSaplingAnchor;
+    //! Number of records of each kind
+    uint64_t nCoins{0};
+    uint64_t nSaplingAnchors{0};
+    uint64_t nSaplingNullifiers{0};
+    uint64_t nEvoRecords{0};
+
+    SnapshotMetadata() {}
+    explicit SnapshotMetadata(const CMessageHeader::MessageStartChars& pchMessageStartIn)
+    {
+        memcpy(pchMessageStart, pchMessageStartIn, CMessageHeader::MESSAGE_START_SIZE);
+    }
+
+    SERIALIZE_METHODS(SnapshotMetadata, obj)
+    {
+        READWRITE(obj.nVersion, obj.pchMessageStart, obj.hashBlock, obj.nChainTx, obj.nChainSaplingValue,
+                  obj.vStakeModifier, obj.hashSaplingAnchor);
+        READWRITE(obj.nCoins, obj.nSaplingAnchors, obj.nSaplingNullifiers, obj.nEvoRecords);
+    }
+};
+
+#endif // PIVX_UTXO_SNAPSHOT_H
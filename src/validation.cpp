@@ -22,9 +22,12 @@
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
 #include "consensus/zerocoin_verify.h"
+#include "ctpl_stl.h"
+#include "evo/deterministicmns.h"
 #include "evo/specialtx_validation.h"
 #include "flatfile.h"
 #include "guiinterface.h"
+#include "index/txindex.h"
 #include "invalid.h"
 #include "interfaces/handler.h"
 #include "legacy/validation_zerocoin_legacy.h"
@@ -34,6 +37,7 @@
 #include "policy/policy.h"
 #include "pow.h"
 #include "reverse_iterate.h"
+#include "sapling/sapling_validation.h"
 #include "script/sigcache.h"
 #include "shutdown.h"
 #include "spork.h"
@@ -42,7 +46,9 @@
 #include "tiertwo/tiertwo_sync_state.h"
 #include "txdb.h"
 #include "undo.h"
+#include "utxo_snapshot.h"
 #include "util/system.h"
+#include "util/threadnames.h"
 #include "util/validation.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
@@ -50,11 +56,13 @@
 #include "zpiv/zpivmodule.h"
 
 #include <future>
+#include <numeric>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 #include <atomic>
 #include <queue>
+#include <thread>
 
 
 #if defined(NDEBUG)
@@ -78,6 +86,8 @@
  */
 RecursiveMutex cs_main;
 
+//! Owns the entries of mapBlockIndex
+static CBlockIndexArena g_block_index_arena;
 BlockMap mapBlockIndex;
 CChain chainActive;
 CBlockIndex* pindexBestHeader = NULL;
@@ -89,12 +99,17 @@ uint256 g_best_block;
 int64_t g_best_block_time = 0;
 
 int nScriptCheckThreads = 0;
+int nImportThreads = 1;
 std::atomic<bool> fImporting{false};
 std::atomic<bool> fReindex{false};
-bool fTxIndex = true;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
+bool fIncrementalFlush = DEFAULT_INCREMENTAL_FLUSH;
 size_t nCoinCacheUsage = 5000 * 300;
+bool fHavePruned = false;
+bool fPruneMode = false;
+uint64_t nPruneTarget = 0;
+uint256 hashAssumeValid;
 
 /* If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -174,6 +189,12 @@ std::set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 std::set<int> setDirtyFileInfo;
+
+/** Global flag to indicate we should check to see if there are
+ *  block/undo files that should be deleted.  Set on startup
+ *  or if we allocate more file space when we're in prune mode
+ */
+bool fCheckForPruning = false;
 } // anon namespace
 
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
@@ -675,28 +696,10 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBl
             return true;
         }
 
-        if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut->GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
-            }
-
-            // transaction not found in the index, nothing more can be done
-            return false;
+        // Once in sync, the index is written when the blocks are connected. While it
+        // is still catching up with the chain, fall back to the slow lookup on a miss.
+        if (g_txindex && g_txindex->FindTx(hash, hashBlock, txOut)) {
+            return true;
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
@@ -787,6 +790,56 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 }
 
 
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos)
+{
+    // The block is preceded by the message start and its size (see WriteBlockToDisk)
+    FlatFilePos hpos = pos;
+    hpos.nPos -= CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars blk_start;
+        unsigned int blk_size;
+        filein >> blk_start >> blk_size;
+        if (memcmp(blk_start, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0) {
+            return error("%s : Block magic mismatch for %s: %s versus expected %s", __func__, pos.ToString(),
+                         HexStr(blk_start), HexStr(Params().MessageStart()));
+        }
+        if (blk_size > MAX_SIZE) {
+            return error("%s : Block data is larger than maximum deserialization size for %s: %s versus %s", __func__,
+                         pos.ToString(), blk_size, MAX_SIZE);
+        }
+        block.resize(blk_size);
+        filein.read((char*)block.data(), blk_size);
+    } catch (const std::exception& e) {
+        return error("%s : Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex)
+{
+    FlatFilePos blockPos = WITH_LOCK(cs_main, return pindex->GetBlockPos(); );
+    if (!ReadRawBlockFromDisk(block, blockPos)) {
+        return false;
+    }
+    // Only the header is deserialized and hashed, not the whole block
+    try {
+        CBlockHeader header;
+        VectorReader(SER_DISK, CLIENT_VERSION, block, 0, header);
+        if (header.GetHash() != pindex->GetBlockHash()) {
+            LogPrintf("%s : block=%s index=%s\n", __func__, header.GetHash().GetHex(), pindex->GetBlockHash().GetHex());
+            return error("ReadRawBlockFromDisk(std::vector<uint8_t>&, CBlockIndex*) : GetHash() doesn't match index");
+        }
+    } catch (const std::exception& e) {
+        return error("%s : Deserialize block header failed: %s for %s", __func__, e.what(), blockPos.ToString());
+    }
+    return true;
+}
+
 double ConvertBitsToDouble(unsigned int nBits)
 {
     int nShift = (nBits >> 24) & 0xff;
@@ -994,7 +1047,7 @@ void static InvalidBlockFound(CBlockIndex* pindex, const CValidationState& state
     }
 }
 
-static bool SkipInvalidUTXOS(int nHeight)
+bool SkipInvalidUTXOS(int nHeight)
 {
     const Consensus::Params& consensus = Params().GetConsensus();
     return Params().NetworkIDString() == CBaseChainParams::MAIN &&
@@ -1229,6 +1282,15 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const FlatFilePos& pos, const uint2
 
 } // anon namespace
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    const FlatFilePos pos = pindex->GetUndoPos();
+    if (pos.IsNull() || !pindex->pprev) {
+        return error("%s: no undo data available", __func__);
+    }
+    return UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash());
+}
+
 enum DisconnectResult
 {
     DISCONNECT_OK,      // All good.
@@ -1399,7 +1461,50 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState& state, int nFile, FlatFilePos& pos, unsigned int nAddSize);
 
+/**
+ * Read a range of the coins spent by a block from the coins database, see
+ * PrefetchInputs. Misses (and read errors, which are reported when the coin
+ * is read again by ConnectBlock) leave the coin spent.
+ */
+class CCoinsPrefetch
+{
+private:
+    const CCoinsView* view{nullptr};
+    std::vector<std::pair<COutPoint, Coin>>* pvCoins{nullptr};
+    size_t nBegin{0};
+    size_t nEnd{0};
+
+public:
+    CCoinsPrefetch() {}
+    CCoinsPrefetch(const CCoinsView* viewIn, std::vector<std::pair<COutPoint, Coin>>* pvCoinsIn, size_t nBeginIn, size_t nEndIn) :
+        view(viewIn), pvCoins(pvCoinsIn), nBegin(nBeginIn), nEnd(nEndIn) {}
+
+    bool operator()()
+    {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            std::pair<COutPoint, Coin>& entry = (*pvCoins)[i];
+            try {
+                if (!view->GetCoin(entry.first, entry.second)) entry.second.Clear();
+            } catch (const std::runtime_error&) {
+                entry.second.Clear();
+            }
+        }
+        return true;
+    }
+
+    void swap(CCoinsPrefetch& check)
+    {
+        std::swap(view, check.view);
+        std::swap(pvCoins, check.pvCoins);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+    }
+};
+
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CSaplingCheck> saplingcheckqueue(8);
+static CCheckQueue<CCoinsPrefetch> coinsprefetchqueue(1);
+static CCheckQueue<CZerocoinSpendCheck> zerocoincheckqueue(8);
 
 void ThreadScriptCheck()
 {
@@ -1407,6 +1512,73 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+void ThreadSaplingCheck()
+{
+    util::ThreadRename("pivx-saplingch");
+    saplingcheckqueue.Thread();
+}
+
+void ThreadCoinsPrefetch()
+{
+    util::ThreadRename("pivx-prefetch");
+    coinsprefetchqueue.Thread();
+}
+
+void ThreadZerocoinCheck()
+{
+    util::ThreadRename("pivx-zerocoinch");
+    zerocoincheckqueue.Thread();
+}
+
+/** Coins read by each worker of the prefetch queue at once */
+static const size_t PREFETCH_BATCH_SIZE = 8;
+
+/**
+ * Read the coins spent by a block from the coins database with the prefetch
+ * queue workers, and add them to pcoinsTip. ConnectBlock then finds them in
+ * the cache, instead of reading them one at a time on this thread. The coins
+ * created by the block itself, and the ones already cached, are skipped.
+ *
+ * cs_main is held from the reads to the insertion in the cache, so that the
+ * database can't be flushed in between.
+ */
+static void PrefetchInputs(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads || !pcoinsdbview) return;
+
+    std::unordered_set<uint256, SaltedIdHasher> setBlockTxids;
+    for (const CTransactionRef& tx : block.vtx) {
+        setBlockTxids.insert(tx->GetHash());
+    }
+    std::vector<std::pair<COutPoint, Coin>> vCoins;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (tx->IsCoinBase() || tx->HasZerocoinSpendInputs()) continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (setBlockTxids.count(txin.prevout.hash) || pcoinsTip->HaveCoinInCache(txin.prevout)) continue;
+            vCoins.emplace_back(txin.prevout, Coin());
+        }
+    }
+    // Not worth waking up the workers
+    if (vCoins.size() < 2 * PREFETCH_BATCH_SIZE) return;
+
+    {
+        CCheckQueueControl<CCoinsPrefetch> control(&coinsprefetchqueue);
+        std::vector<CCoinsPrefetch> vChecks;
+        for (size_t i = 0; i < vCoins.size(); i += PREFETCH_BATCH_SIZE) {
+            vChecks.emplace_back(pcoinsdbview.get(), &vCoins, i, std::min(i + PREFETCH_BATCH_SIZE, vCoins.size()));
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    for (std::pair<COutPoint, Coin>& entry : vCoins) {
+        if (!entry.second.IsSpent()) {
+            pcoinsTip->AddFetchedCoin(entry.first, std::move(entry.second));
+        }
+    }
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeProcessSpecial = 0;
 static int64_t nTimeConnect = 0;
@@ -1416,6 +1588,24 @@ static int64_t nTimeTotal = 0;
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
+bool IsBlockAssumedValid(const CBlockIndex* pindex, const CBlockIndex* pindexAssumeValid, const CBlockIndex* pindexBestHeader,
+                         const Consensus::Params& consensus)
+{
+    if (!pindexAssumeValid || !pindexBestHeader ||
+            pindexAssumeValid->GetAncestor(pindex->nHeight) != pindex ||
+            pindexBestHeader->GetAncestor(pindexAssumeValid->nHeight) != pindexAssumeValid) {
+        return false;
+    }
+    // This block is a member of the assumed verified chain, and the best header builds on top of it.
+    // The equivalent time check discourages hash power from extorting the network via DOS attack
+    //  into accepting an invalid block through telling users they must manually set assumevalid.
+    //  Requiring a software change or burying the invalid block, regardless of the setting, makes
+    //  it hard to hide the implication of the demand. This also avoids having release candidates
+    //  that are hardly doing any signature verification at all in testing without having to
+    //  artificially set the default assumed verified block further back.
+    return GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensus) > 60 * 60 * 24 * 7 * 2;
+}
+
 static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     AssertLockHeld(cs_main);
@@ -1459,6 +1649,8 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     if (block.GetHash() == consensus.hashGenesisBlock) {
         if (!fJustCheck) {
             view.SetBestBlock(pindex->GetBlockHash());
+            if (g_txindex && !g_txindex->ConnectBlock(block, pindex))
+                return AbortNode(state, "Failed to write transaction index");
         }
         return true;
     }
@@ -1488,6 +1680,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     }
 
     bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
+    if (fScriptChecks && !hashAssumeValid.IsNull()) {
+        // We've been configured with the hash of a block which has been externally verified to have a valid history.
+        // No default value is included with the software (defaultAssumeValid is unset on every network): it is only
+        //  enabled by configuring -assumevalid with a block that the user has reviewed.
+        // This setting doesn't force the selection of any particular chain but makes validating some faster by
+        //  effectively caching the result of part of the verification.
+        // Only the script checks are skipped: the inputs, amounts and sapling proofs are always verified.
+        fScriptChecks = !IsBlockAssumedValid(pindex, LookupBlockIndex(hashAssumeValid), pindexBestHeader, consensus);
+    }
 
     // If scripts won't be checked anyways, don't bother seeing if CLTV is activated
     bool fCLTVIsActivated = false;
@@ -1496,15 +1697,14 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     }
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    CCheckQueueControl<CSaplingCheck> saplingControl(nScriptCheckThreads ? &saplingcheckqueue : nullptr);
+    CCheckQueueControl<CZerocoinSpendCheck> zerocoinControl(nScriptCheckThreads ? &zerocoincheckqueue : nullptr);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
     int nInputs = 0;
     unsigned int nSigOps = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     std::vector<std::pair<CBigNum, uint256> > vSpends;
-    vPos.reserve(block.vtx.size());
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     CAmount nValueOut = 0;
@@ -1517,6 +1717,17 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     std::vector<PrecomputedTransactionData> precomTxData;
     precomTxData.reserve(block.vtx.size()); // Required so that pointers to individual precomTxData don't get invalidated
+
+    // Shielded txs are batch-verified, splitting them evenly across the check queue workers
+    std::vector<const CTransaction*> vSaplingTxes;
+    size_t nSaplingBatchSize = 1;
+    if (isV5UpgradeEnforced) {
+        const size_t nSaplingTxes = std::count_if(block.vtx.begin(), block.vtx.end(),
+                                                  [](const CTransactionRef& tx) { return tx->hasSaplingData(); });
+        const size_t nWorkers = std::max(nScriptCheckThreads, 1);
+        nSaplingBatchSize = std::max((size_t)1, (nSaplingTxes + nWorkers - 1) / nWorkers);
+        vSaplingTxes.reserve(nScriptCheckThreads ? nSaplingBatchSize : nSaplingTxes);
+    }
     bool fInitialBlockDownload = IsInitialBlockDownload();
     bool fSaplingMaintenance =  (block.nTime > sporkManager.GetSporkValue(SPORK_20_SAPLING_MAINTENANCE));
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
@@ -1532,12 +1743,27 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             return state.DoS(100, error("%s : shielded transactions are currently in maintenance mode", __func__));
         }
 
+        // Sapling proofs (skipped by ContextualCheckBlock), batch-verified
+        if (isV5UpgradeEnforced && tx.hasSaplingData()) {
+            vSaplingTxes.emplace_back(&tx);
+            if (nScriptCheckThreads && vSaplingTxes.size() >= nSaplingBatchSize) {
+                std::vector<CSaplingCheck> vSaplingChecks;
+                vSaplingChecks.emplace_back(std::move(vSaplingTxes), fJustCheck /* cacheStore */);
+                vSaplingTxes.clear();
+                saplingControl.Add(vSaplingChecks);
+            }
+        }
+
         // When v5 is enforced ContextualCheckTransaction rejects zerocoin transactions.
         // Therefore no need to call HasZerocoinSpendInputs after the enforcement.
         if (!isV5UpgradeEnforced && tx.HasZerocoinSpendInputs()) {
-            if (!ParseAndValidateZerocoinSpends(consensus, tx, pindex->nHeight, state, vSpends)) {
+            // The spends signatures are verified by the zerocoin check queue workers
+            std::vector<CZerocoinSpendCheck> vZerocoinChecks;
+            if (!ParseAndValidateZerocoinSpends(consensus, block.vtx[i], pindex->nHeight, state, vSpends,
+                                                nScriptCheckThreads ? &vZerocoinChecks : nullptr)) {
                 return false; // Invalidity/DoS is handled by the function.
             }
+            zerocoinControl.Add(vZerocoinChecks);
         } else if (!tx.IsCoinBase()) {
             if (!view.HaveInputs(tx)) {
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputs-missingorspent");
@@ -1591,9 +1817,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                 sapling_tree.append(outputDescription.cmu);
             }
         }
+    }
 
-        vPos.emplace_back(tx.GetHash(), pos);
-        pos.nTxOffset += ::GetSerializeSize(tx, CLIENT_VERSION);
+    // Verify the last batch of Sapling proofs
+    if (nScriptCheckThreads) {
+        std::vector<CSaplingCheck> vSaplingChecks;
+        vSaplingChecks.emplace_back(std::move(vSaplingTxes), fJustCheck /* cacheStore */);
+        saplingControl.Add(vSaplingChecks);
+    } else if (!SaplingValidation::BatchCheckTransactionsProofs(vSaplingTxes, state, fJustCheck /* cacheStore */)) {
+        return error("%s: Sapling proofs verification failed with %s", __func__, FormatStateMessage(state));
     }
 
     // Push new tree anchor
@@ -1648,6 +1880,10 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     if (!control.Wait())
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    if (!saplingControl.Wait())
+        return state.DoS(100, error("%s: Sapling CheckQueue failed", __func__), REJECT_INVALID, "bad-txns-sapling-proofs-invalid");
+    if (!zerocoinControl.Wait())
+        return state.DoS(100, error("%s: Zerocoin CheckQueue failed", __func__), REJECT_INVALID, "bad-txns-invalid-zpiv");
     int64_t nTime2 = GetTimeMicros();
     nTimeVerify += nTime2 - nTimeStart;
     LogPrint(BCLog::BENCHMARK, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs - 1), nTimeVerify * 0.000001);
@@ -1685,9 +1921,10 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     if (!vSpends.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpends))
         return AbortNode(state, "Failed to record coin serials to database");
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
+    // The consensus checks of the next blocks look up the txs of this one (e.g. the zerocoin
+    // mints, which never enter the UTXO set): index it before it becomes the tip.
+    if (g_txindex && !g_txindex->ConnectBlock(block, pindex))
+        return AbortNode(state, "Failed to write transaction index");
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -1720,10 +1957,137 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     return true;
 }
 
+uint64_t CalculateCurrentUsage()
+{
+    LOCK(cs_LastBlockFile);
+
+    uint64_t retval = 0;
+    for (const CBlockFileInfo& file : vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
+void PruneOneBlockFile(const int fileNumber)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_LastBlockFile);
+
+    for (const auto& entry : mapBlockIndex) {
+        CBlockIndex* pindex = entry.second;
+        if (pindex->nFile == fileNumber) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            auto range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
+                range.first++;
+                if (it->second == pindex) {
+                    mapBlocksUnlinked.erase(it);
+                }
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
+{
+    for (const int nFile : setFilesToPrune) {
+        FlatFilePos pos(nFile, 0);
+        fs::remove(BlockFileSeq().FileName(pos));
+        fs::remove(UndoFileSeq().FileName(pos));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, nFile);
+    }
+}
+
+/**
+ * Calculate the block/rev files that should be deleted to remain under target.
+ * Block files holding a block within MIN_BLOCKS_TO_KEEP (or -maxreorg, if larger) of the
+ * tip are kept: reorgs, the PoS fork checks of AcceptBlock and the wallet sapling witness
+ * cache read at most that deep. Masternode and budget lookbacks only use the block index,
+ * and the sapling anchors live in the chainstate, so neither needs the block files.
+ */
+static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight)
+{
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == nullptr || nPruneTarget == 0) {
+        return;
+    }
+    if ((uint64_t)chainActive.Tip()->nHeight <= nPruneAfterHeight) {
+        return;
+    }
+
+    const int nKeepBlocks = std::max<int>(MIN_BLOCKS_TO_KEEP, gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH) + 1);
+    const int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - nKeepBlocks;
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files,
+    // so we should leave a buffer under our target to account for another allocation
+    // before the next pruning.
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    int count = 0;
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+            uint64_t nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0)
+                continue;
+
+            if (nCurrentUsage + nBuffer < nPruneTarget) // are we below our target?
+                break;
+
+            // don't prune files that could have a block within nKeepBlocks of the main chain's tip but keep scanning
+            if ((int)vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+                continue;
+
+            PruneOneBlockFile(fileNumber);
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            count++;
+        }
+    }
+
+    LogPrint(BCLog::PRUNE, "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+            nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+            ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
+            nLastBlockWeCanPrune, count);
+}
+
+/** Whether the coins database holds changes of pcoinsTip written by an incremental write,
+ *  and is thus inconsistent until the next full flush. */
+static bool fCoinsPartiallyWritten = false;
+
+/** Whether the coins database head (the block of its partially written coins, if any) is hashBlock
+ *  or one of its ancestors, so that writing the coins of hashBlock completes it. */
+static bool IsCoinsHeadOrAncestor(const uint256& hashBlock) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    const std::vector<uint256> vHeads = pcoinsdbview->GetHeadBlocks();
+    if (vHeads.empty() || vHeads[0] == hashBlock) return true;
+    const CBlockIndex* pindexHead = LookupBlockIndex(vHeads[0]);
+    const CBlockIndex* pindex = LookupBlockIndex(hashBlock);
+    return pindexHead && pindex && pindex->GetAncestor(pindexHead->nHeight) == pindexHead;
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
  * fast is not set and it's been a while since the last write.
+ * With -incrementalflush, the oldest changes of the coins cache are written every few seconds
+ * in between, and unmodified entries are evicted to keep it below the limit.
  * Full flush also updates the money supply from disk (except during shutdown)
  */
 bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
@@ -1733,7 +2097,21 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
+    static int64_t nLastIncrementalWrite = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
+        if (fPruneMode && fCheckForPruning && !fReindex) {
+            FindFilesToPrune(setFilesToPrune, Params().PruneAfterHeight());
+            fCheckForPruning = false;
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
         int64_t nNow = GetTimeMicros();
         // Avoid writing/flushing immediately after startup.
         if (nLastWrite == 0) {
@@ -1748,11 +2126,14 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
         int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
         cacheSize += evoDb->GetMemoryUsage();
+        // With incremental writes, the memory of the evicted entries is kept for reuse:
+        // only the memory in use tells how close to full the cache is.
+        int64_t cacheInUse = cacheSize - (fIncrementalFlush ? pcoinsTip->ReusableMemoryUsage() : 0);
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now
         // (not in the middle of a block processing).
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC &&
-                cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
+                cacheInUse > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
         // The cache is over the limit, we have to write now.
         bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && (unsigned) cacheSize > nCoinCacheUsage;
         // It's been a while since we wrote the block index to disk.
@@ -1761,9 +2142,17 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
         bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
-        bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush;
+        bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+        // Write the oldest changes of the coins cache, and make room in it, every few seconds
+        // (every second when it is filling up), so that the full flushes are rarely needed.
+        bool fCacheFilling = cacheInUse > (int64_t)(8 * nCoinCacheUsage) / 10;
+        bool fIncrementalStep = fIncrementalFlush && !fDoFullFlush &&
+                (mode == FLUSH_STATE_IF_NEEDED || mode == FLUSH_STATE_PERIODIC) &&
+                nNow > nLastIncrementalWrite + (fCacheFilling ? 1 : (int64_t)DATABASE_INCREMENTAL_WRITE_INTERVAL) * 1000000 &&
+                !pcoinsTip->GetBestBlock().IsNull();
+        bool fIncrementalWrite = fIncrementalStep && pcoinsTip->GetDirtyQueueSize() > 0;
         // Write blocks and block index to disk.
-        if (fDoFullFlush || fPeriodicWrite) {
+        if (fDoFullFlush || fPeriodicWrite || fIncrementalWrite) {
             // Depend on nMinDiskSpace to ensure we can write block index
             if (!CheckDiskSpace(GetBlocksDir())) {
                 return AbortNode(state, "Disk space is low!", _("Error: Disk space is low!"));
@@ -1791,9 +2180,18 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             // Flush zerocoin accumulator checkpoints cache
             if (accumulatorCache) accumulatorCache->Flush();
 
+            // Finally remove any pruned files
+            if (fFlushForPrune)
+                UnlinkPrunedFiles(setFilesToPrune);
             nLastWrite = nNow;
         }
 
+        // The coins partially written to the database can only be completed by those of the
+        // same block or of a descendant (the writes move forward along the chain).
+        if (fCoinsPartiallyWritten && (fDoFullFlush || fIncrementalWrite) &&
+                !IsCoinsHeadOrAncestor(pcoinsTip->GetBestBlock())) {
+            return AbortNode(state, "The coins database was partially written for a block not in the chain");
+        }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
         if (fDoFullFlush && !pcoinsTip->GetBestBlock().IsNull()) {
             // Typical Coin structures on disk are around 48 bytes in size.
@@ -1810,12 +2208,33 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             if (!evoDb->CommitRootTransaction()) {
                 return AbortNode(state, "Failed to commit EvoDB");
             }
+            fCoinsPartiallyWritten = false;
             nLastFlush = nNow;
             // Update money supply on memory, reading data from disk
             if (!ShutdownRequested() && !IsInitialBlockDownload()) {
                 MoneySupply.Update(pcoinsTip->GetTotalAmount(), chainActive.Height());
             }
         }
+        // Write part of the chainstate (which may refer to block index entries too). The evo
+        // database is left to the full flush: ReplayBlocks rolls it forward after a crash.
+        if (fIncrementalWrite) {
+            if (!CheckDiskSpace(GetDataDir(), 48 * 2 * 2 * MAX_INCREMENTAL_WRITE_COINS)) {
+                return AbortNode(state, "Disk space is low!", _("Error: Disk space is low!"));
+            }
+            if (!pcoinsTip->WriteOldestDirty(MAX_INCREMENTAL_WRITE_COINS))
+                return AbortNode(state, "Failed to write to coin database");
+            fCoinsPartiallyWritten = true;
+        }
+        if (fIncrementalStep) {
+            // Evict unmodified entries to make room in the coins cache, instead of flushing it.
+            if (cacheInUse > (int64_t)(85 * nCoinCacheUsage) / 100) {
+                const int64_t nTarget = (int64_t)(7 * nCoinCacheUsage) / 10 - evoDb->GetMemoryUsage();
+                size_t nEvicted = pcoinsTip->UncacheClean(std::max<int64_t>(nTarget, 0));
+                LogPrint(BCLog::COINDB, "Evicted %u unmodified coins from the cache (%u waiting to be written)\n",
+                         (unsigned int)nEvicted, (unsigned int)pcoinsTip->GetDirtyQueueSize());
+            }
+            nLastIncrementalWrite = nNow;
+        }
         if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
             // Update best block in wallet (so we can detect restored wallets).
             GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -1834,6 +2253,13 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush()
+{
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_NONE);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
@@ -1903,6 +2329,10 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
     CBlock& block = *pblock;
     if (!ReadBlockFromDisk(block, pindexDelete))
         return error("%s: Failed to read block", __func__);
+    // The coins database must be consistent before undoing a block whose changes may have
+    // been written incrementally already (ReplayBlocks can't roll back partial writes).
+    if (fCoinsPartiallyWritten && !FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
+        return false;
     // Apply the block atomically to the chain state.
     const uint256& saplingAnchorBeforeDisconnect = pcoinsTip->GetBestAnchor();
     int64_t nStart = GetTimeMicros();
@@ -1961,6 +2391,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2036,6 +2467,10 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const st
     nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCHMARK, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    PrefetchInputs(blockConnecting);
+    int64_t nTime2b = GetTimeMicros();
+    nTimePrefetch += nTime2b - nTime2;
+    LogPrint(BCLog::BENCHMARK, "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTime2b - nTime2) * 0.001, nTimePrefetch * 0.000001);
     {
         auto dbTx = evoDb->BeginTransaction();
 
@@ -2048,8 +2483,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const st
             return error("%s: ConnectBlock %s failed, %s", __func__, pindexNew->GetBlockHash().ToString(), FormatStateMessage(state));
         }
         nTime3 = GetTimeMicros();
-        nTimeConnectTotal += nTime3 - nTime2;
-        LogPrint(BCLog::BENCHMARK, "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        nTimeConnectTotal += nTime3 - nTime2b;
+        LogPrint(BCLog::BENCHMARK, "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2b) * 0.001, nTimeConnectTotal * 0.000001);
         bool flushed = view.Flush();
         assert(flushed);
         dbTx->Commit();
@@ -2433,6 +2868,24 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
+/** Compute and set the stake modifier of pindex. It depends on the block transactions
+ *  (the coinstake prevout, and the PoS flags of the blocks in the selection interval) */
+static void SetBlockIndexStakeModifier(CBlockIndex* pindex, const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (block.IsProofOfStake())
+        pindex->SetProofOfStake();
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+    if (!consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_V3_4)) {
+        // compute and set new V1 stake modifier (entropy bits)
+        pindex->SetNewStakeModifier();
+
+    } else {
+        // compute and set new V2 stake modifier (hash of prevout and prevModifier)
+        pindex->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
+    }
+}
+
 static CBlockIndex* AddToBlockIndex(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     AssertLockHeld(cs_main);
@@ -2444,7 +2897,7 @@ static CBlockIndex* AddToBlockIndex(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRE
         return pindex;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = g_block_index_arena.Emplace(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -2458,15 +2911,10 @@ static CBlockIndex* AddToBlockIndex(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRE
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
 
-        const Consensus::Params& consensus = Params().GetConsensus();
-        if (!consensus.NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_V3_4)) {
-            // compute and set new V1 stake modifier (entropy bits)
-            pindexNew->SetNewStakeModifier();
-
-        } else {
-            // compute and set new V2 stake modifier (hash of prevout and prevModifier)
-            pindexNew->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
-        }
+        // Headers-only entries get their stake modifier later, in AcceptBlock,
+        // when the block data is received.
+        if (!block.vtx.empty())
+            SetBlockIndexStakeModifier(pindexNew, block);
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
@@ -2479,6 +2927,38 @@ static CBlockIndex* AddToBlockIndex(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRE
     return pindexNew;
 }
 
+/** Set the chain values of pindexNew, whose parents all have transactions, and make it a tip
+ *  candidate. Recursively process any descendant blocks that now may be eligible to be connected. */
+static void LinkBlockIndex(CBlockIndex* pindexNew) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    std::deque<CBlockIndex*> queue;
+    queue.push_back(pindexNew);
+
+    while (!queue.empty()) {
+        CBlockIndex* pindex = queue.front();
+        queue.pop_front();
+        pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+
+        // Sapling, update chain value
+        pindex->SetChainSaplingValue();
+
+        {
+            LOCK(cs_nBlockSequenceId);
+            pindex->nSequenceId = nBlockSequenceId++;
+        }
+        if (chainActive.Tip() == NULL || !setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip())) {
+            setBlockIndexCandidates.insert(pindex);
+        }
+        std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
+        while (range.first != range.second) {
+            std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
+            queue.push_back(it->second);
+            range.first++;
+            mapBlocksUnlinked.erase(it);
+        }
+    }
+}
+
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBlockIndex* pindexNew, const FlatFilePos& pos)
 {
@@ -2498,7 +2978,7 @@ bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBl
             saplingValue += -tx->sapData->valueBalance;
         }
     }
-    pindexNew->nSaplingValue = saplingValue;
+    pindexNew->SetSaplingValue(saplingValue);
     pindexNew->nChainSaplingValue = nullopt;
 
     pindexNew->nFile = pos.nFile;
@@ -2510,33 +2990,7 @@ bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBl
 
     if (pindexNew->pprev == NULL || pindexNew->pprev->nChainTx) {
         // If pindexNew is the genesis block or all parents are BLOCK_VALID_TRANSACTIONS.
-        std::deque<CBlockIndex*> queue;
-        queue.push_back(pindexNew);
-
-        // Recursively process any descendant blocks that now may be eligible to be connected.
-        while (!queue.empty()) {
-            CBlockIndex* pindex = queue.front();
-            queue.pop_front();
-            pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
-
-            // Sapling, update chain value
-            pindex->SetChainSaplingValue();
-
-            {
-                LOCK(cs_nBlockSequenceId);
-                pindex->nSequenceId = nBlockSequenceId++;
-            }
-            if (chainActive.Tip() == NULL || !setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip())) {
-                setBlockIndexCandidates.insert(pindex);
-            }
-            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
-            while (range.first != range.second) {
-                std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
-                queue.push_back(it->second);
-                range.first++;
-                mapBlocksUnlinked.erase(it);
-            }
-        }
+        LinkBlockIndex(pindexNew);
     } else {
         if (pindexNew->pprev && pindexNew->pprev->IsValid(BLOCK_VALID_TREE)) {
             mapBlocksUnlinked.emplace(pindexNew->pprev, pindexNew);
@@ -2582,11 +3036,13 @@ bool FindBlockPos(CValidationState& state, FlatFilePos& pos, unsigned int nAddSi
 
     if (!fKnown) {
         bool out_of_space;
-        BlockFileSeq().Allocate(pos, nAddSize, out_of_space);
+        size_t bytes_allocated = BlockFileSeq().Allocate(pos, nAddSize, out_of_space);
         if (out_of_space) {
             return AbortNode("Disk space is low!", _("Error: Disk space is low!"));
         }
-        // future: add prunning flag check
+        if (bytes_allocated != 0 && fPruneMode) {
+            fCheckForPruning = true;
+        }
     }
 
     setDirtyFileInfo.insert(nFile);
@@ -2604,11 +3060,13 @@ bool FindUndoPos(CValidationState& state, int nFile, FlatFilePos& pos, unsigned
     setDirtyFileInfo.insert(nFile);
 
     bool out_of_space;
-    UndoFileSeq().Allocate(pos, nAddSize, out_of_space);
+    size_t bytes_allocated = UndoFileSeq().Allocate(pos, nAddSize, out_of_space);
     if (out_of_space) {
         return AbortNode(state, "Disk space is low!", _("Error: Disk space is low!"));
     }
-    // future: add prunning flag check
+    if (bytes_allocated != 0 && fPruneMode) {
+        fCheckForPruning = true;
+    }
 
     return true;
 }
@@ -2697,7 +3155,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     // because we receive the wrong transactions for it.
 
     // Check the merkle root.
-    if (fCheckMerkleRoot) {
+    if (fCheckMerkleRoot && !block.fCheckedMerkleRoot) {
         bool mutated;
         uint256 hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
@@ -2798,7 +3256,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
             REJECT_INVALID, "bad-blk-sigops", true);
 
     // Check PoS signature.
-    if (fCheckSig && !CheckBlockSignature(block)) {
+    if (fCheckSig && !block.fCheckedSignature && !CheckBlockSignature(block)) {
         return state.DoS(100, error("%s : bad proof-of-stake block signature", __func__),
                          REJECT_INVALID, "bad-PoS-sig", true);
     }
@@ -2809,6 +3267,20 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     return true;
 }
 
+void PreCheckBlock(const CBlock& block)
+{
+    bool mutated;
+    if (!block.fCheckedMerkleRoot && BlockMerkleRoot(block, &mutated) == block.hashMerkleRoot && !mutated) {
+        block.fCheckedMerkleRoot = true;
+    }
+    // Zerocoin stakes are left to CheckBlock: parsing the spend uses the
+    // (lazily initialized) zerocoin params and the coin spends cache.
+    const bool fZerocoinStake = block.IsProofOfStake() && block.vtx[1]->vin[0].IsZerocoinSpend();
+    if (!block.fCheckedSignature && !fZerocoinStake && CheckBlockSignature(block)) {
+        block.fCheckedSignature = true;
+    }
+}
+
 bool CheckWork(const CBlock& block, const CBlockIndex* const pindexPrev)
 {
     if (pindexPrev == NULL)
@@ -2942,8 +3414,9 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     // Check that all transactions are finalized
     for (const auto& tx : block.vtx) {
 
-        // Check transaction contextually against consensus rules at block height
-        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, IsInitialBlockDownload())) {
+        // Check transaction contextually against consensus rules at block height.
+        // Sapling proofs are verified later, in parallel, by ConnectBlock.
+        if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true /* isMined */, IsInitialBlockDownload(), false /* fCheckProofs */)) {
             return false;
         }
 
@@ -3046,6 +3519,40 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
     return true;
 }
 
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CBlockIndex** ppindex)
+{
+    AssertLockNotHeld(cs_main);
+    LOCK(cs_main);
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+    for (const CBlockHeader& header : headers) {
+        // we must use CBlocks, as AcceptBlockHeader/CheckWork don't take CBlockHeaders
+        const CBlock block(header);
+        CBlockIndex* pindex = nullptr;
+        CBlockIndex* pindexPrev = nullptr;
+        if (!LookupBlockIndex(block.GetHash())) {
+            if (!GetPrevIndex(block, &pindexPrev, state))
+                return false;
+
+            // The PoS kernel can only be checked with the coinstake, once the block is downloaded.
+            // Here verify everything that the header alone commits to.
+            const int nHeight = pindexPrev->nHeight + 1;
+            if (!consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_POS) &&
+                    !CheckProofOfWork(block.GetHash(), block.nBits))
+                return state.DoS(50, error("%s : proof of work failed for header %s", __func__, block.GetHash().GetHex()),
+                                 REJECT_INVALID, "high-hash");
+            if (!CheckWork(block, pindexPrev))
+                return state.DoS(100, error("%s : incorrect difficulty for header %s", __func__, block.GetHash().GetHex()),
+                                 REJECT_INVALID, "bad-diffbits");
+        }
+        if (!AcceptBlockHeader(block, state, &pindex, pindexPrev))
+            return false;
+        if (ppindex)
+            *ppindex = pindex;
+    }
+    return true;
+}
+
 /*
  * Collect the sets of the inputs (either regular utxos or zerocoin serials) spent
  * by in-block txes.
@@ -3360,6 +3867,10 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
 
     }
 
+    // Header accepted ahead of the block data (headers-first sync)
+    if (pindex->pprev && pindex->vStakeModifier.empty())
+        SetBlockIndexStakeModifier(pindex, block);
+
     // Write block to history file
     try {
         unsigned int nBlockSize = ::GetSerializeSize(block, CLIENT_VERSION);
@@ -3380,13 +3891,71 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockInde
     return true;
 }
 
-bool ProcessNewBlock(const std::shared_ptr<const CBlock>& pblock, const FlatFilePos* dbp)
+/**
+ * Blocks downloaded ahead of the data of their parent (parallel block download).
+ * The PoS checks of AcceptBlock need the stake modifier and the coins of the previous
+ * block, so these are held in memory and accepted, in order, once the parent is.
+ */
+static std::map<uint256, std::shared_ptr<const CBlock>> mapBlocksPendingParent GUARDED_BY(cs_main);
+static std::multimap<uint256, uint256> mapBlocksPendingByPrev GUARDED_BY(cs_main);
+static size_t nBlocksPendingParentSize GUARDED_BY(cs_main) = 0;
+
+bool IsBlockPendingParent(const uint256& hash)
+{
+    AssertLockHeld(cs_main);
+    return mapBlocksPendingParent.count(hash) > 0;
+}
+
+static bool AddBlockPendingParent(const std::shared_ptr<const CBlock>& pblock) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const uint256& hash = pblock->GetHash();
+    if (mapBlocksPendingParent.count(hash))
+        return true;
+    const size_t nSize = GetSerializeSize(*pblock, CLIENT_VERSION);
+    if (nBlocksPendingParentSize + nSize > MAX_BLOCKS_PENDING_PARENT_SIZE)
+        return false;
+    mapBlocksPendingParent.emplace(hash, pblock);
+    mapBlocksPendingByPrev.emplace(pblock->hashPrevBlock, hash);
+    nBlocksPendingParentSize += nSize;
+    return true;
+}
+
+/** Remove, and return, the pending blocks whose parent is hashParent */
+static std::vector<std::shared_ptr<const CBlock>> TakeBlocksPendingParent(const uint256& hashParent) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    std::vector<std::shared_ptr<const CBlock>> vBlocks;
+    const auto range = mapBlocksPendingByPrev.equal_range(hashParent);
+    for (auto it = range.first; it != range.second; ++it) {
+        auto itBlock = mapBlocksPendingParent.find(it->second);
+        assert(itBlock != mapBlocksPendingParent.end());
+        nBlocksPendingParentSize -= GetSerializeSize(*itBlock->second, CLIENT_VERSION);
+        vBlocks.emplace_back(std::move(itBlock->second));
+        mapBlocksPendingParent.erase(itBlock);
+    }
+    mapBlocksPendingByPrev.erase(range.first, range.second);
+    return vBlocks;
+}
+
+/** Discard the pending descendants of a block that could not be accepted (they will be downloaded again if needed) */
+static void DropBlocksPendingParent(const uint256& hashParent) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    std::deque<uint256> queue{hashParent};
+    while (!queue.empty()) {
+        const uint256 hash = queue.front();
+        queue.pop_front();
+        for (const auto& pblock : TakeBlocksPendingParent(hash))
+            queue.push_back(pblock->GetHash());
+    }
+}
+
+static bool ProcessBlock(const std::shared_ptr<const CBlock>& pblock, const FlatFilePos* dbp, bool& fPendingParent)
 {
     AssertLockNotHeld(cs_main);
 
     // Preliminary checks
     int64_t nStartTime = GetTimeMillis();
     int newHeight = 0;
+    fPendingParent = false;
 
     {
         // CheckBlock requires cs_main lock
@@ -3397,6 +3966,21 @@ bool ProcessNewBlock(const std::shared_ptr<const CBlock>& pblock, const FlatFile
             return error ("%s : CheckBlock FAILED for block %s, %s", __func__, pblock->GetHash().GetHex(), FormatStateMessage(state));
         }
 
+        // The header is known but the parent was not received yet
+        const CBlockIndex* pindexPrev = dbp ? nullptr : LookupBlockIndex(pblock->hashPrevBlock);
+        if (pindexPrev && !(pindexPrev->nStatus & BLOCK_HAVE_DATA)) {
+            fPendingParent = true;
+            // Hold only the blocks of an accepted header chain (the ones that we download), so that
+            // unsolicited blocks can't fill the pool, evicting the legitimate ones.
+            const CBlockIndex* pindex = LookupBlockIndex(pblock->GetHash());
+            if (!pindex || (pindex->nStatus & BLOCK_FAILED_MASK)) {
+                LogPrint(BCLog::NET, "%s : unknown header, discarding block %s pending parent\n", __func__, pblock->GetHash().GetHex());
+            } else if (!AddBlockPendingParent(pblock)) {
+                LogPrint(BCLog::NET, "%s : too many blocks pending, discarding %s\n", __func__, pblock->GetHash().GetHex());
+            }
+            return true;
+        }
+
         // Store to disk
         CBlockIndex* pindex = nullptr;
         bool ret = AcceptBlock(*pblock, state, &pindex, dbp);
@@ -3418,17 +4002,48 @@ bool ProcessNewBlock(const std::shared_ptr<const CBlock>& pblock, const FlatFile
     return true;
 }
 
-bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex* const pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckBlockSig)
+bool ProcessNewBlock(const std::shared_ptr<const CBlock>& pblock, const FlatFilePos* dbp)
 {
-    AssertLockHeld(cs_main);
-    assert(pindexPrev);
-    if (pindexPrev != chainActive.Tip()) {
-        LogPrintf("%s : No longer working on chain tip\n", __func__);
+    AssertLockNotHeld(cs_main);
+
+    bool fPendingParent;
+    if (!ProcessBlock(pblock, dbp, fPendingParent)) {
+        WITH_LOCK(cs_main, DropBlocksPendingParent(pblock->GetHash()); );
         return false;
     }
+    if (fPendingParent)
+        return true;
 
-    CCoinsViewCache viewNew(pcoinsTip.get());
-    CBlockIndex indexDummy(block);
+    // Accept, in order, the blocks that were waiting for this one
+    std::deque<uint256> queue{pblock->GetHash()};
+    while (!queue.empty()) {
+        const uint256 hash = queue.front();
+        queue.pop_front();
+        const auto vBlocks = WITH_LOCK(cs_main, return TakeBlocksPendingParent(hash); );
+        for (const auto& pchild : vBlocks) {
+            if (ProcessBlock(pchild, nullptr, fPendingParent)) {
+                if (!fPendingParent)
+                    queue.push_back(pchild->GetHash());
+            } else {
+                WITH_LOCK(cs_main, DropBlocksPendingParent(pchild->GetHash()); );
+            }
+        }
+    }
+
+    return true;
+}
+
+bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex* const pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckBlockSig)
+{
+    AssertLockHeld(cs_main);
+    assert(pindexPrev);
+    if (pindexPrev != chainActive.Tip()) {
+        LogPrintf("%s : No longer working on chain tip\n", __func__);
+        return false;
+    }
+
+    CCoinsViewCache viewNew(pcoinsTip.get());
+    CBlockIndex indexDummy(block);
     indexDummy.pprev = pindexPrev;
     indexDummy.nHeight = pindexPrev->nHeight + 1;
 
@@ -3487,7 +4102,7 @@ CBlockIndex* InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = g_block_index_arena.Emplace();
     mi = mapBlockIndex.emplace(hash, pindexNew).first;
 
     pindexNew->phashBlock = &((*mi).first);
@@ -3504,28 +4119,40 @@ bool static LoadBlockIndexDB(std::string& strError) EXCLUSIVE_LOCKS_REQUIRED(cs_
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
+    // Calculate nChainWork, in a single pass over the entries ordered by
+    // height. The heights are dense, so the entries are bucketed (counting
+    // sort) rather than compared.
+    std::vector<size_t> vHeightStart;
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        const size_t nBucket = item.second->nHeight + 1;
+        if (vHeightStart.size() <= nBucket) vHeightStart.resize(nBucket + 1, 0);
+        vHeightStart[nBucket]++;
+    }
+    std::partial_sum(vHeightStart.begin(), vHeightStart.end(), vHeightStart.begin());
+    std::vector<CBlockIndex*> vSortedByHeight(mapBlockIndex.size());
+    std::set<int> setBlkDataFiles;
     for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
         CBlockIndex* pindex = item.second;
-        vSortedByHeight.emplace_back(pindex->nHeight, pindex);
+        vSortedByHeight[vHeightStart[pindex->nHeight]++] = pindex;
+        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            setBlkDataFiles.insert(pindex->nFile);
+        }
     }
-    std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
+    for (CBlockIndex* pindex : vSortedByHeight) {
         // Stop if shutdown was requested
         if (ShutdownRequested()) return false;
 
-        CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // We can link the chain of blocks for which we've received transactions at some point.
+        // Pruned nodes may have deleted the block.
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
                     // Sapling, calculate chain index value
                     if (pindex->pprev->nChainSaplingValue) {
-                        pindex->nChainSaplingValue = *pindex->pprev->nChainSaplingValue + pindex->nSaplingValue;
+                        pindex->nChainSaplingValue = *pindex->pprev->nChainSaplingValue + pindex->GetSaplingValue();
                     } else {
                         pindex->nChainSaplingValue = nullopt;
                     }
@@ -3537,7 +4164,7 @@ bool static LoadBlockIndexDB(std::string& strError) EXCLUSIVE_LOCKS_REQUIRED(cs_
                 }
             } else {
                 pindex->nChainTx = pindex->nTx;
-                pindex->nChainSaplingValue = pindex->nSaplingValue;
+                pindex->nChainSaplingValue = pindex->GetSaplingValue();
             }
         }
         if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->nChainTx || pindex->pprev == NULL))
@@ -3550,6 +4177,11 @@ bool static LoadBlockIndexDB(std::string& strError) EXCLUSIVE_LOCKS_REQUIRED(cs_
             pindexBestHeader = pindex;
     }
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
@@ -3569,13 +4201,6 @@ bool static LoadBlockIndexDB(std::string& strError) EXCLUSIVE_LOCKS_REQUIRED(cs_
 
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
-    std::set<int> setBlkDataFiles;
-    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
-        CBlockIndex* pindex = item.second;
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
-            setBlkDataFiles.insert(pindex->nFile);
-        }
-    }
     for (std::set<int>::iterator it = setBlkDataFiles.begin(); it != setBlkDataFiles.end(); it++) {
         FlatFilePos pos(*it, 0);
         if (CAutoFile(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION).IsNull()) {
@@ -3588,15 +4213,19 @@ bool static LoadBlockIndexDB(std::string& strError) EXCLUSIVE_LOCKS_REQUIRED(cs_
     pblocktree->ReadFlag("shutdown", fLastShutdownWasPrepared);
     LogPrintf("%s: Last shutdown was prepared: %s\n", __func__, fLastShutdownWasPrepared);
 
+    // Check whether loading a UTXO snapshot was interrupted
+    bool fLoadingSnapshot = false;
+    pblocktree->ReadFlag("loadingsnapshot", fLoadingSnapshot);
+    if (fLoadingSnapshot) {
+        strError = _("Loading a UTXO snapshot was interrupted, the chainstate must be rebuilt with -reindex");
+        return false;
+    }
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
     if (fReindexing) fReindex = true;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
-
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -3647,6 +4276,30 @@ CVerifyDB::~CVerifyDB()
     uiInterface.ShowProgress("", 100);
 }
 
+/** Checks of levels 0 to 2 of VerifyDB, which only depend on the block and undo data. */
+static bool VerifyBlockData(CBlock& block, const CBlockIndex* pindex, int nCheckLevel) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+
+    // check level 0: read from disk
+    if (!ReadBlockFromDisk(block, pindex))
+        return error("%s: *** ReadBlockFromDisk failed at %d, hash=%s", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
+    // check level 1: verify block validity
+    CValidationState state;
+    if (nCheckLevel >= 1 && !CheckBlock(block, state))
+        return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__, pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
+    // check level 2: verify undo validity
+    if (nCheckLevel >= 2) {
+        CBlockUndo undo;
+        FlatFilePos pos = pindex->GetUndoPos();
+        if (!pos.IsNull()) {
+            if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
+                return error("%s: *** found bad undo data at %d, hash=%s\n", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
+        }
+    }
+    return true;
+}
+
 bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth)
 {
     LOCK(cs_main);
@@ -3683,22 +4336,14 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
         if (pindex->nHeight < chainHeight - nCheckDepth)
             break;
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex))
-            return error("%s: *** ReadBlockFromDisk failed at %d, hash=%s", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state))
-            return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__, pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            FlatFilePos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("%s: *** found bad undo data at %d, hash=%s\n", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
         }
+        CBlock block;
+        if (!VerifyBlockData(block, pindex, nCheckLevel))
+            return false;
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             assert(coins.GetBestBlock() == pindex->GetBlockHash());
@@ -3741,6 +4386,46 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
     return true;
 }
 
+bool VerifyChainData(int nCheckLevel, int nHeightStart, int nHeightEnd)
+{
+    nCheckLevel = std::max(0, std::min(2, nCheckLevel));
+    nHeightStart = std::max(1, nHeightStart);
+    if (nHeightEnd < nHeightStart)
+        return true;
+
+    LogPrintf("Verifying blocks %i to %i at level %i in the background\n", nHeightStart, nHeightEnd, nCheckLevel);
+    const int64_t nStart = GetTimeMillis();
+    int reportDone = 0;
+    for (int nHeight = nHeightEnd; nHeight >= nHeightStart; nHeight--) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            return true;
+
+        // Lock per block, so that the node keeps processing blocks and
+        // messages in between. A reorg below nHeightEnd is harmless: the
+        // blocks of the new active chain get checked instead.
+        LOCK(cs_main);
+        const CBlockIndex* pindex = chainActive[nHeight];
+        if (!pindex)
+            continue;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrintf("%s: block verification stopping at height %d (pruning, no data)\n", __func__, nHeight);
+            break;
+        }
+        CBlock block;
+        if (!VerifyBlockData(block, pindex, nCheckLevel))
+            return false;
+
+        const int percentageDone = (int)(((double)(nHeightEnd - nHeight + 1)) / (double)(nHeightEnd - nHeightStart + 1) * 100);
+        if (reportDone < percentageDone / 10) {
+            LogPrintf("%s: verified %d%% of the blocks\n", __func__, percentageDone);
+            reportDone = percentageDone / 10;
+        }
+    }
+    LogPrintf("%s: no inconsistencies in blocks %i to %i (%dms)\n", __func__, nHeightStart, nHeightEnd, GetTimeMillis() - nStart);
+    return true;
+}
+
 /** Apply the effects of a block on the utxo cache, ignoring that it may already have been applied. */
 static bool RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
@@ -3840,6 +4525,375 @@ bool ReplayBlocks(const CChainParams& params, CCoinsView* view)
     return true;
 }
 
+//! The evo database records that are part of the consensus state, thus of UTXO snapshots: the
+//! deterministic masternode lists and the mined LLMQ commitments. DKG contributions are node-local.
+static const std::set<std::string> setSnapshotEvoPrefixes = {"dmn_S", "dmn_D", "q_mc", "q_mcih"};
+
+static bool IsSnapshotEvoRecord(CDataStream ssKey)
+{
+    // All the evo database keys start with a string prefix
+    std::string strPrefix;
+    try {
+        ssKey >> strPrefix;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return setSnapshotEvoPrefixes.count(strPrefix) > 0;
+}
+
+bool DumpUTXOSnapshot(const fs::path& path, SnapshotMetadata& metadata, uint256& hashRet, std::string& strError)
+{
+    // Take consistent views of the coins and of the evo databases at the tip, under cs_main,
+    // then write them out without blocking the validation.
+    std::unique_ptr<CDBSnapshot> coinsSnapshot;
+    std::unique_ptr<CDBSnapshot> evoSnapshot;
+    int nHeight;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+
+        const CBlockIndex* pindex = chainActive.Tip();
+        if (!Params().GetConsensus().NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_V3_4)) {
+            // The V1 stake modifier of the next blocks can't be computed without the history
+            strError = "snapshots need a chain tip with a stake modifier V2";
+            return false;
+        }
+        if (!pindex->nChainSaplingValue || pcoinsdbview->GetBestBlock() != pindex->GetBlockHash()) {
+            strError = "the chainstate is not consistent with the chain tip";
+            return false;
+        }
+
+        metadata = SnapshotMetadata(Params().MessageStart());
+        metadata.hashBlock = pindex->GetBlockHash();
+        metadata.nChainTx = pindex->nChainTx;
+        metadata.nChainSaplingValue = *pindex->nChainSaplingValue;
+        metadata.vStakeModifier.assign(pindex->vStakeModifier.begin(), pindex->vStakeModifier.end());
+        metadata.hashSaplingAnchor = pcoinsdbview->GetBestAnchor();
+        nHeight = pindex->nHeight;
+
+        coinsSnapshot = pcoinsdbview->GetSnapshot();
+        evoSnapshot = std::make_unique<CDBSnapshot>(evoDb->GetRawDB());
+    }
+
+    // The record counts are in the metadata, which comes first
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor(*coinsSnapshot));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        metadata.nCoins++;
+    }
+    pcoinsdbview->ForEachSaplingAnchor([&metadata](const uint256&, const SaplingMerkleTree&) { metadata.nSaplingAnchors++; return true; }, coinsSnapshot.get());
+    pcoinsdbview->ForEachSaplingNullifier([&metadata](const uint256&) { metadata.nSaplingNullifiers++; return true; }, coinsSnapshot.get());
+    std::unique_ptr<CDBIterator> pevocursor(evoDb->GetRawDB().NewIterator(*evoSnapshot));
+    for (pevocursor->SeekToFirst(); pevocursor->Valid(); pevocursor->Next()) {
+        if (IsSnapshotEvoRecord(pevocursor->GetKey())) metadata.nEvoRecords++;
+    }
+
+    const fs::path pathTmp = path.string() + ".incomplete";
+    try {
+        CAutoFile afile(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+        if (afile.IsNull()) {
+            strError = strprintf("unable to open %s for writing", pathTmp.string());
+            return false;
+        }
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        const auto write = [&afile, &hasher](const auto& obj) {
+            afile << obj;
+            hasher << obj;
+        };
+
+        write(metadata);
+        uint64_t nCoins = 0, nAnchors = 0, nNullifiers = 0, nEvoRecords = 0;
+        for (pcursor.reset(pcoinsdbview->Cursor(*coinsSnapshot)); pcursor->Valid(); pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            COutPoint outpoint;
+            Coin coin;
+            if (!pcursor->GetKey(outpoint) || !pcursor->GetValue(coin)) {
+                throw std::runtime_error("unable to read a coin");
+            }
+            write(outpoint);
+            write(coin);
+            nCoins++;
+        }
+        bool fOk = pcoinsdbview->ForEachSaplingAnchor([&](const uint256& root, const SaplingMerkleTree& tree) {
+            write(root);
+            write(tree);
+            nAnchors++;
+            return true;
+        }, coinsSnapshot.get());
+        fOk &= pcoinsdbview->ForEachSaplingNullifier([&](const uint256& nf) {
+            write(nf);
+            nNullifiers++;
+            return true;
+        }, coinsSnapshot.get());
+        if (!fOk) {
+            throw std::runtime_error("unable to read the Sapling anchors and nullifiers");
+        }
+        for (pevocursor->SeekToFirst(); pevocursor->Valid(); pevocursor->Next()) {
+            CDataStream ssKey = pevocursor->GetKey();
+            if (!IsSnapshotEvoRecord(ssKey)) continue;
+            const CDataStream ssValue = pevocursor->GetValue();
+            write(std::vector<unsigned char>(ssKey.begin(), ssKey.end()));
+            write(std::vector<unsigned char>(ssValue.begin(), ssValue.end()));
+            nEvoRecords++;
+        }
+        if (nCoins != metadata.nCoins || nAnchors != metadata.nSaplingAnchors ||
+                nNullifiers != metadata.nSaplingNullifiers || nEvoRecords != metadata.nEvoRecords) {
+            throw std::runtime_error("unexpected record counts");
+        }
+
+        if (!FileCommit(afile.Get()))
+            throw std::runtime_error("FileCommit failed");
+        afile.fclose();
+        hashRet = hasher.GetHash();
+    } catch (const std::exception& e) {
+        strError = strprintf("unable to write the snapshot: %s", e.what());
+        return false;
+    }
+    if (!RenameOver(pathTmp, path)) {
+        strError = strprintf("unable to rename %s", pathTmp.string());
+        return false;
+    }
+
+    LogPrintf("Dumped UTXO snapshot of block %s (height %d): %u coins, %u Sapling anchors, %u nullifiers, %u evo records, content hash %s\n",
+              metadata.hashBlock.ToString(), nHeight, metadata.nCoins, metadata.nSaplingAnchors,
+              metadata.nSaplingNullifiers, metadata.nEvoRecords, hashRet.ToString());
+    return true;
+}
+
+/** Read a UTXO snapshot file, computing its content hash. If fApply, its records are also
+ *  written to the coins cache (flushed as needed) and to the evo database. */
+static bool ReadUTXOSnapshot(const fs::path& path, SnapshotMetadata& metadata, uint256& hashRet, bool fApply, std::string& strError)
+{
+    CAutoFile afile(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (afile.IsNull()) {
+        strError = strprintf("unable to open %s", path.string());
+        return false;
+    }
+    CHashVerifier<CAutoFile> verifier(&afile);
+
+    try {
+        verifier >> metadata;
+        if (metadata.nVersion != SnapshotMetadata::CURRENT_VERSION) {
+            strError = strprintf("unsupported snapshot version %d", metadata.nVersion);
+            return false;
+        }
+        if (memcmp(metadata.pchMessageStart, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0) {
+            strError = "the snapshot is for a different network";
+            return false;
+        }
+
+        const auto flushIfNeeded = [fApply]() {
+            if (fApply && pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage && !pcoinsTip->Flush()) {
+                throw std::runtime_error("failed to write to the coin database");
+            }
+        };
+
+        for (uint64_t i = 0; i < metadata.nCoins; i++) {
+            boost::this_thread::interruption_point();
+            COutPoint outpoint;
+            Coin coin;
+            verifier >> outpoint >> coin;
+            if (fApply) {
+                // Throws on duplicate coins
+                pcoinsTip->AddCoin(outpoint, std::move(coin), false);
+                flushIfNeeded();
+            }
+        }
+
+        CCoinsMapMemoryResource coinsResource;
+        CCoinsMap mapCoins{0, CCoinsMap::hasher{}, CCoinsMap::key_equal{}, &coinsResource};
+        CAnchorsSaplingMapMemoryResource anchorsResource{SAPLING_CACHE_CHUNK_BYTES};
+        CAnchorsSaplingMap mapAnchors{0, CAnchorsSaplingMap::hasher{}, CAnchorsSaplingMap::key_equal{}, &anchorsResource};
+        CNullifiersMapMemoryResource nullifiersResource{SAPLING_CACHE_CHUNK_BYTES};
+        CNullifiersMap mapNullifiers{0, CNullifiersMap::hasher{}, CNullifiersMap::key_equal{}, &nullifiersResource};
+        const auto writeSapling = [&]() {
+            pcoinsTip->BatchWrite(mapCoins, pcoinsTip->GetBestBlock(), metadata.hashSaplingAnchor, mapAnchors, mapNullifiers);
+            flushIfNeeded();
+        };
+        for (uint64_t i = 0; i < metadata.nSaplingAnchors; i++) {
+            boost::this_thread::interruption_point();
+            uint256 root;
+            SaplingMerkleTree tree;
+            verifier >> root >> tree;
+            if (fApply) {
+                CAnchorsSaplingCacheEntry& entry = mapAnchors[root];
+                entry.entered = true;
+                entry.tree = tree;
+                entry.flags = CAnchorsSaplingCacheEntry::DIRTY;
+                if (mapAnchors.size() >= 1000) writeSapling();
+            }
+        }
+        for (uint64_t i = 0; i < metadata.nSaplingNullifiers; i++) {
+            boost::this_thread::interruption_point();
+            uint256 nf;
+            verifier >> nf;
+            if (fApply) {
+                CNullifiersCacheEntry& entry = mapNullifiers[nf];
+                entry.entered = true;
+                entry.flags = CNullifiersCacheEntry::DIRTY;
+                if (mapNullifiers.size() >= 100000) writeSapling();
+            }
+        }
+        if (fApply) writeSapling();
+
+        CDBBatch batch;
+        for (uint64_t i = 0; i < metadata.nEvoRecords; i++) {
+            boost::this_thread::interruption_point();
+            std::vector<unsigned char> vchKey, vchValue;
+            verifier >> vchKey >> vchValue;
+            CDataStream ssKey(vchKey, SER_DISK, CLIENT_VERSION);
+            if (!IsSnapshotEvoRecord(ssKey)) {
+                strError = "the snapshot contains an unexpected evo database record";
+                return false;
+            }
+            if (fApply) {
+                batch.Write(ssKey, CDataStream(vchValue, SER_DISK, CLIENT_VERSION));
+                if (batch.SizeEstimate() > nDefaultDbBatchSize) {
+                    evoDb->GetRawDB().WriteBatch(batch);
+                    batch.Clear();
+                }
+            }
+        }
+        if (fApply) {
+            batch.Write(EVODB_BEST_BLOCK, metadata.hashBlock);
+            evoDb->GetRawDB().WriteBatch(batch);
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("unable to read the snapshot: %s", e.what());
+        return false;
+    }
+
+    if (fgetc(afile.Get()) != EOF) {
+        strError = "unexpected data at the end of the snapshot";
+        return false;
+    }
+    hashRet = verifier.GetHash();
+    return true;
+}
+
+bool VerifyUTXOSnapshot(const fs::path& path, SnapshotMetadata& metadata, uint256& hashRet, std::string& strError)
+{
+    return ReadUTXOSnapshot(path, metadata, hashRet, false, strError);
+}
+
+bool LoadUTXOSnapshot(const fs::path& path, SnapshotMetadata& metadata, std::string& strError)
+{
+    // Experimental: nothing validates the chain below the snapshot in the background
+    if (!Params().IsRegTestNet()) {
+        strError = "loading a snapshot is only available on regtest";
+        return false;
+    }
+
+    // Check the whole file before touching the chainstate
+    uint256 hashSnapshot;
+    if (!ReadUTXOSnapshot(path, metadata, hashSnapshot, false, strError)) {
+        return false;
+    }
+
+    // The chainstate is replaced: hold cs_main for the whole load. Only the genesis block is
+    // connected, so the validation has nothing else to do meanwhile.
+    LOCK(cs_main);
+    CBlockIndex* pindexBase = LookupBlockIndex(metadata.hashBlock);
+    if (!pindexBase) {
+        strError = strprintf("the header of the snapshot block %s is unknown, the headers must be synced first", metadata.hashBlock.ToString());
+        return false;
+    }
+    const MapAssumeutxo& mapAssumeutxo = Params().AssumeutxoData();
+    const auto it = mapAssumeutxo.find(pindexBase->nHeight);
+    if (it == mapAssumeutxo.end() || it->second != hashSnapshot) {
+        strError = strprintf("the snapshot content hash %s (height %d) is not committed in the chain params", hashSnapshot.ToString(), pindexBase->nHeight);
+        return false;
+    }
+    if (!fPruneMode) {
+        strError = "loading a snapshot requires -prune, as the blocks below it are never downloaded";
+        return false;
+    }
+    if (chainActive.Height() != 0) {
+        strError = "the chainstate is not empty, loading a snapshot requires only the genesis block to be connected";
+        return false;
+    }
+    if (pindexBase->nStatus & BLOCK_FAILED_MASK) {
+        strError = "the snapshot block is marked invalid";
+        return false;
+    }
+
+    // From here, a failure (or a crash) leaves a partially written chainstate.
+    // LoadBlockIndexDB detects it from this flag on the next start.
+    FlushStateToDisk();
+    if (!pblocktree->WriteFlag("loadingsnapshot", true)) {
+        strError = "failed to write to the block index database";
+        return false;
+    }
+    uint256 hashApplied;
+    if (!ReadUTXOSnapshot(path, metadata, hashApplied, true, strError) || hashApplied != hashSnapshot) {
+        strError = strprintf("%s, the chainstate must be rebuilt with -reindex", strError.empty() ? "the snapshot changed while loading" : strError);
+        return false;
+    }
+    pcoinsTip->SetBestBlock(pindexBase->GetBlockHash());
+
+    // The blocks below the snapshot are treated as validated and pruned. The transaction
+    // count of those never downloaded is faked, so that LoadBlockIndexDB links them again on
+    // restart, while the chain values of the snapshot block come from the metadata.
+    for (int nHeight = 1; nHeight < pindexBase->nHeight; nHeight++) {
+        CBlockIndex* pindex = pindexBase->GetAncestor(nHeight);
+        if (pindex->nTx == 0) {
+            pindex->nTx = 1;
+            pindex->SetSaplingValue(0);
+        }
+        pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+        pindex->SetChainSaplingValue();
+        pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+        {
+            LOCK(cs_nBlockSequenceId);
+            pindex->nSequenceId = nBlockSequenceId++;
+        }
+        setDirtyBlockIndex.insert(pindex);
+    }
+    const CBlockIndex* pindexPrev = pindexBase->pprev;
+    if (metadata.nChainTx <= pindexPrev->nChainTx || !pindexPrev->nChainSaplingValue) {
+        strError = "invalid snapshot chain values, the chainstate must be rebuilt with -reindex";
+        return false;
+    }
+    pindexBase->nTx = metadata.nChainTx - pindexPrev->nChainTx;
+    pindexBase->SetSaplingValue(metadata.nChainSaplingValue - *pindexPrev->nChainSaplingValue);
+    pindexBase->vStakeModifier.assign(metadata.vStakeModifier.begin(), metadata.vStakeModifier.end());
+    pindexBase->RaiseValidity(BLOCK_VALID_SCRIPTS);
+    setDirtyBlockIndex.insert(pindexBase);
+
+    // Blocks already downloaded below the snapshot are linked now, the ones above it get linked
+    // (and become tip candidates) from the snapshot block.
+    for (auto itUnlinked = mapBlocksUnlinked.begin(); itUnlinked != mapBlocksUnlinked.end();) {
+        if (pindexBase->GetAncestor(itUnlinked->second->nHeight) == itUnlinked->second) {
+            itUnlinked = mapBlocksUnlinked.erase(itUnlinked);
+        } else {
+            itUnlinked++;
+        }
+    }
+    LinkBlockIndex(pindexBase);
+    chainActive.SetTip(pindexBase);
+    PruneBlockIndexCandidates();
+
+    fHavePruned = true;
+    pblocktree->WriteFlag("prunedblockfiles", true);
+    mempool.clear();
+    mnodeman.SetBestHeight(pindexBase->nHeight);
+    g_budgetman.SetBestHeight(pindexBase->nHeight);
+    deterministicMNManager->SetTipIndex(pindexBase);
+    FlushStateToDisk();
+    pblocktree->WriteFlag("loadingsnapshot", false);
+    MoneySupply.Update(pcoinsTip->GetTotalAmount(), pindexBase->nHeight);
+
+    LogPrintf("Loaded UTXO snapshot of block %s (height %d): %u coins, %u Sapling anchors, %u nullifiers, %u evo records\n",
+              metadata.hashBlock.ToString(), pindexBase->nHeight, metadata.nCoins, metadata.nSaplingAnchors,
+              metadata.nSaplingNullifiers, metadata.nEvoRecords);
+
+    const bool fInitialDownload = IsInitialBlockDownload();
+    GetMainSignals().UpdatedBlockTip(pindexBase, chainActive.Genesis(), fInitialDownload);
+    uiInterface.NotifyBlockTip(fInitialDownload, pindexBase);
+    CheckBlockIndex();
+    return true;
+}
+
 // May NOT be used after any connections are up as much
 // of the peer-processing logic assumes a consistent
 // block index state
@@ -3852,16 +4906,17 @@ void UnloadBlockIndex()
     pindexBestHeader = NULL;
     mempool.clear();
     mapBlocksUnlinked.clear();
+    mapBlocksPendingParent.clear();
+    mapBlocksPendingByPrev.clear();
+    nBlocksPendingParentSize = 0;
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
     nBlockSequenceId = 1;
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    g_block_index_arena.Clear();
 }
 
 bool LoadBlockIndex(std::string& strError)
@@ -3883,9 +4938,6 @@ bool LoadBlockIndex(std::string& strError)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
-        pblocktree->WriteFlag("txindex", fTxIndex);
     }
     return true;
 }
@@ -3923,10 +4975,206 @@ bool LoadGenesisBlock()
 }
 
 
+namespace {
+
+/** Upper bound of the serialized size of the blocks queued between the import reader and ProcessNewBlock */
+static const uint64_t MAX_IMPORT_QUEUE_BYTES = 32 * 1024 * 1024;
+/** Upper bound of the serialized size of the out of order blocks kept in memory by the import */
+static const uint64_t MAX_IMPORT_UNKNOWN_PARENT_BYTES = 64 * 1024 * 1024;
+
+/** A block read from a block file. pblock is null if it could not be deserialized. */
+struct ImportedBlock {
+    uint64_t nPos{0};           //!< Position of the serialized block in the file
+    unsigned int nSize{0};      //!< Size of the serialized block
+    std::shared_ptr<CBlock> pblock;
+    uint256 hash;
+};
+
+/** A block whose parent was not known yet when it was read (reindex only). */
+struct UnknownParentBlock {
+    FlatFilePos pos;
+    std::shared_ptr<const CBlock> pblock; //!< Null if the block has to be read from disk again
+    unsigned int nSize{0};
+};
+
+/**
+ * Locate the next block in a block file: find the network magic and read the
+ * block size that follows it. nRewind is the position the search starts from,
+ * and is left one byte past the magic that was found, to resume the search in
+ * case the block turns out to be unreadable. Returns false at the end of the file.
+ */
+bool FindNextBlock(CBufferedFile& blkdat, uint64_t& nRewind, unsigned int& nSize)
+{
+    while (!blkdat.eof()) {
+        blkdat.SetPos(nRewind);
+        nRewind++;         // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        try {
+            // locate a header
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(Params().MessageStart()[0]);
+            nRewind = blkdat.GetPos() + 1;
+            blkdat >> buf;
+            if (memcmp(buf, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+                continue;
+            return true;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            return false;
+        }
+    }
+    return false;
+}
+
+/** Read the serialized block following the header found by FindNextBlock. */
+void ReadBlockData(CBufferedFile& blkdat, unsigned int nSize, uint64_t& nPos, CDataStream& ss)
+{
+    nPos = blkdat.GetPos();
+    blkdat.SetLimit(nPos + nSize);
+    ss.resize(nSize);
+    blkdat.read(ss.data(), nSize);
+}
+
+/** Deserialize and hash a block, and run the checks that need no context. */
+ImportedBlock DecodeBlock(CDataStream& ss, uint64_t nPos, unsigned int nSize)
+{
+    ImportedBlock imported;
+    imported.nPos = nPos;
+    imported.nSize = nSize;
+    try {
+        auto pblock = std::make_shared<CBlock>();
+        ss >> *pblock;
+        imported.hash = pblock->GetHash();
+        PreCheckBlock(*pblock);
+        imported.pblock = std::move(pblock);
+    } catch (const std::exception& e) {
+        LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return imported;
+}
+
+/**
+ * Streams the blocks of a block file: a reader thread locates them and reads
+ * their bytes, a pool of workers deserializes, hashes and pre-checks them, and
+ * Next() hands them back in file order, so that the caller only has to feed
+ * ProcessNewBlock.
+ */
+class BlockImportPipeline
+{
+private:
+    CBufferedFile& m_blkdat;
+    ctpl::thread_pool m_workers;
+    std::thread m_reader;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    //! Blocks being decoded, in file order, with their serialized size
+    std::deque<std::pair<unsigned int, std::future<ImportedBlock>>> m_queue GUARDED_BY(m_mutex);
+    uint64_t m_queued_bytes GUARDED_BY(m_mutex){0};
+    bool m_reader_done GUARDED_BY(m_mutex){false};
+    bool m_interrupt GUARDED_BY(m_mutex){false};
+    std::string m_error GUARDED_BY(m_mutex);
+
+    void ThreadRead();
+
+public:
+    BlockImportPipeline(CBufferedFile& blkdat, int nWorkers) : m_blkdat(blkdat), m_workers(nWorkers)
+    {
+        RenameThreadPool(m_workers, "pivx-loadblk");
+        m_reader = std::thread(&BlockImportPipeline::ThreadRead, this);
+    }
+
+    ~BlockImportPipeline()
+    {
+        {
+            LOCK(m_mutex);
+            m_interrupt = true;
+        }
+        m_cond.notify_all();
+        if (m_reader.joinable()) m_reader.join();
+        m_workers.clear_queue();
+        m_workers.stop(true);
+    }
+
+    /** Get the next block of the file. Returns false once the file is exhausted. */
+    bool Next(ImportedBlock& imported);
+};
+
+void BlockImportPipeline::ThreadRead()
+{
+    util::ThreadRename("pivx-loadblk-rd");
+    try {
+        uint64_t nRewind = m_blkdat.GetPos();
+        unsigned int nSize = 0;
+        while (FindNextBlock(m_blkdat, nRewind, nSize)) {
+            uint64_t nPos = 0;
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            try {
+                ReadBlockData(m_blkdat, nSize, nPos, ss);
+            } catch (const std::exception& e) {
+                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+                continue;
+            }
+            nRewind = nPos + nSize;
+
+            {
+                WAIT_LOCK(m_mutex, lock);
+                while (!m_interrupt && !m_queue.empty() && m_queued_bytes + nSize > MAX_IMPORT_QUEUE_BYTES) {
+                    m_cond.wait(lock);
+                }
+                if (m_interrupt) break;
+                m_queue.emplace_back(nSize, m_workers.push([ss = std::move(ss), nPos, nSize](int) mutable {
+                    return DecodeBlock(ss, nPos, nSize);
+                }));
+                m_queued_bytes += nSize;
+            }
+            m_cond.notify_all();
+        }
+    } catch (const std::exception& e) {
+        LOCK(m_mutex);
+        m_error = e.what();
+    }
+    {
+        LOCK(m_mutex);
+        m_reader_done = true;
+    }
+    m_cond.notify_all();
+}
+
+bool BlockImportPipeline::Next(ImportedBlock& imported)
+{
+    std::future<ImportedBlock> next;
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (m_queue.empty() && !m_reader_done) {
+            m_cond.wait(lock);
+        }
+        if (m_queue.empty()) {
+            if (!m_error.empty()) throw std::runtime_error(m_error);
+            return false;
+        }
+        m_queued_bytes -= m_queue.front().first;
+        next = std::move(m_queue.front().second);
+        m_queue.pop_front();
+    }
+    m_cond.notify_all();
+    imported = next.get();
+    return true;
+}
+
+} // namespace
+
 bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
+    // Map of disk positions for blocks with unknown parent (only used for reindex).
+    // Up to MAX_IMPORT_UNKNOWN_PARENT_BYTES of them are also kept in memory, to
+    // not read them from disk again when their parent shows up.
+    static std::multimap<uint256, UnknownParentBlock> mapBlocksUnknownParent;
+    static uint64_t nUnknownParentBytes = 0;
     int64_t nStart = GetTimeMillis();
 
     // Block checked event listener
@@ -3934,98 +5182,133 @@ bool LoadExternalBlockFile(FILE* fileIn, FlatFilePos* dbp)
     stateCatcher.registerEvent();
 
     int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                uint256 hash = block.GetHash();
-                CBlockIndex* pindex{nullptr};
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != Params().GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
-                                hash.ToString(), block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.emplace(block.hashPrevBlock, *dbp);
-                        continue;
-                    }
+    // Process a block, in file order. Returns false to stop the import.
+    auto ProcessImportedBlock = [&](const ImportedBlock& imported) {
+        try {
+            const uint256& hash = imported.hash;
+            if (dbp)
+                dbp->nPos = imported.nPos;
 
-                    pindex = LookupBlockIndex(hash);
+            CBlockIndex* pindex{nullptr};
+            {
+                LOCK(cs_main);
+                // detect out of order blocks, and store them for later
+                if (hash != Params().GetConsensus().hashGenesisBlock && !LookupBlockIndex(imported.pblock->hashPrevBlock)) {
+                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", "LoadExternalBlockFile",
+                            hash.ToString(), imported.pblock->hashPrevBlock.ToString());
+                    if (dbp) {
+                        UnknownParentBlock unknown;
+                        unknown.pos = *dbp;
+                        if (nUnknownParentBytes + imported.nSize <= MAX_IMPORT_UNKNOWN_PARENT_BYTES) {
+                            unknown.pblock = imported.pblock;
+                            unknown.nSize = imported.nSize;
+                            nUnknownParentBytes += imported.nSize;
+                        }
+                        mapBlocksUnknownParent.emplace(imported.pblock->hashPrevBlock, std::move(unknown));
+                    }
+                    return true;
                 }
 
-                // process in case the block isn't known yet
-                if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    std::shared_ptr<const CBlock> block_ptr = std::make_shared<const CBlock>(block);
-                    stateCatcher.setBlockHash(block_ptr->GetHash());
-                    if (ProcessNewBlock(block_ptr, dbp)) {
-                        nLoaded++;
-                    }
-                    if (stateCatcher.stateErrorFound()) {
-                        break;
-                    }
-                } else if (hash != Params().GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+                pindex = LookupBlockIndex(hash);
+            }
+
+            // process in case the block isn't known yet
+            if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+                stateCatcher.setBlockHash(hash);
+                if (ProcessNewBlock(imported.pblock, dbp)) {
+                    nLoaded++;
+                }
+                if (stateCatcher.stateErrorFound()) {
+                    return false;
                 }
+            } else if (hash != Params().GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+                LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+            }
 
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+            // Recursively process earlier encountered successors of this block
+            std::deque<uint256> queue;
+            queue.push_back(hash);
+            while (!queue.empty()) {
+                uint256 head = queue.front();
+                queue.pop_front();
+                auto range = mapBlocksUnknownParent.equal_range(head);
+                while (range.first != range.second) {
+                    auto it = range.first;
+                    std::shared_ptr<const CBlock> pchild = it->second.pblock;
+                    if (pchild) {
+                        nUnknownParentBytes -= it->second.nSize;
+                    } else {
+                        auto pblock = std::make_shared<CBlock>();
+                        if (ReadBlockFromDisk(*pblock, it->second.pos)) pchild = std::move(pblock);
+                    }
+                    if (pchild) {
+                        const uint256 child_hash = pchild->GetHash();
+                        LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", "LoadExternalBlockFile", child_hash.ToString(),
                                 head.ToString());
-                            std::shared_ptr<const CBlock> block_ptr = std::make_shared<const CBlock>(block);
-                            if (ProcessNewBlock(block_ptr, &it->second)) {
-                                nLoaded++;
-                                queue.emplace_back(block.GetHash());
-                            }
+                        if (ProcessNewBlock(pchild, &it->second.pos)) {
+                            nLoaded++;
+                            queue.emplace_back(child_hash);
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
                     }
+                    range.first++;
+                    mapBlocksUnknownParent.erase(it);
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s", "LoadExternalBlockFile", e.what());
+        }
+        return true;
+    };
+
+    try {
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
+        // Blocks that could not be deserialized, by position and size
+        std::deque<std::pair<uint64_t, unsigned int>> vUndecodable;
+        bool fStop = false;
+        {
+            BlockImportPipeline pipeline(blkdat, std::max(1, nImportThreads));
+            ImportedBlock imported;
+            while (!fStop && pipeline.Next(imported)) {
+                boost::this_thread::interruption_point();
+                if (!imported.pblock) {
+                    vUndecodable.emplace_back(imported.nPos, imported.nSize);
+                    continue;
+                }
+                fStop = !ProcessImportedBlock(imported);
+            }
+        }
+
+        // The reader skipped over the blocks that could not be deserialized.
+        // Search them for block headers, starting one byte past their own one.
+        // They can be further back than the buffer rewinds, so seek the file.
+        while (!fStop && !vUndecodable.empty()) {
+            boost::this_thread::interruption_point();
+            const uint64_t nEnd = vUndecodable.front().first + vUndecodable.front().second;
+            uint64_t nRewind = vUndecodable.front().first - CMessageHeader::MESSAGE_START_SIZE - sizeof(unsigned int) + 1;
+            vUndecodable.pop_front();
+            if (!blkdat.SetPos(nRewind) && !blkdat.Seek(nRewind)) {
+                LogPrintf("%s : unable to seek the file to position %u\n", __func__, nRewind);
+                continue;
+            }
+            unsigned int nSize = 0;
+            while (!fStop && FindNextBlock(blkdat, nRewind, nSize) && nRewind <= nEnd) {
+                uint64_t nPos = 0;
+                CDataStream ss(SER_DISK, CLIENT_VERSION);
+                try {
+                    ReadBlockData(blkdat, nSize, nPos, ss);
+                } catch (const std::exception& e) {
+                    LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+                    continue;
+                }
+                nRewind = nPos + nSize;
+                const ImportedBlock imported = DecodeBlock(ss, nPos, nSize);
+                if (!imported.pblock) {
+                    vUndecodable.emplace_back(nPos, nSize);
+                    continue;
+                }
+                fStop = !ProcessImportedBlock(imported);
             }
         }
     } catch (const std::runtime_error& e) {
@@ -4072,6 +5355,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -4079,6 +5363,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -4089,12 +5374,21 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().GetConsensus().hashGenesisBlock); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
-        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
+        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
+        if (!fHavePruned) {
+            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else {
+            // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
+            if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
+        }
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
+        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0)); // This is pruning-independent.
+        // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                      // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -4106,9 +5400,18 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
-                assert(setBlockIndexCandidates.count(pindex));
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+            if (pindexFirstInvalid == NULL) {
+                // If this block sorts at least as good as the current tip and
+                // is valid and we have all data for its parents, it must be in
+                // setBlockIndexCandidates.  chainActive.Tip() must also be there
+                // even if some data has been pruned.
+                if (pindexFirstMissing == NULL || pindex == chainActive.Tip()) {
+                    assert(setBlockIndexCandidates.count(pindex));
+                }
+                // If some parent is missing, then it could be that this block was in
+                // setBlockIndexCandidates but had to be removed because of the missing data.
+                // In this case it must be in mapBlocksUnlinked -- see test below.
             }
         } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
             assert(setBlockIndexCandidates.count(pindex) == 0);
@@ -4124,12 +5427,28 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
-                assert(foundInUnlinked);
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+            assert(foundInUnlinked);
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
+        if (pindexFirstMissing == NULL) assert(!foundInUnlinked);           // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == NULL && pindexFirstMissing != NULL) {
+            // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
+            assert(fHavePruned); // We must have pruned.
+            // This block may have entered mapBlocksUnlinked if:
+            //  - it has a descendant that at some point had more work than the
+            //    tip, and
+            //  - we tried switching to that descendant but were missing
+            //    data for some intermediate block between chainActive and the
+            //    tip.
+            // So if this block is itself better than chainActive.Tip() and it wasn't in
+            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
+            if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && setBlockIndexCandidates.count(pindex) == 0) {
+                if (pindexFirstInvalid == NULL) {
+                    assert(foundInUnlinked);
+                }
             }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
-            assert(!foundInUnlinked);
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
@@ -4149,6 +5468,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
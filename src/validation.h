@@ -40,6 +40,7 @@
 class AccumulatorCache;
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CBudgetManager;
 class CCoinsViewDB;
 class CZerocoinDB;
@@ -49,6 +50,7 @@ class CInv;
 class CConnman;
 class CNode;
 class CScriptCheck;
+class SnapshotMetadata;
 
 struct PrecomputedTransactionData;
 
@@ -68,6 +70,8 @@ static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
 /** Default for -txindex */
 static const bool DEFAULT_TXINDEX = true;
+/** Default for -blockfilterindex */
+static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 /** The maximum size for transactions we're willing to relay/mine */
 static const unsigned int MAX_STANDARD_TX_SIZE = 100000;
@@ -77,6 +81,10 @@ static const unsigned int MAX_DISCONNECTED_TX_POOL_SIZE = 20000;
 /** Default for -checkblocks */
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Default for -asyncverify */
+static const bool DEFAULT_ASYNC_VERIFYDB = true;
+/** Number of blocks still verified at startup (at -checklevel) with -asyncverify */
+static const signed int ASYNC_VERIFYDB_STARTUP_BLOCKS = 1;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -87,6 +95,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of block decoding threads used by -reindex and -loadblock */
+static const int MAX_IMPORT_THREADS = 8;
+/** -importthreads default (number of block decoding threads, 0 = auto) */
+static const int DEFAULT_IMPORT_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -99,10 +111,18 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Maximum size of the blocks received ahead of their parent, and held in memory until it is accepted. */
+static const unsigned int MAX_BLOCKS_PENDING_PARENT_SIZE = 64 * 1024 * 1024;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Time to wait (in seconds) between incremental writes of the chainstate (-incrementalflush). */
+static const unsigned int DATABASE_INCREMENTAL_WRITE_INTERVAL = 10;
+/** Maximum number of coins written by an incremental write of the chainstate. */
+static const unsigned int MAX_INCREMENTAL_WRITE_COINS = 200000;
+/** Default for -incrementalflush */
+static const bool DEFAULT_INCREMENTAL_FLUSH = false;
 /** Average delay between local address broadcasts */
 static constexpr std::chrono::hours AVG_LOCAL_ADDRESS_BROADCAST_INTERVAL{24};
 /** Average delay between peer address broadcasts */
@@ -111,11 +131,23 @@ static constexpr std::chrono::seconds AVG_ADDRESS_BROADCAST_INTERVAL{30};
 static const unsigned int DEFAULT_SHIELDEDTXFEE_K = 100;
 /** Enable bloom filter */
  static const bool DEFAULT_PEERBLOOMFILTERS = true;
+/** Default for -peerblockfilters, serving of compact block filters (BIP157) */
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
 /** If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 /** Maximum age of our tip in seconds for us to be considered current for fee estimation */
 static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 
+/** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned
+ *  (a day of blocks, well above the default -maxreorg depth and the sapling witness cache). */
+static const unsigned int MIN_BLOCKS_TO_KEEP = 1440;
+
+/** Require that user allocate at least 550MiB for block & undo files (blk???.dat and rev???.dat).
+ *  One day of average-sized blocks, plus their undo data, fits easily. Since we prune in full block
+ *  file chunks, the high water mark which triggers the prune is one 128MiB block file + 15% undo data
+ *  above that. The target is a soft limit: the last MIN_BLOCKS_TO_KEEP blocks are never pruned. */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
+
 struct BlockHasher {
     size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
 };
@@ -138,10 +170,19 @@ extern int64_t g_best_block_time;
 extern std::atomic<bool> fImporting;
 extern std::atomic<bool> fReindex;
 extern int nScriptCheckThreads;
-extern bool fTxIndex;
+extern int nImportThreads;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
+extern bool fIncrementalFlush;
 extern size_t nCoinCacheUsage;
+/** True if any block files have ever been pruned. */
+extern bool fHavePruned;
+/** True if we're running in -prune mode. */
+extern bool fPruneMode;
+/** Number of MiB of block files that we're trying to stay below. */
+extern uint64_t nPruneTarget;
+/** Block hash whose ancestors we will assume to have valid scripts without checking them. */
+extern uint256 hashAssumeValid;
 extern CFeeRate minRelayTxFee;
 extern int64_t nMaxTipAge;
 
@@ -173,6 +214,21 @@ extern CBlockIndex* pindexBestHeader;
  */
 bool ProcessNewBlock(const std::shared_ptr<const CBlock>& pblock, const FlatFilePos* dbp);
 
+/**
+ * Process incoming block headers (headers-first sync).
+ * Only what the headers commit to is checked here (work, time, checkpoints, version):
+ * the proof of stake is verified when the block itself is received.
+ *
+ * @param[in]   headers    The block headers, in chain order.
+ * @param[out]  state      This may be set to an Error state if any error occurred processing them.
+ * @param[out]  ppindex    If set, the pointer will be set to point to the last block index object for the given headers.
+ * @return True if all the headers were accepted
+ */
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CBlockIndex** ppindex = nullptr);
+
+/** Whether a block was received ahead of its parent and is held until the parent is accepted */
+bool IsBlockPendingParent(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const FlatFilePos& pos, bool fReadOnly = false);
 /** Open an undo file (rev?????.dat) */
@@ -194,6 +250,12 @@ void UnloadBlockIndex();
 int ActiveProtocol();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the Sapling proofs checking thread */
+void ThreadSaplingCheck();
+/** Run an instance of the thread reading the coins of a block ahead of its connection */
+void ThreadCoinsPrefetch();
+/** Run an instance of the legacy zerocoin spends checking thread */
+void ThreadZerocoinCheck();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -213,6 +275,22 @@ CAmount GetBlockValue(int nHeight);
 CBlockIndex* InsertBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Prune block files and flush state to disk. */
+void PruneAndFlush();
+
+/** Calculate the amount of disk space the block & undo files currently use */
+uint64_t CalculateCurrentUsage();
+
+/**
+ *  Mark one block file as pruned.
+ *  The blocks it contains lose BLOCK_HAVE_DATA and BLOCK_HAVE_UNDO, and its CBlockFileInfo is reset.
+ */
+void PruneOneBlockFile(const int fileNumber) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/**
+ *  Actually unlink the specified files
+ */
+void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 
 
 /** (try to) add transaction to memory pool **/
@@ -251,6 +329,9 @@ CAmount GetShieldedTxMinFee(const CTransaction& tx);
  */
 bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck>* pvChecks = NULL);
 
+/** Whether the outputs of the (mainnet) blocks at this height listed in invalid_out are kept out of the UTXO set */
+bool SkipInvalidUTXOS(int nHeight);
+
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight, bool fSkipInvalid = false);
 
@@ -311,12 +392,20 @@ public:
 bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos);
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read the serialized block (the same on disk and on the wire), without deserializing it */
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos);
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex);
+/** Read the undo data of a connected block (not the genesis block) */
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
 
 /** Context-independent validity checks */
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/** Run the checks of CheckBlock that need neither context nor cs_main (merkle root, block
+ *  signature), and record their success in the block so that CheckBlock skips them. */
+void PreCheckBlock(const CBlock& block);
 bool CheckWork(const CBlock& block, const CBlockIndex* const pindexPrev);
 
 /** Context-dependent validity checks */
@@ -326,6 +415,11 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
 bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckBlockSig = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** Whether the scripts of a block can be assumed valid (-assumevalid): the block is an ancestor of
+ *  pindexAssumeValid, the best header builds on it, and it's buried by more than two weeks of work. */
+bool IsBlockAssumedValid(const CBlockIndex* pindex, const CBlockIndex* pindexAssumeValid, const CBlockIndex* pindexBestHeader,
+                         const Consensus::Params& consensus);
+
 bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex** ppindex = nullptr, CBlockIndex* pindexPrev = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 
@@ -338,9 +432,32 @@ public:
     bool VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth);
 };
 
+/**
+ * Check the block and undo data (checks of level 0 to 2 of VerifyDB) of the
+ * active chain blocks at heights [nHeightStart, nHeightEnd]. Unlike VerifyDB,
+ * cs_main is only held for one block at a time, so that this can be run in
+ * the background once the node is started.
+ */
+bool VerifyChainData(int nCheckLevel, int nHeightStart, int nHeightEnd);
+
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 
+/** Write the chainstate at the tip (coins, Sapling anchors and nullifiers, evo database
+ *  consensus records) to a UTXO snapshot file, returning its metadata and content hash. */
+bool DumpUTXOSnapshot(const fs::path& path, SnapshotMetadata& metadata, uint256& hashRet, std::string& strError);
+
+/** Read a UTXO snapshot file, checking its format and computing its content hash. */
+bool VerifyUTXOSnapshot(const fs::path& path, SnapshotMetadata& metadata, uint256& hashRet, std::string& strError);
+
+/**
+ * Load a UTXO snapshot, whose content hash must be committed in the chain params, as the
+ * chainstate of a node that has only the genesis block connected. The blocks below the
+ * snapshot are treated as validated and pruned, so this requires -prune.
+ * Experimental and regtest-only: the chain below the snapshot is never validated.
+ */
+bool LoadUTXOSnapshot(const fs::path& path, SnapshotMetadata& metadata, std::string& strError);
+
 inline CBlockIndex* LookupBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     AssertLockHeld(cs_main);
@@ -499,9 +499,9 @@ CBlockIndex* SimpleFakeMine(CWalletTx& wtx, CWallet &wallet, CBlockIndex* pprev
     block.vtx.emplace_back(wtx.tx);
     block.hashMerkleRoot = BlockMerkleRoot(block);
     if (pprev) block.hashPrevBlock = pprev->GetBlockHash();
-    CBlockIndex* fakeIndex = new CBlockIndex(block);
+    CBlockIndex* fakeIndex = InsertBlockIndex(block.GetHash());
+    *fakeIndex = CBlockIndex(block);
     fakeIndex->pprev = pprev;
-    mapBlockIndex.emplace(block.GetHash(), fakeIndex);
     fakeIndex->phashBlock = &mapBlockIndex.find(block.GetHash())->first;
     chainActive.SetTip(fakeIndex);
     BOOST_CHECK(chainActive.Contains(fakeIndex));
@@ -4307,6 +4307,20 @@ CWallet* CWallet::CreateWalletFromFile(const std::string& name, const fs::path&
                 pindexRescan->GetBlockTime() < (walletInstance->nTimeFirstKey - TIMESTAMP_WINDOW)) {
             pindexRescan = chainActive.Next(pindexRescan);
         }
+
+        // We can't rescan beyond non-pruned blocks, stop and throw an error.
+        // This might happen if a user uses an old wallet within a pruned node
+        // or if they ran -disablewallet for a longer time, then decided to re-enable.
+        if (fPruneMode && pindexRescan) {
+            CBlockIndex* block = chainActive.Tip();
+            while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 && pindexRescan != block) {
+                block = block->pprev;
+            }
+            if (pindexRescan != block) {
+                UIError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+                return nullptr;
+            }
+        }
         const int64_t nWalletRescanTime = GetTimeMillis();
         {
             WalletRescanReserver reserver(walletInstance);